@@ -2,7 +2,8 @@ TEMPLATE = subdirs
 
 SUBDIRS = create_certificate \
           create_signed_certificate \
-          create_certificate_chain
+          create_certificate_chain \
+          signer_daemon
 
 
 
@@ -0,0 +1,48 @@
+#include <QCoreApplication>
+#include <QFile>
+#include <QDebug>
+
+#include "signingkey.h"
+#include "signerserver.h"
+
+QT_USE_NAMESPACE_CERTIFICATE
+
+//
+// Holds a CA key so that other processes can issue certificates without
+// having access to it. Clients use SigningKey::fromSignerService() with the
+// same socket name.
+//
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+
+    if (argc != 3) {
+        qDebug() << "Usage:" << argv[0] << "key.pem socketname";
+        return 1;
+    }
+
+    QFile f(QString::fromLocal8Bit(argv[1]));
+    if (!f.open(QIODevice::ReadOnly)) {
+        qDebug() << "Unable to read key" << f.errorString();
+        return 1;
+    }
+
+    QByteArray pem = f.readAll();
+    f.close();
+
+    SigningKey key(pem);
+    pem.fill(0);
+
+    if (key.isNull()) {
+        qDebug() << "Unable to load key" << key.errorString();
+        return 1;
+    }
+
+    SignerServer server(key);
+    if (!server.listen(QString::fromLocal8Bit(argv[2]))) {
+        qDebug() << "Unable to listen" << server.errorString();
+        return 1;
+    }
+
+    return app.exec();
+}
@@ -0,0 +1,9 @@
+TEMPLATE = app
+TARGET = signer_daemon
+
+QT += network
+
+LIBS    += -Wl,-rpath,../../src/certificate -L../../src/certificate -lcertificate
+INCLUDEPATH += ../../src/certificate
+
+SOURCES = main.cpp
@@ -0,0 +1,93 @@
+/****************************************************************************
+**
+** Copyright (C) 2012-2013 Richard J. Moore <rich@kde.org>
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef ASYNCTASK_P_H
+#define ASYNCTASK_P_H
+
+#include <QFuture>
+#include <QFutureInterface>
+#include <QRunnable>
+#include <QThreadPool>
+
+#include "certificatelibrary.h"
+
+QT_BEGIN_NAMESPACE_CERTIFICATE
+
+//
+// Base for the jobs behind the asynchronous APIs. Subclasses implement
+// compute(), and start() queues the job on the library thread pool and
+// returns a future that will receive the result. The job deletes itself
+// once it has run.
+//
+template <typename T>
+class AsyncTask : public QRunnable
+{
+public:
+    AsyncTask()
+    {
+        setAutoDelete(true);
+    }
+
+    QFuture<T> start()
+    {
+        futureInterface.reportStarted();
+        QFuture<T> future = futureInterface.future();
+        CertificateLibrary::threadPool()->start(this);
+        return future;
+    }
+
+    void run()
+    {
+        if (!futureInterface.isCanceled()) {
+            T result = compute();
+            futureInterface.reportResult(result);
+        }
+
+        futureInterface.reportFinished();
+    }
+
+protected:
+    virtual T compute() = 0;
+
+private:
+    QFutureInterface<T> futureInterface;
+};
+
+QT_END_NAMESPACE_CERTIFICATE
+
+#endif // ASYNCTASK_P_H
@@ -0,0 +1,238 @@
+/****************************************************************************
+**
+** Copyright (C) 2012-2013 Richard J. Moore <rich@kde.org>
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include <QAtomicInt>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QSharedPointer>
+#include <QThread>
+#include <QThreadPool>
+#include <QVector>
+#include <QWaitCondition>
+
+#include <gnutls/gnutls.h>
+
+#include "certificatelibrary.h"
+#include "certificaterequest.h"
+#include "certificateprofile_p.h"
+
+#include "batchissuer_p.h"
+
+QT_BEGIN_NAMESPACE_CERTIFICATE
+
+/*!
+  \class BatchIssuer
+  \brief The BatchIssuer class issues certificates for many requests at once.
+
+  The BatchIssuer class takes a list of CertificateRequests and issues a
+  certificate for each of them, signed by a single IssuerContext and using
+  the settings from a single CertificateProfile. The work is spread across
+  the thread pool returned by CertificateLibrary::threadPool(), with the
+  calling thread taking part too. Each thread takes the next unprocessed
+  request as soon as it finishes the last, so the load stays balanced even
+  if some requests take longer than others.
+
+  The results are returned in the same order as the requests, and each one
+  reports its own error so that a bad request does not affect the others.
+*/
+
+/*!
+  \class BatchIssuer::Result
+  \brief The Result class holds the outcome of issuing a single certificate.
+
+  If the certificate could not be issued, then the certificate will be null
+  and error will hold the gnutls error code.
+*/
+
+/*!
+  \internal
+  The state of a single call to issue(). This is shared with the worker jobs
+  so that a job that only starts once all the work is done can still safely
+  find that there is nothing left for it.
+ */
+struct BatchState
+{
+    BatchState(const QList<CertificateRequest> &requests, const IssuerContext &issuer,
+               const CertificateProfile &profile)
+        : requests(requests),
+          issuer(issuer),
+          profile(profile),
+          results(requests.size()),
+          completed(0)
+    {
+        // Each worker writes to distinct elements, so never touch the
+        // vector itself once the work has started
+        output = results.data();
+    }
+
+    void work()
+    {
+        const int count = requests.size();
+        int done = 0;
+
+        for (;;) {
+            int index = next.fetchAndAddOrdered(1);
+            if (index >= count)
+                break;
+
+            BatchIssuer::Result &result = output[index];
+            result.certificate = issue_from_profile(requests.at(index), profile, issuer, &result.error);
+            done++;
+        }
+
+        if (!done)
+            return;
+
+        QMutexLocker lock(&mutex);
+        completed += done;
+        if (completed == count)
+            finished.wakeAll();
+    }
+
+    const QList<CertificateRequest> requests;
+    const IssuerContext issuer;
+    const CertificateProfile profile;
+
+    QVector<BatchIssuer::Result> results;
+    BatchIssuer::Result *output;
+    QAtomicInt next;
+
+    QMutex mutex;
+    QWaitCondition finished;
+    int completed;
+};
+
+class BatchWorker : public QRunnable
+{
+public:
+    BatchWorker(const QSharedPointer<BatchState> &state)
+        : state(state)
+    {
+    }
+
+    void run()
+    {
+        state->work();
+    }
+
+private:
+    QSharedPointer<BatchState> state;
+};
+
+BatchIssuer::Result::Result()
+    : error(GNUTLS_E_SUCCESS)
+{
+}
+
+/*!
+  Returns a string describing the error that occurred when issuing this
+  certificate.
+ */
+QString BatchIssuer::Result::errorString() const
+{
+    return QString::fromUtf8(gnutls_strerror(error));
+}
+
+/*!
+  Creates a BatchIssuer that will issue certificates signed by \a issuer
+  using the settings in \a profile.
+ */
+BatchIssuer::BatchIssuer(const IssuerContext &issuer, const CertificateProfile &profile)
+    : d(new BatchIssuerPrivate)
+{
+    d->issuer = issuer;
+    d->profile = profile;
+    d->maxThreadCount = QThread::idealThreadCount();
+}
+
+/*!
+  Cleans up a BatchIssuer.
+ */
+BatchIssuer::~BatchIssuer()
+{
+    delete d;
+}
+
+/*!
+  Sets the maximum number of threads, including the calling thread, that a
+  single call to issue() will use. By default this is the number of cores
+  available.
+ */
+void BatchIssuer::setMaxThreadCount(int count)
+{
+    d->maxThreadCount = qMax(1, count);
+}
+
+/*!
+  Returns the maximum number of threads that a single call to issue() will
+  use.
+ */
+int BatchIssuer::maxThreadCount() const
+{
+    return d->maxThreadCount;
+}
+
+/*!
+  Issues a certificate for each of the \a requests and returns the results
+  in the same order. This method blocks until every request has been
+  processed.
+ */
+QList<BatchIssuer::Result> BatchIssuer::issue(const QList<CertificateRequest> &requests)
+{
+    if (requests.isEmpty())
+        return QList<Result>();
+
+    QSharedPointer<BatchState> state(new BatchState(requests, d->issuer, d->profile));
+
+    int helpers = qMin(d->maxThreadCount, requests.size()) - 1;
+    QThreadPool *pool = CertificateLibrary::threadPool();
+    for (int i = 0; i < helpers; i++)
+        pool->start(new BatchWorker(state));
+
+    // Work in this thread too, this guarantees progress even if the pool is busy
+    state->work();
+
+    QMutexLocker lock(&state->mutex);
+    while (state->completed < requests.size())
+        state->finished.wait(&state->mutex);
+
+    return state->results.toList();
+}
+
+QT_END_NAMESPACE_CERTIFICATE
@@ -0,0 +1,654 @@
+/****************************************************************************
+**
+** Copyright (C) 2012-2013 Richard J. Moore <rich@kde.org>
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include <QAtomicInt>
+#include <QFile>
+#include <QIODevice>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QSharedPointer>
+#include <QThreadPool>
+#include <QVector>
+#include <QWaitCondition>
+
+#include <string.h>
+
+#include <gnutls/gnutls.h>
+
+#include "certificatelibrary.h"
+
+#include "bundlereader_p.h"
+
+QT_BEGIN_NAMESPACE_CERTIFICATE
+
+/*!
+  \class BundleReader
+  \brief The BundleReader class reads a series of requests or certificates
+  from a single file or device.
+
+  Files containing many concatenated PEM blocks, or many DER structures
+  placed one after another, can be read one object at a time using the
+  BundleReader class. The data is read from the device in chunks as it is
+  needed, so the memory used is bounded by the size of the largest object
+  rather than the size of the bundle. If the bundle is opened by file name
+  then it is memory mapped where possible and nothing is read in advance.
+
+  readRequests() and readCertificates() read several objects at once and
+  can spread the parsing across the thread pool returned by
+  CertificateLibrary::threadPool(), see setMaxThreadCount().
+
+  If an error occurs, such as a truncated object, then reading stops and
+  error() will report the reason. Objects that cannot be parsed do not stop
+  the reader, they are simply returned as null.
+*/
+
+static const int ChunkSize = 64*1024;
+static const int ReadTimeout = 30000;
+
+static const char PemBegin[] = "-----BEGIN ";
+static const char PemEnd[] = "-----END ";
+
+/*!
+  \internal
+  Search for needle in the len bytes at haystack.
+ */
+static int find_bytes(const char *haystack, int len, const char *needle, int needleLen, int from=0)
+{
+    for (int i = from; i <= len - needleLen; i++) {
+        const char *p = static_cast<const char *>(memchr(haystack + i, needle[0], len - needleLen - i + 1));
+        if (!p)
+            return -1;
+
+        i = p - haystack;
+        if (0 == memcmp(p, needle, needleLen))
+            return i;
+    }
+
+    return -1;
+}
+
+BundleReaderPrivate::BundleReaderPrivate(QIODevice *device, QSsl::EncodingFormat format)
+    : device(device),
+      file(0),
+      format(format),
+      bufferPos(0),
+      mapped(0),
+      mappedSize(0),
+      mappedPos(0),
+      eof(false),
+      errno(GNUTLS_E_SUCCESS),
+      maxObjectSize(1024*1024),
+      maxThreadCount(1)
+{
+}
+
+const char *BundleReaderPrivate::data() const
+{
+    if (mapped)
+        return reinterpret_cast<const char *>(mapped + mappedPos);
+    return buffer.constData() + bufferPos;
+}
+
+int BundleReaderPrivate::available() const
+{
+    if (mapped)
+        return int(qMin<qint64>(mappedSize - mappedPos, maxObjectSize + ChunkSize));
+    return buffer.size() - bufferPos;
+}
+
+void BundleReaderPrivate::consume(int bytes)
+{
+    if (mapped)
+        mappedPos += bytes;
+    else
+        bufferPos += bytes;
+}
+
+/*!
+  \internal
+  Make more data available. Returns false if there is no more data.
+ */
+bool BundleReaderPrivate::fill()
+{
+    if (mapped) {
+        // The window over the mapping is limited, so move it on if possible
+        eof = (mappedSize - mappedPos) <= available();
+        return !eof;
+    }
+
+    if (eof || !device)
+        return false;
+
+    // Discard what has been consumed before reading more
+    if (bufferPos) {
+        buffer.remove(0, bufferPos);
+        bufferPos = 0;
+    }
+
+    int oldSize = buffer.size();
+    buffer.resize(oldSize + ChunkSize);
+
+    qint64 count = device->read(buffer.data() + oldSize, ChunkSize);
+
+    // A sequential device such as a socket returns nothing when the data
+    // has simply not arrived yet, so wait for it before giving up
+    while (0 == count && device->isSequential() && device->waitForReadyRead(ReadTimeout))
+        count = device->read(buffer.data() + oldSize, ChunkSize);
+
+    buffer.resize(oldSize + int(qMax<qint64>(count, 0)));
+
+    if (count <= 0)
+        eof = true;
+
+    return count > 0;
+}
+
+/*!
+  \internal
+  Skips any text before the next PEM block. Returns false if there are no
+  more blocks, in which case everything left has been consumed.
+ */
+bool BundleReaderPrivate::skipToPemObject()
+{
+    const int beginLen = sizeof(PemBegin) - 1;
+
+    forever {
+        int len = available();
+
+        int begin = find_bytes(data(), len, PemBegin, beginLen);
+        if (-1 != begin) {
+            consume(begin);
+            return true;
+        }
+
+        // Keep enough to spot a marker split across two reads
+        int keep = qMin(len, beginLen - 1);
+        consume(len - keep);
+        if (!fill()) {
+            consume(available());
+            return false;
+        }
+    }
+}
+
+/*!
+  \internal
+  Returns the next PEM block including its header and footer lines. Any
+  text between blocks is skipped.
+ */
+QByteArray BundleReaderPrivate::nextPemObject()
+{
+    const int beginLen = sizeof(PemBegin) - 1;
+    const int endLen = sizeof(PemEnd) - 1;
+
+    forever {
+        if (!skipToPemObject())
+            return QByteArray();
+
+        const char *window = data();
+        int len = available();
+
+        int end = find_bytes(window, len, PemEnd, endLen, beginLen);
+        int lineEnd = (-1 == end) ? -1 : find_bytes(window, len, "\n", 1, end + endLen);
+
+        if (-1 == lineEnd) {
+            if (len > maxObjectSize) {
+                errno = GNUTLS_E_BASE64_DECODING_ERROR;
+                return QByteArray();
+            }
+
+            if (fill())
+                continue;
+
+            // The footer may simply be missing its final newline
+            if (-1 == end) {
+                errno = GNUTLS_E_BASE64_DECODING_ERROR;
+                return QByteArray();
+            }
+
+            lineEnd = len - 1;
+        }
+
+        QByteArray object(window, lineEnd + 1);
+        consume(lineEnd + 1);
+
+        return object;
+    }
+}
+
+/*!
+  \internal
+  Returns the next DER structure. Every object in a DER bundle must be a
+  SEQUENCE, which is the case for both requests and certificates.
+ */
+QByteArray BundleReaderPrivate::nextDerObject()
+{
+    forever {
+        const unsigned char *window = reinterpret_cast<const unsigned char *>(data());
+        int len = available();
+
+        if (len < 2) {
+            if (fill())
+                continue;
+            if (len)
+                errno = GNUTLS_E_ASN1_DER_OVERFLOW;
+            return QByteArray();
+        }
+
+        if (0x30 != window[0]) {
+            errno = GNUTLS_E_ASN1_DER_ERROR;
+            return QByteArray();
+        }
+
+        qint64 total;
+        if (window[1] < 0x80) {
+            total = 2 + window[1];
+        }
+        else {
+            int lengthBytes = window[1] & 0x7f;
+            if (!lengthBytes || lengthBytes > 4) {
+                errno = GNUTLS_E_ASN1_DER_ERROR;
+                return QByteArray();
+            }
+
+            if (len < 2 + lengthBytes) {
+                if (fill())
+                    continue;
+                errno = GNUTLS_E_ASN1_DER_OVERFLOW;
+                return QByteArray();
+            }
+
+            qint64 length = 0;
+            for (int i = 0; i < lengthBytes; i++)
+                length = (length << 8) | window[2 + i];
+
+            total = 2 + lengthBytes + length;
+        }
+
+        if (total > maxObjectSize) {
+            errno = GNUTLS_E_ASN1_DER_OVERFLOW;
+            return QByteArray();
+        }
+
+        if (len < total) {
+            if (fill())
+                continue;
+            errno = GNUTLS_E_ASN1_DER_OVERFLOW;
+            return QByteArray();
+        }
+
+        QByteArray object(reinterpret_cast<const char *>(window), int(total));
+        consume(int(total));
+
+        return object;
+    }
+}
+
+QByteArray BundleReaderPrivate::nextObject()
+{
+    if (GNUTLS_E_SUCCESS != errno)
+        return QByteArray();
+
+    if (QSsl::Pem == format)
+        return nextPemObject();
+    return nextDerObject();
+}
+
+QList<QByteArray> BundleReaderPrivate::nextObjects(int maxCount)
+{
+    QList<QByteArray> objects;
+
+    while (objects.size() < maxCount) {
+        QByteArray object = nextObject();
+        if (object.isEmpty())
+            break;
+        objects << object;
+    }
+
+    return objects;
+}
+
+static void parse_object(const QByteArray &object, QSsl::EncodingFormat format, CertificateRequest *result)
+{
+    *result = CertificateRequest(object, format);
+}
+
+static void parse_object(const QByteArray &object, QSsl::EncodingFormat format, QSslCertificate *result)
+{
+    *result = QSslCertificate(object, format);
+}
+
+template <typename T>
+static QList<T> parse_objects(const QList<QByteArray> &objects, QSsl::EncodingFormat format)
+{
+    QList<T> result;
+    result.reserve(objects.size());
+
+    for (int i = 0; i < objects.size(); i++) {
+        T item;
+        parse_object(objects.at(i), format, &item);
+        result << item;
+    }
+
+    return result;
+}
+
+/*!
+  \internal
+  The state of a single parallel parse. This is shared with the worker jobs
+  so that a job that only starts once all the work is done can still safely
+  find that there is nothing left for it.
+ */
+template <typename T>
+struct BundleParseState
+{
+    BundleParseState(const QList<QByteArray> &objects, QSsl::EncodingFormat format, int sliceSize)
+        : objects(objects),
+          format(format),
+          sliceSize(sliceSize),
+          results(objects.size()),
+          completed(0)
+    {
+        // Each worker writes to distinct elements, so never touch the
+        // vector itself once the work has started
+        output = results.data();
+    }
+
+    void work()
+    {
+        const int count = objects.size();
+        int done = 0;
+
+        for (;;) {
+            int start = next.fetchAndAddOrdered(1) * sliceSize;
+            if (start >= count)
+                break;
+
+            int end = qMin(start + sliceSize, count);
+            for (int i = start; i < end; i++)
+                parse_object(objects.at(i), format, &output[i]);
+            done += end - start;
+        }
+
+        if (!done)
+            return;
+
+        QMutexLocker lock(&mutex);
+        completed += done;
+        if (completed == count)
+            finished.wakeAll();
+    }
+
+    const QList<QByteArray> objects;
+    const QSsl::EncodingFormat format;
+    const int sliceSize;
+
+    QVector<T> results;
+    T *output;
+    QAtomicInt next;
+
+    QMutex mutex;
+    QWaitCondition finished;
+    int completed;
+};
+
+template <typename T>
+class BundleParseWorker : public QRunnable
+{
+public:
+    BundleParseWorker(const QSharedPointer<BundleParseState<T> > &state)
+        : state(state)
+    {
+    }
+
+    void run()
+    {
+        state->work();
+    }
+
+private:
+    QSharedPointer<BundleParseState<T> > state;
+};
+
+/*!
+  \internal
+  Parse the objects, splitting them into contiguous slices when more than
+  one thread may be used. Each thread, including the calling one, takes the
+  next unparsed slice until none are left, so the parse completes even if
+  the pool is busy or the caller is itself running on the pool. The results
+  are returned in the original order.
+ */
+template <typename T>
+static QList<T> parse_objects(const QList<QByteArray> &objects, QSsl::EncodingFormat format, int maxThreadCount)
+{
+    int slices = qMin(maxThreadCount, objects.size());
+    if (slices <= 1)
+        return parse_objects<T>(objects, format);
+
+    int sliceSize = (objects.size() + slices - 1) / slices;
+    QSharedPointer<BundleParseState<T> > state(new BundleParseState<T>(objects, format, sliceSize));
+
+    QThreadPool *pool = CertificateLibrary::threadPool();
+    for (int i = 1; i < slices; i++)
+        pool->start(new BundleParseWorker<T>(state));
+
+    state->work();
+
+    QMutexLocker lock(&state->mutex);
+    while (state->completed < objects.size())
+        state->finished.wait(&state->mutex);
+
+    return state->results.toList();
+}
+
+/*!
+  Creates a BundleReader that reads from \a device, which must already be
+  open. The device is not owned by the reader and must remain valid while
+  the reader is in use.
+ */
+BundleReader::BundleReader(QIODevice *device, QSsl::EncodingFormat format)
+    : d(new BundleReaderPrivate(device, format))
+{
+}
+
+/*!
+  Creates a BundleReader that reads the file \a fileName. The file will be
+  memory mapped if possible. If the file cannot be opened then error() will
+  return GNUTLS_E_FILE_ERROR.
+ */
+BundleReader::BundleReader(const QString &fileName, QSsl::EncodingFormat format)
+    : d(new BundleReaderPrivate(0, format))
+{
+    d->file = new QFile(fileName);
+    if (!d->file->open(QIODevice::ReadOnly)) {
+        d->errno = GNUTLS_E_FILE_ERROR;
+        return;
+    }
+
+    d->mappedSize = d->file->size();
+    if (d->mappedSize > 0)
+        d->mapped = d->file->map(0, d->mappedSize);
+
+    // Not everything can be mapped (eg. pipes), so fall back to reading
+    if (!d->mapped) {
+        d->mappedSize = 0;
+        d->device = d->file;
+    }
+}
+
+/*!
+  Cleans up a BundleReader.
+ */
+BundleReader::~BundleReader()
+{
+    // Closing the file also removes the mapping
+    delete d->file;
+    delete d;
+}
+
+/*!
+  Returns the error that stopped the reader. The values used are those of
+  gnutls. If there has not been an error then it is guaranteed to be 0.
+ */
+int BundleReader::error() const
+{
+    return d->errno;
+}
+
+/*!
+  Returns a string describing the error that stopped the reader.
+ */
+QString BundleReader::errorString() const
+{
+    return QString::fromUtf8(gnutls_strerror(d->errno));
+}
+
+/*!
+  Returns true if there are no more objects to read, either because the
+  end of the bundle has been reached or because an error occurred. When
+  reading PEM from a device this may need to wait for more data.
+ */
+bool BundleReader::atEnd() const
+{
+    if (GNUTLS_E_SUCCESS != d->errno)
+        return true;
+
+    // Text after the last PEM block is not something left to read
+    if (QSsl::Pem == d->format)
+        return !d->skipToPemObject();
+
+    if (d->mapped)
+        return d->mappedPos >= d->mappedSize;
+
+    return d->eof && !d->available();
+}
+
+/*!
+  Sets the size of the largest object that will be accepted. Reaching an
+  object larger than this is treated as an error, which ensures that a
+  corrupt bundle cannot make the reader buffer unlimited amounts of data.
+  The default is 1MB.
+ */
+void BundleReader::setMaxObjectSize(int bytes)
+{
+    d->maxObjectSize = qMax(bytes, 16);
+}
+
+/*!
+  Returns the size of the largest object that will be accepted.
+ */
+int BundleReader::maxObjectSize() const
+{
+    return d->maxObjectSize;
+}
+
+/*!
+  Sets the maximum number of threads used by readRequests() and
+  readCertificates() to parse the objects. The default is 1, meaning that
+  the objects are parsed in the calling thread.
+ */
+void BundleReader::setMaxThreadCount(int count)
+{
+    d->maxThreadCount = qMax(count, 1);
+}
+
+/*!
+  Returns the maximum number of threads used to parse the objects.
+ */
+int BundleReader::maxThreadCount() const
+{
+    return d->maxThreadCount;
+}
+
+/*!
+  Returns the next object in the bundle without parsing it. For a PEM
+  bundle this is a complete PEM block, for a DER bundle it is a single DER
+  structure. If there are no more objects then an empty QByteArray is
+  returned.
+ */
+QByteArray BundleReader::readObject()
+{
+    return d->nextObject();
+}
+
+/*!
+  Reads and returns the next request from the bundle. If there are no
+  more objects then a null request is returned.
+ */
+CertificateRequest BundleReader::readRequest()
+{
+    QByteArray object = d->nextObject();
+    if (object.isEmpty())
+        return CertificateRequest();
+
+    return CertificateRequest(object, d->format);
+}
+
+/*!
+  Reads up to \a maxCount requests from the bundle. This allows the
+  parsing to be spread across several threads, while still limiting the
+  amount of memory used at any one time.
+ */
+QList<CertificateRequest> BundleReader::readRequests(int maxCount)
+{
+    return parse_objects<CertificateRequest>(d->nextObjects(maxCount), d->format, d->maxThreadCount);
+}
+
+/*!
+  Reads and returns the next certificate from the bundle. If there are no
+  more objects then a null certificate is returned.
+ */
+QSslCertificate BundleReader::readCertificate()
+{
+    QByteArray object = d->nextObject();
+    if (object.isEmpty())
+        return QSslCertificate();
+
+    return QSslCertificate(object, d->format);
+}
+
+/*!
+  Reads up to \a maxCount certificates from the bundle, in the same way as
+  readRequests().
+ */
+QList<QSslCertificate> BundleReader::readCertificates(int maxCount)
+{
+    return parse_objects<QSslCertificate>(d->nextObjects(maxCount), d->format, d->maxThreadCount);
+}
+
+QT_END_NAMESPACE_CERTIFICATE
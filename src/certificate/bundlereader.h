@@ -0,0 +1,88 @@
+/****************************************************************************
+**
+** Copyright (C) 2012-2013 Richard J. Moore <rich@kde.org>
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef BUNDLEREADER_H
+#define BUNDLEREADER_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QList>
+#include <QtCore/QString>
+#include <QtNetwork/QSsl>
+#include <QtNetwork/QSslCertificate>
+
+#include "certificate_global.h"
+#include "certificaterequest.h"
+
+class QIODevice;
+
+QT_BEGIN_NAMESPACE_CERTIFICATE
+
+class Q_CERTIFICATE_EXPORT BundleReader
+{
+public:
+    BundleReader(QIODevice *device, QSsl::EncodingFormat format=QSsl::Pem);
+    BundleReader(const QString &fileName, QSsl::EncodingFormat format=QSsl::Pem);
+    ~BundleReader();
+
+    int error() const;
+    QString errorString() const;
+
+    bool atEnd() const;
+
+    void setMaxObjectSize(int bytes);
+    int maxObjectSize() const;
+
+    void setMaxThreadCount(int count);
+    int maxThreadCount() const;
+
+    QByteArray readObject();
+
+    CertificateRequest readRequest();
+    QList<CertificateRequest> readRequests(int maxCount);
+
+    QSslCertificate readCertificate();
+    QList<QSslCertificate> readCertificates(int maxCount);
+
+private:
+    Q_DISABLE_COPY(BundleReader)
+    struct BundleReaderPrivate *d;
+};
+
+QT_END_NAMESPACE_CERTIFICATE
+
+#endif // BUNDLEREADER_H
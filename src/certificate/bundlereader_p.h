@@ -0,0 +1,87 @@
+/****************************************************************************
+**
+** Copyright (C) 2012-2013 Richard J. Moore <rich@kde.org>
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef BUNDLEREADER_P_H
+#define BUNDLEREADER_P_H
+
+#include <QByteArray>
+
+#include "bundlereader.h"
+
+class QFile;
+
+QT_BEGIN_NAMESPACE_CERTIFICATE
+
+struct BundleReaderPrivate
+{
+    BundleReaderPrivate(QIODevice *device, QSsl::EncodingFormat format);
+
+    const char *data() const;
+    int available() const;
+    void consume(int bytes);
+    bool fill();
+
+    bool skipToPemObject();
+
+    QByteArray nextObject();
+    QByteArray nextPemObject();
+    QByteArray nextDerObject();
+    QList<QByteArray> nextObjects(int maxCount);
+
+    QIODevice *device;
+    QFile *file;
+    QSsl::EncodingFormat format;
+
+    // Data that has been read from the device but not yet consumed
+    QByteArray buffer;
+    int bufferPos;
+
+    // When reading a mapped file, the whole file is available at once
+    const uchar *mapped;
+    qint64 mappedSize;
+    qint64 mappedPos;
+
+    bool eof;
+    int errno;
+    int maxObjectSize;
+    int maxThreadCount;
+};
+
+QT_END_NAMESPACE_CERTIFICATE
+
+#endif // BUNDLEREADER_P_H
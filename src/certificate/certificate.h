@@ -39,6 +39,9 @@
 #ifndef CERTIFICATE_H
 #define CERTIFICATE_H
 
+#include <QtCore/QByteArray>
+#include <QtCore/QPair>
+
 QT_BEGIN_NAMESPACE_CERTIFICATE
 
 namespace Certificate {
@@ -51,6 +54,23 @@ namespace Certificate {
         EntryStateOrProvinceName,
         EntryEmail
     };
+
+    enum SignatureDigest {
+        DigestDefault,
+        DigestSha1,
+        DigestSha256,
+        DigestSha384,
+        DigestSha512
+    };
+
+    enum AlternativeNameType {
+        AlternativeNameDns,
+        AlternativeNameEmail,
+        AlternativeNameIpAddress,
+        AlternativeNameUri
+    };
+
+    typedef QPair<AlternativeNameType, QByteArray> AlternativeName;
 };
 
 QT_END_NAMESPACE_CERTIFICATE
@@ -8,12 +8,28 @@ DEFINES += QT_CERTIFICATE_LIB
 CONFIG += debug
 
 # Input
-SOURCES += certificatebuilder.cpp \
+SOURCES += batchissuer.cpp \
+           bundlereader.cpp \
+           certificatebuilder.cpp \
+           certificatelibrary.cpp \
+           certificateprofile.cpp \
            certificaterequestbuilder.cpp \
            certificaterequest.cpp \
+           issuercontext.cpp \
            keybuilder.cpp \
+           keypool.cpp \
+           leafcertificatecache.cpp \
            utils.cpp \
-           randomgenerator.cpp
+           randomgenerator.cpp \
+           serialallocator.cpp \
+           securememory.cpp \
+           signingkey.cpp \
+           signerclient.cpp \
+           signerserver.cpp \
+           derwriter.cpp \
+           crlbuilder.cpp \
+           crlindex.cpp \
+           ocspresponder.cpp
 
 
 
@@ -43,7 +43,11 @@ extern "C" {
 #include <gnutls/abstract.h>
 };
 
+#include "asynctask_p.h"
+#include "certificateprofile_p.h"
 #include "certificaterequest_p.h"
+#include "issuercontext_p.h"
+#include "signingkey_p.h"
 #include "utils_p.h"
 
 #include "certificatebuilder_p.h"
@@ -62,9 +66,24 @@ CertificateBuilder::CertificateBuilder()
     : d(new CertificateBuilderPrivate)
 {
     ensure_gnutls_init();
+    d->digest = Certificate::DigestDefault;
     d->errno = gnutls_x509_crt_init(&d->crt);
 }
 
+/*!
+  Creates a new CertificateBuilder with the settings from \a profile
+  already applied. Check error() to see if the profile could be applied.
+ */
+CertificateBuilder::CertificateBuilder(const CertificateProfile &profile)
+    : d(new CertificateBuilderPrivate)
+{
+    ensure_gnutls_init();
+    d->digest = Certificate::DigestDefault;
+    d->errno = gnutls_x509_crt_init(&d->crt);
+    if (GNUTLS_E_SUCCESS == d->errno)
+        setProfile(profile);
+}
+
 /*!
   Cleans up a CertificateBuilder.
  */
@@ -102,6 +121,40 @@ bool CertificateBuilder::setRequest(const CertificateRequest &crq)
     return GNUTLS_E_SUCCESS == d->errno;
 }
 
+/*!
+  Applies the fixed settings from \a profile to the certificate, ie. the
+  version, signature digest, basic constraints, key usage and extended key
+  usage. The extensions were encoded when the profile was set up, so they
+  are simply copied into the certificate. The fields that vary between
+  certificates, such as the serial number and validity period, must still
+  be set on the builder.
+ */
+bool CertificateBuilder::setProfile(const CertificateProfile &profile)
+{
+    const CertificateProfilePrivate *p = profile.d.constData();
+
+    d->errno = p->errno;
+    if (GNUTLS_E_SUCCESS != d->errno)
+        return false;
+
+    if (!setVersion(p->version))
+        return false;
+
+    d->digest = p->digest;
+
+    for (int i = 0; i < p->extensions.size(); i++) {
+        const ProfileExtension &ext = p->extensions.at(i);
+
+        d->errno = gnutls_x509_crt_set_extension_by_oid(d->crt, ext.oid.constData(),
+                                                        ext.der.constData(), ext.der.size(),
+                                                        ext.critical);
+        if (GNUTLS_E_SUCCESS != d->errno)
+            return false;
+    }
+
+    return true;
+}
+
 /*!
   Set the version of the X.509 certificate. In general the version will be 3.
  */
@@ -170,37 +223,9 @@ bool CertificateBuilder::setBasicConstraints(bool ca, int pathLength)
  */
 bool CertificateBuilder::addKeyPurpose(KeyPurpose purpose, bool critical)
 {
-    QByteArray ba;
-
-    switch(purpose) {
-    case PurposeWebServer:
-        ba = QByteArray(GNUTLS_KP_TLS_WWW_SERVER);
-        break;
-    case PurposeWebClient:
-        ba = QByteArray(GNUTLS_KP_TLS_WWW_CLIENT);
-        break;
-    case PurposeCodeSigning:
-        ba = QByteArray(GNUTLS_KP_CODE_SIGNING);
-        break;
-    case PurposeEmailProtection:
-        ba = QByteArray(GNUTLS_KP_EMAIL_PROTECTION);
-        break;
-    case PurposeTimeStamping:
-        ba = QByteArray(GNUTLS_KP_TIME_STAMPING);
-        break;
-    case PurposeOcspSigning:
-        ba = QByteArray(GNUTLS_KP_OCSP_SIGNING);
-        break;
-    case PurposeIpsecIke:
-        ba = QByteArray(GNUTLS_KP_IPSEC_IKE);
-        break;
-    case PurposeAny:
-        ba = QByteArray(GNUTLS_KP_ANY);
-        break;
-    default:
-        qWarning("Unknown Purpose %d", int(purpose));
+    QByteArray ba = keypurpose_to_oid(purpose);
+    if (ba.isNull())
         return false;
-    }
 
     return addKeyPurpose(ba, critical);
 }
@@ -224,27 +249,7 @@ bool CertificateBuilder::addKeyPurpose(const QByteArray &oid, bool critical)
  */
 bool CertificateBuilder::setKeyUsage(KeyUsageFlags usages)
 {
-    uint usage = 0;
-    if (usages & UsageEncipherOnly)
-        usage |= GNUTLS_KEY_ENCIPHER_ONLY;
-    if (usages & UsageCrlSign)
-        usage |= GNUTLS_KEY_CRL_SIGN;
-    if (usages & UsageKeyCertSign)
-        usage |= GNUTLS_KEY_KEY_CERT_SIGN;
-    if (usages & UsageKeyAgreement)
-        usage |= GNUTLS_KEY_KEY_AGREEMENT;
-    if (usages & UsageDataEncipherment)
-        usage |= GNUTLS_KEY_DATA_ENCIPHERMENT;
-    if (usages & UsageKeyEncipherment)
-        usage |= GNUTLS_KEY_KEY_ENCIPHERMENT;
-    if (usages & UsageNonRepudiation)
-        usage |= GNUTLS_KEY_NON_REPUDIATION;
-    if (usages & UsageDigitalSignature)
-        usage |= GNUTLS_KEY_DIGITAL_SIGNATURE;
-    if (usages & UsageDecipherOnly)
-        usage |= GNUTLS_KEY_DECIPHER_ONLY;
-
-    d->errno = gnutls_x509_crt_set_key_usage(d->crt, usage);
+    d->errno = gnutls_x509_crt_set_key_usage(d->crt, keyusage_to_gnutls(usages));
     return GNUTLS_E_SUCCESS == d->errno;
 }
 
@@ -273,102 +278,175 @@ bool CertificateBuilder::addSubjectKeyIdentifier()
 bool CertificateBuilder::addAuthorityKeyIdentifier(const QSslCertificate &qcacert)
 {
     gnutls_x509_crt_t cacrt = qsslcert_to_crt(qcacert, &d->errno);
-    if (GNUTLS_E_SUCCESS != d->errno)
+    if (GNUTLS_E_SUCCESS != d->errno) {
+        if (cacrt)
+            gnutls_x509_crt_deinit(cacrt);
         return false;
+    }
 
-    QByteArray ba(128, 0); // Normally 20 bytes (SHA1)
-    size_t size = ba.size();
+    QByteArray ba = crt_to_keyid(cacrt, &d->errno);
+    gnutls_x509_crt_deinit(cacrt);
 
-    // Try using the subject keyid
-    d->errno = gnutls_x509_crt_get_subject_key_id(cacrt, reinterpret_cast<unsigned char *>(ba.data()), &size, NULL);
+    if (GNUTLS_E_SUCCESS != d->errno)
+        return false;
 
-    // Or fallback to creating it
-    if (GNUTLS_E_SUCCESS != d->errno) {
-        d->errno = gnutls_x509_crt_get_key_id(cacrt, 0, reinterpret_cast<unsigned char *>(ba.data()), &size);
+    d->errno = gnutls_x509_crt_set_authority_key_id(d->crt, reinterpret_cast<const unsigned char *>(ba.constData()), ba.size());
 
-        if (GNUTLS_E_SUCCESS != d->errno) {
-            gnutls_x509_crt_deinit(cacrt);
-            return false;
-        }
+    return GNUTLS_E_SUCCESS == d->errno;
+}
+
+/*!
+  Adds the authority key identifier extension to the certificate using the
+  key identifier that was calculated when the \a issuer was created. The
+  issuer must be the one later used to sign the certificate.
+ */
+bool CertificateBuilder::addAuthorityKeyIdentifier(const IssuerContext &issuer)
+{
+    if (issuer.isNull()) {
+        d->errno = issuer.error() ? issuer.error() : GNUTLS_E_INVALID_REQUEST;
+        return false;
     }
 
-    gnutls_x509_crt_deinit(cacrt);
-    d->errno = gnutls_x509_crt_set_authority_key_id(d->crt, reinterpret_cast<const unsigned char *>(ba.constData()), size);
+    const QByteArray &ba = issuer.d->keyId;
+    d->errno = gnutls_x509_crt_set_authority_key_id(d->crt, reinterpret_cast<const unsigned char *>(ba.constData()), ba.size());
+
+    return GNUTLS_E_SUCCESS == d->errno;
+}
 
+/*!
+  Adds a CRL distribution point extension giving the URI from which the
+  CRL covering the certificate can be fetched. When the issuer publishes
+  partitioned CRLs using CrlBuilder::signedPartitionCrl() this must be the
+  distribution point of the partition containing the certificate's serial.
+ */
+bool CertificateBuilder::addCrlDistributionPoint(const QByteArray &uri)
+{
+    d->errno = gnutls_x509_crt_set_crl_dist_points2(d->crt, GNUTLS_SAN_URI, uri.constData(), uri.size(), 0);
     return GNUTLS_E_SUCCESS == d->errno;
 }
 
+/*!
+  Sets the digest used when signing the certificate. The default,
+  Certificate::DigestDefault, uses SHA1 for RSA and DSA keys and a digest
+  matching the size of the curve for ECDSA keys. The digest is ignored when
+  signing with an Ed25519 key since EdDSA defines its own. Signing with an
+  ECDSA or Ed25519 key is considerably cheaper than signing with an RSA key,
+  so these are a good choice for CAs that issue large numbers of
+  certificates.
+ */
+void CertificateBuilder::setSignatureDigest(Certificate::SignatureDigest digest)
+{
+    d->digest = digest;
+}
+
+/*!
+  Returns the digest that will be used when signing the certificate.
+ */
+Certificate::SignatureDigest CertificateBuilder::signatureDigest() const
+{
+    return d->digest;
+}
+
 /*!
   Creates a self-signed certificate by signing the certificate with the specified
   key.
  */
 QSslCertificate CertificateBuilder::signedCertificate(const QSslKey &qkey)
 {
-    gnutls_x509_privkey_t key = qsslkey_to_key(qkey, &d->errno);
-    if (GNUTLS_E_SUCCESS != d->errno) {
-        gnutls_x509_privkey_deinit(key);
+    gnutls_privkey_t abstractKey = qsslkey_to_privkey(qkey, &d->errno);
+    if (GNUTLS_E_SUCCESS != d->errno)
         return QSslCertificate();
-    };
 
-    gnutls_privkey_t abstractKey;
-    d->errno = gnutls_privkey_init(&abstractKey);
-    if (GNUTLS_E_SUCCESS != d->errno) {
-        gnutls_x509_privkey_deinit(key);
+    d->errno = gnutls_x509_crt_privkey_sign(d->crt, d->crt, abstractKey,
+                                            signature_digest(d->digest, abstractKey), 0);
+
+    gnutls_privkey_deinit(abstractKey);
+
+    if (GNUTLS_E_SUCCESS != d->errno)
         return QSslCertificate();
-    }
 
-    gnutls_privkey_import_x509(abstractKey, key, GNUTLS_PRIVKEY_IMPORT_AUTO_RELEASE);
+    return crt_to_qsslcert(d->crt, &d->errno);    
+}
+
+/*!
+  Creates a self-signed certificate by signing the certificate with the
+  specified encoded private key. This allows certificates to be created
+  using keys that QSslKey cannot represent, such as the Ed25519 keys
+  returned by KeyBuilder::generateEncoded(). The key may be either an
+  unencrypted PKCS#8 structure or in the traditional format for its type.
+  As with the QSslKey version, the request set on the builder should have
+  been signed with the same key, see
+  CertificateRequestBuilder::signedRequest().
+ */
+QSslCertificate CertificateBuilder::signedCertificate(const QByteArray &encodedKey, QSsl::EncodingFormat format)
+{
+    gnutls_privkey_t abstractKey = encoded_to_privkey(encodedKey, format, &d->errno);
+    if (GNUTLS_E_SUCCESS != d->errno)
+        return QSslCertificate();
 
-    d->errno = gnutls_x509_crt_privkey_sign(d->crt, d->crt, abstractKey, GNUTLS_DIG_SHA1, 0);
+    d->errno = gnutls_x509_crt_privkey_sign(d->crt, d->crt, abstractKey,
+                                            signature_digest(d->digest, abstractKey), 0);
 
-    gnutls_x509_privkey_deinit(key);
+    gnutls_privkey_deinit(abstractKey);
 
     if (GNUTLS_E_SUCCESS != d->errno)
         return QSslCertificate();
 
-    return crt_to_qsslcert(d->crt, &d->errno);    
+    return crt_to_qsslcert(d->crt, &d->errno);
 }
 
 /*!
-  Creates a certificate signed by the specified CA certificate using the
-  CA key.
+  Creates a self-signed certificate by signing the certificate with the
+  specified signing key, which may be held in a PKCS#11 token.
  */
-QSslCertificate CertificateBuilder::signedCertificate(const QSslCertificate &qcacert, const QSslKey &qcakey)
+QSslCertificate CertificateBuilder::signedCertificate(const SigningKey &key)
 {
-    //
-    // Extract the CA key
-    //
-    gnutls_x509_privkey_t key = qsslkey_to_key(qcakey, &d->errno);
-    if (GNUTLS_E_SUCCESS != d->errno) {
-        gnutls_x509_privkey_deinit(key);
+    if (key.isNull()) {
+        d->errno = key.error() ? key.error() : GNUTLS_E_INVALID_REQUEST;
         return QSslCertificate();
-    };
+    }
 
-    gnutls_privkey_t abstractKey;
-    d->errno = gnutls_privkey_init(&abstractKey);
-    if (GNUTLS_E_SUCCESS != d->errno) {
-        gnutls_x509_privkey_deinit(key);
-        return QSslCertificate();
+    {
+        SigningKeyLocker locker(key.d.data());
+        gnutls_privkey_t privkey = locker.privkey();
+
+        d->errno = gnutls_x509_crt_privkey_sign(d->crt, d->crt, privkey,
+                                                signature_digest(d->digest, privkey), 0);
     }
 
-    gnutls_privkey_import_x509(abstractKey, key, GNUTLS_PRIVKEY_IMPORT_AUTO_RELEASE);
+    if (GNUTLS_E_SUCCESS != d->errno)
+        return QSslCertificate();
 
-    //
-    // Extract the CA cert
-    //
-    gnutls_x509_crt_t cacrt = qsslcert_to_crt(qcacert, &d->errno);
-    if (GNUTLS_E_SUCCESS != d->errno) {
-        gnutls_x509_privkey_deinit(key);
+    return crt_to_qsslcert(d->crt, &d->errno);
+}
+
+/*!
+  Creates a certificate signed by the specified CA certificate using the
+  CA key. If you are going to issue several certificates using the same CA
+  then it is more efficient to create an IssuerContext once and use that
+  instead.
+ */
+QSslCertificate CertificateBuilder::signedCertificate(const QSslCertificate &qcacert, const QSslKey &qcakey)
+{
+    return signedCertificate(IssuerContext(qcacert, qcakey));
+}
+
+/*!
+  Creates a certificate signed by the CA certificate and key held by the
+  specified \a issuer.
+ */
+QSslCertificate CertificateBuilder::signedCertificate(const IssuerContext &issuer)
+{
+    if (issuer.isNull()) {
+        d->errno = issuer.error() ? issuer.error() : GNUTLS_E_INVALID_REQUEST;
         return QSslCertificate();
     }
 
-    //
-    // Sign the cert
-    //
-    d->errno = gnutls_x509_crt_privkey_sign(d->crt, cacrt, abstractKey, GNUTLS_DIG_SHA1, 0);
+    SigningKeyLocker locker(issuer.d->key.d.data());
+    gnutls_privkey_t key = locker.privkey();
 
-    gnutls_x509_crt_deinit(cacrt);
-    gnutls_x509_privkey_deinit(key);
+    d->errno = gnutls_x509_crt_privkey_sign(d->crt, issuer.d->crt, key,
+                                            signature_digest(d->digest, key), 0);
 
     if (GNUTLS_E_SUCCESS != d->errno)
         return QSslCertificate();
@@ -376,4 +454,95 @@ QSslCertificate CertificateBuilder::signedCertificate(const QSslCertificate &qca
     return crt_to_qsslcert(d->crt, &d->errno);
 }
 
+class SignCertificateTask : public AsyncTask<QSslCertificate>
+{
+public:
+    SignCertificateTask(CertificateBuilder *builder, const QSslKey &key)
+        : mode(SelfSigned),
+          builder(builder),
+          key(key)
+    {
+    }
+
+    SignCertificateTask(CertificateBuilder *builder, const QSslCertificate &cacert, const QSslKey &cakey)
+        : mode(CaSigned),
+          builder(builder),
+          key(cakey),
+          cacert(cacert)
+    {
+    }
+
+    SignCertificateTask(CertificateBuilder *builder, const IssuerContext &issuer)
+        : mode(IssuerSigned),
+          builder(builder),
+          issuer(issuer)
+    {
+    }
+
+protected:
+    QSslCertificate compute()
+    {
+        switch(mode) {
+        case SelfSigned:
+            return builder->signedCertificate(key);
+        case CaSigned:
+            return builder->signedCertificate(cacert, key);
+        case IssuerSigned:
+            return builder->signedCertificate(issuer);
+        }
+
+        return QSslCertificate();
+    }
+
+private:
+    enum Mode {
+        SelfSigned,
+        CaSigned,
+        IssuerSigned
+    };
+
+    Mode mode;
+    CertificateBuilder *builder;
+    QSslKey key;
+    QSslCertificate cacert;
+    IssuerContext issuer;
+};
+
+/*!
+  Creates a self-signed certificate in the same way as signedCertificate(),
+  but does so using the thread pool returned by
+  CertificateLibrary::threadPool(). The builder must not be modified or
+  destroyed until the returned future has finished, after which error() will
+  report the outcome.
+ */
+QFuture<QSslCertificate> CertificateBuilder::signedCertificateAsync(const QSslKey &qkey)
+{
+    SignCertificateTask *task = new SignCertificateTask(this, qkey);
+    return task->start();
+}
+
+/*!
+  Creates a certificate signed by the specified CA certificate using the CA
+  key, running in the thread pool returned by CertificateLibrary::threadPool().
+  The builder must not be modified or destroyed until the returned future has
+  finished.
+ */
+QFuture<QSslCertificate> CertificateBuilder::signedCertificateAsync(const QSslCertificate &qcacert, const QSslKey &qcakey)
+{
+    SignCertificateTask *task = new SignCertificateTask(this, qcacert, qcakey);
+    return task->start();
+}
+
+/*!
+  Creates a certificate signed by the CA certificate and key held by the
+  specified \a issuer, running in the thread pool returned by
+  CertificateLibrary::threadPool(). The builder must not be modified or
+  destroyed until the returned future has finished.
+ */
+QFuture<QSslCertificate> CertificateBuilder::signedCertificateAsync(const IssuerContext &issuer)
+{
+    SignCertificateTask *task = new SignCertificateTask(this, issuer);
+    return task->start();
+}
+
 QT_END_NAMESPACE_CERTIFICATE
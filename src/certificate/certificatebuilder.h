@@ -41,15 +41,20 @@
 
 #include <QString>
 #include <QFlags>
+#include <QFuture>
 #include <QtNetwork/QSslCertificate>
 
 #include "certificate_global.h"
+#include "certificate.h"
 
 class QDateTime;
 
 QT_BEGIN_NAMESPACE_CERTIFICATE
 
 class CertificateRequest;
+class CertificateProfile;
+class IssuerContext;
+class SigningKey;
 
 class Q_CERTIFICATE_EXPORT CertificateBuilder
 {
@@ -79,12 +84,14 @@ public:
     Q_DECLARE_FLAGS(KeyUsageFlags, KeyUsageFlag)
 
     CertificateBuilder();
+    explicit CertificateBuilder(const CertificateProfile &profile);
     ~CertificateBuilder();
 
     int error() const;
     QString errorString() const;
 
     bool setRequest(const CertificateRequest &crq);
+    bool setProfile(const CertificateProfile &profile);
 
     bool setVersion(int version=3);
     bool setSerial(const QByteArray &serial);
@@ -107,9 +114,24 @@ public:
     // Key identifiers
     bool addSubjectKeyIdentifier();
     bool addAuthorityKeyIdentifier(const QSslCertificate &cacert);
+    bool addAuthorityKeyIdentifier(const IssuerContext &issuer);
+
+    // Revocation
+    bool addCrlDistributionPoint(const QByteArray &uri);
+
+    // Signing
+    void setSignatureDigest(Certificate::SignatureDigest digest);
+    Certificate::SignatureDigest signatureDigest() const;
 
     QSslCertificate signedCertificate(const QSslKey &key);
+    QSslCertificate signedCertificate(const QByteArray &encodedKey, QSsl::EncodingFormat format=QSsl::Pem);
+    QSslCertificate signedCertificate(const SigningKey &key);
     QSslCertificate signedCertificate(const QSslCertificate &cacert, const QSslKey &cakey);
+    QSslCertificate signedCertificate(const IssuerContext &issuer);
+
+    QFuture<QSslCertificate> signedCertificateAsync(const QSslKey &key);
+    QFuture<QSslCertificate> signedCertificateAsync(const QSslCertificate &cacert, const QSslKey &cakey);
+    QFuture<QSslCertificate> signedCertificateAsync(const IssuerContext &issuer);
 
 private:
     struct CertificateBuilderPrivate *d;
@@ -50,6 +50,7 @@ struct CertificateBuilderPrivate
 {
     int errno;
     gnutls_x509_crt_t crt;
+    Certificate::SignatureDigest digest;
 };
 
 QT_END_NAMESPACE_CERTIFICATE
@@ -0,0 +1,185 @@
+/****************************************************************************
+**
+** Copyright (C) 2012-2013 Richard J. Moore <rich@kde.org>
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include <gnutls/gnutls.h>
+#include <gnutls/crypto.h>
+#include <gnutls/x509.h>
+
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSslSocket>
+#include <QThreadPool>
+
+#include "securememory_p.h"
+#include "utils_p.h"
+
+#include "certificatelibrary.h"
+
+QT_BEGIN_NAMESPACE_CERTIFICATE
+
+/*!
+  \class CertificateLibrary
+  \brief The CertificateLibrary class provides control over the library as a
+  whole.
+
+  The library initialises gnutls automatically the first time it is used, and
+  this is safe to happen from several threads at once. The CertificateLibrary
+  class allows applications to pay the start up costs at a time of their own
+  choosing rather than during the first request they handle.
+
+  It also controls the thread pool used by the asynchronous methods such as
+  KeyBuilder::generateAsync() and CertificateBuilder::signedCertificateAsync().
+*/
+
+struct ThreadPoolSetting
+{
+    ThreadPoolSetting()
+        : pool(0)
+    {
+    }
+
+    QMutex mutex;
+    QThreadPool *pool;
+};
+
+Q_GLOBAL_STATIC(ThreadPoolSetting, threadPoolSetting)
+
+/*!
+  Performs the work that would otherwise happen the first time a certificate,
+  request or key is created in the calling thread. This initialises gnutls,
+  seeds its random number generators, loads the digest and X.509 support and
+  makes sure the Qt SSL backend has been loaded.
+
+  Some of this state is held per-thread, so servers that issue certificates
+  from worker threads should call this from each worker as it starts. Returns
+  true if everything was initialised successfully.
+ */
+bool CertificateLibrary::warmUp()
+{
+    if (GNUTLS_E_SUCCESS != ensure_gnutls_init())
+        return false;
+
+    // Seed the random generators for this thread
+    unsigned char seed;
+    if (GNUTLS_E_SUCCESS != gnutls_rnd(GNUTLS_RND_NONCE, &seed, sizeof(seed)))
+        return false;
+    if (GNUTLS_E_SUCCESS != gnutls_rnd(GNUTLS_RND_RANDOM, &seed, sizeof(seed)))
+        return false;
+    if (GNUTLS_E_SUCCESS != gnutls_rnd(GNUTLS_RND_KEY, &seed, sizeof(seed)))
+        return false;
+
+    // Load the digest used for signing and key identifiers
+    unsigned char digest[20];
+    if (GNUTLS_E_SUCCESS != gnutls_hash_fast(GNUTLS_DIG_SHA1, &seed, sizeof(seed), digest))
+        return false;
+
+    // Set up the ASN.1 structures used when building certificates
+    gnutls_x509_crt_t crt;
+    if (GNUTLS_E_SUCCESS != gnutls_x509_crt_init(&crt))
+        return false;
+    gnutls_x509_crt_deinit(crt);
+
+    gnutls_x509_crq_t crq;
+    if (GNUTLS_E_SUCCESS != gnutls_x509_crq_init(&crq))
+        return false;
+    gnutls_x509_crq_deinit(crq);
+
+    gnutls_x509_privkey_t key;
+    if (GNUTLS_E_SUCCESS != gnutls_x509_privkey_init(&key))
+        return false;
+    gnutls_x509_privkey_deinit(key);
+
+    // Allocate the export buffer and secure arena for this thread
+    export_scratch_buffer();
+    SecureScope scope;
+    scope.allocate(1);
+
+    // Results are returned as QSsl types so make sure Qt's backend is loaded
+    return QSslSocket::supportsSsl();
+}
+
+/*!
+  Sets the thread pool that will be used to run asynchronous operations. The
+  pool is not owned by the library, and must remain valid until all the
+  operations started using it have finished. Passing 0 restores the default,
+  which is QThreadPool::globalInstance().
+ */
+void CertificateLibrary::setThreadPool(QThreadPool *pool)
+{
+    ThreadPoolSetting *setting = threadPoolSetting();
+
+    QMutexLocker lock(&setting->mutex);
+    setting->pool = pool;
+}
+
+/*!
+  Returns the thread pool that will be used to run asynchronous operations.
+ */
+QThreadPool *CertificateLibrary::threadPool()
+{
+    ThreadPoolSetting *setting = threadPoolSetting();
+
+    QMutexLocker lock(&setting->mutex);
+    return setting->pool ? setting->pool : QThreadPool::globalInstance();
+}
+
+/*!
+  Controls whether the memory the library uses for private keys is locked
+  into RAM so that it cannot be written to swap. The default is false.
+
+  Private keys passing through the library are held in a per-thread arena
+  which is zeroed as soon as each operation has finished with it, and is
+  excluded from core dumps where the platform allows. Locking requires the
+  process to be permitted to lock memory (see RLIMIT_MEMLOCK); if it is not
+  then the arena is used unlocked. The memory gnutls allocates internally is
+  not affected by this setting.
+ */
+void CertificateLibrary::setLockedKeyMemory(bool lock)
+{
+    set_secure_memory_locked(lock);
+}
+
+/*!
+  Returns true if the memory used for private keys will be locked into RAM.
+ */
+bool CertificateLibrary::lockedKeyMemory()
+{
+    return secure_memory_locked();
+}
+
+QT_END_NAMESPACE_CERTIFICATE
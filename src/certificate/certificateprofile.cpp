@@ -0,0 +1,398 @@
+/****************************************************************************
+**
+** Copyright (C) 2012-2013 Richard J. Moore <rich@kde.org>
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include <QDateTime>
+
+#include <gnutls/x509.h>
+#include <gnutls/x509-ext.h>
+
+#include "certificaterequest.h"
+#include "issuercontext.h"
+#include "randomgenerator.h"
+#include "utils_p.h"
+
+#include "certificateprofile_p.h"
+
+QT_BEGIN_NAMESPACE_CERTIFICATE
+
+/*!
+  \class CertificateProfile
+  \brief The CertificateProfile class describes the settings shared by a
+  group of certificates.
+
+  Most certificates issued by a CA differ only in their subject, public key,
+  serial number and validity period. The CertificateProfile class holds the
+  rest of the settings, such as the key usage and basic constraints, so that
+  they can be specified once and then applied to each certificate using
+  CertificateBuilder::setProfile(). Profiles are also used by BatchIssuer to
+  describe the certificates it should issue.
+
+  The extensions in a profile are DER encoded as soon as they are set, so
+  applying a profile to a builder only has to copy them into the certificate
+  rather than encoding them again for every certificate issued.
+
+  By default a profile creates version 3 certificates that are valid for 365
+  days, with a 16 byte serial number, and subject and authority key
+  identifiers.
+*/
+
+CertificateProfilePrivate::CertificateProfilePrivate()
+    : errno(GNUTLS_E_SUCCESS),
+      version(3),
+      validityPeriod(365),
+      serialSize(16),
+      digest(Certificate::DigestDefault),
+      copyRequestExtensions(false),
+      subjectKeyIdentifier(true),
+      authorityKeyIdentifier(true)
+{
+    ensure_gnutls_init();
+}
+
+/*!
+  \internal
+  Store the encoded extension, replacing any earlier value for the same OID.
+  Takes ownership of the data in \a der.
+ */
+void CertificateProfilePrivate::setExtension(const char *oid, gnutls_datum_t *der, bool critical)
+{
+    ProfileExtension ext;
+    ext.oid = QByteArray(oid);
+    ext.der = QByteArray(reinterpret_cast<const char *>(der->data), der->size);
+    ext.critical = critical;
+    gnutls_free(der->data);
+
+    for (int i = 0; i < extensions.size(); i++) {
+        if (extensions[i].oid == ext.oid) {
+            extensions[i] = ext;
+            return;
+        }
+    }
+
+    extensions.append(ext);
+}
+
+/*!
+  \internal
+  Issue a certificate for \a crq signed by \a issuer using the settings from
+  \a profile. The error, if any, is returned in \a errno.
+ */
+QSslCertificate issue_from_profile(const CertificateRequest &crq, const CertificateProfile &profile,
+                                   const IssuerContext &issuer, int *errno)
+{
+    CertificateBuilder builder;
+    QDateTime now = QDateTime::currentDateTimeUtc();
+
+    bool ok = builder.setRequest(crq)
+        && (!profile.copyRequestExtensions() || builder.copyRequestExtensions(crq))
+        && builder.setProfile(profile)
+        && builder.setSerial(RandomGenerator::getPositiveBytes(profile.serialSize()))
+        && builder.setActivationTime(now)
+        && builder.setExpirationTime(now.addDays(profile.validityPeriod()))
+        && (!profile.addSubjectKeyIdentifier() || builder.addSubjectKeyIdentifier())
+        && (!profile.addAuthorityKeyIdentifier() || builder.addAuthorityKeyIdentifier(issuer));
+
+    if (!ok) {
+        *errno = builder.error();
+        return QSslCertificate();
+    }
+
+    QSslCertificate result = builder.signedCertificate(issuer);
+    *errno = builder.error();
+
+    return result;
+}
+
+/*!
+  Creates a CertificateProfile with the default settings.
+ */
+CertificateProfile::CertificateProfile()
+    : d(new CertificateProfilePrivate)
+{
+}
+
+/*!
+  Creates a CertificateProfile that is a copy of other.
+ */
+CertificateProfile::CertificateProfile(const CertificateProfile &other)
+    : d(other.d)
+{
+}
+
+/*!
+  Clean up.
+ */
+CertificateProfile::~CertificateProfile()
+{
+}
+
+/*!
+  Makes this profile a copy of other.
+ */
+CertificateProfile &CertificateProfile::operator=(const CertificateProfile &other)
+{
+    d = other.d;
+    return *this;
+}
+
+/*!
+  Returns the last error that occurred when encoding the extensions of this
+  profile. The values used are those of gnutls. If there has not been an
+  error then it is guaranteed to be 0.
+ */
+int CertificateProfile::error() const
+{
+    return d->errno;
+}
+
+/*!
+  Returns a string describing the last error that occurred when encoding
+  the extensions of this profile.
+ */
+QString CertificateProfile::errorString() const
+{
+    return QString::fromUtf8(gnutls_strerror(d->errno));
+}
+
+/*!
+  Set the version of the X.509 certificates. In general the version will be 3.
+ */
+void CertificateProfile::setVersion(int version)
+{
+    d->version = version;
+}
+
+/*!
+  Returns the version of the X.509 certificates.
+ */
+int CertificateProfile::version() const
+{
+    return d->version;
+}
+
+/*!
+  Sets the number of days for which the certificates will be valid. The
+  validity period starts at the time each certificate is issued.
+ */
+void CertificateProfile::setValidityPeriod(int days)
+{
+    d->validityPeriod = days;
+}
+
+/*!
+  Returns the number of days for which the certificates will be valid.
+ */
+int CertificateProfile::validityPeriod() const
+{
+    return d->validityPeriod;
+}
+
+/*!
+  Sets the digest used to sign the certificates. See
+  CertificateBuilder::setSignatureDigest() for details.
+ */
+void CertificateProfile::setSignatureDigest(Certificate::SignatureDigest digest)
+{
+    d->digest = digest;
+}
+
+/*!
+  Returns the digest used to sign the certificates.
+ */
+Certificate::SignatureDigest CertificateProfile::signatureDigest() const
+{
+    return d->digest;
+}
+
+/*!
+  Sets the number of random bytes used for the serial number of each
+  certificate.
+ */
+void CertificateProfile::setSerialSize(int bytes)
+{
+    d->serialSize = bytes;
+}
+
+/*!
+  Returns the number of random bytes used for the serial number of each
+  certificate.
+ */
+int CertificateProfile::serialSize() const
+{
+    return d->serialSize;
+}
+
+/*!
+  Sets whether the extensions in each request are copied to the certificate.
+  Settings from the profile take precedence over those in the request. See
+  CertificateBuilder::copyRequestExtensions() for the risks involved.
+ */
+void CertificateProfile::setCopyRequestExtensions(bool copy)
+{
+    d->copyRequestExtensions = copy;
+}
+
+/*!
+  Returns true if the extensions in each request are copied to the certificate.
+ */
+bool CertificateProfile::copyRequestExtensions() const
+{
+    return d->copyRequestExtensions;
+}
+
+/*!
+  Sets the basic constraints extension that will be added to the
+  certificates. See CertificateBuilder::setBasicConstraints().
+ */
+void CertificateProfile::setBasicConstraints(bool ca, int pathLength)
+{
+    gnutls_datum_t der;
+    int err = gnutls_x509_ext_export_basic_constraints(ca, pathLength, &der);
+    if (GNUTLS_E_SUCCESS != err) {
+        d->errno = err;
+        return;
+    }
+
+    d->setExtension(GNUTLS_X509EXT_OID_BASIC_CONSTRAINTS, &der, true);
+}
+
+/*!
+  Sets the key usage flags for the certificates.
+ */
+void CertificateProfile::setKeyUsage(CertificateBuilder::KeyUsageFlags usage)
+{
+    gnutls_datum_t der;
+    int err = gnutls_x509_ext_export_key_usage(keyusage_to_gnutls(usage), &der);
+    if (GNUTLS_E_SUCCESS != err) {
+        d->errno = err;
+        return;
+    }
+
+    d->setExtension(GNUTLS_X509EXT_OID_KEY_USAGE, &der, true);
+}
+
+/*!
+  Adds the specified purpose to the list of those the certificates may be
+  used for.
+ */
+void CertificateProfile::addKeyPurpose(CertificateBuilder::KeyPurpose purpose, bool critical)
+{
+    QByteArray oid = keypurpose_to_oid(purpose);
+    if (oid.isNull())
+        return;
+
+    addKeyPurpose(oid, critical);
+}
+
+/*!
+  Adds the purpose with the specified OID to the list of those the
+  certificates may be used for. The extension is marked critical if any of
+  the purposes were added as critical.
+ */
+void CertificateProfile::addKeyPurpose(const QByteArray &oid, bool critical)
+{
+    d->keyPurposes.append(qMakePair(oid, critical));
+
+    gnutls_x509_key_purposes_t purposes;
+    int err = gnutls_x509_key_purpose_init(&purposes);
+    if (GNUTLS_E_SUCCESS != err) {
+        d->errno = err;
+        return;
+    }
+
+    bool anyCritical = false;
+    for (int i = 0; i < d->keyPurposes.size(); i++) {
+        err = gnutls_x509_key_purpose_set(purposes, d->keyPurposes[i].first.constData());
+        if (GNUTLS_E_SUCCESS != err) {
+            gnutls_x509_key_purpose_deinit(purposes);
+            d->errno = err;
+            return;
+        }
+
+        anyCritical = anyCritical || d->keyPurposes[i].second;
+    }
+
+    gnutls_datum_t der;
+    err = gnutls_x509_ext_export_key_purposes(purposes, &der);
+    gnutls_x509_key_purpose_deinit(purposes);
+
+    if (GNUTLS_E_SUCCESS != err) {
+        d->errno = err;
+        return;
+    }
+
+    d->setExtension(GNUTLS_X509EXT_OID_EXTENDED_KEY_USAGE, &der, anyCritical);
+}
+
+/*!
+  Sets whether the subject key identifier extension is added to the
+  certificates.
+ */
+void CertificateProfile::setAddSubjectKeyIdentifier(bool add)
+{
+    d->subjectKeyIdentifier = add;
+}
+
+/*!
+  Returns true if the subject key identifier extension is added to the
+  certificates.
+ */
+bool CertificateProfile::addSubjectKeyIdentifier() const
+{
+    return d->subjectKeyIdentifier;
+}
+
+/*!
+  Sets whether the authority key identifier extension is added to the
+  certificates.
+ */
+void CertificateProfile::setAddAuthorityKeyIdentifier(bool add)
+{
+    d->authorityKeyIdentifier = add;
+}
+
+/*!
+  Returns true if the authority key identifier extension is added to the
+  certificates.
+ */
+bool CertificateProfile::addAuthorityKeyIdentifier() const
+{
+    return d->authorityKeyIdentifier;
+}
+
+QT_END_NAMESPACE_CERTIFICATE
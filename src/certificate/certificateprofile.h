@@ -0,0 +1,101 @@
+/****************************************************************************
+**
+** Copyright (C) 2012-2013 Richard J. Moore <rich@kde.org>
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef CERTIFICATEPROFILE_H
+#define CERTIFICATEPROFILE_H
+
+#include <QtCore/qshareddata.h>
+#include <QtCore/QByteArray>
+#include <QtCore/QString>
+
+#include "certificate_global.h"
+#include "certificatebuilder.h"
+
+QT_BEGIN_NAMESPACE_CERTIFICATE
+
+class CertificateProfilePrivate;
+
+class Q_CERTIFICATE_EXPORT CertificateProfile
+{
+public:
+    CertificateProfile();
+    CertificateProfile(const CertificateProfile &other);
+    ~CertificateProfile();
+
+    CertificateProfile &operator=(const CertificateProfile &other);
+
+    void swap(CertificateProfile &other) { qSwap(d, other.d); }
+
+    int error() const;
+    QString errorString() const;
+
+    void setVersion(int version=3);
+    int version() const;
+
+    void setValidityPeriod(int days);
+    int validityPeriod() const;
+
+    void setSignatureDigest(Certificate::SignatureDigest digest);
+    Certificate::SignatureDigest signatureDigest() const;
+
+    void setSerialSize(int bytes);
+    int serialSize() const;
+
+    void setCopyRequestExtensions(bool copy);
+    bool copyRequestExtensions() const;
+
+    void setBasicConstraints(bool ca=false, int pathLength=-1);
+    void setKeyUsage(CertificateBuilder::KeyUsageFlags usage);
+    void addKeyPurpose(CertificateBuilder::KeyPurpose purpose, bool critical=false);
+    void addKeyPurpose(const QByteArray &oid, bool critical=false);
+
+    void setAddSubjectKeyIdentifier(bool add);
+    bool addSubjectKeyIdentifier() const;
+
+    void setAddAuthorityKeyIdentifier(bool add);
+    bool addAuthorityKeyIdentifier() const;
+
+private:
+    friend class CertificateBuilder;
+    friend class CertificateProfilePrivate;
+    QSharedDataPointer<CertificateProfilePrivate> d;
+};
+
+QT_END_NAMESPACE_CERTIFICATE
+
+#endif // CERTIFICATEPROFILE_H
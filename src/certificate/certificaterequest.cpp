@@ -37,6 +37,7 @@
 ****************************************************************************/
 
 #include <QByteArray>
+#include <QFile>
 #include <QIODevice>
 #include <QStringList>
 #include <QDebug>
@@ -51,6 +52,10 @@ QT_BEGIN_NAMESPACE_CERTIFICATE
   \class CertificateRequest
   \brief The CertificateRequest class provides a convenient interface for an X.509
   certificate signing request.
+
+  CertificateRequest is implicitly shared and none of its accessors modify
+  it, so a request can be passed between threads and read from several of
+  them at once without being copied.
 */
 
 /*!
@@ -59,20 +64,12 @@ QT_BEGIN_NAMESPACE_CERTIFICATE
  */
 static QByteArray request_to_bytearray(gnutls_x509_crq_t crq, gnutls_x509_crt_fmt_t format, int *errno)
 {
-    QByteArray ba(4096, 0);
-    size_t size = ba.size();
-
-    *errno = gnutls_x509_crq_export(crq, format, ba.data(), &size);
-
-    if (GNUTLS_E_SUCCESS != *errno)
-        return QByteArray();
-
-    ba.resize(size); // size has now been updated
-    return ba;
+    return export_to_bytearray(gnutls_x509_crq_export, crq, format, errno);
 }
 
 CertificateRequestPrivate::CertificateRequestPrivate()
-    : null(true)
+    : null(true),
+      nameEntriesParsed(0)
 {
     ensure_gnutls_init();
 
@@ -80,11 +77,155 @@ CertificateRequestPrivate::CertificateRequestPrivate()
     errno = GNUTLS_E_SUCCESS;
 }
 
+/*!
+  \internal
+  Makes a deep copy of the request. gnutls has no way to duplicate a crq
+  directly, so it is exported and imported again.
+ */
+CertificateRequestPrivate::CertificateRequestPrivate(const CertificateRequestPrivate &other)
+    : QSharedData(other),
+      null(other.null),
+      errno(other.errno),
+      nameEntriesParsed(0)
+{
+    gnutls_x509_crq_init(&crq);
+
+    if (null)
+        return;
+
+    int err;
+    QByteArray der = request_to_bytearray(other.crq, GNUTLS_X509_FMT_DER, &err);
+    if (GNUTLS_E_SUCCESS == err) {
+        gnutls_datum_t buffer;
+        buffer.data = reinterpret_cast<unsigned char *>(der.data());
+        buffer.size = der.size();
+
+        err = gnutls_x509_crq_import(crq, &buffer, GNUTLS_X509_FMT_DER);
+    }
+
+    if (GNUTLS_E_SUCCESS != err) {
+        null = true;
+        errno = err;
+    }
+}
+
 CertificateRequestPrivate::~CertificateRequestPrivate()
 {
     gnutls_x509_crq_deinit(crq);
 }
 
+/*!
+  \internal
+  Import the request from the encoded data. gnutls only reads from the
+  buffer, so it is used in place without being copied.
+ */
+void CertificateRequestPrivate::load(const char *data, int size, QSsl::EncodingFormat format)
+{
+    gnutls_datum_t buffer;
+    buffer.data = reinterpret_cast<unsigned char *>(const_cast<char *>(data));
+    buffer.size = size;
+
+    errno = gnutls_x509_crq_import(crq, &buffer, (QSsl::Pem == format) ? GNUTLS_X509_FMT_PEM : GNUTLS_X509_FMT_DER);
+    if (GNUTLS_E_SUCCESS == errno)
+        null = false;
+}
+
+/*!
+  \internal
+  Read a field of the distinguished name into buffer, growing it if needed.
+  On success the buffer holds the field and size is its length.
+ */
+template <typename F>
+static int read_dn_field(F reader, QByteArray &buffer, size_t *size)
+{
+    *size = buffer.size();
+    int err = reader(buffer.data(), size);
+    if (GNUTLS_E_SHORT_MEMORY_BUFFER == err) {
+        buffer.resize(int(*size) + 1);
+        *size = buffer.size();
+        err = reader(buffer.data(), size);
+    }
+
+    return err;
+}
+
+struct DnOidReader
+{
+    DnOidReader(gnutls_x509_crq_t crq, int index) : crq(crq), index(index) {}
+    int operator()(char *data, size_t *size) const { return gnutls_x509_crq_get_dn_oid(crq, index, data, size); }
+
+    gnutls_x509_crq_t crq;
+    int index;
+};
+
+struct DnValueReader
+{
+    DnValueReader(gnutls_x509_crq_t crq, const char *oid, int index) : crq(crq), oid(oid), index(index) {}
+    int operator()(char *data, size_t *size) const { return gnutls_x509_crq_get_dn_by_oid(crq, oid, index, false, data, size); }
+
+    gnutls_x509_crq_t crq;
+    const char *oid;
+    int index;
+};
+
+/*!
+  \internal
+  Decode the distinguished name the first time it is needed. The whole name
+  is read in one go using a single buffer, after which lookups only have to
+  search the (short) list of attributes.
+ */
+void CertificateRequestPrivate::ensureNameEntries() const
+{
+    if (atomic_load_acquire(nameEntriesParsed))
+        return;
+
+    QMutexLocker lock(&nameMutex);
+    if (atomic_load_acquire(nameEntriesParsed))
+        return;
+
+    QByteArray buffer(256, 0);
+    size_t size;
+
+    for (int index = 0; GNUTLS_E_SUCCESS == read_dn_field(DnOidReader(crq, index), buffer, &size); index++)
+        nameAttributes << QByteArray(buffer.constData(), int(size));
+
+    for (int i = 0; i < nameAttributes.size(); i++) {
+        const QByteArray &oid = nameAttributes.at(i);
+
+        bool seen = false;
+        for (int j = 0; j < nameEntries.size() && !seen; j++)
+            seen = (nameEntries.at(j).oid == oid);
+        if (seen)
+            continue;
+
+        RequestNameEntry entry;
+        entry.oid = oid;
+
+        for (int index = 0; GNUTLS_E_SUCCESS == read_dn_field(DnValueReader(crq, oid.constData(), index), buffer, &size); index++)
+            entry.values << QString::fromUtf8(buffer.constData(), int(size));
+
+        nameEntries << entry;
+    }
+
+    nameEntriesParsed.fetchAndStoreRelease(1);
+}
+
+/*!
+  \internal
+  Returns the values of the attribute with the specified oid.
+ */
+QStringList CertificateRequestPrivate::nameEntryValues(const char *oid) const
+{
+    ensureNameEntries();
+
+    for (int i = 0; i < nameEntries.size(); i++) {
+        if (nameEntries.at(i).oid == oid)
+            return nameEntries.at(i).values;
+    }
+
+    return QStringList();
+}
+
 /*!
   Create a null CertificateRequest.
  */
@@ -108,15 +249,61 @@ CertificateRequest::CertificateRequest(QIODevice *io, QSsl::EncodingFormat forma
     : d(new CertificateRequestPrivate)
 {
     QByteArray buf = io->readAll();
+    d->load(buf.constData(), buf.size(), format);
+}
 
-    // Setup a datum
-    gnutls_datum_t buffer;
-    buffer.data = (unsigned char *)(buf.data());
-    buffer.size = buf.size();
+/*!
+  Load a CertificateRequest from \a data using the specified format. The
+  data is parsed directly, so this avoids the copy made when reading from a
+  QIODevice.
+ */
+CertificateRequest::CertificateRequest(const QByteArray &data, QSsl::EncodingFormat format)
+    : d(new CertificateRequestPrivate)
+{
+    d->load(data.constData(), data.size(), format);
+}
 
-    d->errno = gnutls_x509_crq_import(d->crq, &buffer, (QSsl::Pem == format) ? GNUTLS_X509_FMT_PEM : GNUTLS_X509_FMT_DER);
-    if (GNUTLS_E_SUCCESS == d->errno)
-        d->null = false;
+/*!
+  Load a CertificateRequest from \a size bytes at \a data using the
+  specified format. The data is only read during the call and does not need
+  to remain valid afterwards.
+ */
+CertificateRequest CertificateRequest::fromData(const char *data, int size, QSsl::EncodingFormat format)
+{
+    CertificateRequest result;
+    result.d->load(data, size, format);
+    return result;
+}
+
+/*!
+  Load a CertificateRequest from the file \a fileName using the specified
+  format. Where possible the file is memory mapped rather than read, so its
+  contents are never copied. If the file cannot be opened then the request
+  will be null and error() will return GNUTLS_E_FILE_ERROR.
+ */
+CertificateRequest CertificateRequest::fromFile(const QString &fileName, QSsl::EncodingFormat format)
+{
+    CertificateRequest result;
+
+    QFile f(fileName);
+    if (!f.open(QIODevice::ReadOnly)) {
+        result.d->errno = GNUTLS_E_FILE_ERROR;
+        return result;
+    }
+
+    const qint64 size = f.size();
+    uchar *mapped = (size > 0) ? f.map(0, size) : 0;
+    if (mapped) {
+        result.d->load(reinterpret_cast<const char *>(mapped), int(size), format);
+        f.unmap(mapped);
+    }
+    else {
+        // Not everything can be mapped (eg. pipes), so fall back to reading
+        QByteArray buf = f.readAll();
+        result.d->load(buf.constData(), buf.size(), format);
+    }
+
+    return result;
 }
 
 /*!
@@ -135,9 +322,10 @@ bool CertificateRequest::isNull() const
 }
 
 /*!
-  Returns the last error that occurred when using this object. The values
-  used are those of gnutls. If there has not been an error then it is
-  guaranteed to be 0.
+  Returns the error that occurred when this request was loaded or signed.
+  The values used are those of gnutls. If there has not been an error then
+  it is guaranteed to be 0. The accessors do not change the error, instead
+  they return an empty value if the information could not be read.
  */
 int CertificateRequest::error() const
 {
@@ -145,8 +333,8 @@ int CertificateRequest::error() const
 }
 
 /*!
-  Returns a string describing the last error that occurred when using
-  this object.
+  Returns a string describing the error that occurred when this request
+  was loaded or signed.
  */
 QString CertificateRequest::errorString() const
 {
@@ -164,86 +352,66 @@ int CertificateRequest::version() const
 /*!
   Returns the list of attributes that are present in this requests
   distinguished name. The attributes are returned as OIDs.
+
+  The distinguished name is decoded the first time that it is accessed and
+  the result is shared by all copies of the request.
  */
-QList<QByteArray> CertificateRequest::nameEntryAttributes()
+QList<QByteArray> CertificateRequest::nameEntryAttributes() const
 {
-    QList<QByteArray> result;
-
-    int index = 0;
-    do {
-        QByteArray buffer(1024, 0);
-        size_t size = buffer.size();
-
-        d->errno = gnutls_x509_crq_get_dn_oid(d->crq, index, buffer.data(), &size);
-
-        if (GNUTLS_E_SUCCESS == d->errno) {
-            buffer.resize(size);
-            result << buffer;
-        }
-        index++;
-    } while(GNUTLS_E_SUCCESS == d->errno);
-
-    return result;
+    d->ensureNameEntries();
+    return d->nameAttributes;
 }
 
 /*!
   Returns the list of entries for the attribute specified.
  */
-QStringList CertificateRequest::nameEntryInfo(Certificate::EntryType attribute)
+QStringList CertificateRequest::nameEntryInfo(Certificate::EntryType attribute) const
 {
-    return nameEntryInfo(entrytype_to_oid(attribute));
+    const char *oid = entrytype_oid(attribute);
+    if (!oid)
+        return QStringList();
+
+    return d->nameEntryValues(oid);
 }
 
 /*!
   Returns the list of entries for the attribute specified by the oid.
  */
-QStringList CertificateRequest::nameEntryInfo(const QByteArray &oid)
+QStringList CertificateRequest::nameEntryInfo(const QByteArray &oid) const
 {
-    QStringList result;
     if (oid.isNull())
-        return result;
+        return QStringList();
 
-    int index = 0;
-    do {
-        QByteArray buffer(1024, 0);
-        size_t size = buffer.size();
-
-        d->errno = gnutls_x509_crq_get_dn_by_oid(d->crq, oid.constData(), index, false, buffer.data(), &size);
-
-        if (GNUTLS_E_SUCCESS == d->errno)
-            result << QString::fromUtf8(buffer);
-
-        index++;
-    } while(GNUTLS_E_SUCCESS == d->errno);
-
-    return result;
+    return d->nameEntryValues(oid.constData());
 }
 
 /*!
   Returns a QByteArray containing this request encoded as PEM.
  */
-QByteArray CertificateRequest::toPem()
+QByteArray CertificateRequest::toPem() const
 {
-    return request_to_bytearray(d->crq, GNUTLS_X509_FMT_PEM, &d->errno);
+    int err;
+    return request_to_bytearray(d->crq, GNUTLS_X509_FMT_PEM, &err);
 }
 
 /*!
   Returns a QByteArray containing this request encoded as DER.
  */
-QByteArray CertificateRequest::toDer()
+QByteArray CertificateRequest::toDer() const
 {
-    return request_to_bytearray(d->crq, GNUTLS_X509_FMT_DER, &d->errno);
+    int err;
+    return request_to_bytearray(d->crq, GNUTLS_X509_FMT_DER, &err);
 }
 
 /*!
   Returns a QString containing this request as a human readable string.
  */
-QString CertificateRequest::toText()
+QString CertificateRequest::toText() const
 {
     gnutls_datum_t datum;
-    d->errno = gnutls_x509_crq_print(d->crq, GNUTLS_CRT_PRINT_FULL, &datum);
+    int err = gnutls_x509_crq_print(d->crq, GNUTLS_CRT_PRINT_FULL, &datum);
 
-    if (GNUTLS_E_SUCCESS != d->errno)
+    if (GNUTLS_E_SUCCESS != err)
         return QString();
 
     QString result = QString::fromUtf8(reinterpret_cast<const char *>(datum.data), datum.size);
@@ -58,8 +58,12 @@ public:
     CertificateRequest();
     CertificateRequest(const CertificateRequest &other);
     CertificateRequest(QIODevice *io, QSsl::EncodingFormat format=QSsl::Pem);
+    explicit CertificateRequest(const QByteArray &data, QSsl::EncodingFormat format=QSsl::Pem);
     ~CertificateRequest();
 
+    static CertificateRequest fromData(const char *data, int size, QSsl::EncodingFormat format=QSsl::Pem);
+    static CertificateRequest fromFile(const QString &fileName, QSsl::EncodingFormat format=QSsl::Pem);
+
     CertificateRequest &operator=(const CertificateRequest &other);
 
     void swap(CertificateRequest &other) { qSwap(d, other.d); }
@@ -72,15 +76,15 @@ public:
     // TODO: Include accessors for the fields
     int version() const;
 
-    QList<QByteArray> nameEntryAttributes();
+    QList<QByteArray> nameEntryAttributes() const;
 
     // TODO: QList<QByteArray>?
-    QStringList nameEntryInfo(Certificate::EntryType attribute);
-    QStringList nameEntryInfo(const QByteArray &attribute);
+    QStringList nameEntryInfo(Certificate::EntryType attribute) const;
+    QStringList nameEntryInfo(const QByteArray &attribute) const;
 
-    QByteArray toPem();
-    QByteArray toDer();
-    QString toText();
+    QByteArray toPem() const;
+    QByteArray toDer() const;
+    QString toText() const;
 
 private:
     friend class CertificateRequestPrivate;
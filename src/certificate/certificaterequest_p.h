@@ -39,6 +39,11 @@
 #ifndef CERTIFICATEREQUEST_P_H
 #define CERTIFICATEREQUEST_P_H
 
+#include <QAtomicInt>
+#include <QList>
+#include <QMutex>
+#include <QStringList>
+
 #include "certificaterequest.h"
 
 #include <gnutls/gnutls.h>
@@ -46,15 +51,34 @@
 
 QT_BEGIN_NAMESPACE_CERTIFICATE
 
+struct RequestNameEntry
+{
+    QByteArray oid;
+    QStringList values;
+};
+
 class CertificateRequestPrivate : public QSharedData
 {
 public:
     CertificateRequestPrivate();
+    CertificateRequestPrivate(const CertificateRequestPrivate &other);
     ~CertificateRequestPrivate();
 
+    void load(const char *data, int size, QSsl::EncodingFormat format);
+
+    void ensureNameEntries() const;
+    QStringList nameEntryValues(const char *oid) const;
+
     bool null;
     int errno;
     gnutls_x509_crq_t crq;
+
+    // The distinguished name is decoded on first use. Once the flag is set
+    // the lists are never modified again, so are read without the mutex.
+    mutable QMutex nameMutex;
+    mutable QAtomicInt nameEntriesParsed;
+    mutable QList<QByteArray> nameAttributes;
+    mutable QList<RequestNameEntry> nameEntries;
 };
 
 QT_END_NAMESPACE_CERTIFICATE
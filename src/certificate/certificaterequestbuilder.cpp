@@ -38,7 +38,9 @@
 
 #include <QIODevice>
 
+#include "asynctask_p.h"
 #include "certificaterequest_p.h"
+#include "securememory_p.h"
 #include "utils_p.h"
 
 #include "certificaterequestbuilder_p.h"
@@ -61,6 +63,7 @@ CertificateRequestBuilder::CertificateRequestBuilder()
 
     gnutls_x509_crq_init(&d->crq);
     d->errno = GNUTLS_E_SUCCESS;
+    d->digest = Certificate::DigestDefault;
 }
 
 /*!
@@ -130,6 +133,31 @@ bool CertificateRequestBuilder::setKey(const QSslKey &qkey)
     return GNUTLS_E_SUCCESS == d->errno;
 }
 
+/*!
+  Sets the key that will be used for the request from an encoded private
+  key. The key may be either an unencrypted PKCS#8 structure or in the
+  traditional format for its type.
+ */
+bool CertificateRequestBuilder::setKey(const QByteArray &encodedKey, QSsl::EncodingFormat format)
+{
+    gnutls_privkey_t key = encoded_to_privkey(encodedKey, format, &d->errno);
+    if (GNUTLS_E_SUCCESS != d->errno)
+        return false;
+
+    gnutls_pubkey_t pubkey;
+    d->errno = gnutls_pubkey_init(&pubkey);
+    if (GNUTLS_E_SUCCESS == d->errno) {
+        d->errno = gnutls_pubkey_import_privkey(pubkey, key, 0, 0);
+        if (GNUTLS_E_SUCCESS == d->errno)
+            d->errno = gnutls_x509_crq_set_pubkey(d->crq, pubkey);
+        gnutls_pubkey_deinit(pubkey);
+    }
+
+    gnutls_privkey_deinit(key);
+
+    return GNUTLS_E_SUCCESS == d->errno;
+}
+
 /*!
   Returns the list of attributes that are present in this requests
   distinguished name. The attributes are returned as OIDs.
@@ -222,6 +250,10 @@ bool CertificateRequestBuilder::addNameEntry(const QByteArray &oid, const QByteA
 bool CertificateRequestBuilder::addSubjectAlternativeNameEntry(QSsl::AlternativeNameEntryType qtype, const QByteArray &value)
 {
     gnutls_x509_subject_alt_name_t type = qssl_altnameentrytype_to_altname(qtype);
+    if (InvalidAltName == type) {
+        d->errno = GNUTLS_E_INVALID_REQUEST;
+        return false;
+    }
 
     d->errno = gnutls_x509_crq_set_subject_alt_name(d->crq, type, value.constData(), value.size(), GNUTLS_FSAN_APPEND);
     return GNUTLS_E_SUCCESS == d->errno;
@@ -230,36 +262,128 @@ bool CertificateRequestBuilder::addSubjectAlternativeNameEntry(QSsl::Alternative
 bool CertificateRequestBuilder::addSubjectAlternativeNameEntry(QSsl::AlternateNameEntryType qtype, const QByteArray &value)
 {
     gnutls_x509_subject_alt_name_t type = qssl_altnameentrytype_to_altname(qtype);
+    if (InvalidAltName == type) {
+        d->errno = GNUTLS_E_INVALID_REQUEST;
+        return false;
+    }
 
     d->errno = gnutls_x509_crq_set_subject_alt_name(d->crq, type, value.constData(), value.size(), GNUTLS_FSAN_APPEND);
     return GNUTLS_E_SUCCESS == d->errno;
 }
 #endif
 
+/*!
+  Sets the subject alternative name extension of the request to contain
+  exactly the specified \a names, replacing any names that have already been
+  added. Names of type Certificate::AlternativeNameIpAddress should be given
+  in their textual form, eg. "192.0.2.1" or "2001:db8::1". The list must
+  not be empty, since the extension is not allowed to be.
+
+  Unlike addSubjectAlternativeNameEntry(), which re-encodes the whole
+  extension each time it is called, this encodes the extension once and so
+  should be used when a request contains a large number of names.
+ */
+bool CertificateRequestBuilder::setSubjectAlternativeNames(const QList<Certificate::AlternativeName> &names)
+{
+    QByteArray ext = altnames_to_extension(names, &d->errno);
+    if (GNUTLS_E_SUCCESS != d->errno)
+        return false;
+
+    d->errno = gnutls_x509_crq_set_extension_by_oid(d->crq, GNUTLS_X509EXT_OID_SAN,
+                                                    ext.constData(), ext.size(), 0);
+    return GNUTLS_E_SUCCESS == d->errno;
+}
+
+/*!
+  Sets the digest used when signing the request. The default,
+  Certificate::DigestDefault, uses SHA1 for RSA and DSA keys and a digest
+  matching the size of the curve for ECDSA keys. The digest is ignored for
+  Ed25519 keys.
+ */
+void CertificateRequestBuilder::setSignatureDigest(Certificate::SignatureDigest digest)
+{
+    d->digest = digest;
+}
+
+/*!
+  Returns the digest that will be used when signing the request.
+ */
+Certificate::SignatureDigest CertificateRequestBuilder::signatureDigest() const
+{
+    return d->digest;
+}
+
 /*!
   Signs the request with the specified key and returns the signed request.
  */
 CertificateRequest CertificateRequestBuilder::signedRequest(const QSslKey &qkey)
+{
+    QByteArray der = qkey.toDer();
+    CertificateRequest result = signedRequest(der, QSsl::Der);
+    secure_zero(der);
+
+    return result;
+}
+
+/*!
+  Signs the request with the specified encoded private key and returns the
+  signed request. This allows requests to be signed with keys that QSslKey
+  cannot represent, such as the Ed25519 keys returned by
+  KeyBuilder::generateEncoded(). The key may be either an unencrypted PKCS#8
+  structure or in the traditional format for its type.
+ */
+CertificateRequest CertificateRequestBuilder::signedRequest(const QByteArray &encodedKey, QSsl::EncodingFormat format)
 {
     CertificateRequest result;
 
-    gnutls_x509_privkey_t key = qsslkey_to_key(qkey, &d->errno);
-    if (GNUTLS_E_SUCCESS != d->errno) {
-        gnutls_x509_privkey_deinit(key);
+    gnutls_privkey_t key = encoded_to_privkey(encodedKey, format, &d->errno);
+    if (GNUTLS_E_SUCCESS != d->errno)
         return result;
-    };
 
-    d->errno = gnutls_x509_crq_sign2(d->crq, key, GNUTLS_DIG_SHA1, 0);
-    gnutls_x509_privkey_deinit(key);
+    d->errno = gnutls_x509_crq_privkey_sign(d->crq, key, signature_digest(d->digest, key), 0);
+    gnutls_privkey_deinit(key);
 
     if (GNUTLS_E_SUCCESS != d->errno)
         return result;
 
     gnutls_x509_crq_t crqsave = result.d->crq;
     result.d->crq = d->crq;
+    result.d->null = false;
     d->crq = crqsave;
 
     return result;
 }
 
+class SignRequestTask : public AsyncTask<CertificateRequest>
+{
+public:
+    SignRequestTask(CertificateRequestBuilder *builder, const QSslKey &key)
+        : builder(builder),
+          key(key)
+    {
+    }
+
+protected:
+    CertificateRequest compute()
+    {
+        return builder->signedRequest(key);
+    }
+
+private:
+    CertificateRequestBuilder *builder;
+    QSslKey key;
+};
+
+/*!
+  Signs the request in the same way as signedRequest(), but does so using the
+  thread pool returned by CertificateLibrary::threadPool(). The builder must
+  not be modified or destroyed until the returned future has finished, after
+  which error() will report the outcome.
+ */
+QFuture<CertificateRequest> CertificateRequestBuilder::signedRequestAsync(const QSslKey &qkey)
+{
+    SignRequestTask *task = new SignRequestTask(this, qkey);
+    return task->start();
+}
+
 QT_END_NAMESPACE_CERTIFICATE
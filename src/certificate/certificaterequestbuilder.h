@@ -41,6 +41,7 @@
 
 #include <QSslKey>
 #include <QStringList>
+#include <QFuture>
 
 #include "certificaterequest.h"
 #include "certificate.h"
@@ -65,6 +66,7 @@ public:
     int version() const;
 
     bool setKey(const QSslKey &key);
+    bool setKey(const QByteArray &encodedKey, QSsl::EncodingFormat format=QSsl::Pem);
 
     bool addNameEntry(Certificate::EntryType type, const QByteArray &value);
     bool addNameEntry(const QByteArray &oid, const QByteArray &value, bool raw=false);
@@ -78,8 +80,14 @@ public:
 #else
     bool addSubjectAlternativeNameEntry(QSsl::AlternateNameEntryType type, const QByteArray &value);
 #endif
+    bool setSubjectAlternativeNames(const QList<Certificate::AlternativeName> &names);
+
+    void setSignatureDigest(Certificate::SignatureDigest digest);
+    Certificate::SignatureDigest signatureDigest() const;
 
     CertificateRequest signedRequest(const QSslKey &key);
+    CertificateRequest signedRequest(const QByteArray &encodedKey, QSsl::EncodingFormat format=QSsl::Pem);
+    QFuture<CertificateRequest> signedRequestAsync(const QSslKey &key);
 
 private:
     struct CertificateRequestBuilderPrivate *d;
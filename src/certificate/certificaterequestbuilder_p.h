@@ -50,6 +50,7 @@ struct CertificateRequestBuilderPrivate
 {
     int errno;
     gnutls_x509_crq_t crq;
+    Certificate::SignatureDigest digest;
 };
 
 QT_END_NAMESPACE_CERTIFICATE
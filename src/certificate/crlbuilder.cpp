@@ -0,0 +1,430 @@
+/****************************************************************************
+**
+** Copyright (C) 2012-2013 Richard J. Moore <rich@kde.org>
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include <gnutls/gnutls.h>
+#include <gnutls/x509.h>
+
+#include "derwriter_p.h"
+#include "issuercontext_p.h"
+#include "signingkey_p.h"
+#include "utils_p.h"
+
+#include "crlbuilder_p.h"
+
+QT_BEGIN_NAMESPACE_CERTIFICATE
+
+/*!
+  \class CrlBuilder
+  \brief The CrlBuilder class is a tool for creating certificate revocation
+  lists.
+
+  CrlBuilder keeps the serial numbers of the revoked certificates in order,
+  and encodes each entry once when it is added. Issuing a new CRL after
+  adding a revocation then only needs the entries to be copied into place
+  and the result signed, rather than the whole list being encoded again.
+
+  As well as complete CRLs, CrlBuilder can produce delta CRLs containing
+  only the revocations made since the last complete CRL, and partitioned
+  CRLs covering a range of serial numbers. Partitioned CRLs carry an issuing
+  distribution point, which should match the distribution point of the
+  certificates whose serials fall in the range (see
+  CertificateBuilder::addCrlDistributionPoint()). Every CRL issued is given
+  the next CRL number.
+
+  The serial numbers used are the raw big-endian bytes, as passed to
+  CertificateBuilder::setSerial().
+*/
+
+static const char *OidCrlNumber = "2.5.29.20";
+static const char *OidReasonCode = "2.5.29.21";
+static const char *OidDeltaCrlIndicator = "2.5.29.27";
+static const char *OidIssuingDistributionPoint = "2.5.29.28";
+static const char *OidAuthorityKeyIdentifier = "2.5.29.35";
+
+CrlBuilderPrivate::CrlBuilderPrivate()
+    : errno(GNUTLS_E_SUCCESS),
+      number(1),
+      digest(Certificate::DigestDefault),
+      bodyValid(true),
+      baseNumber(0),
+      haveBase(false)
+{
+    ensure_gnutls_init();
+}
+
+QByteArray CrlBuilderPrivate::entriesDer(QMap<QByteArray, QByteArray>::const_iterator begin,
+                                         QMap<QByteArray, QByteArray>::const_iterator end) const
+{
+    int size = 0;
+    for (QMap<QByteArray, QByteArray>::const_iterator it = begin; it != end; ++it)
+        size += it.value().size();
+
+    QByteArray result;
+    result.reserve(size);
+    for (QMap<QByteArray, QByteArray>::const_iterator it = begin; it != end; ++it)
+        result += it.value();
+
+    return result;
+}
+
+/*!
+  \internal
+  Builds and signs a CRL containing the encoded \a entries. The authority
+  key identifier and CRL number are always included, followed by any
+  \a extensions specific to the type of CRL.
+ */
+QByteArray CrlBuilderPrivate::sign(const IssuerContext &issuer, const QByteArray &entries,
+                                   const QByteArray &extensions, QSsl::EncodingFormat format)
+{
+    if (issuer.isNull()) {
+        errno = issuer.error() ? issuer.error() : GNUTLS_E_INVALID_REQUEST;
+        return QByteArray();
+    }
+
+    SigningKeyPrivate *key = issuer.d->key.d.data();
+
+    QByteArray algorithm = signingkey_algorithm(key, digest, &errno);
+    if (GNUTLS_E_SUCCESS != errno)
+        return QByteArray();
+
+    gnutls_datum_t dn;
+    errno = gnutls_x509_crt_get_raw_dn(issuer.d->crt, &dn);
+    if (GNUTLS_E_SUCCESS != errno)
+        return QByteArray();
+
+    QByteArray tbs;
+    tbs.reserve(entries.size() + 512);
+    tbs += der_integer(quint64(1)); // v2
+    tbs += algorithm;
+    tbs.append(reinterpret_cast<const char *>(dn.data), dn.size);
+    gnutls_free(dn.data);
+
+    tbs += der_time(thisUpdate.isValid() ? thisUpdate : QDateTime::currentDateTimeUtc());
+    if (nextUpdate.isValid())
+        tbs += der_time(nextUpdate);
+
+    if (!entries.isEmpty())
+        tbs += der_wrap(DerSequence, entries);
+
+    QByteArray exts;
+    if (!issuer.d->keyId.isEmpty()) {
+        QByteArray keyId = der_wrap(DerContext, issuer.d->keyId);
+        exts += der_extension(OidAuthorityKeyIdentifier, false, der_wrap(DerSequence, keyId));
+    }
+    exts += der_extension(OidCrlNumber, false, der_integer(number));
+    exts += extensions;
+    tbs += der_wrap(DerConstructedContext, der_wrap(DerSequence, exts));
+
+    tbs = der_wrap(DerSequence, tbs);
+
+    QByteArray signature = signingkey_sign(key, digest, tbs, &errno);
+    if (GNUTLS_E_SUCCESS != errno)
+        return QByteArray();
+
+    QByteArray crl = der_wrap(DerSequence, tbs + algorithm + der_bit_string(signature));
+    number++;
+
+    if (QSsl::Pem == format)
+        return der_to_pem(crl, "X509 CRL");
+    return crl;
+}
+
+/*!
+  Creates a new CrlBuilder with no revoked certificates. The first CRL
+  issued will be number 1.
+ */
+CrlBuilder::CrlBuilder()
+    : d(new CrlBuilderPrivate)
+{
+}
+
+/*!
+  Cleans up a CrlBuilder.
+ */
+CrlBuilder::~CrlBuilder()
+{
+    delete d;
+}
+
+/*!
+  Returns the last error that occurred when using this object. The values
+  used are those of gnutls. If there has not been an error then it is
+  guaranteed to be 0.
+ */
+int CrlBuilder::error() const
+{
+    return d->errno;
+}
+
+/*!
+  Returns a string describing the last error that occurred when using
+  this object.
+ */
+QString CrlBuilder::errorString() const
+{
+    return QString::fromUtf8(gnutls_strerror(d->errno));
+}
+
+/*!
+  Adds the certificate with the specified \a serial to the list of revoked
+  certificates. If the serial is already present then its revocation time
+  and reason are replaced. Returns false if the serial is empty or longer
+  than the 20 bytes allowed by RFC 5280, or if \a revocationTime is not
+  valid.
+
+  RFC 5280 only allows ReasonRemoveFromCrl in delta CRLs. It is accepted
+  for a serial that is currently revoked with ReasonCertificateHold once a
+  complete CRL has been issued, and releases the hold: the serial is taken
+  out of the complete CRLs and listed with ReasonRemoveFromCrl in the delta
+  CRLs until the next complete CRL. Otherwise it is rejected.
+
+  Adding serials in increasing order is the cheapest, since the encoded
+  list can then simply be extended.
+ */
+bool CrlBuilder::addRevokedSerial(const QByteArray &serial, const QDateTime &revocationTime,
+                                  RevocationReason reason)
+{
+    QByteArray key = serial_to_key(serial);
+    if (key.isNull() || !revocationTime.isValid()) {
+        d->errno = GNUTLS_E_INVALID_REQUEST;
+        return false;
+    }
+
+    if (ReasonRemoveFromCrl == reason && (!d->haveBase || !d->onHold.contains(key))) {
+        d->errno = GNUTLS_E_INVALID_REQUEST;
+        return false;
+    }
+
+    QByteArray entry = der_integer(serial) + der_time(revocationTime);
+    if (ReasonUnspecified != reason) {
+        QByteArray ext = der_extension(OidReasonCode, false, der_enumerated(int(reason)));
+        entry += der_wrap(DerSequence, ext);
+    }
+    entry = der_wrap(DerSequence, entry);
+
+    d->sinceBase.insert(key, entry);
+    d->errno = GNUTLS_E_SUCCESS;
+
+    if (ReasonRemoveFromCrl == reason) {
+        d->entries.remove(key);
+        d->onHold.remove(key);
+        d->bodyValid = false;
+        return true;
+    }
+
+    if (ReasonCertificateHold == reason)
+        d->onHold.insert(key);
+    else
+        d->onHold.remove(key);
+
+    bool appending = d->entries.isEmpty() || d->entries.lastKey() < key;
+
+    QMap<QByteArray, QByteArray>::iterator it = d->entries.find(key);
+    if (it != d->entries.end()) {
+        it.value() = entry;
+        d->bodyValid = false;
+    }
+    else {
+        d->entries.insert(key, entry);
+
+        if (appending && d->bodyValid)
+            d->body += entry;
+        else
+            d->bodyValid = false;
+    }
+
+    return true;
+}
+
+/*!
+  Returns true if the certificate with the specified \a serial has been
+  revoked.
+ */
+bool CrlBuilder::isRevoked(const QByteArray &serial) const
+{
+    QByteArray key = serial_to_key(serial);
+    return !key.isNull() && d->entries.contains(key);
+}
+
+/*!
+  Returns the number of revoked certificates.
+ */
+int CrlBuilder::count() const
+{
+    return d->entries.size();
+}
+
+/*!
+  Sets the number that will be given to the next CRL issued. The number is
+  incremented each time a CRL is issued.
+ */
+void CrlBuilder::setCrlNumber(quint64 number)
+{
+    d->number = number;
+}
+
+/*!
+  Returns the number that will be given to the next CRL issued.
+ */
+quint64 CrlBuilder::crlNumber() const
+{
+    return d->number;
+}
+
+/*!
+  Sets the issue time of the CRLs. If this is not set then the time at
+  which each CRL is signed is used.
+ */
+void CrlBuilder::setThisUpdate(const QDateTime &time)
+{
+    d->thisUpdate = time;
+}
+
+/*!
+  Returns the issue time of the CRLs.
+ */
+QDateTime CrlBuilder::thisUpdate() const
+{
+    return d->thisUpdate;
+}
+
+/*!
+  Sets the time by which the next CRL will be issued. RFC 5280 requires
+  this to be set.
+ */
+void CrlBuilder::setNextUpdate(const QDateTime &time)
+{
+    d->nextUpdate = time;
+}
+
+/*!
+  Returns the time by which the next CRL will be issued.
+ */
+QDateTime CrlBuilder::nextUpdate() const
+{
+    return d->nextUpdate;
+}
+
+/*!
+  Sets the digest used when signing CRLs. See
+  CertificateBuilder::setSignatureDigest() for the meaning of the default.
+ */
+void CrlBuilder::setSignatureDigest(Certificate::SignatureDigest digest)
+{
+    d->digest = digest;
+}
+
+/*!
+  Returns the digest that will be used when signing CRLs.
+ */
+Certificate::SignatureDigest CrlBuilder::signatureDigest() const
+{
+    return d->digest;
+}
+
+/*!
+  Returns a complete CRL listing every revoked certificate, signed by
+  \a issuer. This becomes the base CRL for subsequent delta CRLs. If the
+  CRL cannot be created then an empty QByteArray is returned and error()
+  will report the reason.
+ */
+QByteArray CrlBuilder::signedCrl(const IssuerContext &issuer, QSsl::EncodingFormat format)
+{
+    if (!d->bodyValid) {
+        d->body = d->entriesDer(d->entries.constBegin(), d->entries.constEnd());
+        d->bodyValid = true;
+    }
+
+    quint64 issued = d->number;
+    QByteArray result = d->sign(issuer, d->body, QByteArray(), format);
+    if (result.isEmpty())
+        return result;
+
+    d->baseNumber = issued;
+    d->haveBase = true;
+    d->sinceBase.clear();
+
+    return result;
+}
+
+/*!
+  Returns a delta CRL listing the certificates revoked since the last call
+  to signedCrl(), signed by \a issuer. A complete CRL must have been issued
+  first.
+ */
+QByteArray CrlBuilder::signedDeltaCrl(const IssuerContext &issuer, QSsl::EncodingFormat format)
+{
+    if (!d->haveBase) {
+        d->errno = GNUTLS_E_INVALID_REQUEST;
+        return QByteArray();
+    }
+
+    QByteArray indicator = der_extension(OidDeltaCrlIndicator, true, der_integer(d->baseNumber));
+    return d->sign(issuer, d->entriesDer(d->sinceBase.constBegin(), d->sinceBase.constEnd()),
+                   indicator, format);
+}
+
+/*!
+  Returns a CRL listing the revoked certificates with serial numbers from
+  \a firstSerial to \a lastSerial inclusive, signed by \a issuer. The CRL
+  includes a critical issuing distribution point extension naming the URI
+  \a distributionPoint, which must be the CRL distribution point of the
+  certificates in that range.
+ */
+QByteArray CrlBuilder::signedPartitionCrl(const IssuerContext &issuer,
+                                          const QByteArray &firstSerial, const QByteArray &lastSerial,
+                                          const QByteArray &distributionPoint,
+                                          QSsl::EncodingFormat format)
+{
+    QByteArray first = serial_to_key(firstSerial);
+    QByteArray last = serial_to_key(lastSerial);
+    if (first.isNull() || last.isNull() || last < first || distributionPoint.isEmpty()) {
+        d->errno = GNUTLS_E_INVALID_REQUEST;
+        return QByteArray();
+    }
+
+    // distributionPoint [0] { fullName [0] { uniformResourceIdentifier [6] } }
+    QByteArray name = der_wrap(DerContext | 6, distributionPoint);
+    QByteArray point = der_wrap(DerConstructedContext, der_wrap(DerConstructedContext, name));
+    QByteArray idp = der_extension(OidIssuingDistributionPoint, true, der_wrap(DerSequence, point));
+
+    return d->sign(issuer, d->entriesDer(d->entries.lowerBound(first), d->entries.upperBound(last)),
+                   idp, format);
+}
+
+QT_END_NAMESPACE_CERTIFICATE
@@ -0,0 +1,107 @@
+/****************************************************************************
+**
+** Copyright (C) 2012-2013 Richard J. Moore <rich@kde.org>
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef CRLBUILDER_H
+#define CRLBUILDER_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QDateTime>
+#include <QtCore/QString>
+#include <QtNetwork/QSsl>
+
+#include "certificate_global.h"
+#include "certificate.h"
+
+QT_BEGIN_NAMESPACE_CERTIFICATE
+
+class IssuerContext;
+
+class Q_CERTIFICATE_EXPORT CrlBuilder
+{
+public:
+    enum RevocationReason {
+        ReasonUnspecified = 0,
+        ReasonKeyCompromise = 1,
+        ReasonCaCompromise = 2,
+        ReasonAffiliationChanged = 3,
+        ReasonSuperseded = 4,
+        ReasonCessationOfOperation = 5,
+        ReasonCertificateHold = 6,
+        ReasonRemoveFromCrl = 8,
+        ReasonPrivilegeWithdrawn = 9,
+        ReasonAaCompromise = 10
+    };
+
+    CrlBuilder();
+    ~CrlBuilder();
+
+    int error() const;
+    QString errorString() const;
+
+    bool addRevokedSerial(const QByteArray &serial, const QDateTime &revocationTime,
+                          RevocationReason reason=ReasonUnspecified);
+    bool isRevoked(const QByteArray &serial) const;
+    int count() const;
+
+    void setCrlNumber(quint64 number);
+    quint64 crlNumber() const;
+
+    void setThisUpdate(const QDateTime &time);
+    QDateTime thisUpdate() const;
+
+    void setNextUpdate(const QDateTime &time);
+    QDateTime nextUpdate() const;
+
+    void setSignatureDigest(Certificate::SignatureDigest digest);
+    Certificate::SignatureDigest signatureDigest() const;
+
+    QByteArray signedCrl(const IssuerContext &issuer, QSsl::EncodingFormat format=QSsl::Der);
+    QByteArray signedDeltaCrl(const IssuerContext &issuer, QSsl::EncodingFormat format=QSsl::Der);
+    QByteArray signedPartitionCrl(const IssuerContext &issuer,
+                                  const QByteArray &firstSerial, const QByteArray &lastSerial,
+                                  const QByteArray &distributionPoint,
+                                  QSsl::EncodingFormat format=QSsl::Der);
+
+private:
+    Q_DISABLE_COPY(CrlBuilder)
+    struct CrlBuilderPrivate *d;
+};
+
+QT_END_NAMESPACE_CERTIFICATE
+
+#endif // CRLBUILDER_H
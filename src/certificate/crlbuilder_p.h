@@ -0,0 +1,89 @@
+/****************************************************************************
+**
+** Copyright (C) 2012-2013 Richard J. Moore <rich@kde.org>
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef CRLBUILDER_P_H
+#define CRLBUILDER_P_H
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QMap>
+#include <QSet>
+
+#include "crlbuilder.h"
+
+QT_BEGIN_NAMESPACE_CERTIFICATE
+
+class IssuerContext;
+
+struct CrlBuilderPrivate
+{
+    CrlBuilderPrivate();
+
+    QByteArray entriesDer(QMap<QByteArray, QByteArray>::const_iterator begin,
+                          QMap<QByteArray, QByteArray>::const_iterator end) const;
+    QByteArray sign(const IssuerContext &issuer, const QByteArray &entries,
+                    const QByteArray &extensions, QSsl::EncodingFormat format);
+
+    int errno;
+    quint64 number;
+    QDateTime thisUpdate;
+    QDateTime nextUpdate;
+    Certificate::SignatureDigest digest;
+
+    // Encoded revokedCertificates entries keyed by the serial padded to 20
+    // bytes, so that they are in numerical order.
+    QMap<QByteArray, QByteArray> entries;
+
+    // The concatenation of all the entries, kept up to date while serials
+    // are added in increasing order.
+    QByteArray body;
+    bool bodyValid;
+
+    // The keys of the entries whose reason is ReasonCertificateHold, which
+    // are the only ones that can be released with ReasonRemoveFromCrl
+    QSet<QByteArray> onHold;
+
+    // Entries added since the last full CRL, which was numbered baseNumber
+    QMap<QByteArray, QByteArray> sinceBase;
+    quint64 baseNumber;
+    bool haveBase;
+};
+
+QT_END_NAMESPACE_CERTIFICATE
+
+#endif // CRLBUILDER_P_H
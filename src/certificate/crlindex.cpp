@@ -0,0 +1,498 @@
+/****************************************************************************
+**
+** Copyright (C) 2012-2013 Richard J. Moore <rich@kde.org>
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include <algorithm>
+
+#include <QFile>
+#include <QMutexLocker>
+#include <QThread>
+
+#include <gnutls/gnutls.h>
+#include <gnutls/x509.h>
+
+#include "utils_p.h"
+
+#include "crlindex_p.h"
+
+QT_BEGIN_NAMESPACE_CERTIFICATE
+
+/*!
+  \class CrlIndex
+  \brief The CrlIndex class answers revocation queries against a CRL.
+
+  Finding a serial in a CRL using gnutls means walking the list of revoked
+  certificates, which is far too slow for CRLs with hundreds of thousands of
+  entries. CrlIndex parses the CRL once when it is loaded, keeping only a
+  sorted array of the revoked serial numbers, and answers isRevoked() with a
+  binary search.
+
+  Queries may be made from any number of threads at once and never block.
+  Loading a new CRL builds a complete new index before replacing the old one
+  in a single step, so queries see either the old CRL or the new one and
+  never a mixture. The old index is freed once the queries using it have
+  finished. Loads are serialised against each other.
+
+  If an issuer has been set then each CRL must be signed by it, otherwise it
+  is rejected and the previous CRL remains in use. Only complete CRLs can be
+  loaded. Delta CRLs and CRLs with an issuing distribution point, such as
+  those from CrlBuilder::signedDeltaCrl() and
+  CrlBuilder::signedPartitionCrl(), list only some of the revoked
+  certificates and are rejected.
+*/
+
+static const char *OidDeltaCrlIndicator = "2.5.29.27";
+static const char *OidIssuingDistributionPoint = "2.5.29.28";
+
+/*!
+  \internal
+  Fills in the key for the big-endian \a serial, following the same rules as
+  serial_to_key(). Returns false if the serial is empty or too long.
+ */
+bool CrlSerialKey::set(const char *serial, int size)
+{
+    while (size > 0 && 0 == *serial) {
+        serial++;
+        size--;
+    }
+
+    if (size > int(sizeof(bytes)))
+        return false;
+
+    memset(bytes, 0, sizeof(bytes) - size);
+    memcpy(bytes + sizeof(bytes) - size, serial, size);
+    return true;
+}
+
+const CrlEntry *CrlTable::find(const CrlSerialKey &key) const
+{
+    CrlEntry probe;
+    probe.serial = key;
+
+    QVector<CrlEntry>::const_iterator it = std::lower_bound(entries.constBegin(), entries.constEnd(), probe);
+    if (it == entries.constEnd() || !(it->serial == key))
+        return 0;
+
+    return &*it;
+}
+
+CrlIndexPrivate::CrlIndexPrivate()
+    : errno(GNUTLS_E_SUCCESS),
+      current(0),
+      epoch(0)
+{
+    ensure_gnutls_init();
+}
+
+CrlIndexPrivate::~CrlIndexPrivate()
+{
+    delete current.fetchAndStoreOrdered(0);
+}
+
+/*!
+  \internal
+  Builds a table from the encoded CRL, checking its signature if an issuer
+  has been set. Returns 0 and sets errno on failure.
+ */
+CrlTable *CrlIndexPrivate::parse(const char *data, int size, QSsl::EncodingFormat format)
+{
+    gnutls_x509_crl_t crl;
+    errno = gnutls_x509_crl_init(&crl);
+    if (GNUTLS_E_SUCCESS != errno)
+        return 0;
+
+    gnutls_datum_t datum;
+    datum.data = reinterpret_cast<unsigned char *>(const_cast<char *>(data));
+    datum.size = size;
+
+    errno = gnutls_x509_crl_import(crl, &datum, (QSsl::Pem == format) ? GNUTLS_X509_FMT_PEM : GNUTLS_X509_FMT_DER);
+    if (GNUTLS_E_SUCCESS != errno) {
+        gnutls_x509_crl_deinit(crl);
+        return 0;
+    }
+
+    // Only a complete CRL can replace the whole table. Everything that a
+    // delta or partitioned CRL leaves out would read as not revoked.
+    for (unsigned int i = 0; ; i++) {
+        char oid[128];
+        size_t oidSize = sizeof(oid);
+        unsigned int critical;
+
+        int ret = gnutls_x509_crl_get_extension_info(crl, i, oid, &oidSize, &critical);
+        if (GNUTLS_E_REQUESTED_DATA_NOT_AVAILABLE == ret)
+            break;
+
+        if (ret < 0)
+            errno = ret;
+        else if (0 == strcmp(oid, OidDeltaCrlIndicator) || 0 == strcmp(oid, OidIssuingDistributionPoint))
+            errno = GNUTLS_E_X509_UNSUPPORTED_CRITICAL_EXTENSION;
+
+        if (GNUTLS_E_SUCCESS != errno) {
+            gnutls_x509_crl_deinit(crl);
+            return 0;
+        }
+    }
+
+    if (!issuer.isNull()) {
+        gnutls_x509_crt_t crt = qsslcert_to_crt(issuer, &errno);
+
+        unsigned int status = 0;
+        if (GNUTLS_E_SUCCESS == errno)
+            errno = gnutls_x509_crl_verify(crl, &crt, 1, 0, &status);
+        if (GNUTLS_E_SUCCESS == errno && status)
+            errno = GNUTLS_E_PK_SIG_VERIFY_FAILED;
+
+        if (crt)
+            gnutls_x509_crt_deinit(crt);
+
+        if (GNUTLS_E_SUCCESS != errno) {
+            gnutls_x509_crl_deinit(crl);
+            return 0;
+        }
+    }
+
+    CrlTable *table = new CrlTable;
+
+    int count = gnutls_x509_crl_get_crt_count(crl);
+    if (count > 0)
+        table->entries.reserve(count);
+
+    // Use the iterator, fetching entries by index is quadratic
+    gnutls_x509_crl_iter_t iter = 0;
+    forever {
+        unsigned char serial[64];
+        size_t serialSize = sizeof(serial);
+        time_t revoked;
+
+        int ret = gnutls_x509_crl_iter_crt_serial(crl, &iter, serial, &serialSize, &revoked);
+        if (GNUTLS_E_REQUESTED_DATA_NOT_AVAILABLE == ret)
+            break;
+        if (ret < 0) {
+            errno = ret;
+            break;
+        }
+
+        // Dropping an entry would report a revoked certificate as valid
+        CrlEntry entry;
+        if (!entry.serial.set(reinterpret_cast<const char *>(serial), int(serialSize))) {
+            errno = GNUTLS_E_ASN1_VALUE_NOT_VALID;
+            break;
+        }
+
+        entry.revoked = uint(revoked);
+        table->entries.append(entry);
+    }
+    gnutls_x509_crl_iter_deinit(iter);
+
+    unsigned char number[20];
+    size_t numberSize = sizeof(number);
+    if (gnutls_x509_crl_get_number(crl, number, &numberSize, 0) >= 0) {
+        for (size_t i = 0; i < numberSize; i++)
+            table->number = (table->number << 8) | number[i];
+    }
+
+    table->thisUpdate = QDateTime::fromTime_t(gnutls_x509_crl_get_this_update(crl)).toUTC();
+
+    time_t next = gnutls_x509_crl_get_next_update(crl);
+    if (time_t(-1) != next)
+        table->nextUpdate = QDateTime::fromTime_t(next).toUTC();
+
+    gnutls_x509_crl_deinit(crl);
+
+    if (GNUTLS_E_SUCCESS != errno) {
+        delete table;
+        return 0;
+    }
+
+    // CRLs are normally in order already, but nothing requires it
+    std::sort(table->entries.begin(), table->entries.end());
+
+    return table;
+}
+
+/*!
+  \internal
+  Replaces the current table and frees the old one once no reader can still
+  be using it. Must be called with the load mutex held.
+ */
+void CrlIndexPrivate::publish(CrlTable *table)
+{
+    CrlTable *old = current.fetchAndStoreOrdered(table);
+
+    // Readers entering from now on see the new table. Those that entered in
+    // the previous epoch may still have the old one.
+    int previous = epoch.fetchAndAddOrdered(1);
+    while (atomic_load_acquire(readers[previous & 1].count))
+        QThread::yieldCurrentThread();
+
+    delete old;
+}
+
+int CrlIndexPrivate::enter() const
+{
+    forever {
+        int e = atomic_load_acquire(epoch);
+        readers[e & 1].count.ref();
+
+        // If publish() advanced the epoch meanwhile it may not be waiting
+        // for this slot, so register again in the new one. ref() is a full
+        // barrier, so this load cannot move ahead of it.
+        if (atomic_load_acquire(epoch) == e)
+            return e;
+
+        readers[e & 1].count.deref();
+    }
+}
+
+void CrlIndexPrivate::leave(int epoch) const
+{
+    readers[epoch & 1].count.deref();
+}
+
+/*!
+  \internal
+  Looks \a serial up with a single visit to the current table. Returns -1 if
+  no CRL has been loaded, 0 if the serial is not revoked and 1 if it is, in
+  which case the revocation time is stored in \a revoked if it is not 0.
+ */
+int crlindex_lookup(const CrlIndex *index, const QByteArray &serial, uint *revoked)
+{
+    CrlSerialKey key;
+    bool valid = !serial.isEmpty() && key.set(serial.constData(), serial.size());
+
+    CrlIndexReader table(index->d);
+    if (table.isNull())
+        return -1;
+
+    const CrlEntry *entry = valid ? table->find(key) : 0;
+    if (!entry)
+        return 0;
+
+    if (revoked)
+        *revoked = entry->revoked;
+    return 1;
+}
+
+/*!
+  Creates an empty CrlIndex. No certificates are reported as revoked until
+  a CRL has been loaded.
+ */
+CrlIndex::CrlIndex()
+    : d(new CrlIndexPrivate)
+{
+}
+
+/*!
+  Cleans up a CrlIndex. There must be no queries in progress.
+ */
+CrlIndex::~CrlIndex()
+{
+    delete d;
+}
+
+/*!
+  Returns the error that occurred when the last CRL was loaded. The values
+  used are those of gnutls. If there has not been an error then it is
+  guaranteed to be 0.
+ */
+int CrlIndex::error() const
+{
+    return d->errno;
+}
+
+/*!
+  Returns a string describing the error that occurred when the last CRL was
+  loaded.
+ */
+QString CrlIndex::errorString() const
+{
+    return QString::fromUtf8(gnutls_strerror(d->errno));
+}
+
+/*!
+  Sets the CA certificate whose signature CRLs must carry. CRLs that are
+  already loaded are not checked again.
+ */
+void CrlIndex::setIssuer(const QSslCertificate &cacert)
+{
+    QMutexLocker lock(&d->loadMutex);
+    d->issuer = cacert;
+}
+
+/*!
+  Returns the CA certificate whose signature CRLs must carry.
+ */
+QSslCertificate CrlIndex::issuer() const
+{
+    QMutexLocker lock(&d->loadMutex);
+    return d->issuer;
+}
+
+/*!
+  Loads the encoded \a crl, replacing the CRL currently in use. If the CRL
+  cannot be parsed, is not signed by the issuer, or is not a complete CRL,
+  then false is returned and the current CRL is kept.
+ */
+bool CrlIndex::load(const QByteArray &crl, QSsl::EncodingFormat format)
+{
+    QMutexLocker lock(&d->loadMutex);
+
+    CrlTable *table = d->parse(crl.constData(), crl.size(), format);
+    if (!table)
+        return false;
+
+    d->publish(table);
+    return true;
+}
+
+/*!
+  Loads the CRL in the file \a fileName, replacing the CRL currently in use.
+  Where possible the file is memory mapped while it is parsed rather than
+  read. If the file cannot be opened then error() will return
+  GNUTLS_E_FILE_ERROR.
+ */
+bool CrlIndex::loadFile(const QString &fileName, QSsl::EncodingFormat format)
+{
+    QMutexLocker lock(&d->loadMutex);
+
+    QFile f(fileName);
+    if (!f.open(QIODevice::ReadOnly)) {
+        d->errno = GNUTLS_E_FILE_ERROR;
+        return false;
+    }
+
+    CrlTable *table = 0;
+
+    const qint64 size = f.size();
+    uchar *mapped = (size > 0) ? f.map(0, size) : 0;
+    if (mapped) {
+        table = d->parse(reinterpret_cast<const char *>(mapped), int(size), format);
+        f.unmap(mapped);
+    }
+    else {
+        QByteArray buf = f.readAll();
+        table = d->parse(buf.constData(), buf.size(), format);
+    }
+
+    if (!table)
+        return false;
+
+    d->publish(table);
+    return true;
+}
+
+/*!
+  Returns true if the certificate with the big-endian \a serial appears in
+  the current CRL. Returns false if no CRL has been loaded.
+ */
+bool CrlIndex::isRevoked(const QByteArray &serial) const
+{
+    return isRevoked(serial.constData(), serial.size());
+}
+
+/*!
+  \overload
+  Checks the \a size byte serial at \a serial. This does not allocate, so is
+  the best choice for very high query rates.
+ */
+bool CrlIndex::isRevoked(const char *serial, int size) const
+{
+    CrlSerialKey key;
+    if (0 == size || !key.set(serial, size))
+        return false;
+
+    CrlIndexReader table(d);
+    return !table.isNull() && table->find(key);
+}
+
+/*!
+  Returns the time at which the certificate with the big-endian \a serial was
+  revoked according to the current CRL, or an invalid QDateTime if it has
+  not been revoked.
+ */
+QDateTime CrlIndex::revocationTime(const QByteArray &serial) const
+{
+    CrlSerialKey key;
+    if (serial.isEmpty() || !key.set(serial.constData(), serial.size()))
+        return QDateTime();
+
+    CrlIndexReader table(d);
+    const CrlEntry *entry = table.isNull() ? 0 : table->find(key);
+    if (!entry)
+        return QDateTime();
+
+    return QDateTime::fromTime_t(entry->revoked).toUTC();
+}
+
+/*!
+  Returns the number of revoked certificates in the current CRL.
+ */
+int CrlIndex::count() const
+{
+    CrlIndexReader table(d);
+    return table.isNull() ? 0 : table->entries.size();
+}
+
+/*!
+  Returns the CRL number of the current CRL, or 0 if it does not have one.
+ */
+quint64 CrlIndex::crlNumber() const
+{
+    CrlIndexReader table(d);
+    return table.isNull() ? 0 : table->number;
+}
+
+/*!
+  Returns the issue time of the current CRL.
+ */
+QDateTime CrlIndex::thisUpdate() const
+{
+    CrlIndexReader table(d);
+    return table.isNull() ? QDateTime() : table->thisUpdate;
+}
+
+/*!
+  Returns the time by which the issuer will publish the next CRL. This is
+  invalid if the current CRL does not say.
+ */
+QDateTime CrlIndex::nextUpdate() const
+{
+    CrlIndexReader table(d);
+    return table.isNull() ? QDateTime() : table->nextUpdate;
+}
+
+QT_END_NAMESPACE_CERTIFICATE
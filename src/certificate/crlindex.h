@@ -0,0 +1,84 @@
+/****************************************************************************
+**
+** Copyright (C) 2012-2013 Richard J. Moore <rich@kde.org>
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef CRLINDEX_H
+#define CRLINDEX_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QDateTime>
+#include <QtCore/QString>
+#include <QtNetwork/QSsl>
+#include <QtNetwork/QSslCertificate>
+
+#include "certificate_global.h"
+
+QT_BEGIN_NAMESPACE_CERTIFICATE
+
+class Q_CERTIFICATE_EXPORT CrlIndex
+{
+public:
+    CrlIndex();
+    ~CrlIndex();
+
+    int error() const;
+    QString errorString() const;
+
+    void setIssuer(const QSslCertificate &cacert);
+    QSslCertificate issuer() const;
+
+    bool load(const QByteArray &crl, QSsl::EncodingFormat format=QSsl::Der);
+    bool loadFile(const QString &fileName, QSsl::EncodingFormat format=QSsl::Der);
+
+    bool isRevoked(const QByteArray &serial) const;
+    bool isRevoked(const char *serial, int size) const;
+    QDateTime revocationTime(const QByteArray &serial) const;
+
+    int count() const;
+    quint64 crlNumber() const;
+    QDateTime thisUpdate() const;
+    QDateTime nextUpdate() const;
+
+private:
+    friend int crlindex_lookup(const CrlIndex *index, const QByteArray &serial, uint *revoked);
+    Q_DISABLE_COPY(CrlIndex)
+    struct CrlIndexPrivate *d;
+};
+
+QT_END_NAMESPACE_CERTIFICATE
+
+#endif // CRLINDEX_H
@@ -0,0 +1,152 @@
+/****************************************************************************
+**
+** Copyright (C) 2012-2013 Richard J. Moore <rich@kde.org>
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef CRLINDEX_P_H
+#define CRLINDEX_P_H
+
+#include <string.h>
+
+#include <QAtomicInt>
+#include <QAtomicPointer>
+#include <QMutex>
+#include <QVector>
+
+#include "crlindex.h"
+#include "utils_p.h"
+
+QT_BEGIN_NAMESPACE_CERTIFICATE
+
+// A serial number left-padded to 20 bytes, as produced by serial_to_key(),
+// so that memcmp() orders serials numerically.
+struct CrlSerialKey
+{
+    bool set(const char *serial, int size);
+
+    bool operator<(const CrlSerialKey &other) const { return memcmp(bytes, other.bytes, sizeof(bytes)) < 0; }
+    bool operator==(const CrlSerialKey &other) const { return 0 == memcmp(bytes, other.bytes, sizeof(bytes)); }
+
+    uchar bytes[20];
+};
+
+struct CrlEntry
+{
+    bool operator<(const CrlEntry &other) const { return serial < other.serial; }
+
+    CrlSerialKey serial;
+    uint revoked;
+};
+
+// One loaded CRL. Never modified once it has been published.
+struct CrlTable
+{
+    CrlTable() : number(0) {}
+
+    const CrlEntry *find(const CrlSerialKey &key) const;
+
+    QVector<CrlEntry> entries;
+    quint64 number;
+    QDateTime thisUpdate;
+    QDateTime nextUpdate;
+};
+
+// A reader count on a cache line of its own, so that readers registering in
+// one slot do not slow down those using the other, or the loads of the
+// epoch and the current table.
+struct CrlReaderSlot
+{
+    QAtomicInt count;
+    char padding[64 - sizeof(QAtomicInt)];
+};
+
+struct CrlIndexPrivate
+{
+    CrlIndexPrivate();
+    ~CrlIndexPrivate();
+
+    CrlTable *parse(const char *data, int size, QSsl::EncodingFormat format);
+    void publish(CrlTable *table);
+
+    int enter() const;
+    void leave(int epoch) const;
+
+    int errno;
+    QSslCertificate issuer;
+
+    // Serialises loading, readers never take it
+    QMutex loadMutex;
+
+    mutable QAtomicPointer<CrlTable> current;
+
+    // Readers register in the slot for the epoch they entered. publish()
+    // advances the epoch and then waits for the previous slot to empty
+    // before freeing the table it replaced.
+    mutable QAtomicInt epoch;
+    char padding[64];
+    mutable CrlReaderSlot readers[2];
+};
+
+// Keeps the current table alive for as long as it is in scope
+class CrlIndexReader
+{
+public:
+    CrlIndexReader(const CrlIndexPrivate *d)
+        : d(d),
+          epoch(d->enter()),
+          table(atomic_load_acquire(d->current))
+    {
+    }
+
+    ~CrlIndexReader()
+    {
+        d->leave(epoch);
+    }
+
+    const CrlTable *operator->() const { return table; }
+    bool isNull() const { return !table; }
+
+private:
+    const CrlIndexPrivate *d;
+    int epoch;
+    const CrlTable *table;
+};
+
+int crlindex_lookup(const CrlIndex *index, const QByteArray &serial, uint *revoked);
+
+QT_END_NAMESPACE_CERTIFICATE
+
+#endif // CRLINDEX_P_H
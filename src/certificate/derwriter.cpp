@@ -0,0 +1,221 @@
+/****************************************************************************
+**
+** Copyright (C) 2012-2013 Richard J. Moore <rich@kde.org>
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include <QDateTime>
+#include <QList>
+
+#include "derwriter_p.h"
+
+QT_BEGIN_NAMESPACE_CERTIFICATE
+
+void der_append_header(QByteArray &out, uchar tag, int length)
+{
+    out.append(char(tag));
+
+    if (length < 0x80) {
+        out.append(char(length));
+        return;
+    }
+
+    int bytes = 1;
+    while (bytes < 4 && (length >> (8 * bytes)))
+        bytes++;
+
+    out.append(char(0x80 | bytes));
+    for (int i = bytes - 1; i >= 0; i--)
+        out.append(char((length >> (8 * i)) & 0xff));
+}
+
+QByteArray der_wrap(uchar tag, const QByteArray &content)
+{
+    QByteArray result;
+    result.reserve(content.size() + 6);
+    der_append_header(result, tag, content.size());
+    result.append(content);
+    return result;
+}
+
+/*!
+  \internal
+  Encodes the unsigned big-endian \a magnitude as an INTEGER, removing
+  redundant leading zeros and adding one if the value would otherwise be
+  negative.
+ */
+QByteArray der_integer(const QByteArray &magnitude)
+{
+    int start = 0;
+    while (start < magnitude.size() - 1 && 0 == magnitude[start])
+        start++;
+
+    QByteArray content;
+    if (magnitude.isEmpty())
+        content.append(char(0));
+    else if (uchar(magnitude[start]) & 0x80)
+        content.append(char(0));
+    content.append(magnitude.constData() + start, magnitude.size() - start);
+
+    return der_wrap(DerInteger, content);
+}
+
+QByteArray der_integer(quint64 value)
+{
+    QByteArray magnitude(8, 0);
+    for (int i = 7; i >= 0; i--) {
+        magnitude[i] = char(value & 0xff);
+        value >>= 8;
+    }
+
+    return der_integer(magnitude);
+}
+
+QByteArray der_enumerated(int value)
+{
+    QByteArray content;
+    if (value > 0x7f)
+        content.append(char(value >> 8));
+    content.append(char(value & 0xff));
+
+    return der_wrap(DerEnumerated, content);
+}
+
+QByteArray der_boolean(bool value)
+{
+    return der_wrap(DerBoolean, QByteArray(1, value ? char(0xff) : char(0)));
+}
+
+QByteArray der_null()
+{
+    return QByteArray("\x05\x00", 2);
+}
+
+QByteArray der_oid(const char *dotted)
+{
+    QList<QByteArray> parts = QByteArray(dotted).split('.');
+    if (parts.size() < 2)
+        return QByteArray();
+
+    QList<quint64> arcs;
+    arcs << parts[0].toULongLong() * 40 + parts[1].toULongLong();
+    for (int i = 2; i < parts.size(); i++)
+        arcs << parts[i].toULongLong();
+
+    QByteArray content;
+    for (int i = 0; i < arcs.size(); i++) {
+        quint64 arc = arcs[i];
+
+        char bytes[10];
+        int count = 0;
+        do {
+            bytes[count++] = char(arc & 0x7f);
+            arc >>= 7;
+        } while (arc);
+
+        while (count > 1)
+            content.append(char(bytes[--count] | 0x80));
+        content.append(bytes[0]);
+    }
+
+    return der_wrap(DerOid, content);
+}
+
+/*!
+  \internal
+  Encodes \a time as required by RFC 5280, using UTCTime for dates before
+  2050 and GeneralizedTime after.
+ */
+QByteArray der_time(const QDateTime &time)
+{
+    QDateTime utc = time.toUTC();
+
+    int year = utc.date().year();
+    if (year < 1950 || year >= 2050)
+        return der_generalized_time(utc);
+
+    QByteArray content = utc.toString(QLatin1String("yyMMddHHmmss")).toLatin1() + 'Z';
+    return der_wrap(DerUtcTime, content);
+}
+
+QByteArray der_generalized_time(const QDateTime &time)
+{
+    QByteArray content = time.toUTC().toString(QLatin1String("yyyyMMddHHmmss")).toLatin1() + 'Z';
+    return der_wrap(DerGeneralizedTime, content);
+}
+
+QByteArray der_bit_string(const QByteArray &bits)
+{
+    QByteArray content;
+    content.reserve(bits.size() + 1);
+    content.append(char(0)); // No unused bits
+    content.append(bits);
+
+    return der_wrap(DerBitString, content);
+}
+
+QByteArray der_extension(const char *oid, bool critical, const QByteArray &value)
+{
+    QByteArray content = der_oid(oid);
+    if (critical)
+        content += der_boolean(true);
+    content += der_wrap(DerOctetString, value);
+
+    return der_wrap(DerSequence, content);
+}
+
+QByteArray der_to_pem(const QByteArray &der, const char *label)
+{
+    QByteArray base64 = der.toBase64();
+
+    QByteArray result;
+    result.reserve(base64.size() + base64.size() / 64 + 64);
+    result += "-----BEGIN ";
+    result += label;
+    result += "-----\n";
+
+    for (int i = 0; i < base64.size(); i += 64) {
+        result += base64.mid(i, 64);
+        result += '\n';
+    }
+
+    result += "-----END ";
+    result += label;
+    result += "-----\n";
+
+    return result;
+}
+
+QT_END_NAMESPACE_CERTIFICATE
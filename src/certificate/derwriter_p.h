@@ -0,0 +1,89 @@
+/****************************************************************************
+**
+** Copyright (C) 2012-2013 Richard J. Moore <rich@kde.org>
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef DERWRITER_P_H
+#define DERWRITER_P_H
+
+#include <QtCore/QByteArray>
+
+#include "certificate_global.h"
+
+class QDateTime;
+
+QT_BEGIN_NAMESPACE_CERTIFICATE
+
+//
+// Minimal DER encoding helpers for the structures that gnutls cannot build
+// incrementally. Each function returns a complete TLV.
+//
+
+enum DerTag {
+    DerBoolean = 0x01,
+    DerInteger = 0x02,
+    DerBitString = 0x03,
+    DerOctetString = 0x04,
+    DerNull = 0x05,
+    DerOid = 0x06,
+    DerEnumerated = 0x0a,
+    DerUtcTime = 0x17,
+    DerGeneralizedTime = 0x18,
+    DerSequence = 0x30,
+    DerContext = 0x80,
+    DerConstructedContext = 0xa0
+};
+
+void der_append_header(QByteArray &out, uchar tag, int length);
+QByteArray der_wrap(uchar tag, const QByteArray &content);
+
+QByteArray der_integer(const QByteArray &magnitude);
+QByteArray der_integer(quint64 value);
+QByteArray der_enumerated(int value);
+QByteArray der_boolean(bool value);
+QByteArray der_null();
+QByteArray der_oid(const char *dotted);
+QByteArray der_time(const QDateTime &time);
+QByteArray der_generalized_time(const QDateTime &time);
+QByteArray der_bit_string(const QByteArray &bits);
+
+QByteArray der_extension(const char *oid, bool critical, const QByteArray &value);
+
+QByteArray der_to_pem(const QByteArray &der, const char *label);
+
+QT_END_NAMESPACE_CERTIFICATE
+
+#endif // DERWRITER_P_H
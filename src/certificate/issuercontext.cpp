@@ -0,0 +1,233 @@
+/****************************************************************************
+**
+** Copyright (C) 2012-2013 Richard J. Moore <rich@kde.org>
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "utils_p.h"
+
+#include "issuercontext_p.h"
+
+QT_BEGIN_NAMESPACE_CERTIFICATE
+
+/*!
+  \class IssuerContext
+  \brief The IssuerContext class holds a CA certificate and key ready for
+  signing.
+
+  Signing a certificate with CertificateBuilder::signedCertificate() using a
+  QSslCertificate and QSslKey means that the CA certificate and key have to be
+  converted for use by gnutls every time. An IssuerContext performs these
+  conversions once, along with calculating the authority key identifier, so
+  that it can be reused to issue any number of certificates.
+
+  IssuerContext is explicitly shared, copies refer to the same underlying CA
+  certificate and key. Since it is never modified after it has been created,
+  a single IssuerContext can be used by builders in several threads at once.
+*/
+
+IssuerContextPrivate::IssuerContextPrivate()
+    : null(true),
+      errno(GNUTLS_E_SUCCESS),
+      crt(0)
+{
+    ensure_gnutls_init();
+}
+
+IssuerContextPrivate::~IssuerContextPrivate()
+{
+    if (crt)
+        gnutls_x509_crt_deinit(crt);
+}
+
+/*!
+  \internal
+  Converts the CA certificate and calculates the key identifier once the key
+  has been loaded.
+ */
+void IssuerContextPrivate::setup(const QSslCertificate &cacert)
+{
+    crt = qsslcert_to_crt(cacert, &errno);
+    if (GNUTLS_E_SUCCESS != errno)
+        return;
+
+    keyId = crt_to_keyid(crt, &errno);
+    if (GNUTLS_E_SUCCESS != errno)
+        return;
+
+    cert = cacert;
+    null = false;
+}
+
+/*!
+  Creates a null IssuerContext.
+ */
+IssuerContext::IssuerContext()
+    : d(new IssuerContextPrivate)
+{
+}
+
+/*!
+  Creates an IssuerContext that will sign certificates using the CA
+  certificate \a cacert and its private key \a cakey. If either cannot be
+  converted then the context will be null and error() will report the reason.
+ */
+IssuerContext::IssuerContext(const QSslCertificate &cacert, const QSslKey &cakey)
+    : d(new IssuerContextPrivate)
+{
+    d->key = SigningKey(cakey);
+    d->errno = d->key.error();
+    if (d->key.isNull())
+        return;
+
+    d->setup(cacert);
+}
+
+/*!
+  Creates an IssuerContext that will sign certificates using the CA
+  certificate \a cacert and the encoded private key \a encodedKey. This
+  allows keys that QSslKey cannot represent, such as Ed25519 keys, to be
+  used for issuing certificates. The key may be either an unencrypted
+  PKCS#8 structure or in the traditional format for its type.
+ */
+IssuerContext::IssuerContext(const QSslCertificate &cacert, const QByteArray &encodedKey, QSsl::EncodingFormat format)
+    : d(new IssuerContextPrivate)
+{
+    d->key = SigningKey(encodedKey, format);
+    d->errno = d->key.error();
+    if (d->key.isNull())
+        return;
+
+    d->setup(cacert);
+}
+
+/*!
+  Creates an IssuerContext that will sign certificates using the CA
+  certificate \a cacert and the signing key \a cakey. This allows the CA key
+  to be held in a PKCS#11 token, see SigningKey::fromPkcs11Url().
+ */
+IssuerContext::IssuerContext(const QSslCertificate &cacert, const SigningKey &cakey)
+    : d(new IssuerContextPrivate)
+{
+    d->key = cakey;
+    d->errno = cakey.error();
+    if (cakey.isNull()) {
+        if (GNUTLS_E_SUCCESS == d->errno)
+            d->errno = GNUTLS_E_INVALID_REQUEST;
+        return;
+    }
+
+    d->setup(cacert);
+}
+
+/*!
+  Creates an IssuerContext that shares the CA certificate and key of \a other.
+ */
+IssuerContext::IssuerContext(const IssuerContext &other)
+    : d(other.d)
+{
+}
+
+/*!
+  Clean up.
+ */
+IssuerContext::~IssuerContext()
+{
+}
+
+/*!
+  Makes this IssuerContext share the CA certificate and key of \a other.
+ */
+IssuerContext &IssuerContext::operator=(const IssuerContext &other)
+{
+    d = other.d;
+    return *this;
+}
+
+/*!
+  Returns true if this IssuerContext is null, either because it was default
+  constructed or because the CA certificate or key could not be loaded.
+ */
+bool IssuerContext::isNull() const
+{
+    return d->null;
+}
+
+/*!
+  Returns the error that occurred when creating this object. The values
+  used are those of gnutls. If there has not been an error then it is
+  guaranteed to be 0.
+ */
+int IssuerContext::error() const
+{
+    return d->errno;
+}
+
+/*!
+  Returns a string describing the error that occurred when creating this
+  object.
+ */
+QString IssuerContext::errorString() const
+{
+    return QString::fromUtf8(gnutls_strerror(d->errno));
+}
+
+/*!
+  Returns the CA certificate.
+ */
+QSslCertificate IssuerContext::certificate() const
+{
+    return d->cert;
+}
+
+/*!
+  Returns the key identifier of the CA certificate. This is the value that
+  CertificateBuilder::addAuthorityKeyIdentifier() will add to certificates
+  issued using this context.
+ */
+QByteArray IssuerContext::authorityKeyIdentifier() const
+{
+    return d->keyId;
+}
+
+/*!
+  Returns the key used to sign certificates.
+ */
+SigningKey IssuerContext::signingKey() const
+{
+    return d->key;
+}
+
+QT_END_NAMESPACE_CERTIFICATE
@@ -0,0 +1,85 @@
+/****************************************************************************
+**
+** Copyright (C) 2012-2013 Richard J. Moore <rich@kde.org>
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef ISSUERCONTEXT_H
+#define ISSUERCONTEXT_H
+
+#include <QtCore/qshareddata.h>
+#include <QtNetwork/QSslCertificate>
+#include <QtNetwork/QSslKey>
+
+#include "certificate_global.h"
+#include "signingkey.h"
+
+QT_BEGIN_NAMESPACE_CERTIFICATE
+
+class IssuerContextPrivate;
+
+class Q_CERTIFICATE_EXPORT IssuerContext
+{
+public:
+    IssuerContext();
+    IssuerContext(const QSslCertificate &cacert, const QSslKey &cakey);
+    IssuerContext(const QSslCertificate &cacert, const QByteArray &encodedKey, QSsl::EncodingFormat format=QSsl::Pem);
+    IssuerContext(const QSslCertificate &cacert, const SigningKey &cakey);
+    IssuerContext(const IssuerContext &other);
+    ~IssuerContext();
+
+    IssuerContext &operator=(const IssuerContext &other);
+
+    void swap(IssuerContext &other) { qSwap(d, other.d); }
+
+    bool isNull() const;
+
+    int error() const;
+    QString errorString() const;
+
+    QSslCertificate certificate() const;
+    QByteArray authorityKeyIdentifier() const;
+    SigningKey signingKey() const;
+
+private:
+    friend class CertificateBuilder;
+    friend struct CrlBuilderPrivate;
+    friend struct OcspResponderPrivate;
+    QExplicitlySharedDataPointer<IssuerContextPrivate> d;
+};
+
+QT_END_NAMESPACE_CERTIFICATE
+
+#endif // ISSUERCONTEXT_H
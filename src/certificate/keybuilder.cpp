@@ -39,6 +39,8 @@
 #include <gnutls/gnutls.h>
 #include <gnutls/x509.h>
 
+#include "asynctask_p.h"
+#include "securememory_p.h"
 #include "utils_p.h"
 
 #include "keybuilder.h"
@@ -53,56 +55,207 @@ QT_BEGIN_NAMESPACE_CERTIFICATE
   key for an X.509 certificate.
 */
 
+static gnutls_sec_param_t strength_to_sec_param(KeyBuilder::KeyStrength strength)
+{
+    switch(strength) {
+    case KeyBuilder::StrengthLow:
+        return GNUTLS_SEC_PARAM_LOW;
+    case KeyBuilder::StrengthNormal:
+        return GNUTLS_SEC_PARAM_NORMAL;
+    case KeyBuilder::StrengthHigh:
+        return GNUTLS_SEC_PARAM_HIGH;
+    case KeyBuilder::StrengthUltra:
+        return GNUTLS_SEC_PARAM_ULTRA;
+    default:
+        qWarning("Unhandled strength %d passed to generate", uint(strength));
+    }
+
+    return GNUTLS_SEC_PARAM_NORMAL;
+}
+
+static gnutls_ecc_curve_t strength_to_curve(KeyBuilder::KeyStrength strength)
+{
+    switch(strength) {
+    case KeyBuilder::StrengthLow:
+    case KeyBuilder::StrengthNormal:
+        return GNUTLS_ECC_CURVE_SECP256R1;
+    case KeyBuilder::StrengthHigh:
+        return GNUTLS_ECC_CURVE_SECP384R1;
+    case KeyBuilder::StrengthUltra:
+        return GNUTLS_ECC_CURVE_SECP521R1;
+    default:
+        qWarning("Unhandled strength %d passed to generate", uint(strength));
+    }
+
+    return GNUTLS_ECC_CURVE_SECP256R1;
+}
+
+static gnutls_x509_privkey_t generate_privkey(KeyBuilder::KeyType type, KeyBuilder::KeyStrength strength, int *errno)
+{
+    gnutls_pk_algorithm_t pk;
+    uint bits;
+
+    switch(type) {
+    case KeyBuilder::TypeRsa:
+        pk = GNUTLS_PK_RSA;
+        bits = gnutls_sec_param_to_pk_bits(pk, strength_to_sec_param(strength));
+        break;
+    case KeyBuilder::TypeDsa:
+        pk = GNUTLS_PK_DSA;
+        bits = gnutls_sec_param_to_pk_bits(pk, strength_to_sec_param(strength));
+        break;
+    case KeyBuilder::TypeEc:
+        pk = GNUTLS_PK_ECDSA;
+        bits = GNUTLS_CURVE_TO_BITS(strength_to_curve(strength));
+        break;
+#if GNUTLS_VERSION_NUMBER >= 0x030600
+    case KeyBuilder::TypeEd25519:
+        // Ed25519 has a fixed size, so the strength is ignored
+        pk = GNUTLS_PK_EDDSA_ED25519;
+        bits = GNUTLS_CURVE_TO_BITS(GNUTLS_ECC_CURVE_ED25519);
+        break;
+#endif
+    default:
+        *errno = GNUTLS_E_UNIMPLEMENTED_FEATURE;
+        return 0;
+    }
+
+    gnutls_x509_privkey_t key;
+    *errno = gnutls_x509_privkey_init(&key);
+    if (GNUTLS_E_SUCCESS != *errno)
+        return 0;
+
+    *errno = gnutls_x509_privkey_generate(key, pk, bits, 0);
+    if (GNUTLS_E_SUCCESS != *errno) {
+        gnutls_x509_privkey_deinit(key);
+        return 0;
+    }
+
+    return key;
+}
+
 /*!
   Generates a new key using the specified algorithm and strength. The algorithm
   will generally be RSA. The various strengths allow you to specify the trade-off
   between the security of the key and the time involved in creating it.
 
+  When built against Qt 5.5 or later QSsl::Ec may also be used, in which case
+  StrengthLow and StrengthNormal give a P-256 key, StrengthHigh gives a P-384
+  key and StrengthUltra gives a P-521 key. Generating an EC key is very much
+  faster than generating an RSA key of comparable strength.
+
   Note that this method can take a considerable length of time to execute, so in
-  gui applications it should be run in a worker thread.
+  gui applications it should be run in a worker thread, or generateAsync() should
+  be used instead.
  */
 QSslKey KeyBuilder::generate( QSsl::KeyAlgorithm algo, KeyStrength strength )
 {
     ensure_gnutls_init();
 
-    gnutls_sec_param_t sec;
-    switch(strength) {
-    case StrengthLow:
-        sec = GNUTLS_SEC_PARAM_LOW;
+    KeyType type;
+    switch(algo) {
+    case QSsl::Rsa:
+        type = TypeRsa;
         break;
-    case StrengthNormal:
-        sec = GNUTLS_SEC_PARAM_NORMAL;
+    case QSsl::Dsa:
+        type = TypeDsa;
         break;
-    case StrengthHigh:
-        sec = GNUTLS_SEC_PARAM_HIGH;
-        break;
-    case StrengthUltra:
-        sec = GNUTLS_SEC_PARAM_ULTRA;
+#if QT_VERSION >= 0x050500
+    case QSsl::Ec:
+        type = TypeEc;
         break;
+#endif
     default:
-        qWarning("Unhandled strength %d passed to generate", uint(strength));
-        sec = GNUTLS_SEC_PARAM_NORMAL;
+        qWarning("Unsupported key algorithm %d passed to generate", int(algo));
+        return QSslKey();
     }
 
-    uint bits = gnutls_sec_param_to_pk_bits((algo == QSsl::Rsa) ? GNUTLS_PK_RSA : GNUTLS_PK_DSA, sec);
-    gnutls_x509_privkey_t key;
-    gnutls_x509_privkey_init(&key);
-
-    int errno = gnutls_x509_privkey_generate(key, (algo == QSsl::Rsa) ? GNUTLS_PK_RSA : GNUTLS_PK_DSA, bits, 0);
+    int errno;
+    gnutls_x509_privkey_t key = generate_privkey(type, strength, &errno);
     if (GNUTLS_E_SUCCESS != errno) {
         qWarning("Failed to generate key %s", gnutls_strerror(errno));
-        gnutls_x509_privkey_deinit(key);
         return QSslKey();
     }
 
     QSslKey qkey = key_to_qsslkey(key, algo, &errno);
+    gnutls_x509_privkey_deinit(key);
+
     if (GNUTLS_E_SUCCESS != errno) {
         qWarning("Failed to convert key to bytearray %s", gnutls_strerror(errno));
-        gnutls_x509_privkey_deinit(key);
         return QSslKey();
     }
-    
+
     return qkey;
 }
 
+/*!
+  Generates a new key of the specified type and returns it as an unencrypted
+  PKCS#8 structure in the requested format. This allows keys to be created
+  that cannot be represented by QSslKey, such as Ed25519 keys (for which the
+  strength is ignored) or EC keys when using a version of Qt older than 5.5.
+  The curves used for EC keys are the same as those described for generate().
+
+  If the key cannot be generated then an empty QByteArray is returned.
+ */
+QByteArray KeyBuilder::generateEncoded( KeyType type, KeyStrength strength, QSsl::EncodingFormat format )
+{
+    ensure_gnutls_init();
+
+    int errno;
+    gnutls_x509_privkey_t key = generate_privkey(type, strength, &errno);
+    if (GNUTLS_E_SUCCESS != errno) {
+        qWarning("Failed to generate key %s", gnutls_strerror(errno));
+        return QByteArray();
+    }
+
+    gnutls_datum_t datum;
+    errno = gnutls_x509_privkey_export2_pkcs8(key,
+                                              (QSsl::Pem == format) ? GNUTLS_X509_FMT_PEM : GNUTLS_X509_FMT_DER,
+                                              0, GNUTLS_PKCS_PLAIN, &datum);
+    gnutls_x509_privkey_deinit(key);
+
+    if (GNUTLS_E_SUCCESS != errno) {
+        qWarning("Failed to convert key to bytearray %s", gnutls_strerror(errno));
+        return QByteArray();
+    }
+
+    QByteArray result(reinterpret_cast<const char *>(datum.data), datum.size);
+    secure_zero(datum.data, datum.size);
+    gnutls_free(datum.data);
+
+    return result;
+}
+
+class KeyGenerationTask : public AsyncTask<QSslKey>
+{
+public:
+    KeyGenerationTask(QSsl::KeyAlgorithm algo, KeyBuilder::KeyStrength strength)
+        : algo(algo),
+          strength(strength)
+    {
+    }
+
+protected:
+    QSslKey compute()
+    {
+        return KeyBuilder::generate(algo, strength);
+    }
+
+private:
+    QSsl::KeyAlgorithm algo;
+    KeyBuilder::KeyStrength strength;
+};
+
+/*!
+  Generates a new key in the same way as generate(), but does so using the
+  thread pool returned by CertificateLibrary::threadPool(). The returned future
+  will contain the key once it has been created, allowing applications with an
+  event loop to use a QFutureWatcher rather than blocking.
+ */
+QFuture<QSslKey> KeyBuilder::generateAsync( QSsl::KeyAlgorithm algo, KeyStrength strength )
+{
+    KeyGenerationTask *task = new KeyGenerationTask(algo, strength);
+    return task->start();
+}
+
 QT_END_NAMESPACE_CERTIFICATE
@@ -41,6 +41,7 @@
 
 #include <QtNetwork/QSslKey>
 #include <QtNetwork/QSsl>
+#include <QtCore/QFuture>
 
 #include "certificate_global.h"
 
@@ -56,7 +57,16 @@ public:
         StrengthUltra
     };
 
+    enum KeyType {
+        TypeRsa,
+        TypeDsa,
+        TypeEc,
+        TypeEd25519
+    };
+
     static QSslKey generate( QSsl::KeyAlgorithm algo, KeyStrength strength );
+    static QByteArray generateEncoded( KeyType type, KeyStrength strength, QSsl::EncodingFormat format=QSsl::Pem );
+    static QFuture<QSslKey> generateAsync( QSsl::KeyAlgorithm algo, KeyStrength strength );
 
 private:
     KeyBuilder() {}
@@ -0,0 +1,308 @@
+/****************************************************************************
+**
+** Copyright (C) 2012-2013 Richard J. Moore <rich@kde.org>
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include <QElapsedTimer>
+#include <QMutexLocker>
+#include <QRunnable>
+
+#include "keypool_p.h"
+
+QT_BEGIN_NAMESPACE_CERTIFICATE
+
+/*!
+  \class KeyPool
+  \brief The KeyPool class keeps a supply of pre-generated QSslKeys.
+
+  Generating a key, particularly an RSA key, can take hundreds of milliseconds.
+  The KeyPool class generates keys in advance on worker threads so that they
+  are available immediately when they are needed. A separate pool is kept for
+  each combination of algorithm and strength that has been requested, and each
+  pool is automatically refilled once the number of keys available drops to
+  the low-water mark.
+
+  If a key is requested when the pool is empty, then it will be generated
+  synchronously in the calling thread and the request will be recorded as a
+  miss in the statistics.
+*/
+
+/*!
+  \class KeyPool::Statistics
+  \brief The Statistics class reports the state of one of the pools within a
+  KeyPool.
+
+  The times reported are in milliseconds and only include keys that were
+  generated in the background.
+*/
+
+class KeyPoolRefill : public QRunnable
+{
+public:
+    KeyPoolRefill(KeyPoolPrivate *d, QSsl::KeyAlgorithm algo, KeyBuilder::KeyStrength strength)
+        : d(d),
+          algo(algo),
+          strength(strength)
+    {
+    }
+
+    void run()
+    {
+        d->mutex.lock();
+        bool stopping = d->stopping;
+        d->mutex.unlock();
+
+        QSslKey key;
+        QElapsedTimer timer;
+        timer.start();
+
+        if (!stopping)
+            key = KeyBuilder::generate(algo, strength);
+
+        d->keyGenerated(algo, strength, key, timer.elapsed());
+    }
+
+private:
+    KeyPoolPrivate *d;
+    QSsl::KeyAlgorithm algo;
+    KeyBuilder::KeyStrength strength;
+};
+
+KeyPool::Statistics::Statistics()
+    : hits(0),
+      misses(0),
+      depth(0),
+      refills(0),
+      totalRefillTime(0),
+      maxRefillTime(0)
+{
+}
+
+KeyPoolPrivate::KeyPoolPrivate()
+    : poolSize(4),
+      lowWaterMark(1),
+      stopping(false)
+{
+}
+
+int KeyPoolPrivate::bucketId(QSsl::KeyAlgorithm algo, KeyBuilder::KeyStrength strength)
+{
+    return (int(algo) << 8) | int(strength);
+}
+
+/*!
+  \internal
+  Queue enough generation jobs to bring the bucket back up to the pool size if
+  it has fallen to the low-water mark. Must be called with the mutex held.
+ */
+void KeyPoolPrivate::refill(QSsl::KeyAlgorithm algo, KeyBuilder::KeyStrength strength, KeyPoolBucket &bucket)
+{
+    if (stopping || bucket.keys.size() + bucket.pending > lowWaterMark)
+        return;
+
+    int needed = poolSize - bucket.keys.size() - bucket.pending;
+    for (int i = 0; i < needed; i++) {
+        bucket.pending++;
+        threadPool.start(new KeyPoolRefill(this, algo, strength));
+    }
+}
+
+void KeyPoolPrivate::keyGenerated(QSsl::KeyAlgorithm algo, KeyBuilder::KeyStrength strength,
+                                  const QSslKey &key, qint64 elapsed)
+{
+    QMutexLocker lock(&mutex);
+
+    KeyPoolBucket &bucket = buckets[bucketId(algo, strength)];
+    bucket.pending--;
+
+    if (stopping || key.isNull())
+        return;
+
+    bucket.stats.refills++;
+    bucket.stats.totalRefillTime += elapsed;
+    if (elapsed > bucket.stats.maxRefillTime)
+        bucket.stats.maxRefillTime = elapsed;
+
+    if (bucket.keys.size() < poolSize)
+        bucket.keys.enqueue(key);
+}
+
+/*!
+  Creates an empty KeyPool. No keys are generated until either reserve() or
+  take() is called.
+ */
+KeyPool::KeyPool()
+    : d(new KeyPoolPrivate)
+{
+}
+
+/*!
+  Cleans up a KeyPool. Any keys that are being generated in the background
+  will be waited for, then discarded.
+ */
+KeyPool::~KeyPool()
+{
+    d->mutex.lock();
+    d->stopping = true;
+    d->mutex.unlock();
+
+    d->threadPool.waitForDone();
+    delete d;
+}
+
+/*!
+  Sets the number of keys that will be kept available for each algorithm and
+  strength. The default is 4.
+ */
+void KeyPool::setPoolSize(int size)
+{
+    QMutexLocker lock(&d->mutex);
+    d->poolSize = qMax(1, size);
+}
+
+/*!
+  Returns the number of keys that will be kept available for each algorithm
+  and strength.
+ */
+int KeyPool::poolSize() const
+{
+    QMutexLocker lock(&d->mutex);
+    return d->poolSize;
+}
+
+/*!
+  Sets the number of available keys at or below which the pool will start
+  to generate more keys. The default is 1.
+ */
+void KeyPool::setLowWaterMark(int mark)
+{
+    QMutexLocker lock(&d->mutex);
+    d->lowWaterMark = qMax(0, mark);
+}
+
+/*!
+  Returns the number of available keys at or below which the pool will start
+  to generate more keys.
+ */
+int KeyPool::lowWaterMark() const
+{
+    QMutexLocker lock(&d->mutex);
+    return d->lowWaterMark;
+}
+
+/*!
+  Sets the maximum number of threads that will be used to generate keys. By
+  default this is the number of cores available.
+ */
+void KeyPool::setMaxThreadCount(int count)
+{
+    d->threadPool.setMaxThreadCount(count);
+}
+
+/*!
+  Returns the maximum number of threads that will be used to generate keys.
+ */
+int KeyPool::maxThreadCount() const
+{
+    return d->threadPool.maxThreadCount();
+}
+
+/*!
+  Starts filling the pool for the specified algorithm and strength in the
+  background. Calling this before the first take() means that the first
+  request will not have to generate a key itself.
+ */
+void KeyPool::reserve(QSsl::KeyAlgorithm algo, KeyBuilder::KeyStrength strength)
+{
+    QMutexLocker lock(&d->mutex);
+
+    KeyPoolBucket &bucket = d->buckets[KeyPoolPrivate::bucketId(algo, strength)];
+    d->refill(algo, strength, bucket);
+}
+
+/*!
+  Removes a key of the specified algorithm and strength from the pool and
+  returns it. If the pool is empty then a key is generated synchronously
+  using KeyBuilder::generate(). Either way, the pool will be refilled in the
+  background if it has dropped to the low-water mark.
+
+  Each key is only ever returned once.
+ */
+QSslKey KeyPool::take(QSsl::KeyAlgorithm algo, KeyBuilder::KeyStrength strength)
+{
+    QSslKey key;
+
+    d->mutex.lock();
+
+    KeyPoolBucket &bucket = d->buckets[KeyPoolPrivate::bucketId(algo, strength)];
+    if (!bucket.keys.isEmpty()) {
+        key = bucket.keys.dequeue();
+        bucket.stats.hits++;
+    }
+    else {
+        bucket.stats.misses++;
+    }
+
+    d->refill(algo, strength, bucket);
+    d->mutex.unlock();
+
+    if (key.isNull())
+        key = KeyBuilder::generate(algo, strength);
+
+    return key;
+}
+
+/*!
+  Returns the statistics for the pool of keys with the specified algorithm
+  and strength.
+ */
+KeyPool::Statistics KeyPool::statistics(QSsl::KeyAlgorithm algo, KeyBuilder::KeyStrength strength) const
+{
+    QMutexLocker lock(&d->mutex);
+
+    Statistics stats;
+
+    QHash<int, KeyPoolBucket>::const_iterator it = d->buckets.constFind(KeyPoolPrivate::bucketId(algo, strength));
+    if (it == d->buckets.constEnd())
+        return stats;
+
+    stats = it->stats;
+    stats.depth = it->keys.size();
+
+    return stats;
+}
+
+QT_END_NAMESPACE_CERTIFICATE
@@ -0,0 +1,81 @@
+/****************************************************************************
+**
+** Copyright (C) 2012-2013 Richard J. Moore <rich@kde.org>
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef KEYPOOL_P_H
+#define KEYPOOL_P_H
+
+#include <QHash>
+#include <QQueue>
+#include <QMutex>
+#include <QThreadPool>
+
+#include "keypool.h"
+
+QT_BEGIN_NAMESPACE_CERTIFICATE
+
+struct KeyPoolBucket
+{
+    KeyPoolBucket() : pending(0) {}
+
+    QQueue<QSslKey> keys;
+    int pending;
+    KeyPool::Statistics stats;
+};
+
+struct KeyPoolPrivate
+{
+    KeyPoolPrivate();
+
+    static int bucketId(QSsl::KeyAlgorithm algo, KeyBuilder::KeyStrength strength);
+
+    void refill(QSsl::KeyAlgorithm algo, KeyBuilder::KeyStrength strength, KeyPoolBucket &bucket);
+    void keyGenerated(QSsl::KeyAlgorithm algo, KeyBuilder::KeyStrength strength,
+                      const QSslKey &key, qint64 elapsed);
+
+    int poolSize;
+    int lowWaterMark;
+    bool stopping;
+
+    mutable QMutex mutex;
+    QHash<int, KeyPoolBucket> buckets;
+    QThreadPool threadPool;
+};
+
+QT_END_NAMESPACE_CERTIFICATE
+
+#endif // KEYPOOL_P_H
@@ -0,0 +1,455 @@
+/****************************************************************************
+**
+** Copyright (C) 2012-2013 Richard J. Moore <rich@kde.org>
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include <QHostAddress>
+#include <QReadLocker>
+#include <QSet>
+#include <QWriteLocker>
+
+#include <algorithm>
+
+#include <gnutls/gnutls.h>
+#include <gnutls/crypto.h>
+
+#include "certificaterequest.h"
+#include "certificaterequestbuilder.h"
+#include "certificateprofile_p.h"
+#include "keypool.h"
+#include "utils_p.h"
+
+#include "leafcertificatecache_p.h"
+
+QT_BEGIN_NAMESPACE_CERTIFICATE
+
+/*!
+  \class LeafCertificateCache
+  \brief The LeafCertificateCache class issues and caches certificates for
+  host names on demand.
+
+  Applications such as TLS test proxies need a certificate for every host
+  name they see, and usually see the same names many times. The
+  LeafCertificateCache class issues a certificate the first time a host name
+  (together with a particular set of subject alternative names) is requested,
+  then returns the same certificate and key for later requests. The number
+  of entries is bounded. When it is full, an entry that has not been used
+  recently is discarded. Requests answered from the cache only share a read lock, so they
+  do not hold each other up.
+
+  If several threads ask for the same uncached name at once, only one of
+  them issues the certificate and the others wait for the result.
+
+  By default a new RSA key is generated for each entry. The key type can be
+  changed with setKeyType(), keys can be taken from a KeyPool, or a single
+  key can be shared by every entry using setSharedKey().
+*/
+
+/*!
+  \class LeafCertificateCache::Entry
+  \brief The Entry class holds a certificate issued by a LeafCertificateCache
+  along with its private key.
+
+  If the certificate could not be issued, then it will be null and error
+  will hold the gnutls error code.
+*/
+
+LeafCertificateCache::Entry::Entry()
+    : error(GNUTLS_E_SUCCESS)
+{
+}
+
+/*!
+  \internal
+  Returns the key of the entry for \a hostName and \a alternativeNames. Most
+  lookups are for a host name on its own, which is used directly as the
+  key. Otherwise the names are put in a canonical form and hashed, and the
+  hash is prefixed with a NUL so it cannot match a host name.
+ */
+QByteArray LeafCertificateCachePrivate::cacheKey(const QString &hostName, const QStringList &alternativeNames)
+{
+    const QString host = hostName.toLower();
+
+    QStringList names;
+    foreach (const QString &name, alternativeNames) {
+        QString lower = name.toLower();
+        if (lower != host)
+            names.append(lower);
+    }
+
+    if (names.isEmpty() && !host.contains(QChar(0)))
+        return host.toUtf8();
+
+    std::sort(names.begin(), names.end());
+    names.erase(std::unique(names.begin(), names.end()), names.end());
+    names.prepend(host);
+
+    QByteArray data = names.join(QLatin1String("\n")).toUtf8();
+
+    QByteArray key(33, 0);
+    if (gnutls_hash_fast(GNUTLS_DIG_SHA256, data.constData(), data.size(), key.data() + 1) < 0)
+        return data.prepend('\0');
+
+    return key;
+}
+
+/*!
+  \internal
+  Returns the subject alternative name for \a name, which is an IP address
+  name if \a name is an IPv4 or IPv6 address and a DNS name otherwise.
+ */
+Certificate::AlternativeName LeafCertificateCachePrivate::alternativeName(const QString &name)
+{
+    QHostAddress address;
+    if (address.setAddress(name))
+        return Certificate::AlternativeName(Certificate::AlternativeNameIpAddress, name.toUtf8());
+
+    return Certificate::AlternativeName(Certificate::AlternativeNameDns, name.toUtf8());
+}
+
+/*!
+  \internal
+  Gives \a leaf a second chance when the clock hand next reaches it. Only
+  needs the read lock. The flag is only written when it changes, so hits on
+  a popular entry do not keep writing to it.
+ */
+void LeafCertificateCachePrivate::touch(const CachedLeaf *leaf) const
+{
+    if (!atomic_load_acquire(leaf->referenced))
+        leaf->referenced.fetchAndStoreRelaxed(1);
+}
+
+/*!
+  \internal
+  Adds \a entry under \a key just behind the clock hand, so that it is the
+  last entry the hand reaches. Must be called with the write lock held.
+ */
+void LeafCertificateCachePrivate::insert(const QByteArray &key, const LeafCertificateCache::Entry &entry)
+{
+    CachedLeaf *leaf = new CachedLeaf(key, entry);
+
+    if (hand) {
+        leaf->next = hand;
+        leaf->prev = hand->prev;
+        hand->prev->next = leaf;
+        hand->prev = leaf;
+    }
+    else {
+        hand = leaf;
+    }
+
+    entries.insert(key, leaf);
+}
+
+/*!
+  \internal
+  Discards entries until no more than \a keep are left. The clock hand
+  skips, and clears, entries that have been used since it last passed them,
+  so each eviction takes constant time on average. Must be called with the
+  write lock held.
+ */
+void LeafCertificateCachePrivate::evict(int keep)
+{
+    while (entries.size() > qMax(0, keep)) {
+        while (hand->referenced.fetchAndStoreRelaxed(0))
+            hand = hand->next;
+
+        CachedLeaf *victim = hand;
+        hand = (victim->next == victim) ? 0 : victim->next;
+        victim->prev->next = victim->next;
+        victim->next->prev = victim->prev;
+
+        entries.remove(victim->key);
+        delete victim;
+    }
+}
+
+/*!
+  \internal
+  Discards every entry. Must be called with the write lock held.
+ */
+void LeafCertificateCachePrivate::clear()
+{
+    qDeleteAll(entries);
+    entries.clear();
+    hand = 0;
+}
+
+LeafCertificateCache::Entry LeafCertificateCachePrivate::issue(const QSslKey &key, const QString &hostName,
+                                                               const QStringList &alternativeNames)
+{
+    LeafCertificateCache::Entry entry;
+    entry.key = key;
+
+    if (key.isNull()) {
+        entry.error = GNUTLS_E_INVALID_REQUEST;
+        return entry;
+    }
+
+    CertificateRequestBuilder reqbuilder;
+    QByteArray host = hostName.toUtf8();
+
+    // DNS names are case insensitive, so only the first spelling is kept
+    QSet<QString> seen;
+    seen.insert(hostName.toLower());
+
+    QList<Certificate::AlternativeName> names;
+    names << alternativeName(hostName);
+    for (int i = 0; i < alternativeNames.size(); i++) {
+        QString lower = alternativeNames[i].toLower();
+        if (seen.contains(lower))
+            continue;
+
+        seen.insert(lower);
+        names << alternativeName(alternativeNames[i]);
+    }
+
+    bool ok = reqbuilder.setVersion(1)
+        && reqbuilder.setKey(key)
+        && reqbuilder.addNameEntry(Certificate::EntryCommonName, host)
+        && reqbuilder.setSubjectAlternativeNames(names);
+
+    if (!ok) {
+        entry.error = reqbuilder.error();
+        return entry;
+    }
+
+    CertificateRequest req = reqbuilder.signedRequest(key);
+    if (GNUTLS_E_SUCCESS != reqbuilder.error()) {
+        entry.error = reqbuilder.error();
+        return entry;
+    }
+
+    entry.certificate = issue_from_profile(req, profile, issuer, &entry.error);
+    return entry;
+}
+
+/*!
+  Creates a LeafCertificateCache that issues certificates signed by \a issuer
+  using the settings in \a profile. The subject alternative names are always
+  copied from the generated request, regardless of the profile settings.
+ */
+LeafCertificateCache::LeafCertificateCache(const IssuerContext &issuer, const CertificateProfile &profile)
+    : d(new LeafCertificateCachePrivate)
+{
+    d->issuer = issuer;
+    d->profile = profile;
+    d->profile.setCopyRequestExtensions(true);
+    d->keyAlgorithm = QSsl::Rsa;
+    d->keyStrength = KeyBuilder::StrengthNormal;
+    d->keyPool = 0;
+    d->capacity = 1000;
+    d->hand = 0;
+}
+
+/*!
+  Cleans up a LeafCertificateCache.
+ */
+LeafCertificateCache::~LeafCertificateCache()
+{
+    d->clear();
+    delete d;
+}
+
+/*!
+  Sets the maximum number of certificates that will be cached. The default
+  is 1000.
+ */
+void LeafCertificateCache::setCapacity(int entries)
+{
+    QWriteLocker lock(&d->lock);
+    d->capacity = entries;
+    d->evict(entries);
+}
+
+/*!
+  Returns the maximum number of certificates that will be cached.
+ */
+int LeafCertificateCache::capacity() const
+{
+    QReadLocker lock(&d->lock);
+    return d->capacity;
+}
+
+/*!
+  Sets a key that will be used for every certificate issued from now on,
+  avoiding the need to generate a key per entry. Pass a null key to go back
+  to generating a key for each entry.
+ */
+void LeafCertificateCache::setSharedKey(const QSslKey &key)
+{
+    QWriteLocker lock(&d->lock);
+    d->sharedKey = key;
+}
+
+/*!
+  Returns the key shared by all the entries, or a null key if each entry has
+  its own key.
+ */
+QSslKey LeafCertificateCache::sharedKey() const
+{
+    QReadLocker lock(&d->lock);
+    return d->sharedKey;
+}
+
+/*!
+  Sets the algorithm and strength of the keys generated for each entry. The
+  default is a normal strength RSA key.
+ */
+void LeafCertificateCache::setKeyType(QSsl::KeyAlgorithm algo, KeyBuilder::KeyStrength strength)
+{
+    QWriteLocker lock(&d->lock);
+    d->keyAlgorithm = algo;
+    d->keyStrength = strength;
+}
+
+/*!
+  Sets a KeyPool that the keys for each entry will be taken from, rather
+  than generating them as they are needed. The pool is not owned by the
+  cache and must outlive it. Pass 0 to stop using the pool.
+ */
+void LeafCertificateCache::setKeyPool(KeyPool *pool)
+{
+    QWriteLocker lock(&d->lock);
+    d->keyPool = pool;
+}
+
+/*!
+  Returns the certificate and key for \a hostName with the additional
+  subject alternative names \a alternativeNames. The host name is always
+  included as both the common name and a subject alternative name. If the
+  certificate is not already cached then it is issued now.
+
+  The order and case of the names do not matter when looking up an entry.
+ */
+LeafCertificateCache::Entry LeafCertificateCache::certificate(const QString &hostName,
+                                                              const QStringList &alternativeNames)
+{
+    const QByteArray key = LeafCertificateCachePrivate::cacheKey(hostName, alternativeNames);
+
+    CachedLeaf *leaf;
+
+    d->lock.lockForRead();
+    leaf = d->entries.value(key);
+    if (leaf) {
+        d->touch(leaf);
+        Entry entry = leaf->entry;
+        d->lock.unlock();
+        return entry;
+    }
+    d->lock.unlock();
+
+    QWriteLocker lock(&d->lock);
+
+    // Another thread may have finished issuing it in the meantime
+    leaf = d->entries.value(key);
+    if (leaf) {
+        d->touch(leaf);
+        return leaf->entry;
+    }
+
+    QSharedPointer<PendingLeaf> pending = d->pending.value(key);
+    if (pending) {
+        while (!pending->finished)
+            pending->done.wait(&d->lock);
+        return pending->entry;
+    }
+
+    pending = QSharedPointer<PendingLeaf>(new PendingLeaf);
+    d->pending.insert(key, pending);
+
+    QSslKey leafKey = d->sharedKey;
+    KeyPool *keyPool = d->keyPool;
+    QSsl::KeyAlgorithm keyAlgorithm = d->keyAlgorithm;
+    KeyBuilder::KeyStrength keyStrength = d->keyStrength;
+
+    lock.unlock();
+
+    if (leafKey.isNull()) {
+        if (keyPool)
+            leafKey = keyPool->take(keyAlgorithm, keyStrength);
+        else
+            leafKey = KeyBuilder::generate(keyAlgorithm, keyStrength);
+    }
+
+    Entry entry = d->issue(leafKey, hostName, alternativeNames);
+
+    lock.relock();
+
+    if (!entry.isNull() && d->capacity > 0) {
+        d->evict(d->capacity - 1);
+        d->insert(key, entry);
+    }
+
+    pending->entry = entry;
+    pending->finished = true;
+    d->pending.remove(key);
+    pending->done.wakeAll();
+
+    return entry;
+}
+
+/*!
+  Returns true if a certificate for \a hostName with the additional subject
+  alternative names \a alternativeNames is cached.
+ */
+bool LeafCertificateCache::contains(const QString &hostName, const QStringList &alternativeNames) const
+{
+    const QByteArray key = LeafCertificateCachePrivate::cacheKey(hostName, alternativeNames);
+
+    QReadLocker lock(&d->lock);
+    return d->entries.contains(key);
+}
+
+/*!
+  Returns the number of certificates that are cached.
+ */
+int LeafCertificateCache::size() const
+{
+    QReadLocker lock(&d->lock);
+    return d->entries.size();
+}
+
+/*!
+  Removes all the certificates from the cache.
+ */
+void LeafCertificateCache::clear()
+{
+    QWriteLocker lock(&d->lock);
+    d->clear();
+}
+
+QT_END_NAMESPACE_CERTIFICATE
@@ -0,0 +1,117 @@
+/****************************************************************************
+**
+** Copyright (C) 2012-2013 Richard J. Moore <rich@kde.org>
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef LEAFCERTIFICATECACHE_P_H
+#define LEAFCERTIFICATECACHE_P_H
+
+#include <QAtomicInt>
+#include <QHash>
+#include <QReadWriteLock>
+#include <QSharedPointer>
+#include <QWaitCondition>
+
+#include "certificate.h"
+#include "certificateprofile.h"
+#include "issuercontext.h"
+
+#include "leafcertificatecache.h"
+
+QT_BEGIN_NAMESPACE_CERTIFICATE
+
+//
+// An issuance that is in progress. Other threads that miss on the same name
+// wait for this rather than issuing a duplicate certificate.
+//
+struct PendingLeaf
+{
+    PendingLeaf() : finished(false) {}
+
+    QWaitCondition done;
+    LeafCertificateCache::Entry entry;
+    bool finished;
+};
+
+//
+// A cached certificate. The entries form a ring that is swept by a clock
+// hand when one has to be evicted. Hits only hold the read lock, so they
+// just set the referenced flag, which gives the entry a second chance.
+//
+struct CachedLeaf
+{
+    CachedLeaf(const QByteArray &key, const LeafCertificateCache::Entry &entry)
+        : key(key), entry(entry), referenced(0), prev(this), next(this) {}
+
+    QByteArray key;
+    LeafCertificateCache::Entry entry;
+    mutable QAtomicInt referenced;
+    CachedLeaf *prev;
+    CachedLeaf *next;
+};
+
+struct LeafCertificateCachePrivate
+{
+    static QByteArray cacheKey(const QString &hostName, const QStringList &alternativeNames);
+    static Certificate::AlternativeName alternativeName(const QString &name);
+
+    LeafCertificateCache::Entry issue(const QSslKey &key, const QString &hostName,
+                                      const QStringList &alternativeNames);
+
+    void touch(const CachedLeaf *leaf) const;
+    void insert(const QByteArray &key, const LeafCertificateCache::Entry &entry);
+    void evict(int keep);
+    void clear();
+
+    IssuerContext issuer;
+    CertificateProfile profile;
+
+    QSslKey sharedKey;
+    QSsl::KeyAlgorithm keyAlgorithm;
+    KeyBuilder::KeyStrength keyStrength;
+    KeyPool *keyPool;
+    int capacity;
+
+    // Entries are keyed by their host name, or a hash of all their names
+    mutable QReadWriteLock lock;
+    QHash<QByteArray, CachedLeaf *> entries;
+    CachedLeaf *hand;
+    QHash<QByteArray, QSharedPointer<PendingLeaf> > pending;
+};
+
+QT_END_NAMESPACE_CERTIFICATE
+
+#endif // LEAFCERTIFICATECACHE_P_H
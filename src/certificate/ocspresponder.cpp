@@ -0,0 +1,1042 @@
+/****************************************************************************
+**
+** Copyright (C) 2012-2013 Richard J. Moore <rich@kde.org>
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include <QMutexLocker>
+#include <QRunnable>
+
+#include <gnutls/abstract.h>
+#include <gnutls/crypto.h>
+#include <gnutls/ocsp.h>
+#include <gnutls/x509.h>
+
+#include "crlindex_p.h"
+#include "derwriter_p.h"
+#include "issuercontext_p.h"
+#include "signingkey_p.h"
+#include "utils_p.h"
+
+#include "ocspresponder_p.h"
+
+QT_BEGIN_NAMESPACE_CERTIFICATE
+
+/*!
+  \class OcspResponder
+  \brief The OcspResponder class answers OCSP requests for the certificates
+  of an issuer.
+
+  OcspResponder takes a DER encoded OCSP request, as sent in the body of an
+  HTTP POST, and returns the DER encoded response. Transport is left to the
+  application. The status of each certificate is taken from a CrlIndex, so
+  the responder agrees with the issuer's CRL. A certificate that is not on
+  the CRL is reported as good. If no CrlIndex has been set, or it has no CRL
+  loaded, every certificate is reported as unknown.
+
+  Responses are signed with the issuer's own key and cached. A request for a
+  certificate whose response is in the cache is answered with a hash lookup
+  and a copy, and needs no signature. Before a cached response reaches its
+  next update time it is signed again in the background, in batches, on the
+  responder's own threads. Only responses that have been requested since
+  they were last signed are refreshed. The others are dropped when they
+  expire. prepare() signs responses for a list of serials ahead of time and
+  keeps them refreshed whether or not they are requested, so that requests
+  for those certificates never wait for a signature. Any other certificate
+  is signed when it is first requested, once however many requests for it
+  arrive while that happens. The number of responses cached for these is
+  limited by setCapacity().
+
+  A cached response is only used while the CRL still gives the same status
+  for the certificate. Loading a new CRL into the CrlIndex therefore takes
+  effect at once.
+
+  As recommended by RFC 5019, request nonces are ignored so that responses
+  can be cached.
+*/
+
+/*!
+  \class OcspResponder::Statistics
+  \brief The Statistics class reports how well the response cache of an
+  OcspResponder is working.
+*/
+
+static const char *OidPkixOcspBasic = "1.3.6.1.5.5.7.48.1.1";
+
+static QByteArray hash(gnutls_digest_algorithm_t digest, const QByteArray &data)
+{
+    int size = gnutls_hash_get_len(digest);
+    if (size <= 0)
+        return QByteArray();
+
+    QByteArray result(size, 0);
+    if (gnutls_hash_fast(digest, data.constData(), data.size(), result.data()) < 0)
+        return QByteArray();
+
+    return result;
+}
+
+// Returns the contents of the DER element at *offset, and moves past it
+static bool der_next(const QByteArray &der, int *offset, uchar *tag, QByteArray *content)
+{
+    int pos = *offset;
+    if (pos + 2 > der.size())
+        return false;
+
+    *tag = uchar(der[pos++]);
+    int length = uchar(der[pos++]);
+    if (length & 0x80) {
+        int bytes = length & 0x7f;
+        if (bytes < 1 || bytes > 3 || pos + bytes > der.size())
+            return false;
+
+        length = 0;
+        while (bytes--)
+            length = (length << 8) | uchar(der[pos++]);
+    }
+
+    if (length > der.size() - pos)
+        return false;
+
+    *content = der.mid(pos, length);
+    *offset = pos + length;
+    return true;
+}
+
+//
+// Returns the value of the subjectPublicKey BIT STRING, which is what the
+// issuerKeyHash of a CertID is calculated over.
+//
+static QByteArray crt_to_public_key(gnutls_x509_crt_t crt, int *errno)
+{
+    gnutls_pubkey_t pubkey;
+    *errno = gnutls_pubkey_init(&pubkey);
+    if (GNUTLS_E_SUCCESS != *errno)
+        return QByteArray();
+
+    gnutls_datum_t datum;
+    *errno = gnutls_pubkey_import_x509(pubkey, crt, 0);
+    if (GNUTLS_E_SUCCESS == *errno)
+        *errno = gnutls_pubkey_export2(pubkey, GNUTLS_X509_FMT_DER, &datum);
+    gnutls_pubkey_deinit(pubkey);
+
+    if (GNUTLS_E_SUCCESS != *errno)
+        return QByteArray();
+
+    QByteArray spki(reinterpret_cast<const char *>(datum.data), datum.size);
+    gnutls_free(datum.data);
+
+    // SubjectPublicKeyInfo ::= SEQUENCE { algorithm, subjectPublicKey }
+    int offset = 0;
+    uchar tag;
+    QByteArray sequence, algorithm, bits;
+    if (!der_next(spki, &offset, &tag, &sequence) || DerSequence != tag) {
+        *errno = GNUTLS_E_ASN1_DER_ERROR;
+        return QByteArray();
+    }
+
+    offset = 0;
+    if (!der_next(sequence, &offset, &tag, &algorithm)
+        || !der_next(sequence, &offset, &tag, &bits) || DerBitString != tag || bits.isEmpty()) {
+        *errno = GNUTLS_E_ASN1_DER_ERROR;
+        return QByteArray();
+    }
+
+    // Skip the count of unused bits
+    return bits.mid(1);
+}
+
+class OcspRefreshThread : public QThread
+{
+public:
+    OcspRefreshThread(OcspResponderPrivate *d)
+        : d(d)
+    {
+    }
+
+    void run()
+    {
+        d->refreshLoop();
+    }
+
+private:
+    OcspResponderPrivate *d;
+};
+
+class OcspRefreshBatch : public QRunnable
+{
+public:
+    OcspRefreshBatch(OcspResponderPrivate *d, const QList<QByteArray> &keys)
+        : d(d),
+          keys(keys)
+    {
+    }
+
+    void run()
+    {
+        foreach (const QByteArray &key, keys) {
+            if (d->stopping.fetchAndAddOrdered(0))
+                return;
+
+            OcspCertId id;
+            id.der = key;
+
+            OcspCacheShard &shard = d->shard(key);
+            shard.mutex.lock();
+            QHash<QByteArray, OcspCacheEntry>::const_iterator it = shard.entries.constFind(key);
+            bool found = (it != shard.entries.constEnd());
+            if (found)
+                id.serial = it->serial;
+            shard.mutex.unlock();
+
+            if (!found)
+                continue;
+
+            OcspCertStatus status;
+            qint64 expiresAt, refreshAt;
+            QByteArray response = d->sign(QList<OcspCertId>() << id, &status, &expiresAt, &refreshAt);
+
+            d->store(id, response, status, expiresAt, refreshAt, true);
+        }
+    }
+
+private:
+    OcspResponderPrivate *d;
+    QList<QByteArray> keys;
+};
+
+OcspResponder::Statistics::Statistics()
+    : hits(0),
+      misses(0),
+      refreshes(0),
+      size(0)
+{
+}
+
+/*!
+  \internal
+  Moves \a entry, which is stored under \a key, to time \a at in the
+  schedule. Must be called with the shard's mutex held.
+ */
+void OcspCacheShard::reschedule(const QByteArray &key, OcspCacheEntry &entry, qint64 at)
+{
+    if (entry.scheduledAt)
+        schedule.remove(entry.scheduledAt, key);
+
+    entry.scheduledAt = at;
+    if (at)
+        schedule.insert(at, key);
+}
+
+/*!
+  \internal
+  Removes the entry \a it from the shard and its schedule. Must be called
+  with the shard's mutex held.
+ */
+void OcspCacheShard::remove(QHash<QByteArray, OcspCacheEntry>::iterator it)
+{
+    if (it->scheduledAt)
+        schedule.remove(it->scheduledAt, it.key());
+
+    entries.erase(it);
+}
+
+/*!
+  \internal
+  Makes room for a new entry by removing the unused entry that is due to be
+  refreshed or dropped soonest. Entries that have been requested or were
+  added by prepare() are never removed. Only the first few entries in the
+  schedule are looked at, so this may fail even though there is an unused
+  entry further on. Must be called with the shard's mutex held.
+ */
+bool OcspCacheShard::evictUnused()
+{
+    QMultiMap<qint64, QByteArray>::iterator it = schedule.begin();
+    for (int i = 0; i < 8 && it != schedule.end(); i++, ++it) {
+        QHash<QByteArray, OcspCacheEntry>::iterator entry = entries.find(it.value());
+        if (entry == entries.end() || entry->used || entry->pinned || entry->refreshing)
+            continue;
+
+        remove(entry);
+        return true;
+    }
+
+    return false;
+}
+
+OcspResponderPrivate::OcspResponderPrivate(const IssuerContext &issuer)
+    : issuer(issuer),
+      index(0),
+      capacity(100000),
+      stopping(0),
+      errno(GNUTLS_E_SUCCESS),
+      validity(24 * 60 * 60),
+      margin(60 * 60),
+      batchSize(64),
+      digest(Certificate::DigestDefault),
+      nextWake(0),
+      refresher(0)
+{
+    ensure_gnutls_init();
+
+    if (issuer.isNull()) {
+        errno = issuer.error() ? issuer.error() : GNUTLS_E_INVALID_REQUEST;
+        return;
+    }
+
+    gnutls_datum_t dn;
+    errno = gnutls_x509_crt_get_raw_dn(issuer.d->crt, &dn);
+    if (GNUTLS_E_SUCCESS != errno)
+        return;
+
+    rawName = QByteArray(reinterpret_cast<const char *>(dn.data), dn.size);
+    gnutls_free(dn.data);
+
+    rawKey = crt_to_public_key(issuer.d->crt, &errno);
+    if (GNUTLS_E_SUCCESS != errno)
+        return;
+
+    sha1NameHash = hash(GNUTLS_DIG_SHA1, rawName);
+    sha1KeyHash = hash(GNUTLS_DIG_SHA1, rawKey);
+    sha256NameHash = hash(GNUTLS_DIG_SHA256, rawName);
+    sha256KeyHash = hash(GNUTLS_DIG_SHA256, rawKey);
+
+    algorithm = signingkey_algorithm(issuer.d->key.d.data(), digest, &errno);
+}
+
+bool OcspResponderPrivate::issuerHashes(gnutls_digest_algorithm_t digest,
+                                        QByteArray *nameHash, QByteArray *keyHash) const
+{
+    if (GNUTLS_DIG_SHA1 == digest) {
+        *nameHash = sha1NameHash;
+        *keyHash = sha1KeyHash;
+    }
+    else if (GNUTLS_DIG_SHA256 == digest) {
+        *nameHash = sha256NameHash;
+        *keyHash = sha256KeyHash;
+    }
+    else {
+        *nameHash = hash(digest, rawName);
+        *keyHash = hash(digest, rawKey);
+    }
+
+    return !nameHash->isEmpty() && !keyHash->isEmpty();
+}
+
+OcspCertId OcspResponderPrivate::certId(gnutls_digest_algorithm_t digest, const QByteArray &nameHash,
+                                        const QByteArray &keyHash, const QByteArray &serial) const
+{
+    QByteArray algorithm = der_wrap(DerSequence, der_oid(gnutls_digest_get_oid(digest)) + der_null());
+
+    OcspCertId id;
+    id.serial = serial;
+    id.der = der_wrap(DerSequence,
+                      algorithm
+                      + der_wrap(DerOctetString, nameHash)
+                      + der_wrap(DerOctetString, keyHash)
+                      + der_integer(serial));
+
+    return id;
+}
+
+/*!
+  \internal
+  Extracts the CertIDs from \a request. Returns the responseStatus to send
+  if the request cannot be answered.
+ */
+int OcspResponderPrivate::parseRequest(const QByteArray &request, QList<OcspCertId> *ids) const
+{
+    // The hashes are only missing if the issuer could not be used
+    if (sha1KeyHash.isEmpty())
+        return OcspInternalError;
+
+    gnutls_ocsp_req_t req;
+    if (GNUTLS_E_SUCCESS != gnutls_ocsp_req_init(&req))
+        return OcspInternalError;
+
+    gnutls_datum_t datum;
+    datum.data = reinterpret_cast<unsigned char *>(const_cast<char *>(request.constData()));
+    datum.size = request.size();
+
+    if (GNUTLS_E_SUCCESS != gnutls_ocsp_req_import(req, &datum)) {
+        gnutls_ocsp_req_deinit(req);
+        return OcspMalformedRequest;
+    }
+
+    int status = OcspSuccessful;
+    for (unsigned int i = 0; OcspSuccessful == status; i++) {
+        gnutls_digest_algorithm_t digest;
+        gnutls_datum_t nameHash, keyHash, serial;
+
+        int ret = gnutls_ocsp_req_get_cert_id(req, i, &digest, &nameHash, &keyHash, &serial);
+        if (GNUTLS_E_REQUESTED_DATA_NOT_AVAILABLE == ret)
+            break;
+        if (ret < 0) {
+            status = OcspMalformedRequest;
+            break;
+        }
+
+        QByteArray name(reinterpret_cast<const char *>(nameHash.data), nameHash.size);
+        QByteArray key(reinterpret_cast<const char *>(keyHash.data), keyHash.size);
+        QByteArray number(reinterpret_cast<const char *>(serial.data), serial.size);
+        gnutls_free(nameHash.data);
+        gnutls_free(keyHash.data);
+        gnutls_free(serial.data);
+
+        // Only certificates from our issuer can be answered
+        QByteArray expectedName, expectedKey;
+        if (!issuerHashes(digest, &expectedName, &expectedKey) || name != expectedName || key != expectedKey)
+            status = OcspUnauthorized;
+        else if (serial_to_key(number).isNull())
+            status = OcspMalformedRequest;
+        else
+            ids->append(certId(digest, name, key, number));
+    }
+
+    gnutls_ocsp_req_deinit(req);
+
+    if (OcspSuccessful == status && ids->isEmpty())
+        status = OcspMalformedRequest;
+
+    return status;
+}
+
+OcspCertStatus OcspResponderPrivate::certStatus(const CrlIndex *index, const QByteArray &serial,
+                                                QDateTime *revoked)
+{
+    if (!index)
+        return OcspUnknown;
+
+    uint time;
+    int found = crlindex_lookup(index, serial, &time);
+    if (found < 0)
+        return OcspUnknown;
+    if (!found)
+        return OcspGood;
+
+    if (revoked)
+        *revoked = QDateTime::fromTime_t(time).toUTC();
+    return OcspRevoked;
+}
+
+QByteArray OcspResponderPrivate::singleResponse(const OcspCertId &id, OcspCertStatus status,
+                                                const QDateTime &revoked,
+                                                const QDateTime &thisUpdate, const QDateTime &nextUpdate)
+{
+    // CertStatus ::= CHOICE { good [0], revoked [1], unknown [2] }
+    QByteArray certStatus;
+    if (OcspGood == status)
+        certStatus = der_wrap(DerContext, QByteArray());
+    else if (OcspRevoked == status)
+        certStatus = der_wrap(DerConstructedContext | 1, der_generalized_time(revoked));
+    else
+        certStatus = der_wrap(DerContext | 2, QByteArray());
+
+    return der_wrap(DerSequence,
+                    id.der
+                    + certStatus
+                    + der_generalized_time(thisUpdate)
+                    + der_wrap(DerConstructedContext, der_generalized_time(nextUpdate)));
+}
+
+QByteArray OcspResponderPrivate::errorResponse(OcspResponseStatus status)
+{
+    return der_wrap(DerSequence, der_enumerated(status));
+}
+
+/*!
+  \internal
+  Returns a signed response giving the current status of each of \a ids,
+  or an empty QByteArray if it could not be signed. The status of the first
+  certificate, the time at which the response expires and the time at which
+  it should be signed again are also returned.
+ */
+QByteArray OcspResponderPrivate::sign(const QList<OcspCertId> &ids, OcspCertStatus *status,
+                                      qint64 *expiresAt, qint64 *refreshAt) const
+{
+    settingsMutex.lock();
+    int period = validity;
+    int early = qMin(margin, validity / 2);
+    Certificate::SignatureDigest signatureDigest = digest;
+    QByteArray signatureAlgorithm = algorithm;
+    settingsMutex.unlock();
+
+    const CrlIndex *crls = index.fetchAndAddOrdered(0);
+
+    QDateTime now = QDateTime::currentDateTimeUtc();
+    QDateTime next = now.addSecs(period);
+    *expiresAt = next.toMSecsSinceEpoch();
+    *refreshAt = *expiresAt - qint64(early) * 1000;
+
+    QByteArray singles;
+    for (int i = 0; i < ids.size(); i++) {
+        QDateTime revoked;
+        OcspCertStatus single = certStatus(crls, ids[i].serial, &revoked);
+        if (0 == i)
+            *status = single;
+
+        singles += singleResponse(ids[i], single, revoked, now, next);
+    }
+
+    // ResponseData with the responder identified by the hash of its key
+    QByteArray responderId = der_wrap(DerConstructedContext | 2, der_wrap(DerOctetString, sha1KeyHash));
+    QByteArray tbs = der_wrap(DerSequence,
+                              responderId
+                              + der_generalized_time(now)
+                              + der_wrap(DerSequence, singles));
+
+    int error;
+    QByteArray signature = signingkey_sign(issuer.d->key.d.data(), signatureDigest, tbs, &error);
+    if (GNUTLS_E_SUCCESS != error || signatureAlgorithm.isEmpty())
+        return QByteArray();
+
+    QByteArray basic = der_wrap(DerSequence, tbs + signatureAlgorithm + der_bit_string(signature));
+    QByteArray responseBytes = der_wrap(DerSequence, der_oid(OidPkixOcspBasic) + der_wrap(DerOctetString, basic));
+
+    return der_wrap(DerSequence,
+                    der_enumerated(OcspSuccessful)
+                    + der_wrap(DerConstructedContext, responseBytes));
+}
+
+/*!
+  \internal
+  Puts a newly signed response into the cache. Refreshed responses are
+  discarded if their entry has been removed in the meantime, and new ones
+  if the cache is full and no unused entry can be removed to make room.
+ */
+void OcspResponderPrivate::store(const OcspCertId &id, const QByteArray &response, OcspCertStatus status,
+                                 qint64 expiresAt, qint64 refreshAt, bool refresh)
+{
+    if (stopping.fetchAndAddOrdered(0))
+        return;
+
+    OcspCacheShard &shard = this->shard(id.der);
+    QMutexLocker lock(&shard.mutex);
+
+    QHash<QByteArray, OcspCacheEntry>::iterator it = shard.entries.find(id.der);
+    if (it == shard.entries.end()) {
+        if (refresh)
+            return;
+
+        // When the shard is full, responses nobody has asked for again make
+        // way for new ones
+        int limit = (capacity.fetchAndAddRelaxed(0) + ShardCount - 1) / ShardCount;
+        if (shard.entries.size() >= limit && !shard.evictUnused())
+            return;
+
+        it = shard.entries.insert(id.der, OcspCacheEntry());
+    }
+
+    it->refreshing = false;
+
+    if (response.isEmpty()) {
+        // Try again shortly, the old response is kept until it expires
+        it->refreshAt = QDateTime::currentMSecsSinceEpoch() + 10 * 1000;
+    }
+    else {
+        it->serial = id.serial;
+        it->response = response;
+        it->status = status;
+        it->expiresAt = expiresAt;
+        it->refreshAt = refreshAt;
+        it->used = false;
+
+        if (refresh)
+            shard.refreshes++;
+    }
+
+    qint64 at = it->refreshAt;
+    shard.reschedule(id.der, *it, at);
+    lock.unlock();
+
+    wakeRefresher(at);
+}
+
+/*!
+  \internal
+  Makes sure that the refresh thread wakes up no later than \a at.
+ */
+void OcspResponderPrivate::wakeRefresher(qint64 at)
+{
+    QMutexLocker lock(&refreshMutex);
+
+    if (at < nextWake) {
+        nextWake = at;
+        wake.wakeOne();
+    }
+}
+
+/*!
+  \internal
+  Runs on the refresh thread. Takes the entries that have fallen due from
+  the schedule of each shard, then signs the ones that are still wanted
+  again and drops the expired ones that nobody has asked for.
+ */
+void OcspResponderPrivate::refreshLoop()
+{
+    QMutexLocker lock(&refreshMutex);
+
+    while (!stopping.fetchAndAddOrdered(0)) {
+        qint64 now = QDateTime::currentMSecsSinceEpoch();
+        qint64 next = now + 60 * 1000;
+        nextWake = next;
+        lock.unlock();
+
+        QList<QByteArray> due;
+
+        for (int i = 0; i < ShardCount; i++) {
+            OcspCacheShard &shard = shards[i];
+            QMutexLocker shardLock(&shard.mutex);
+
+            while (!shard.schedule.isEmpty() && shard.schedule.begin().key() <= now) {
+                QByteArray key = shard.schedule.begin().value();
+                shard.schedule.erase(shard.schedule.begin());
+
+                QHash<QByteArray, OcspCacheEntry>::iterator it = shard.entries.find(key);
+                if (it == shard.entries.end())
+                    continue;
+
+                it->scheduledAt = 0;
+
+                if (it->refreshing) {
+                    continue;
+                }
+                else if (it->used || it->pinned) {
+                    it->refreshing = true;
+                    due << key;
+                }
+                else if (it->expiresAt <= now) {
+                    shard.remove(it);
+                }
+                else {
+                    shard.reschedule(key, *it, it->expiresAt);
+                }
+            }
+
+            if (!shard.schedule.isEmpty())
+                next = qMin(next, shard.schedule.begin().key());
+        }
+
+        startBatches(due);
+
+        lock.relock();
+        nextWake = qMin(nextWake, next);
+
+        // Anything stored while the shards were being looked at has lowered
+        // nextWake, so is not missed even though its wakeOne() was
+        qint64 wait = nextWake - QDateTime::currentMSecsSinceEpoch();
+        if (wait > 0 && !stopping.fetchAndAddOrdered(0))
+            wake.wait(&refreshMutex, ulong(wait));
+    }
+}
+
+/*!
+  \internal
+  Signs the responses for the cache entries \a keys on the thread pool.
+ */
+void OcspResponderPrivate::startBatches(const QList<QByteArray> &keys)
+{
+    settingsMutex.lock();
+    int size = batchSize;
+    settingsMutex.unlock();
+
+    for (int i = 0; i < keys.size(); i += size)
+        threadPool.start(new OcspRefreshBatch(this, keys.mid(i, size)));
+}
+
+/*!
+  Creates an OcspResponder answering for certificates issued by \a issuer.
+  Responses are signed using the issuer's key.
+ */
+OcspResponder::OcspResponder(const IssuerContext &issuer)
+    : d(new OcspResponderPrivate(issuer))
+{
+    d->refresher = new OcspRefreshThread(d);
+    d->refresher->start();
+}
+
+/*!
+  Cleans up an OcspResponder. Any responses that are being signed in the
+  background will be waited for, then discarded.
+ */
+OcspResponder::~OcspResponder()
+{
+    d->stopping.fetchAndStoreOrdered(1);
+
+    d->refreshMutex.lock();
+    d->wake.wakeAll();
+    d->refreshMutex.unlock();
+
+    d->refresher->wait();
+    delete d->refresher;
+
+    d->threadPool.waitForDone();
+    delete d;
+}
+
+/*!
+  Returns the error that prevented the responder from being set up. The
+  values used are those of gnutls. If there has not been an error then it
+  is guaranteed to be 0. While there is an error every request is answered
+  with an internalError response.
+ */
+int OcspResponder::error() const
+{
+    QMutexLocker lock(&d->settingsMutex);
+    return d->errno;
+}
+
+/*!
+  Returns a string describing the error that prevented the responder from
+  being set up.
+ */
+QString OcspResponder::errorString() const
+{
+    return QString::fromUtf8(gnutls_strerror(error()));
+}
+
+/*!
+  Sets the CrlIndex that the status of certificates is looked up in. The
+  index must remain valid for as long as the responder uses it. Passing 0
+  causes every certificate to be reported as unknown.
+ */
+void OcspResponder::setCrlIndex(const CrlIndex *index)
+{
+    d->index.fetchAndStoreOrdered(index);
+}
+
+/*!
+  Returns the CrlIndex that the status of certificates is looked up in.
+ */
+const CrlIndex *OcspResponder::crlIndex() const
+{
+    return d->index.fetchAndAddOrdered(0);
+}
+
+/*!
+  Sets the number of seconds between the thisUpdate and nextUpdate times of
+  the responses. Clients may cache a response for this long, so it limits
+  how quickly they learn of a revocation. The default is one day.
+
+  Responses stay in the cache for up to this long too, so together with
+  the number of certificates requested in that time it decides how large
+  the cache grows. The size is limited by setCapacity().
+ */
+void OcspResponder::setValidityPeriod(int seconds)
+{
+    QMutexLocker lock(&d->settingsMutex);
+    d->validity = qMax(1, seconds);
+}
+
+/*!
+  Returns the number of seconds for which responses are valid.
+ */
+int OcspResponder::validityPeriod() const
+{
+    QMutexLocker lock(&d->settingsMutex);
+    return d->validity;
+}
+
+/*!
+  Sets the maximum number of responses kept in the cache to \a entries.
+  Once the cache is full, a new response replaces one that has not been
+  requested since it was signed. If every response has been requested,
+  new ones are answered without being cached. Responses added by prepare()
+  are always kept. Lowering the capacity does not remove responses that are
+  already cached. The default is 100000.
+ */
+void OcspResponder::setCapacity(int entries)
+{
+    d->capacity.fetchAndStoreOrdered(qMax(0, entries));
+}
+
+/*!
+  Returns the maximum number of responses kept in the cache.
+ */
+int OcspResponder::capacity() const
+{
+    return d->capacity.fetchAndAddOrdered(0);
+}
+
+/*!
+  Sets how many seconds before a cached response expires it is signed
+  again. The margin is limited to half of the validity period. The default
+  is one hour.
+ */
+void OcspResponder::setRefreshMargin(int seconds)
+{
+    QMutexLocker lock(&d->settingsMutex);
+    d->margin = qMax(0, seconds);
+}
+
+/*!
+  Returns how many seconds before a cached response expires it is signed
+  again.
+ */
+int OcspResponder::refreshMargin() const
+{
+    QMutexLocker lock(&d->settingsMutex);
+    return d->margin;
+}
+
+/*!
+  Sets the number of responses signed by each background job. Larger
+  batches reduce the scheduling overhead, smaller ones spread the work over
+  more threads. The default is 64.
+ */
+void OcspResponder::setBatchSize(int size)
+{
+    QMutexLocker lock(&d->settingsMutex);
+    d->batchSize = qMax(1, size);
+}
+
+/*!
+  Returns the number of responses signed by each background job.
+ */
+int OcspResponder::batchSize() const
+{
+    QMutexLocker lock(&d->settingsMutex);
+    return d->batchSize;
+}
+
+/*!
+  Sets the maximum number of threads used to sign responses in the
+  background. By default this is the number of cores available.
+ */
+void OcspResponder::setMaxThreadCount(int count)
+{
+    d->threadPool.setMaxThreadCount(count);
+}
+
+/*!
+  Returns the maximum number of threads used to sign responses in the
+  background.
+ */
+int OcspResponder::maxThreadCount() const
+{
+    return d->threadPool.maxThreadCount();
+}
+
+/*!
+  Sets the digest used when signing responses. See
+  CertificateBuilder::setSignatureDigest() for the meaning of the default.
+  Responses that are already cached are not affected.
+ */
+void OcspResponder::setSignatureDigest(Certificate::SignatureDigest digest)
+{
+    QMutexLocker lock(&d->settingsMutex);
+
+    if (d->issuer.isNull())
+        return;
+
+    d->digest = digest;
+    d->algorithm = signingkey_algorithm(d->issuer.d->key.d.data(), digest, &d->errno);
+}
+
+/*!
+  Returns the digest used when signing responses.
+ */
+Certificate::SignatureDigest OcspResponder::signatureDigest() const
+{
+    QMutexLocker lock(&d->settingsMutex);
+    return d->digest;
+}
+
+/*!
+  Starts signing responses for the certificates with the specified
+  \a serials in the background, for requests that identify the certificate
+  using SHA-1 as RFC 5019 requires. These responses are kept and refreshed
+  until clear() is called, even if they are never requested, and are kept
+  even if that takes the cache beyond its capacity().
+ */
+void OcspResponder::prepare(const QList<QByteArray> &serials)
+{
+    if (GNUTLS_E_SUCCESS != error())
+        return;
+
+    QList<QByteArray> keys;
+    foreach (const QByteArray &serial, serials) {
+        if (serial_to_key(serial).isNull())
+            continue;
+
+        OcspCertId id = d->certId(GNUTLS_DIG_SHA1, d->sha1NameHash, d->sha1KeyHash, serial);
+
+        OcspCacheShard &shard = d->shard(id.der);
+        QMutexLocker lock(&shard.mutex);
+
+        OcspCacheEntry &entry = shard.entries[id.der];
+        entry.serial = serial;
+        entry.pinned = true;
+
+        // The batch puts the entry back in the schedule once it is signed
+        if (!entry.refreshing) {
+            entry.refreshing = true;
+            shard.reschedule(id.der, entry, 0);
+            keys << id.der;
+        }
+    }
+
+    d->startBatches(keys);
+}
+
+/*!
+  Waits for up to \a msecs milliseconds for the responses being signed in
+  the background to be finished. Waits forever if \a msecs is -1. Returns
+  true if all of the responses were finished.
+ */
+bool OcspResponder::waitForPrepared(int msecs)
+{
+    return d->threadPool.waitForDone(msecs);
+}
+
+/*!
+  Returns the DER encoded OCSPResponse answering the DER encoded \a request.
+  If the request cannot be parsed, or asks about a certificate from another
+  issuer, an unsigned error response is returned as RFC 6960 requires.
+
+  This may be called from any number of threads at once.
+ */
+QByteArray OcspResponder::respond(const QByteArray &request)
+{
+    QList<OcspCertId> ids;
+    int status = d->parseRequest(request, &ids);
+    if (OcspSuccessful != status)
+        return OcspResponderPrivate::errorResponse(OcspResponseStatus(status));
+
+    OcspCertStatus certStatus;
+    qint64 expiresAt, refreshAt;
+
+    // Requests for several certificates at once are rare, so are not cached
+    if (ids.size() > 1) {
+        QByteArray response = d->sign(ids, &certStatus, &expiresAt, &refreshAt);
+        return response.isEmpty() ? OcspResponderPrivate::errorResponse(OcspInternalError) : response;
+    }
+
+    const OcspCertId &id = ids.first();
+
+    // The CrlIndex does not block, so is asked before any lock is taken
+    OcspCertStatus current = OcspResponderPrivate::certStatus(d->index.fetchAndAddOrdered(0), id.serial, 0);
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+
+    OcspCacheShard &shard = d->shard(id.der);
+    shard.mutex.lock();
+
+    QHash<QByteArray, OcspCacheEntry>::iterator it = shard.entries.find(id.der);
+    if (it != shard.entries.end() && !it->response.isEmpty()
+        && now < it->expiresAt && it->status == current) {
+
+        // An unused entry may have been left to expire, so have it refreshed
+        bool refresh = !it->used && !it->refreshing && it->refreshAt <= now;
+        if (refresh)
+            shard.reschedule(id.der, *it, now);
+
+        it->used = true;
+        shard.hits++;
+
+        QByteArray response = it->response;
+        shard.mutex.unlock();
+
+        if (refresh)
+            d->wakeRefresher(now);
+        return response;
+    }
+
+    shard.misses++;
+
+    // Only the first of several requests for the same CertID signs it
+    QSharedPointer<OcspPendingResponse> pending = shard.pending.value(id.der);
+    if (pending) {
+        while (!pending->finished)
+            pending->done.wait(&shard.mutex);
+        shard.mutex.unlock();
+
+        return pending->response.isEmpty() ? OcspResponderPrivate::errorResponse(OcspInternalError)
+                                           : pending->response;
+    }
+
+    pending = QSharedPointer<OcspPendingResponse>(new OcspPendingResponse);
+    shard.pending.insert(id.der, pending);
+    shard.mutex.unlock();
+
+    QByteArray response = d->sign(QList<OcspCertId>() << id, &certStatus, &expiresAt, &refreshAt);
+    if (!response.isEmpty())
+        d->store(id, response, certStatus, expiresAt, refreshAt, false);
+
+    shard.mutex.lock();
+    pending->response = response;
+    pending->finished = true;
+    shard.pending.remove(id.der);
+    pending->done.wakeAll();
+    shard.mutex.unlock();
+
+    return response.isEmpty() ? OcspResponderPrivate::errorResponse(OcspInternalError) : response;
+}
+
+/*!
+  Returns the statistics for the response cache.
+ */
+OcspResponder::Statistics OcspResponder::statistics() const
+{
+    Statistics stats;
+
+    for (int i = 0; i < OcspResponderPrivate::ShardCount; i++) {
+        OcspCacheShard &shard = d->shards[i];
+        QMutexLocker lock(&shard.mutex);
+
+        stats.hits += shard.hits;
+        stats.misses += shard.misses;
+        stats.refreshes += shard.refreshes;
+        stats.size += shard.entries.size();
+    }
+
+    return stats;
+}
+
+/*!
+  Removes every response from the cache, including those added by
+  prepare().
+ */
+void OcspResponder::clear()
+{
+    for (int i = 0; i < OcspResponderPrivate::ShardCount; i++) {
+        OcspCacheShard &shard = d->shards[i];
+        QMutexLocker lock(&shard.mutex);
+
+        shard.entries.clear();
+        shard.schedule.clear();
+    }
+}
+
+QT_END_NAMESPACE_CERTIFICATE
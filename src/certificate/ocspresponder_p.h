@@ -0,0 +1,213 @@
+/****************************************************************************
+**
+** Copyright (C) 2012-2013 Richard J. Moore <rich@kde.org>
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef OCSPRESPONDER_P_H
+#define OCSPRESPONDER_P_H
+
+#include <QAtomicInt>
+#include <QAtomicPointer>
+#include <QDateTime>
+#include <QHash>
+#include <QMap>
+#include <QMutex>
+#include <QSharedPointer>
+#include <QThread>
+#include <QThreadPool>
+#include <QWaitCondition>
+
+#include <gnutls/gnutls.h>
+
+#include "issuercontext.h"
+
+#include "ocspresponder.h"
+
+QT_BEGIN_NAMESPACE_CERTIFICATE
+
+// responseStatus values from RFC 6960
+enum OcspResponseStatus {
+    OcspSuccessful = 0,
+    OcspMalformedRequest = 1,
+    OcspInternalError = 2,
+    OcspTryLater = 3,
+    OcspSigRequired = 5,
+    OcspUnauthorized = 6
+};
+
+enum OcspCertStatus {
+    OcspGood,
+    OcspRevoked,
+    OcspUnknown
+};
+
+// A CertID from a request, re-encoded so that it can be used as a cache key
+struct OcspCertId
+{
+    QByteArray der;
+    QByteArray serial;
+};
+
+struct OcspCacheEntry
+{
+    OcspCacheEntry()
+        : status(OcspUnknown),
+          expiresAt(0),
+          refreshAt(0),
+          scheduledAt(0),
+          used(false),
+          pinned(false),
+          refreshing(false)
+    {
+    }
+
+    QByteArray serial;
+    QByteArray response;
+    OcspCertStatus status;
+    qint64 expiresAt;
+    qint64 refreshAt;
+
+    // The time this entry is queued under in the shard's schedule, or 0
+    qint64 scheduledAt;
+
+    // Only entries that have been requested since they were signed, or that
+    // were added by prepare(), are signed again before they expire
+    bool used;
+    bool pinned;
+    bool refreshing;
+};
+
+//
+// A miss that is being signed. Other requests for the same CertID wait for
+// it rather than making a signature of their own.
+//
+struct OcspPendingResponse
+{
+    OcspPendingResponse() : finished(false) {}
+
+    QWaitCondition done;
+    QByteArray response;
+    bool finished;
+};
+
+//
+// One part of the response cache. Requests for different CertIDs usually
+// fall in different shards, so do not wait for each other.
+//
+struct OcspCacheShard
+{
+    OcspCacheShard() : hits(0), misses(0), refreshes(0) {}
+
+    void reschedule(const QByteArray &key, OcspCacheEntry &entry, qint64 at);
+    void remove(QHash<QByteArray, OcspCacheEntry>::iterator it);
+    bool evictUnused();
+
+    QMutex mutex;
+    QHash<QByteArray, OcspCacheEntry> entries;
+    QHash<QByteArray, QSharedPointer<OcspPendingResponse> > pending;
+
+    // Entries ordered by when the refresh thread next needs to look at them
+    QMultiMap<qint64, QByteArray> schedule;
+
+    int hits;
+    int misses;
+    int refreshes;
+};
+
+struct OcspResponderPrivate
+{
+    enum { ShardCount = 16 };
+
+    OcspResponderPrivate(const IssuerContext &issuer);
+
+    OcspCacheShard &shard(const QByteArray &key) { return shards[qHash(key) % ShardCount]; }
+
+    bool issuerHashes(gnutls_digest_algorithm_t digest, QByteArray *nameHash, QByteArray *keyHash) const;
+    OcspCertId certId(gnutls_digest_algorithm_t digest, const QByteArray &nameHash,
+                      const QByteArray &keyHash, const QByteArray &serial) const;
+
+    int parseRequest(const QByteArray &request, QList<OcspCertId> *ids) const;
+    static OcspCertStatus certStatus(const CrlIndex *index, const QByteArray &serial, QDateTime *revoked);
+    static QByteArray singleResponse(const OcspCertId &id, OcspCertStatus status, const QDateTime &revoked,
+                                     const QDateTime &thisUpdate, const QDateTime &nextUpdate);
+    static QByteArray errorResponse(OcspResponseStatus status);
+
+    QByteArray sign(const QList<OcspCertId> &ids, OcspCertStatus *status,
+                    qint64 *expiresAt, qint64 *refreshAt) const;
+    void store(const OcspCertId &id, const QByteArray &response, OcspCertStatus status,
+               qint64 expiresAt, qint64 refreshAt, bool refresh);
+
+    void refreshLoop();
+    void wakeRefresher(qint64 at);
+    void startBatches(const QList<QByteArray> &keys);
+
+    // Set up by the constructor and never changed
+    IssuerContext issuer;
+    QByteArray rawName;
+    QByteArray rawKey;
+
+    // Hashes of the issuer's name and public key for CertIDs using SHA-1
+    // and SHA-256, other digests are hashed on demand
+    QByteArray sha1NameHash;
+    QByteArray sha1KeyHash;
+    QByteArray sha256NameHash;
+    QByteArray sha256KeyHash;
+
+    mutable QAtomicPointer<const CrlIndex> index;
+    QAtomicInt capacity;
+    QAtomicInt stopping;
+
+    mutable QMutex settingsMutex;
+    int errno;
+    QByteArray algorithm;
+    int validity;
+    int margin;
+    int batchSize;
+    Certificate::SignatureDigest digest;
+
+    OcspCacheShard shards[ShardCount];
+
+    QMutex refreshMutex;
+    QWaitCondition wake;
+    qint64 nextWake;
+
+    QThreadPool threadPool;
+    QThread *refresher;
+};
+
+QT_END_NAMESPACE_CERTIFICATE
+
+#endif // OCSPRESPONDER_P_H
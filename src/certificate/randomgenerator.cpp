@@ -36,9 +36,20 @@
 **
 ****************************************************************************/
 
+#include <QAtomicInt>
+#include <QThreadStorage>
+
+#include <string.h>
+
+#ifdef Q_OS_UNIX
+#include <pthread.h>
+#endif
+
 #include <gnutls/gnutls.h>
 #include <gnutls/crypto.h>
 
+#include "utils_p.h"
+
 #include "randomgenerator.h"
 
 QT_BEGIN_NAMESPACE_CERTIFICATE
@@ -50,8 +61,91 @@ QT_BEGIN_NAMESPACE_CERTIFICATE
   The RandomGenerator class provides a source of secure random numbers using
   the gnutls rnd API. The numbers are suitable for uses such as certificate
   serial numbers.
+
+  To avoid calling into gnutls for every few bytes, each thread keeps a
+  buffer of random data for the nonce and random levels which is refilled
+  in large blocks. Bytes are cleared from the buffer as they are handed
+  out. The buffer is discarded if the process has forked since it was
+  filled, so a child process never returns the same values as its parent.
+  Data at the key level is never buffered.
 */
 
+/*!
+  \enum RandomGenerator::RandomLevel
+
+  \value LevelNonce Unpredictable data suitable for nonces.
+  \value LevelRandom Data suitable for values such as serial numbers.
+  \value LevelKey Data suitable for generating keys. This is always
+  requested directly from gnutls.
+*/
+
+static const int RandomPoolSize = 4096;
+
+// Incremented in the child each time the process forks
+static QBasicAtomicInt forkGeneration = Q_BASIC_ATOMIC_INITIALIZER(0);
+
+#ifdef Q_OS_UNIX
+static pthread_once_t forkHandlerOnce = PTHREAD_ONCE_INIT;
+
+static void random_fork_child()
+{
+    forkGeneration.fetchAndAddRelaxed(1);
+}
+
+static void random_register_fork_handler()
+{
+    pthread_atfork(0, 0, random_fork_child);
+}
+#endif
+
+struct RandomPool
+{
+    RandomPool()
+        : generation(forkGeneration.fetchAndAddRelaxed(0))
+    {
+        used[0] = used[1] = RandomPoolSize;
+    }
+
+    ~RandomPool()
+    {
+        gnutls_memset(data, 0, sizeof(data));
+    }
+
+    int generation;
+    int used[2];
+    char data[2][RandomPoolSize];
+};
+
+static RandomPool *random_pool()
+{
+    static QThreadStorage<RandomPool *> pools;
+
+    if (!pools.hasLocalData()) {
+#ifdef Q_OS_UNIX
+        pthread_once(&forkHandlerOnce, random_register_fork_handler);
+#endif
+        pools.setLocalData(new RandomPool);
+    }
+
+    return pools.localData();
+}
+
+static gnutls_rnd_level_t level_to_gnutls(RandomGenerator::RandomLevel level)
+{
+    switch(level) {
+    case RandomGenerator::LevelNonce:
+        return GNUTLS_RND_NONCE;
+    case RandomGenerator::LevelRandom:
+        return GNUTLS_RND_RANDOM;
+    case RandomGenerator::LevelKey:
+        return GNUTLS_RND_KEY;
+    default:
+        qWarning("Unknown random level %d", int(level));
+    }
+
+    return GNUTLS_RND_KEY;
+}
+
 /*!
   Generates a set of random bytes of the specified size. In order to allow
   these to be conveniently used as serial numbers, this method ensures that
@@ -66,15 +160,71 @@ QByteArray RandomGenerator::getPositiveBytes(int size)
 {
     QByteArray result(size, 0);
 
-    int errno = gnutls_rnd(GNUTLS_RND_RANDOM, result.data(), size);
-    if (GNUTLS_E_SUCCESS != errno)
+    if (!fillPositive(result.data(), size))
         return QByteArray();
 
+    return result;
+}
+
+/*!
+  Fills \a buffer with \a size random bytes of the specified \a level. This
+  avoids allocating a QByteArray for each value, which is useful when
+  generating large numbers of serial numbers or nonces. Returns false if
+  the random data could not be generated, in which case the contents of
+  the buffer are undefined.
+ */
+bool RandomGenerator::fill(char *buffer, int size, RandomLevel level)
+{
+    if (size <= 0)
+        return size == 0;
+
+    // Large requests and key material go straight to gnutls
+    if (LevelKey == level || size > RandomPoolSize / 4)
+        return GNUTLS_E_SUCCESS == gnutls_rnd(level_to_gnutls(level), buffer, size);
+
+    RandomPool *pool = random_pool();
+
+    // Never share buffered data with a forked child
+    int generation = forkGeneration.fetchAndAddRelaxed(0);
+    if (generation != pool->generation) {
+        gnutls_memset(pool->data, 0, sizeof(pool->data));
+        pool->used[0] = pool->used[1] = RandomPoolSize;
+        pool->generation = generation;
+    }
+
+    const int index = (LevelNonce == level) ? 0 : 1;
+    char *data = pool->data[index];
+
+    if (pool->used[index] + size > RandomPoolSize) {
+        ensure_gnutls_init();
+        if (GNUTLS_E_SUCCESS != gnutls_rnd(level_to_gnutls(level), data, RandomPoolSize))
+            return false;
+        pool->used[index] = 0;
+    }
+
+    char *start = data + pool->used[index];
+    memcpy(buffer, start, size);
+    memset(start, 0, size);
+    pool->used[index] += size;
+
+    return true;
+}
+
+/*!
+  Fills \a buffer in the same way as fill(), then clears the top bit of the
+  first byte so that the value is positive when treated as a big-endian
+  integer, as required for serial numbers.
+ */
+bool RandomGenerator::fillPositive(char *buffer, int size, RandomLevel level)
+{
+    if (!fill(buffer, size, level))
+        return false;
+
     // Clear the top bit to ensure the number is positive
-    char *data = result.data();
-    *data = *data & 0x07f;
+    if (size > 0)
+        *buffer = *buffer & 0x07f;
 
-    return result;
+    return true;
 }
 
 QT_END_NAMESPACE_CERTIFICATE
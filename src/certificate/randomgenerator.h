@@ -48,8 +48,17 @@ QT_BEGIN_NAMESPACE_CERTIFICATE
 class Q_CERTIFICATE_EXPORT RandomGenerator
 {
 public:
+    enum RandomLevel {
+        LevelNonce,
+        LevelRandom,
+        LevelKey
+    };
+
     static QByteArray getPositiveBytes(int size);
 
+    static bool fill(char *buffer, int size, RandomLevel level=LevelRandom);
+    static bool fillPositive(char *buffer, int size, RandomLevel level=LevelRandom);
+
 private:
     RandomGenerator() {}
     ~RandomGenerator() {}
@@ -0,0 +1,228 @@
+/****************************************************************************
+**
+** Copyright (C) 2012-2013 Richard J. Moore <rich@kde.org>
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include <gnutls/gnutls.h>
+
+#include <QAtomicInt>
+#include <QThreadStorage>
+
+#include <stdlib.h>
+
+#ifdef Q_OS_UNIX
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "securememory_p.h"
+
+QT_BEGIN_NAMESPACE_CERTIFICATE
+
+static const int ArenaSize = 16384; // Enough for the DER of any key we generate
+
+static QAtomicInt lockMemory(0);
+
+/*!
+  \internal
+  Zeros memory in a way that will not be optimised away.
+ */
+void secure_zero(void *data, size_t size)
+{
+    if (data && size)
+        gnutls_memset(data, 0, size);
+}
+
+/*!
+  \internal
+  Zeros the contents of a QByteArray. If the data is shared with another
+  QByteArray, for example one held inside a QSslKey, then it is left alone
+  since it is still in use.
+ */
+void secure_zero(QByteArray &ba)
+{
+    if (ba.isEmpty() || !ba.isDetached())
+        return;
+
+    secure_zero(ba.data(), ba.size());
+}
+
+void set_secure_memory_locked(bool lock)
+{
+    lockMemory.fetchAndStoreRelaxed(lock ? 1 : 0);
+}
+
+bool secure_memory_locked()
+{
+    return lockMemory.fetchAndAddRelaxed(0) != 0;
+}
+
+SecureBlock SecureBlock::allocate(int size)
+{
+    SecureBlock block;
+
+#ifdef Q_OS_UNIX
+    long page = sysconf(_SC_PAGESIZE);
+    size = int((size + page - 1) / page * page);
+
+    void *p = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+    if (MAP_FAILED == p)
+        return block;
+
+#ifdef MADV_DONTDUMP
+    // Keep key material out of core dumps
+    madvise(p, size, MADV_DONTDUMP);
+#endif
+
+    // Locking can fail if RLIMIT_MEMLOCK is low, the memory is still zeroed
+    if (secure_memory_locked())
+        block.locked = (0 == mlock(p, size));
+#else
+    void *p = ::malloc(size);
+    if (!p)
+        return block;
+#endif
+
+    block.data = static_cast<char *>(p);
+    block.size = size;
+    return block;
+}
+
+void SecureBlock::release()
+{
+    if (!data)
+        return;
+
+    secure_zero(data, size);
+
+#ifdef Q_OS_UNIX
+    if (locked)
+        munlock(data, size);
+    munmap(data, size);
+#else
+    ::free(data);
+#endif
+
+    data = 0;
+    size = 0;
+    locked = false;
+}
+
+class SecureArena
+{
+public:
+    SecureArena()
+        : used(0)
+    {
+    }
+
+    ~SecureArena()
+    {
+        block.release();
+    }
+
+    static SecureArena *local();
+
+    SecureBlock block;
+    int used;
+};
+
+SecureArena *SecureArena::local()
+{
+    static QThreadStorage<SecureArena *> arenas;
+
+    if (!arenas.hasLocalData())
+        arenas.setLocalData(new SecureArena);
+
+    return arenas.localData();
+}
+
+SecureScope::SecureScope()
+    : arena(SecureArena::local())
+{
+    mark = arena->used;
+
+#ifdef Q_OS_UNIX
+    // Bring an idle arena into line with the current locking setting
+    SecureBlock &block = arena->block;
+    if (block.data && 0 == arena->used && block.locked != secure_memory_locked()) {
+        if (block.locked)
+            block.locked = (0 != munlock(block.data, block.size));
+        else
+            block.locked = (0 == mlock(block.data, block.size));
+    }
+#endif
+}
+
+SecureScope::~SecureScope()
+{
+    secure_zero(arena->block.data + mark, arena->used - mark);
+    arena->used = mark;
+
+    for (int i = 0; i < overflow.size(); i++)
+        overflow[i].release();
+}
+
+/*!
+  \internal
+  Returns size bytes of memory that will be zeroed when this scope is
+  destroyed, or 0 if no memory could be allocated. Requests that do not fit
+  in the arena are given a block of their own.
+ */
+char *SecureScope::allocate(int size)
+{
+    if (size < 0)
+        return 0;
+
+    if (!arena->block.data)
+        arena->block = SecureBlock::allocate(ArenaSize);
+
+    int aligned = (size + 15) & ~15;
+    if (arena->block.data && arena->used + aligned <= arena->block.size) {
+        char *p = arena->block.data + arena->used;
+        arena->used += aligned;
+        return p;
+    }
+
+    SecureBlock block = SecureBlock::allocate(qMax(size, 1));
+    if (!block.data)
+        return 0;
+
+    overflow << block;
+    return block.data;
+}
+
+QT_END_NAMESPACE_CERTIFICATE
@@ -0,0 +1,90 @@
+/****************************************************************************
+**
+** Copyright (C) 2012-2013 Richard J. Moore <rich@kde.org>
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef SECUREMEMORY_P_H
+#define SECUREMEMORY_P_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QList>
+
+#include "certificate_global.h"
+
+QT_BEGIN_NAMESPACE_CERTIFICATE
+
+void secure_zero(void *data, size_t size);
+void secure_zero(QByteArray &ba);
+
+void set_secure_memory_locked(bool lock);
+bool secure_memory_locked();
+
+struct SecureBlock
+{
+    SecureBlock() : data(0), size(0), locked(false) {}
+
+    static SecureBlock allocate(int size);
+    void release();
+
+    char *data;
+    int size;
+    bool locked;
+};
+
+class SecureArena;
+
+// Hands out memory for key material from a per-thread arena. Everything
+// allocated through a scope is zeroed when the scope is destroyed, and the
+// arena is locked into RAM if set_secure_memory_locked() has been enabled.
+class SecureScope
+{
+public:
+    SecureScope();
+    ~SecureScope();
+
+    char *allocate(int size);
+
+private:
+    Q_DISABLE_COPY(SecureScope)
+
+    SecureArena *arena;
+    int mark;
+    QList<SecureBlock> overflow;
+};
+
+QT_END_NAMESPACE_CERTIFICATE
+
+#endif // SECUREMEMORY_P_H
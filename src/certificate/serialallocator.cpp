@@ -0,0 +1,828 @@
+/****************************************************************************
+**
+** Copyright (C) 2012-2013 Richard J. Moore <rich@kde.org>
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include <QDir>
+#include <QMutexLocker>
+#include <QReadLocker>
+#include <QWriteLocker>
+#if QT_VERSION >= 0x050100
+#include <QSaveFile>
+#endif
+
+#include <algorithm>
+#include <string.h>
+
+#ifdef Q_OS_WIN
+#include <io.h>
+#include <windows.h>
+#else
+#include <stdio.h>
+#include <unistd.h>
+#endif
+
+#include <gnutls/gnutls.h>
+
+#include "randomgenerator.h"
+#include "utils_p.h"
+
+#include "serialallocator_p.h"
+
+QT_BEGIN_NAMESPACE_CERTIFICATE
+
+/*!
+  \class SerialAllocator
+  \brief The SerialAllocator class hands out random serial numbers that are
+  guaranteed never to have been used before.
+
+  Random serial numbers are very unlikely to collide, but at high volumes
+  a CA needs to be certain. SerialAllocator records every serial it
+  allocates for an issuer and checks each new random serial against that
+  record before returning it.
+
+  The record is kept in two files. The index file holds the serials in
+  sorted order and is memory mapped, so it is searched without being read
+  into memory. Serials allocated since the index was last rewritten are
+  appended to a journal alongside it (the file name with .journal added)
+  and replayed when the allocator is next opened. flush() merges the
+  journal into the index. The journal is synced to disk before any serial
+  is returned, so a serial is never handed out twice, even after a crash.
+
+  Most lookups never touch the index at all: the serials are split into
+  shards, each with a bloom filter, and a serial that the filter has not
+  seen is known to be unused. Each shard has its own lock and candidates
+  are generated before any lock is taken, so many threads can allocate at
+  once. allocate(int) takes each lock at most once for a whole batch,
+  which suits the worker threads of a BatchIssuer.
+*/
+
+static const char IndexMagic[] = "QCSERIAL";
+static const int IndexHeaderSize = 16;
+
+static const int BloomHashes = 7;
+static const int BloomBitsPerSerial = 10;
+static const qint64 MinShardCapacity = 4096;
+
+static void bloom_hashes(const char *serial, int size, quint64 *h1, quint64 *h2)
+{
+    // FNV-1a, with a second value derived from it for double hashing
+    quint64 h = Q_UINT64_C(14695981039346656037);
+    for (int i = 0; i < size; i++) {
+        h ^= uchar(serial[i]);
+        h *= Q_UINT64_C(1099511628211);
+    }
+
+    *h1 = h;
+    *h2 = ((h >> 33) | (h << 31)) * Q_UINT64_C(0xff51afd7ed558ccd) | 1;
+}
+
+static void bloom_init(SerialBloomFilter &filter, qint64 serials)
+{
+    // Leave plenty of room for growth before the next rebuild
+    filter.capacity = qMax(MinShardCapacity, serials * 2);
+
+    quint64 bits = 64;
+    while (bits < quint64(filter.capacity * BloomBitsPerSerial))
+        bits <<= 1;
+
+    filter.bits.fill(0, int(bits / 64));
+    filter.mask = bits - 1;
+}
+
+static void bloom_add(SerialBloomFilter &filter, const char *serial, int size)
+{
+    quint64 h1, h2;
+    bloom_hashes(serial, size, &h1, &h2);
+
+    for (int i = 0; i < BloomHashes; i++) {
+        quint64 bit = (h1 + i * h2) & filter.mask;
+        filter.bits[int(bit >> 6)] |= Q_UINT64_C(1) << (bit & 63);
+    }
+}
+
+static bool bloom_test(const SerialBloomFilter &filter, const char *serial, int size)
+{
+    quint64 h1, h2;
+    bloom_hashes(serial, size, &h1, &h2);
+
+    for (int i = 0; i < BloomHashes; i++) {
+        quint64 bit = (h1 + i * h2) & filter.mask;
+        if (!(filter.bits.at(int(bit >> 6)) & (Q_UINT64_C(1) << (bit & 63))))
+            return false;
+    }
+
+    return true;
+}
+
+/*!
+  \internal
+  Waits until the data written to the file \a handle is on the disk.
+  QFile::flush() only hands it to the operating system.
+ */
+static bool sync_file(int handle)
+{
+#if defined(Q_OS_WIN)
+    return 0 != FlushFileBuffers(reinterpret_cast<HANDLE>(_get_osfhandle(handle)));
+#elif defined(Q_OS_LINUX)
+    return 0 == fdatasync(handle);
+#else
+    return 0 == fsync(handle);
+#endif
+}
+
+#if QT_VERSION < 0x050100
+/*!
+  \internal
+  Moves \a from over \a to in a single step, so that a crash leaves either
+  the old file or the new one. QFile::rename() will not replace an
+  existing file, and removing it first leaves a window with neither.
+ */
+static bool replace_file(const QString &from, const QString &to)
+{
+#if defined(Q_OS_WIN)
+    QString nativeFrom = QDir::toNativeSeparators(from);
+    QString nativeTo = QDir::toNativeSeparators(to);
+    return 0 != MoveFileExW(reinterpret_cast<const wchar_t *>(nativeFrom.utf16()),
+                            reinterpret_cast<const wchar_t *>(nativeTo.utf16()),
+                            MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+#else
+    return 0 == ::rename(QFile::encodeName(from).constData(), QFile::encodeName(to).constData());
+#endif
+}
+#endif
+
+struct SerialLessThan
+{
+    SerialLessThan(int size) : size(size) {}
+
+    bool operator()(const QByteArray &a, const QByteArray &b) const
+    {
+        return memcmp(a.constData(), b.constData(), size) < 0;
+    }
+
+    int size;
+};
+
+SerialAllocatorPrivate::SerialAllocatorPrivate(const QString &fileName, int serialSize)
+    : fileName(fileName),
+      serialSize(serialSize),
+      errno(GNUTLS_E_SUCCESS),
+      opened(false),
+      indexGeneration(0),
+      indexFile(0),
+      records(0),
+      recordCount(0),
+      journalFile(fileName + QLatin1String(".journal"))
+{
+}
+
+SerialAllocatorPrivate::~SerialAllocatorPrivate()
+{
+    delete indexFile;
+}
+
+int SerialAllocatorPrivate::shardIndex(const char *serial)
+{
+    // Serials are positive, so skip the top bit. Using the leading bits
+    // keeps each shard's part of the index contiguous.
+    return (uchar(serial[0]) >> 3) & (SerialShardCount - 1);
+}
+
+bool SerialAllocatorPrivate::open()
+{
+    if (serialSize < 1) {
+        errno.fetchAndStoreRelaxed(GNUTLS_E_INVALID_REQUEST);
+        return false;
+    }
+
+    if (!mapIndex() || !loadJournal())
+        return false;
+
+    rebuildFilters();
+
+    opened = true;
+    return true;
+}
+
+/*!
+  \internal
+  Maps the index file, creating an empty one if it does not exist. The
+  current mapping is only given up once the new one is in place, so it is
+  still usable if this fails.
+ */
+bool SerialAllocatorPrivate::mapIndex()
+{
+    QFile *file = new QFile(fileName);
+    const uchar *mapped = 0;
+    qint64 count = 0;
+
+    if (file->exists()) {
+        if (!file->open(QIODevice::ReadOnly)) {
+            delete file;
+            errno.fetchAndStoreRelaxed(GNUTLS_E_FILE_ERROR);
+            return false;
+        }
+
+        qint64 size = file->size();
+        if (size) {
+            QByteArray header = file->read(IndexHeaderSize);
+            if (header.size() != IndexHeaderSize || !header.startsWith(IndexMagic)
+                || uchar(header.at(8)) != uchar(serialSize >> 24) || uchar(header.at(9)) != uchar(serialSize >> 16)
+                || uchar(header.at(10)) != uchar(serialSize >> 8) || uchar(header.at(11)) != uchar(serialSize)
+                || (size - IndexHeaderSize) % serialSize) {
+                delete file;
+                errno.fetchAndStoreRelaxed(GNUTLS_E_FILE_ERROR);
+                return false;
+            }
+
+            count = (size - IndexHeaderSize) / serialSize;
+        }
+
+        if (count) {
+            mapped = file->map(0, size);
+            if (!mapped) {
+                delete file;
+                errno.fetchAndStoreRelaxed(GNUTLS_E_FILE_ERROR);
+                return false;
+            }
+        }
+    }
+
+    QWriteLocker lock(&indexLock);
+
+    if (indexFile) {
+        if (records)
+            indexFile->unmap(const_cast<uchar *>(records - IndexHeaderSize));
+        delete indexFile;
+    }
+
+    indexFile = file;
+    records = mapped ? mapped + IndexHeaderSize : 0;
+    recordCount = count;
+    indexGeneration++;
+    return true;
+}
+
+/*!
+  \internal
+  Replays the serials allocated since the last flush.
+ */
+bool SerialAllocatorPrivate::loadJournal()
+{
+    if (!journalFile.open(QIODevice::ReadWrite)) {
+        errno.fetchAndStoreRelaxed(GNUTLS_E_FILE_ERROR);
+        return false;
+    }
+
+    QByteArray data = journalFile.readAll();
+
+    // Drop anything partially written by a crash so new entries line up
+    int whole = data.size() - data.size() % serialSize;
+    if (whole != data.size())
+        journalFile.resize(whole);
+    journalFile.seek(whole);
+
+    // A flush whose index could not be mapped leaves serials in both
+    for (int offset = 0; offset < whole; offset += serialSize) {
+        QByteArray serial(data.constData() + offset, serialSize);
+        if (!indexContains(serial.constData()))
+            shards[shardIndex(serial.constData())].journal.insert(serial);
+    }
+
+    return true;
+}
+
+const char *SerialAllocatorPrivate::record(qint64 index) const
+{
+    return reinterpret_cast<const char *>(records) + index * serialSize;
+}
+
+/*!
+  \internal
+  Returns the position of the first record in the index whose first byte
+  is at least \a firstByte.
+ */
+qint64 SerialAllocatorPrivate::lowerBound(int firstByte) const
+{
+    qint64 low = 0;
+    qint64 high = recordCount;
+
+    while (low < high) {
+        qint64 mid = low + (high - low) / 2;
+        if (uchar(*record(mid)) < firstByte)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    return low;
+}
+
+/*!
+  \internal
+  Returns a bloom filter holding the serials in the index that belong to
+  \a shard, with room for \a journalSize more, and stores how many there
+  were in \a indexCount. The index is sorted, so the shard's serials are
+  found by a binary search and only they are read. The caller must hold
+  either the index lock or every shard lock.
+ */
+SerialBloomFilter SerialAllocatorPrivate::indexFilter(int shard, qint64 journalSize, qint64 *indexCount) const
+{
+    // The shard is given by bits 3 to 6 of the first byte. Serials are
+    // normally positive, but reserve() accepts any, so the values with the
+    // top bit set make a second range.
+    qint64 begin[2];
+    qint64 end[2];
+    *indexCount = 0;
+    for (int i = 0; i < 2; i++) {
+        int first = i * 0x80 + shard * 8;
+        begin[i] = lowerBound(first);
+        end[i] = lowerBound(first + 8);
+        *indexCount += end[i] - begin[i];
+    }
+
+    SerialBloomFilter filter;
+    bloom_init(filter, *indexCount + journalSize);
+
+    for (int i = 0; i < 2; i++) {
+        for (qint64 r = begin[i]; r < end[i]; r++)
+            bloom_add(filter, record(r), serialSize);
+    }
+
+    return filter;
+}
+
+/*!
+  \internal
+  Recreates the bloom filters of all the shards. The caller must hold
+  every shard lock.
+ */
+void SerialAllocatorPrivate::rebuildFilters()
+{
+    for (int i = 0; i < SerialShardCount; i++) {
+        SerialShard &shard = shards[i];
+
+        qint64 indexCount;
+        shard.filter = indexFilter(i, shard.journal.size(), &indexCount);
+
+        QSet<QByteArray>::const_iterator it = shard.journal.constBegin();
+        for (; it != shard.journal.constEnd(); ++it)
+            bloom_add(shard.filter, it->constData(), serialSize);
+
+        shard.count = indexCount + shard.journal.size();
+        shard.rebuilding = false;
+    }
+}
+
+/*!
+  \internal
+  Recreates the bloom filter of \a shard once it has outgrown it. The
+  caller must not hold the shard lock: the index is read without it, so
+  other threads can keep allocating from the shard using the old filter,
+  and the lock is only taken again to add the journal and swap the new
+  filter in.
+ */
+void SerialAllocatorPrivate::rebuildFilter(int index)
+{
+    SerialShard &shard = shards[index];
+
+    shard.mutex.lock();
+    const int generation = indexGeneration;
+    const qint64 journalSize = shard.journal.size();
+    shard.mutex.unlock();
+
+    qint64 indexCount;
+    indexLock.lockForRead();
+    SerialBloomFilter filter = indexFilter(index, journalSize, &indexCount);
+    indexLock.unlock();
+
+    QMutexLocker lock(&shard.mutex);
+
+    // A flush in the meantime has already rebuilt every filter
+    if (generation != indexGeneration)
+        return;
+
+    QSet<QByteArray>::const_iterator it = shard.journal.constBegin();
+    for (; it != shard.journal.constEnd(); ++it)
+        bloom_add(filter, it->constData(), serialSize);
+
+    shard.filter = filter;
+    shard.rebuilding = false;
+}
+
+bool SerialAllocatorPrivate::indexContains(const char *serial) const
+{
+    qint64 low = 0;
+    qint64 high = recordCount;
+
+    while (low < high) {
+        qint64 mid = low + (high - low) / 2;
+        int cmp = memcmp(record(mid), serial, serialSize);
+        if (0 == cmp)
+            return true;
+        if (cmp < 0)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    return false;
+}
+
+bool SerialAllocatorPrivate::containsLocked(SerialShard &shard, const QByteArray &serial) const
+{
+    if (!bloom_test(shard.filter, serial.constData(), serialSize))
+        return false;
+
+    return shard.journal.contains(serial) || indexContains(serial.constData());
+}
+
+/*!
+  \internal
+  Records \a serial in \a shard. Returns true if the shard has outgrown its
+  bloom filter and the caller should rebuild it once the lock is released.
+ */
+bool SerialAllocatorPrivate::insertLocked(SerialShard &shard, const QByteArray &serial)
+{
+    shard.journal.insert(serial);
+    shard.count++;
+
+    // The filter stays correct when it is overfull, it just gives more
+    // false positives until the new one is ready
+    bloom_add(shard.filter, serial.constData(), serialSize);
+
+    if (shard.rebuilding || shard.count <= shard.filter.capacity)
+        return false;
+
+    shard.rebuilding = true;
+    return true;
+}
+
+/*!
+  \internal
+  Records the candidates that have not been used before and returns them.
+  Each shard is locked once for the whole batch.
+ */
+QList<QByteArray> SerialAllocatorPrivate::insert(const QList<QByteArray> &candidates)
+{
+    QList<QByteArray> byShard[SerialShardCount];
+    for (int i = 0; i < candidates.size(); i++)
+        byShard[shardIndex(candidates.at(i).constData())] << candidates.at(i);
+
+    QList<QByteArray> accepted;
+    for (int i = 0; i < SerialShardCount; i++) {
+        if (byShard[i].isEmpty())
+            continue;
+
+        SerialShard &shard = shards[i];
+        QMutexLocker lock(&shard.mutex);
+        bool rebuild = false;
+
+        for (int j = 0; j < byShard[i].size(); j++) {
+            const QByteArray &serial = byShard[i].at(j);
+            if (containsLocked(shard, serial))
+                continue;
+
+            if (insertLocked(shard, serial))
+                rebuild = true;
+            accepted << serial;
+        }
+
+        lock.unlock();
+        if (rebuild)
+            rebuildFilter(i);
+    }
+
+    return accepted;
+}
+
+bool SerialAllocatorPrivate::writeJournal(const QList<QByteArray> &serials)
+{
+    QByteArray data;
+    data.reserve(serials.size() * serialSize);
+    for (int i = 0; i < serials.size(); i++)
+        data += serials.at(i);
+
+    journalMutex.lock();
+    bool ok = journalFile.write(data) == data.size() && journalFile.flush();
+    int handle = journalFile.handle();
+    journalMutex.unlock();
+
+    // Outside the lock, so that threads appending at the same time can
+    // share the cost of getting their serials onto the disk
+    if (!ok || !sync_file(handle)) {
+        errno.fetchAndStoreRelaxed(GNUTLS_E_FILE_ERROR);
+        return false;
+    }
+
+    return true;
+}
+
+/*!
+  Creates a SerialAllocator that records its serials in \a fileName, and
+  allocates serials of \a serialSize bytes. Existing records are loaded if
+  the files already exist. If they cannot be opened, or were created with
+  a different serial size, then error() will report GNUTLS_E_FILE_ERROR and
+  no serials will be allocated.
+ */
+SerialAllocator::SerialAllocator(const QString &fileName, int serialSize)
+    : d(new SerialAllocatorPrivate(fileName, serialSize))
+{
+    d->open();
+}
+
+/*!
+  Cleans up a SerialAllocator. Serials allocated since the last flush()
+  remain in the journal and are loaded again next time.
+ */
+SerialAllocator::~SerialAllocator()
+{
+    delete d;
+}
+
+/*!
+  Returns the last error that occurred when using this object. The values
+  used are those of gnutls. If there has not been an error then it is
+  guaranteed to be 0.
+ */
+int SerialAllocator::error() const
+{
+    return atomic_load_acquire(d->errno);
+}
+
+/*!
+  Returns a string describing the last error that occurred when using
+  this object.
+ */
+QString SerialAllocator::errorString() const
+{
+    return QString::fromUtf8(gnutls_strerror(error()));
+}
+
+/*!
+  Returns the name of the index file.
+ */
+QString SerialAllocator::fileName() const
+{
+    return d->fileName;
+}
+
+/*!
+  Returns the size in bytes of the serials allocated.
+ */
+int SerialAllocator::serialSize() const
+{
+    return d->serialSize;
+}
+
+/*!
+  Returns the number of serials that have been recorded.
+ */
+qint64 SerialAllocator::count() const
+{
+    qint64 total = 0;
+    for (int i = 0; i < SerialShardCount; i++) {
+        QMutexLocker lock(&d->shards[i].mutex);
+        total += d->shards[i].count;
+    }
+
+    return total;
+}
+
+/*!
+  Returns true if \a serial has already been recorded.
+ */
+bool SerialAllocator::contains(const QByteArray &serial) const
+{
+    if (!d->opened || serial.size() != d->serialSize)
+        return false;
+
+    SerialShard &shard = d->shards[SerialAllocatorPrivate::shardIndex(serial.constData())];
+    QMutexLocker lock(&shard.mutex);
+
+    return d->containsLocked(shard, serial);
+}
+
+/*!
+  Records \a serial as used, for example when importing the serials of
+  certificates that were issued before the allocator was introduced.
+  Returns false if the serial was already recorded or could not be saved.
+ */
+bool SerialAllocator::reserve(const QByteArray &serial)
+{
+    if (!d->opened || serial.size() != d->serialSize) {
+        d->errno.fetchAndStoreRelaxed(GNUTLS_E_INVALID_REQUEST);
+        return false;
+    }
+
+    QList<QByteArray> accepted = d->insert(QList<QByteArray>() << serial);
+    if (accepted.isEmpty())
+        return false;
+
+    return d->writeJournal(accepted);
+}
+
+/*!
+  Returns a new random serial that has never been returned before. The
+  serial is positive (ie. the top bit is clear). If a serial cannot be
+  allocated then a null QByteArray is returned.
+ */
+QByteArray SerialAllocator::allocate()
+{
+    QList<QByteArray> serials = allocate(1);
+    if (serials.isEmpty())
+        return QByteArray();
+
+    return serials.first();
+}
+
+/*!
+  Returns \a count new random serials. This is considerably cheaper than
+  calling allocate() repeatedly since the random data is generated in one
+  go, each shard is locked only once, and the journal is written once.
+  Either all of the serials requested are returned or none of them.
+ */
+QList<QByteArray> SerialAllocator::allocate(int count)
+{
+    QList<QByteArray> result;
+    if (!d->opened || count <= 0)
+        return result;
+
+    const int size = d->serialSize;
+
+    while (result.size() < count) {
+        int needed = count - result.size();
+
+        // Generate the candidates before taking any locks
+        QByteArray block(needed * size, 0);
+        if (!RandomGenerator::fill(block.data(), block.size())) {
+            d->errno.fetchAndStoreRelaxed(GNUTLS_E_RANDOM_FAILED);
+            return QList<QByteArray>();
+        }
+
+        QList<QByteArray> candidates;
+        for (int i = 0; i < needed; i++) {
+            char *serial = block.data() + i * size;
+            *serial = *serial & 0x07f;
+            candidates << QByteArray(serial, size);
+        }
+
+        // Anything rejected as a duplicate is simply replaced next time round
+        result += d->insert(candidates);
+    }
+
+    if (!d->writeJournal(result))
+        return QList<QByteArray>();
+
+    return result;
+}
+
+/*!
+  Merges the journal into the sorted index file and empties the journal.
+  Allocation is blocked while this happens, so it is best done when the
+  allocator is idle, or periodically to stop the journal growing too
+  large. Returns false if the index could not be written, in which case
+  the existing files are left unchanged. If the new index is written but
+  cannot be mapped then false is also returned, the allocator carries on
+  using the old index and the journal, and the next flush() tries again.
+ */
+bool SerialAllocator::flush()
+{
+    if (!d->opened)
+        return false;
+
+    QMutexLocker journalLock(&d->journalMutex);
+    for (int i = 0; i < SerialShardCount; i++)
+        d->shards[i].mutex.lock();
+
+    QVector<QByteArray> pending;
+    for (int i = 0; i < SerialShardCount; i++) {
+        QSet<QByteArray>::const_iterator it = d->shards[i].journal.constBegin();
+        for (; it != d->shards[i].journal.constEnd(); ++it)
+            pending << *it;
+    }
+
+    std::sort(pending.begin(), pending.end(), SerialLessThan(d->serialSize));
+
+    bool ok = true;
+
+#if QT_VERSION >= 0x050100
+    QSaveFile out(d->fileName);
+#else
+    QFile out(d->fileName + QLatin1String(".tmp"));
+#endif
+
+    if (!out.open(QIODevice::WriteOnly)) {
+        ok = false;
+    }
+    else {
+        QByteArray header(IndexMagic);
+        header += char(d->serialSize >> 24);
+        header += char(d->serialSize >> 16);
+        header += char(d->serialSize >> 8);
+        header += char(d->serialSize);
+        header += QByteArray(IndexHeaderSize - header.size(), 0);
+
+        QByteArray chunk = header;
+
+        // Merge the sorted journal with the existing index
+        qint64 r = 0;
+        int p = 0;
+        while (ok && (r < d->recordCount || p < pending.size())) {
+            const char *next;
+            int cmp = -1;
+            if (r < d->recordCount && p < pending.size())
+                cmp = memcmp(d->record(r), pending.at(p).constData(), d->serialSize);
+            else if (r == d->recordCount)
+                cmp = 1;
+
+            // A journal left over from a flush that could not be mapped may
+            // repeat serials that are already in the index
+            if (0 == cmp)
+                p++;
+
+            if (cmp <= 0)
+                next = d->record(r++);
+            else
+                next = pending.at(p++).constData();
+
+            chunk.append(next, d->serialSize);
+            if (chunk.size() >= 64*1024) {
+                ok = out.write(chunk) == chunk.size();
+                chunk.clear();
+            }
+        }
+
+        if (ok && !chunk.isEmpty())
+            ok = out.write(chunk) == chunk.size();
+
+#if QT_VERSION >= 0x050100
+        ok = ok && out.commit();
+#else
+        ok = ok && out.flush() && sync_file(out.handle());
+        out.close();
+        ok = ok && replace_file(out.fileName(), d->fileName);
+        if (!ok)
+            out.remove();
+#endif
+    }
+
+    if (ok) {
+        ok = d->mapIndex();
+        if (ok) {
+            for (int i = 0; i < SerialShardCount; i++)
+                d->shards[i].journal.clear();
+
+            d->journalFile.resize(0);
+            d->journalFile.seek(0);
+            d->rebuildFilters();
+        }
+        // Otherwise the old mapping is still in use. Every serial since it
+        // was made is in the journal too, so allocation carries on and the
+        // next flush tries again.
+    }
+    else {
+        d->errno.fetchAndStoreRelaxed(GNUTLS_E_FILE_ERROR);
+    }
+
+    for (int i = SerialShardCount - 1; i >= 0; i--)
+        d->shards[i].mutex.unlock();
+
+    return ok;
+}
+
+QT_END_NAMESPACE_CERTIFICATE
@@ -0,0 +1,132 @@
+/****************************************************************************
+**
+** Copyright (C) 2012-2013 Richard J. Moore <rich@kde.org>
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef SERIALALLOCATOR_P_H
+#define SERIALALLOCATOR_P_H
+
+#include <QAtomicInt>
+#include <QFile>
+#include <QMutex>
+#include <QReadWriteLock>
+#include <QSet>
+#include <QVector>
+
+#include "serialallocator.h"
+
+QT_BEGIN_NAMESPACE_CERTIFICATE
+
+enum {
+    SerialShardCount = 16
+};
+
+struct SerialBloomFilter
+{
+    SerialBloomFilter() : mask(0), capacity(0) {}
+
+    QVector<quint64> bits;
+    quint64 mask;
+    qint64 capacity;
+};
+
+//
+// The serials are split into shards by their leading bits, each with its
+// own lock, bloom filter and set of serials allocated since the last
+// flush. Threads allocating at the same time will usually be working on
+// different shards.
+//
+struct SerialShard
+{
+    SerialShard() : count(0), rebuilding(false) {}
+
+    QMutex mutex;
+    SerialBloomFilter filter;
+    qint64 count;
+    bool rebuilding;
+    QSet<QByteArray> journal;
+};
+
+struct SerialAllocatorPrivate
+{
+    SerialAllocatorPrivate(const QString &fileName, int serialSize);
+    ~SerialAllocatorPrivate();
+
+    static int shardIndex(const char *serial);
+
+    bool open();
+    bool mapIndex();
+    bool loadJournal();
+
+    SerialBloomFilter indexFilter(int shard, qint64 journalSize, qint64 *indexCount) const;
+    void rebuildFilters();
+    void rebuildFilter(int shard);
+
+    const char *record(qint64 index) const;
+    qint64 lowerBound(int firstByte) const;
+    bool indexContains(const char *serial) const;
+    bool containsLocked(SerialShard &shard, const QByteArray &serial) const;
+    bool insertLocked(SerialShard &shard, const QByteArray &serial);
+
+    QList<QByteArray> insert(const QList<QByteArray> &candidates);
+    bool writeJournal(const QList<QByteArray> &serials);
+
+    QString fileName;
+    int serialSize;
+    QAtomicInt errno;
+    bool opened;
+
+    // The sorted index of serials from earlier flushes, memory mapped. It
+    // is only replaced by flush(), which holds every shard lock and the
+    // index lock for writing. A shard whose filter is rebuilt outside its
+    // lock holds the index lock for reading instead, and uses the
+    // generation to spot a flush in the meantime.
+    QReadWriteLock indexLock;
+    int indexGeneration;
+    QFile *indexFile;
+    const uchar *records;
+    qint64 recordCount;
+
+    // Serials allocated since the last flush are appended here
+    QMutex journalMutex;
+    QFile journalFile;
+
+    SerialShard shards[SerialShardCount];
+};
+
+QT_END_NAMESPACE_CERTIFICATE
+
+#endif // SERIALALLOCATOR_P_H
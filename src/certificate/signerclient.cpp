@@ -0,0 +1,412 @@
+/****************************************************************************
+**
+** Copyright (C) 2012-2013 Richard J. Moore <rich@kde.org>
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include <QHash>
+#include <QList>
+#include <QLocalSocket>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSemaphore>
+#include <QThread>
+#include <QWaitCondition>
+#include <QtEndian>
+
+#include <string.h>
+
+#include "signerserver_p.h"
+
+#include "signerclient_p.h"
+
+QT_BEGIN_NAMESPACE_CERTIFICATE
+
+struct SignerCall
+{
+    SignerCall() : id(0), done(false), result(GNUTLS_E_SUCCESS) {}
+
+    quint32 id;
+    QByteArray frame;
+    bool done;
+    int result;
+    QByteArray reply;
+};
+
+/*!
+  \internal
+  The connection to a SignerServer used by the keys returned by
+  SigningKey::fromSignerService(). The socket is owned by a thread of its own,
+  and the threads that want signatures queue their requests for it then wait
+  for the replies. Everything queued between two passes of the event loop is
+  sent in a single write, and any number of requests may be outstanding up to
+  the limit given to the constructor.
+ */
+class SignerClient : public QObject
+{
+    Q_OBJECT
+
+public:
+    SignerClient(const QString &serverName, int maxPending);
+    ~SignerClient();
+
+    int open();
+    int call(quint8 op, quint32 algo, quint32 flags, const QByteArray &payload, QByteArray *reply);
+
+    quint32 pkAlgorithm;
+    quint32 bits;
+
+private slots:
+    void connectSocket();
+    void closeSocket();
+    void flush();
+    void readReplies();
+    void socketClosed();
+
+private:
+    void failAll(int error);
+
+    QString serverName;
+    QThread thread;
+    QLocalSocket *socket;
+    QByteArray buffer;
+
+    QSemaphore permits;
+    QMutex mutex;
+    QWaitCondition replied;
+    QList<SignerCall *> outgoing;
+    QHash<quint32, SignerCall *> inflight;
+    quint32 nextId;
+    bool flushQueued;
+    int failure;
+};
+
+SignerClient::SignerClient(const QString &serverName, int maxPending)
+    : pkAlgorithm(GNUTLS_PK_UNKNOWN),
+      bits(0),
+      serverName(serverName),
+      socket(0),
+      permits(qMax(1, maxPending)),
+      nextId(0),
+      flushQueued(false),
+      failure(GNUTLS_E_SUCCESS)
+{
+}
+
+SignerClient::~SignerClient()
+{
+    if (thread.isRunning()) {
+        QMetaObject::invokeMethod(this, "closeSocket", Qt::BlockingQueuedConnection);
+        thread.quit();
+        thread.wait();
+    }
+}
+
+/*!
+  \internal
+  Starts the socket thread, connects to the server and asks it for the
+  details of its key. Returns 0 on success, otherwise a gnutls error code.
+ */
+int SignerClient::open()
+{
+    moveToThread(&thread);
+    thread.start();
+
+    QMetaObject::invokeMethod(this, "connectSocket", Qt::BlockingQueuedConnection);
+
+    QByteArray info;
+    int result = call(SignerInfo, 0, 0, QByteArray(), &info);
+    if (GNUTLS_E_SUCCESS != result)
+        return result;
+
+    if (info.size() != 8)
+        return GNUTLS_E_PARSING_ERROR;
+
+    pkAlgorithm = signer_uint32(info.constData());
+    bits = signer_uint32(info.constData() + 4);
+
+    return GNUTLS_E_SUCCESS;
+}
+
+/*!
+  \internal
+  Sends a request to the server and waits for the reply. Blocks if the
+  maximum number of requests are already outstanding.
+ */
+int SignerClient::call(quint8 op, quint32 algo, quint32 flags, const QByteArray &payload, QByteArray *reply)
+{
+    permits.acquire();
+
+    SignerCall request;
+    int result;
+
+    {
+        QMutexLocker lock(&mutex);
+
+        if (GNUTLS_E_SUCCESS != failure) {
+            result = failure;
+        }
+        else {
+            request.id = nextId++;
+            request.frame = signer_request(request.id, op, algo, flags, payload);
+            outgoing << &request;
+
+            if (!flushQueued) {
+                flushQueued = true;
+                QMetaObject::invokeMethod(this, "flush", Qt::QueuedConnection);
+            }
+
+            while (!request.done)
+                replied.wait(&mutex);
+
+            result = request.result;
+        }
+    }
+
+    permits.release();
+
+    if (GNUTLS_E_SUCCESS == result)
+        *reply = request.reply;
+
+    return result;
+}
+
+void SignerClient::connectSocket()
+{
+    socket = new QLocalSocket;
+    connect(socket, SIGNAL(readyRead()), this, SLOT(readReplies()));
+    connect(socket, SIGNAL(disconnected()), this, SLOT(socketClosed()));
+
+    socket->connectToServer(serverName);
+    if (!socket->waitForConnected(5000)) {
+        QMutexLocker lock(&mutex);
+        failAll(GNUTLS_E_PUSH_ERROR);
+    }
+}
+
+void SignerClient::closeSocket()
+{
+    // Deleted here since the socket belongs to this thread
+    if (socket) {
+        socket->disconnect(this);
+        socket->abort();
+        delete socket;
+        socket = 0;
+    }
+
+    QMutexLocker lock(&mutex);
+    failAll(GNUTLS_E_PREMATURE_TERMINATION);
+}
+
+void SignerClient::flush()
+{
+    QByteArray batch;
+
+    {
+        QMutexLocker lock(&mutex);
+        flushQueued = false;
+
+        for (int i = 0; i < outgoing.size(); i++) {
+            batch += outgoing[i]->frame;
+            inflight.insert(outgoing[i]->id, outgoing[i]);
+        }
+        outgoing.clear();
+    }
+
+    if (!batch.isEmpty() && socket)
+        socket->write(batch);
+}
+
+void SignerClient::readReplies()
+{
+    buffer += socket->readAll();
+
+    QByteArray body;
+    int offset = 0;
+    bool bad = false;
+
+    QMutexLocker lock(&mutex);
+
+    while (signer_next_frame(buffer, &offset, &body, &bad)) {
+        if (body.size() < 8) {
+            bad = true;
+            break;
+        }
+
+        SignerCall *call = inflight.take(signer_uint32(body.constData()));
+        if (!call)
+            continue;
+
+        call->result = qint32(signer_uint32(body.constData() + 4));
+        call->reply = body.mid(8);
+        call->done = true;
+    }
+
+    buffer.remove(0, offset);
+    replied.wakeAll();
+
+    if (bad) {
+        failAll(GNUTLS_E_PULL_ERROR);
+        socket->abort();
+    }
+}
+
+void SignerClient::socketClosed()
+{
+    QMutexLocker lock(&mutex);
+    failAll(GNUTLS_E_PREMATURE_TERMINATION);
+}
+
+/*!
+  \internal
+  Fails every request that has not had a reply, and any that are made in
+  future. Must be called with the mutex held.
+ */
+void SignerClient::failAll(int error)
+{
+    if (GNUTLS_E_SUCCESS == failure)
+        failure = error;
+
+    QList<SignerCall *> calls = outgoing + inflight.values();
+    outgoing.clear();
+    inflight.clear();
+
+    for (int i = 0; i < calls.size(); i++) {
+        calls[i]->result = failure;
+        calls[i]->done = true;
+    }
+
+    replied.wakeAll();
+}
+
+static int sign_request(void *userdata, quint8 op, gnutls_sign_algorithm_t algo, unsigned int flags,
+                        const gnutls_datum_t *input, gnutls_datum_t *signature)
+{
+    SignerClient *client = static_cast<SignerClient *>(userdata);
+
+    QByteArray payload(reinterpret_cast<const char *>(input->data), input->size);
+    QByteArray reply;
+
+    int result = client->call(op, algo, flags, payload, &reply);
+    if (GNUTLS_E_SUCCESS != result)
+        return result;
+
+    signature->data = static_cast<unsigned char *>(gnutls_malloc(qMax(1, reply.size())));
+    if (!signature->data)
+        return GNUTLS_E_MEMORY_ERROR;
+
+    memcpy(signature->data, reply.constData(), reply.size());
+    signature->size = reply.size();
+
+    return GNUTLS_E_SUCCESS;
+}
+
+static int sign_data_func(gnutls_privkey_t key, gnutls_sign_algorithm_t algo, void *userdata,
+                          unsigned int flags, const gnutls_datum_t *data, gnutls_datum_t *signature)
+{
+    Q_UNUSED(key);
+    return sign_request(userdata, SignerSignData, algo, flags, data, signature);
+}
+
+static int sign_hash_func(gnutls_privkey_t key, gnutls_sign_algorithm_t algo, void *userdata,
+                          unsigned int flags, const gnutls_datum_t *hash, gnutls_datum_t *signature)
+{
+    Q_UNUSED(key);
+    return sign_request(userdata, SignerSignHash, algo, flags, hash, signature);
+}
+
+static int info_func(gnutls_privkey_t key, unsigned int flags, void *userdata)
+{
+    Q_UNUSED(key);
+
+    SignerClient *client = static_cast<SignerClient *>(userdata);
+
+    if (flags & GNUTLS_PRIVKEY_INFO_PK_ALGO)
+        return int(client->pkAlgorithm);
+    if (flags & GNUTLS_PRIVKEY_INFO_PK_ALGO_BITS)
+        return int(client->bits);
+    if (flags & GNUTLS_PRIVKEY_INFO_HAVE_SIGN_ALGO) {
+        gnutls_sign_algorithm_t algo = gnutls_sign_algorithm_t(GNUTLS_FLAGS_TO_SIGN_ALGO(flags));
+        return gnutls_sign_supports_pk_algorithm(algo, gnutls_pk_algorithm_t(client->pkAlgorithm)) ? 1 : 0;
+    }
+    if (flags & GNUTLS_PRIVKEY_INFO_SIGN_ALGO)
+        return GNUTLS_SIGN_UNKNOWN;
+
+    return GNUTLS_E_INVALID_REQUEST;
+}
+
+static void deinit_func(gnutls_privkey_t key, void *userdata)
+{
+    Q_UNUSED(key);
+    delete static_cast<SignerClient *>(userdata);
+}
+
+/*!
+  \internal
+  Connects to the SignerServer listening on serverName and returns a key
+  that signs by sending requests to it.
+ */
+gnutls_privkey_t signer_client_privkey(const QString &serverName, int maxPending, int *errno)
+{
+    SignerClient *client = new SignerClient(serverName, maxPending);
+
+    *errno = client->open();
+    if (GNUTLS_E_SUCCESS != *errno) {
+        delete client;
+        return 0;
+    }
+
+    gnutls_privkey_t key;
+    *errno = gnutls_privkey_init(&key);
+    if (GNUTLS_E_SUCCESS != *errno) {
+        delete client;
+        return 0;
+    }
+
+    // The key takes ownership of the client
+    *errno = gnutls_privkey_import_ext4(key, client, sign_data_func, sign_hash_func, 0,
+                                        deinit_func, info_func, GNUTLS_PRIVKEY_IMPORT_AUTO_RELEASE);
+    if (GNUTLS_E_SUCCESS != *errno) {
+        gnutls_privkey_deinit(key);
+        delete client;
+        return 0;
+    }
+
+    return key;
+}
+
+QT_END_NAMESPACE_CERTIFICATE
+
+#include "signerclient.moc"
@@ -0,0 +1,530 @@
+/****************************************************************************
+**
+** Copyright (C) 2012-2013 Richard J. Moore <rich@kde.org>
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include <gnutls/gnutls.h>
+#include <gnutls/abstract.h>
+
+#include <QFile>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QSharedPointer>
+#include <QThreadPool>
+#include <QtEndian>
+
+#include "signingkey_p.h"
+
+#include "signerserver.h"
+#include "signerserver_p.h"
+
+QT_BEGIN_NAMESPACE_CERTIFICATE
+
+/*!
+  \class SignerServer
+  \brief The SignerServer class allows a private key to be used for signing
+  by other processes without them having access to it.
+
+  A SignerServer listens on a local socket and signs the digests sent to it
+  by clients using its SigningKey. Clients obtain a SigningKey for the
+  server using SigningKey::fromSignerService(), which can then be used with
+  an IssuerContext or CertificateBuilder in the same way as any other key.
+  This allows the CA key to be held by a small, separate process rather than
+  by every application that issues certificates.
+
+  Requests are signed using a thread pool belonging to the server so that
+  several can be in progress at once, and clients may pipeline requests over
+  a single connection. The SignerServer must be used from a thread that is
+  running an event loop.
+
+  The server performs no authentication of its own, any process that can
+  connect to the socket can obtain signatures. Access must be controlled
+  using the permissions of the socket, which listen() restricts to the user
+  running the server.
+*/
+
+QByteArray signer_request(quint32 id, quint8 op, quint32 algo, quint32 flags, const QByteArray &payload)
+{
+    uchar header[17];
+    qToBigEndian<quint32>(13 + payload.size(), header);
+    qToBigEndian<quint32>(id, header + 4);
+    header[8] = op;
+    qToBigEndian<quint32>(algo, header + 9);
+    qToBigEndian<quint32>(flags, header + 13);
+
+    QByteArray frame;
+    frame.reserve(sizeof(header) + payload.size());
+    frame.append(reinterpret_cast<const char *>(header), sizeof(header));
+    frame.append(payload);
+    return frame;
+}
+
+QByteArray signer_response(quint32 id, qint32 result, const QByteArray &payload)
+{
+    uchar header[12];
+    qToBigEndian<quint32>(8 + payload.size(), header);
+    qToBigEndian<quint32>(id, header + 4);
+    qToBigEndian<quint32>(quint32(result), header + 8);
+
+    QByteArray frame;
+    frame.reserve(sizeof(header) + payload.size());
+    frame.append(reinterpret_cast<const char *>(header), sizeof(header));
+    frame.append(payload);
+    return frame;
+}
+
+quint32 signer_uint32(const char *data)
+{
+    return qFromBigEndian<quint32>(reinterpret_cast<const uchar *>(data));
+}
+
+/*!
+  \internal
+  Extracts the body of the frame starting at \a offset in \a buffer and
+  advances the offset past it. Returns false if the buffer does not yet hold
+  a complete frame, in which case \a bad is set if the frame is too large to
+  ever be accepted.
+ */
+bool signer_next_frame(const QByteArray &buffer, int *offset, QByteArray *body, bool *bad)
+{
+    if (buffer.size() - *offset < 4)
+        return false;
+
+    quint32 length = signer_uint32(buffer.constData() + *offset);
+    if (length > quint32(SignerMaxFrameSize)) {
+        *bad = true;
+        return false;
+    }
+
+    if (quint32(buffer.size() - *offset - 4) < length)
+        return false;
+
+    *body = buffer.mid(*offset + 4, int(length));
+    *offset += 4 + int(length);
+    return true;
+}
+
+class SignerConnection;
+
+// Lets signing tasks find their connection, which may have gone away by the
+// time the signature is ready.
+struct SignerReplyTarget
+{
+    SignerReplyTarget(SignerConnection *connection) : connection(connection) {}
+
+    QMutex mutex;
+    SignerConnection *connection;
+};
+
+class SignerServerPrivate : public QObject
+{
+    Q_OBJECT
+
+public:
+    SignerServerPrivate(const SigningKey &key, SigningKeyPrivate *keyd);
+
+    SigningKey key;
+    SigningKeyPrivate *keyd;
+    quint32 pkAlgorithm;
+    quint32 bits;
+    int maxPending;
+    QLocalServer server;
+    QThreadPool threadPool;
+
+private slots:
+    void newConnection();
+};
+
+class SignerConnection : public QObject
+{
+    Q_OBJECT
+
+public:
+    SignerConnection(QLocalSocket *socket, SignerServerPrivate *server);
+    ~SignerConnection();
+
+public slots:
+    void requestSigned(uint id, int result, const QByteArray &signature);
+
+private slots:
+    void readRequests();
+    void socketClosed();
+
+private:
+    SignerServerPrivate *server;
+    QLocalSocket *socket;
+    QSharedPointer<SignerReplyTarget> target;
+    QByteArray buffer;
+    int pending;
+    bool closed;
+};
+
+class SignerTask : public QRunnable
+{
+public:
+    SignerTask(const QSharedPointer<SignerReplyTarget> &target, const SigningKey &key, SigningKeyPrivate *keyd,
+               quint32 id, quint8 op, quint32 algo, quint32 flags, const QByteArray &data)
+        : target(target),
+          key(key),
+          keyd(keyd),
+          id(id),
+          op(op),
+          algo(algo),
+          flags(flags),
+          data(data)
+    {
+    }
+
+    void run()
+    {
+        QByteArray signature;
+        int result = sign(&signature);
+
+        QMutexLocker lock(&target->mutex);
+        if (target->connection) {
+            QMetaObject::invokeMethod(target->connection, "requestSigned", Qt::QueuedConnection,
+                                      Q_ARG(uint, id), Q_ARG(int, result), Q_ARG(QByteArray, signature));
+        }
+    }
+
+private:
+    int sign(QByteArray *signature)
+    {
+        // Only pass on the flags that affect the signature itself
+        unsigned int signFlags = flags & (GNUTLS_PRIVKEY_SIGN_FLAG_TLS1_RSA
+                                          | GNUTLS_PRIVKEY_SIGN_FLAG_RSA_PSS
+                                          | GNUTLS_PRIVKEY_FLAG_REPRODUCIBLE);
+
+        gnutls_datum_t input;
+        input.data = reinterpret_cast<unsigned char *>(data.data());
+        input.size = data.size();
+
+        gnutls_datum_t sig;
+        int result;
+
+        {
+            SigningKeyLocker locker(keyd);
+
+            if (SignerSignData == op) {
+                result = gnutls_privkey_sign_data2(locker.privkey(), gnutls_sign_algorithm_t(algo),
+                                                   signFlags, &input, &sig);
+            }
+            else if (signFlags & GNUTLS_PRIVKEY_SIGN_FLAG_TLS1_RSA) {
+                // The input is a DigestInfo that only needs padding
+                result = gnutls_privkey_sign_hash(locker.privkey(), GNUTLS_DIG_UNKNOWN,
+                                                  signFlags, &input, &sig);
+            }
+            else {
+                result = gnutls_privkey_sign_hash2(locker.privkey(), gnutls_sign_algorithm_t(algo),
+                                                   signFlags, &input, &sig);
+            }
+        }
+
+        if (GNUTLS_E_SUCCESS != result)
+            return result;
+
+        *signature = QByteArray(reinterpret_cast<const char *>(sig.data), sig.size);
+        gnutls_free(sig.data);
+
+        return GNUTLS_E_SUCCESS;
+    }
+
+    QSharedPointer<SignerReplyTarget> target;
+    SigningKey key;
+    SigningKeyPrivate *keyd;
+    quint32 id;
+    quint8 op;
+    quint32 algo;
+    quint32 flags;
+    QByteArray data;
+};
+
+SignerServerPrivate::SignerServerPrivate(const SigningKey &key, SigningKeyPrivate *keyd)
+    : key(key),
+      keyd(keyd),
+      pkAlgorithm(GNUTLS_PK_UNKNOWN),
+      bits(0),
+      maxPending(64)
+{
+    if (!key.isNull()) {
+        SigningKeyLocker locker(keyd);
+
+        unsigned int keyBits = 0;
+        pkAlgorithm = gnutls_privkey_get_pk_algorithm(locker.privkey(), &keyBits);
+        bits = keyBits;
+    }
+
+    connect(&server, SIGNAL(newConnection()), this, SLOT(newConnection()));
+}
+
+void SignerServerPrivate::newConnection()
+{
+    while (server.hasPendingConnections())
+        new SignerConnection(server.nextPendingConnection(), this);
+}
+
+SignerConnection::SignerConnection(QLocalSocket *socket, SignerServerPrivate *server)
+    : QObject(server),
+      server(server),
+      socket(socket),
+      target(new SignerReplyTarget(this)),
+      pending(0),
+      closed(false)
+{
+    socket->setParent(this);
+
+    // Stop reading once the buffer is full so that a client sending faster
+    // than we can sign is made to wait
+    socket->setReadBufferSize(64 * 1024);
+
+    connect(socket, SIGNAL(readyRead()), this, SLOT(readRequests()));
+    connect(socket, SIGNAL(disconnected()), this, SLOT(socketClosed()));
+
+    readRequests();
+}
+
+SignerConnection::~SignerConnection()
+{
+    QMutexLocker lock(&target->mutex);
+    target->connection = 0;
+}
+
+void SignerConnection::readRequests()
+{
+    if (closed)
+        return;
+
+    QByteArray replies;
+    QByteArray body;
+    int offset = 0;
+    bool bad = false;
+
+    while (pending < server->maxPending) {
+        if (!signer_next_frame(buffer, &offset, &body, &bad)) {
+            if (bad || !socket->bytesAvailable())
+                break;
+
+            buffer.remove(0, offset);
+            offset = 0;
+            buffer += socket->readAll();
+            continue;
+        }
+
+        if (body.size() < 13) {
+            bad = true;
+            break;
+        }
+
+        quint32 id = signer_uint32(body.constData());
+        quint8 op = quint8(body[4]);
+        quint32 algo = signer_uint32(body.constData() + 5);
+        quint32 flags = signer_uint32(body.constData() + 9);
+
+        if (SignerInfo == op) {
+            QByteArray info(8, 0);
+            qToBigEndian<quint32>(server->pkAlgorithm, reinterpret_cast<uchar *>(info.data()));
+            qToBigEndian<quint32>(server->bits, reinterpret_cast<uchar *>(info.data()) + 4);
+            replies += signer_response(id, server->key.isNull() ? GNUTLS_E_INVALID_REQUEST : GNUTLS_E_SUCCESS, info);
+        }
+        else if ((SignerSignHash == op || SignerSignData == op) && !server->key.isNull()) {
+            pending++;
+            server->threadPool.start(new SignerTask(target, server->key, server->keyd,
+                                                                   id, op, algo, flags, body.mid(13)));
+        }
+        else {
+            replies += signer_response(id, GNUTLS_E_INVALID_REQUEST, QByteArray());
+        }
+    }
+
+    buffer.remove(0, offset);
+
+    if (!replies.isEmpty())
+        socket->write(replies);
+
+    if (bad) {
+        // The stream can't be resynchronised
+        socket->abort();
+        socketClosed();
+    }
+}
+
+void SignerConnection::requestSigned(uint id, int result, const QByteArray &signature)
+{
+    pending--;
+
+    if (!closed) {
+        socket->write(signer_response(id, result, signature));
+        readRequests();
+    }
+    else if (!pending) {
+        deleteLater();
+    }
+}
+
+void SignerConnection::socketClosed()
+{
+    if (closed)
+        return;
+
+    closed = true;
+    if (!pending)
+        deleteLater();
+}
+
+/*!
+  Creates a SignerServer that will sign requests using \a key. The server
+  does not accept connections until listen() has been called.
+ */
+SignerServer::SignerServer(const SigningKey &key)
+    : d(new SignerServerPrivate(key, key.d.data()))
+{
+}
+
+/*!
+  Stops the server and closes all of the connections to it. Requests that
+  are being signed are discarded once they complete.
+ */
+SignerServer::~SignerServer()
+{
+    delete d;
+}
+
+/*!
+  Sets the maximum number of requests from a single connection that will be
+  signed at the same time. Once this many are outstanding the server stops
+  reading from the connection until one has finished. The default is 64.
+ */
+void SignerServer::setMaxPending(int count)
+{
+    d->maxPending = qMax(1, count);
+}
+
+/*!
+  Returns the maximum number of requests from a single connection that will
+  be signed at the same time.
+ */
+int SignerServer::maxPending() const
+{
+    return d->maxPending;
+}
+
+/*!
+  Sets the maximum number of threads that will be used to sign requests. By
+  default this is the number of cores available.
+ */
+void SignerServer::setMaxThreadCount(int count)
+{
+    d->threadPool.setMaxThreadCount(count);
+}
+
+/*!
+  Returns the maximum number of threads that will be used to sign requests.
+ */
+int SignerServer::maxThreadCount() const
+{
+    return d->threadPool.maxThreadCount();
+}
+
+/*!
+  Starts listening for clients on the local socket \a name, removing any
+  stale socket left behind by a previous server. Only the user running the
+  server may connect. With Qt 4 the permissions are changed just after the
+  socket has been created, and if they cannot be changed the server stops
+  listening again. Returns true on success.
+ */
+bool SignerServer::listen(const QString &name)
+{
+    QLocalServer::removeServer(name);
+
+#if QT_VERSION >= 0x050000
+    d->server.setSocketOptions(QLocalServer::UserAccessOption);
+
+    return d->server.listen(name);
+#else
+    // Qt 4 creates the socket under the process umask, so restrict it to
+    // the owner afterwards and refuse to serve if that is not possible
+    if (!d->server.listen(name))
+        return false;
+
+#ifdef Q_OS_UNIX
+    if (!QFile::setPermissions(d->server.fullServerName(), QFile::ReadOwner | QFile::WriteOwner)) {
+        d->server.close();
+        return false;
+    }
+#endif
+
+    return true;
+#endif
+}
+
+/*!
+  Stops listening for new clients. Existing connections are not affected.
+ */
+void SignerServer::close()
+{
+    d->server.close();
+}
+
+/*!
+  Returns true if the server is listening for clients.
+ */
+bool SignerServer::isListening() const
+{
+    return d->server.isListening();
+}
+
+/*!
+  Returns the name the server is listening on.
+ */
+QString SignerServer::serverName() const
+{
+    return d->server.serverName();
+}
+
+/*!
+  Returns a string describing the last error that occurred when listening.
+ */
+QString SignerServer::errorString() const
+{
+    return d->server.errorString();
+}
+
+QT_END_NAMESPACE_CERTIFICATE
+
+#include "signerserver.moc"
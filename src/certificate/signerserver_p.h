@@ -0,0 +1,73 @@
+/****************************************************************************
+**
+** Copyright (C) 2012-2013 Richard J. Moore <rich@kde.org>
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef SIGNERSERVER_P_H
+#define SIGNERSERVER_P_H
+
+#include <QtCore/QByteArray>
+
+#include "certificate_global.h"
+
+QT_BEGIN_NAMESPACE_CERTIFICATE
+
+//
+// The signer protocol is a sequence of frames, each of which is a big-endian
+// quint32 length followed by that many bytes. Requests contain a quint32 id,
+// a quint8 operation, the quint32 gnutls signature algorithm and flags, then
+// the data to be signed. Responses contain the id of the request, a qint32
+// gnutls result code and the signature. Requests may be pipelined, and the
+// responses can arrive in any order.
+//
+
+enum SignerOperation {
+    SignerInfo = 1,     // Response is the quint32 pk algorithm and bits
+    SignerSignHash = 2,
+    SignerSignData = 3  // Used for EdDSA, which cannot sign a digest
+};
+
+static const int SignerMaxFrameSize = 1024 * 1024;
+
+QByteArray signer_request(quint32 id, quint8 op, quint32 algo, quint32 flags, const QByteArray &payload);
+QByteArray signer_response(quint32 id, qint32 result, const QByteArray &payload);
+
+quint32 signer_uint32(const char *data);
+bool signer_next_frame(const QByteArray &buffer, int *offset, QByteArray *body, bool *bad);
+
+QT_END_NAMESPACE_CERTIFICATE
+
+#endif // SIGNERSERVER_P_H
@@ -0,0 +1,438 @@
+/****************************************************************************
+**
+** Copyright (C) 2012-2013 Richard J. Moore <rich@kde.org>
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include <gnutls/pkcs11.h>
+
+#include <QFile>
+#include <QMutexLocker>
+
+#include <string.h>
+
+#include "derwriter_p.h"
+#include "securememory_p.h"
+#include "signerclient_p.h"
+#include "utils_p.h"
+
+#include "signingkey_p.h"
+
+QT_BEGIN_NAMESPACE_CERTIFICATE
+
+/*!
+  \class SigningKey
+  \brief The SigningKey class represents a private key that can be used to
+  sign certificates, wherever it is stored.
+
+  A SigningKey can be created from a QSslKey or an encoded private key held
+  in memory, or it can refer to a key held in a PKCS#11 token such as an HSM
+  using fromPkcs11Url(). In the latter case the key never leaves the token,
+  instead the library asks the token to perform each signature. Similarly,
+  fromSignerService() refers to a key held by another process running a
+  SignerServer.
+
+  A token session can only perform one operation at a time, so a SigningKey
+  for a PKCS#11 key can keep several logged in sessions open. Signatures are
+  spread across the sessions so that builders in different threads, for
+  example those used by BatchIssuer, do not have to wait for each other.
+
+  SigningKey is explicitly shared, copies refer to the same underlying key
+  and sessions.
+*/
+
+/*!
+  \internal
+  Supplies the PIN to gnutls when a token requires a login. A PIN that has
+  been rejected is never retried since doing so could lock the token.
+ */
+static int pin_callback(void *userdata, int attempt, const char *token_url, const char *token_label,
+                        unsigned int flags, char *pin, size_t pin_max)
+{
+    Q_UNUSED(token_url);
+    Q_UNUSED(token_label);
+
+    SigningKeyPrivate *d = static_cast<SigningKeyPrivate *>(userdata);
+
+    if (attempt > 0 || (flags & GNUTLS_PIN_WRONG) || d->pin.isEmpty())
+        return GNUTLS_E_PKCS11_PIN_ERROR;
+
+    if (size_t(d->pin.size()) >= pin_max)
+        return GNUTLS_E_SHORT_MEMORY_BUFFER;
+
+    memcpy(pin, d->pin.constData(), d->pin.size());
+    pin[d->pin.size()] = '\0';
+
+    return GNUTLS_E_SUCCESS;
+}
+
+SigningKeyPrivate::SigningKeyPrivate()
+    : null(true),
+      errno(GNUTLS_E_SUCCESS),
+      exclusive(false)
+{
+    ensure_gnutls_init();
+}
+
+SigningKeyPrivate::~SigningKeyPrivate()
+{
+    for (int i = 0; i < keys.size(); i++)
+        gnutls_privkey_deinit(keys[i]);
+
+    secure_zero(pin);
+}
+
+void SigningKeyPrivate::setKey(gnutls_privkey_t key)
+{
+    keys << key;
+    null = false;
+}
+
+/*!
+  \internal
+  Returns a key that the caller may sign with until it is passed to
+  release(). For token keys this waits until a session is free.
+ */
+gnutls_privkey_t SigningKeyPrivate::acquire()
+{
+    // The list of keys is never modified once the SigningKey has been created
+    if (!exclusive || keys.isEmpty())
+        return keys.value(0);
+
+    QMutexLocker lock(&mutex);
+    while (idle.isEmpty())
+        available.wait(&mutex);
+
+    // Reuse the most recently used session first
+    return idle.takeLast();
+}
+
+void SigningKeyPrivate::release(gnutls_privkey_t key)
+{
+    if (!exclusive || !key)
+        return;
+
+    QMutexLocker lock(&mutex);
+    idle << key;
+    available.wakeOne();
+}
+
+static gnutls_sign_algorithm_t sign_algorithm(gnutls_privkey_t key, Certificate::SignatureDigest digest,
+                                              gnutls_pk_algorithm_t *pk)
+{
+    *pk = gnutls_pk_algorithm_t(gnutls_privkey_get_pk_algorithm(key, 0));
+
+#if GNUTLS_VERSION_NUMBER >= 0x030600
+    // EdDSA has no separate digest
+    if (GNUTLS_PK_EDDSA_ED25519 == *pk)
+        return GNUTLS_SIGN_EDDSA_ED25519;
+#endif
+
+    return gnutls_pk_to_sign(*pk, signature_digest(digest, key));
+}
+
+/*!
+  \internal
+  Returns the DER AlgorithmIdentifier of the signatures signingkey_sign()
+  will make, for inclusion in the structure being signed.
+ */
+QByteArray signingkey_algorithm(SigningKeyPrivate *d, Certificate::SignatureDigest digest, int *errno)
+{
+    SigningKeyLocker locker(d);
+    if (!locker.privkey()) {
+        *errno = GNUTLS_E_INVALID_REQUEST;
+        return QByteArray();
+    }
+
+    gnutls_pk_algorithm_t pk;
+    const char *oid = gnutls_sign_get_oid(sign_algorithm(locker.privkey(), digest, &pk));
+    if (!oid) {
+        *errno = GNUTLS_E_UNKNOWN_ALGORITHM;
+        return QByteArray();
+    }
+
+    // RSA signatures must have explicit NULL parameters, others have none
+    QByteArray params = der_oid(oid);
+    if (GNUTLS_PK_RSA == pk)
+        params += der_null();
+
+    *errno = GNUTLS_E_SUCCESS;
+    return der_wrap(DerSequence, params);
+}
+
+/*!
+  \internal
+  Signs \a data for inclusion in a structure such as a CRL or an OCSP
+  response that the library encodes itself.
+ */
+QByteArray signingkey_sign(SigningKeyPrivate *d, Certificate::SignatureDigest digest, const QByteArray &data,
+                           int *errno)
+{
+    SigningKeyLocker locker(d);
+    if (!locker.privkey()) {
+        *errno = GNUTLS_E_INVALID_REQUEST;
+        return QByteArray();
+    }
+
+    gnutls_pk_algorithm_t pk;
+    gnutls_sign_algorithm_t sign = sign_algorithm(locker.privkey(), digest, &pk);
+
+    gnutls_datum_t input;
+    input.data = reinterpret_cast<unsigned char *>(const_cast<char *>(data.constData()));
+    input.size = data.size();
+
+    gnutls_datum_t signature;
+    *errno = gnutls_privkey_sign_data2(locker.privkey(), sign, 0, &input, &signature);
+    if (GNUTLS_E_SUCCESS != *errno)
+        return QByteArray();
+
+    QByteArray result(reinterpret_cast<const char *>(signature.data), signature.size);
+    gnutls_free(signature.data);
+
+    return result;
+}
+
+/*!
+  Creates a null SigningKey.
+ */
+SigningKey::SigningKey()
+    : d(new SigningKeyPrivate)
+{
+}
+
+/*!
+  Creates a SigningKey from \a key. If the key cannot be converted then the
+  SigningKey will be null and error() will report the reason.
+ */
+SigningKey::SigningKey(const QSslKey &key)
+    : d(new SigningKeyPrivate)
+{
+    gnutls_privkey_t privkey = qsslkey_to_privkey(key, &d->errno);
+    if (GNUTLS_E_SUCCESS != d->errno)
+        return;
+
+    d->setKey(privkey);
+}
+
+/*!
+  Creates a SigningKey from the encoded private key \a encodedKey. The key
+  may be either an unencrypted PKCS#8 structure or in the traditional format
+  for its type.
+ */
+SigningKey::SigningKey(const QByteArray &encodedKey, QSsl::EncodingFormat format)
+    : d(new SigningKeyPrivate)
+{
+    gnutls_privkey_t privkey = encoded_to_privkey(encodedKey, format, &d->errno);
+    if (GNUTLS_E_SUCCESS != d->errno)
+        return;
+
+    d->setKey(privkey);
+}
+
+/*!
+  Creates a SigningKey that shares the key of \a other.
+ */
+SigningKey::SigningKey(const SigningKey &other)
+    : d(other.d)
+{
+}
+
+/*!
+  Clean up. Any token sessions are closed once the last copy of the key has
+  been destroyed.
+ */
+SigningKey::~SigningKey()
+{
+}
+
+/*!
+  Loads the PKCS#11 module at \a modulePath so that the keys held by its
+  tokens can be used with fromPkcs11Url(). Modules registered with p11-kit
+  are loaded automatically and do not need to be added. Returns 0 on success,
+  otherwise a gnutls error code.
+ */
+int SigningKey::addPkcs11Provider(const QString &modulePath)
+{
+    int errno = ensure_gnutls_init();
+    if (GNUTLS_E_SUCCESS != errno)
+        return errno;
+
+    return gnutls_pkcs11_add_provider(QFile::encodeName(modulePath).constData(), 0);
+}
+
+/*!
+  Creates a SigningKey for the private key in a PKCS#11 token identified by
+  \a url, for example "pkcs11:token=CA;object=ca-key;type=private". If the
+  token requires a login then \a pin is used; it is never retried if the
+  token rejects it.
+
+  The key keeps \a sessions logged in sessions open to the token, which is
+  the number of signatures that can be in progress at once. If the key
+  cannot be found, or any of the sessions cannot be opened, then the
+  SigningKey will be null and error() will report the reason.
+ */
+SigningKey SigningKey::fromPkcs11Url(const QString &url, const QByteArray &pin, int sessions)
+{
+    SigningKey result;
+    SigningKeyPrivate *d = result.d.data();
+
+    // A private copy, so that it can be wiped when the key goes away
+    d->pin = QByteArray(pin.constData(), pin.size());
+
+    QByteArray encodedUrl = url.toUtf8();
+
+    for (int i = 0; i < qMax(1, sessions); i++) {
+        gnutls_pkcs11_privkey_t p11key;
+        d->errno = gnutls_pkcs11_privkey_init(&p11key);
+        if (GNUTLS_E_SUCCESS != d->errno)
+            break;
+
+        // Each imported key holds a session of its own
+        gnutls_pkcs11_privkey_set_pin_function(p11key, pin_callback, d);
+        d->errno = gnutls_pkcs11_privkey_import_url(p11key, encodedUrl.constData(),
+                                                    GNUTLS_PKCS11_OBJ_FLAG_LOGIN);
+        if (GNUTLS_E_SUCCESS != d->errno) {
+            gnutls_pkcs11_privkey_deinit(p11key);
+            break;
+        }
+
+        gnutls_privkey_t privkey;
+        d->errno = gnutls_privkey_init(&privkey);
+        if (GNUTLS_E_SUCCESS != d->errno) {
+            gnutls_pkcs11_privkey_deinit(p11key);
+            break;
+        }
+
+        // The abstract key takes ownership of the PKCS#11 key
+        gnutls_privkey_set_pin_function(privkey, pin_callback, d);
+        d->errno = gnutls_privkey_import_pkcs11(privkey, p11key, GNUTLS_PRIVKEY_IMPORT_AUTO_RELEASE);
+        if (GNUTLS_E_SUCCESS != d->errno) {
+            gnutls_privkey_deinit(privkey);
+            gnutls_pkcs11_privkey_deinit(p11key);
+            break;
+        }
+
+        d->keys << privkey;
+    }
+
+    if (GNUTLS_E_SUCCESS != d->errno) {
+        for (int i = 0; i < d->keys.size(); i++)
+            gnutls_privkey_deinit(d->keys[i]);
+        d->keys.clear();
+        return result;
+    }
+
+    // Only once every session is open, acquire() would wait forever for
+    // a session otherwise
+    d->exclusive = true;
+    d->idle = d->keys;
+    d->null = false;
+
+    return result;
+}
+
+/*!
+  Creates a SigningKey that signs by sending requests to the SignerServer
+  listening on the local socket \a serverName. Only digests are sent to the
+  server, except for Ed25519 keys which must sign the data itself.
+
+  Requests from several threads share one connection, and up to \a
+  maxPending of them may be waiting for the server at once; further requests
+  block until one of those has completed. If the server cannot be reached
+  then the SigningKey will be null and error() will report the reason. If
+  the connection is lost later, then signing will fail.
+ */
+SigningKey SigningKey::fromSignerService(const QString &serverName, int maxPending)
+{
+    SigningKey result;
+
+    gnutls_privkey_t privkey = signer_client_privkey(serverName, maxPending, &result.d->errno);
+    if (GNUTLS_E_SUCCESS != result.d->errno)
+        return result;
+
+    result.d->setKey(privkey);
+    return result;
+}
+
+/*!
+  Makes this SigningKey share the key of \a other.
+ */
+SigningKey &SigningKey::operator=(const SigningKey &other)
+{
+    d = other.d;
+    return *this;
+}
+
+/*!
+  Returns true if this SigningKey is null, either because it was default
+  constructed or because the key could not be loaded.
+ */
+bool SigningKey::isNull() const
+{
+    return d->null;
+}
+
+/*!
+  Returns the error that occurred when loading the key. The values used are
+  those of gnutls. If there has not been an error then it is guaranteed to
+  be 0.
+ */
+int SigningKey::error() const
+{
+    return d->errno;
+}
+
+/*!
+  Returns a string describing the error that occurred when loading the key.
+ */
+QString SigningKey::errorString() const
+{
+    return QString::fromUtf8(gnutls_strerror(d->errno));
+}
+
+/*!
+  Returns the number of signatures that can be performed at once. This is
+  the number of token sessions for a PKCS#11 key, and 0 for a null key. Keys
+  with no limit, such as those held in memory, return -1.
+ */
+int SigningKey::sessionCount() const
+{
+    if (d->null)
+        return 0;
+
+    return d->exclusive ? d->keys.size() : -1;
+}
+
+QT_END_NAMESPACE_CERTIFICATE
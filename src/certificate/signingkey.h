@@ -0,0 +1,86 @@
+/****************************************************************************
+**
+** Copyright (C) 2012-2013 Richard J. Moore <rich@kde.org>
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef SIGNINGKEY_H
+#define SIGNINGKEY_H
+
+#include <QtCore/qshareddata.h>
+#include <QtNetwork/QSslKey>
+
+#include "certificate_global.h"
+
+QT_BEGIN_NAMESPACE_CERTIFICATE
+
+class SigningKeyPrivate;
+
+class Q_CERTIFICATE_EXPORT SigningKey
+{
+public:
+    SigningKey();
+    explicit SigningKey(const QSslKey &key);
+    explicit SigningKey(const QByteArray &encodedKey, QSsl::EncodingFormat format=QSsl::Pem);
+    SigningKey(const SigningKey &other);
+    ~SigningKey();
+
+    static int addPkcs11Provider(const QString &modulePath);
+    static SigningKey fromPkcs11Url(const QString &url, const QByteArray &pin=QByteArray(), int sessions=1);
+    static SigningKey fromSignerService(const QString &serverName, int maxPending=64);
+
+    SigningKey &operator=(const SigningKey &other);
+
+    void swap(SigningKey &other) { qSwap(d, other.d); }
+
+    bool isNull() const;
+
+    int error() const;
+    QString errorString() const;
+
+    int sessionCount() const;
+
+private:
+    friend class CertificateBuilder;
+    friend struct CrlBuilderPrivate;
+    friend struct OcspResponderPrivate;
+    friend class IssuerContext;
+    friend class SignerServer;
+    QExplicitlySharedDataPointer<SigningKeyPrivate> d;
+};
+
+QT_END_NAMESPACE_CERTIFICATE
+
+#endif // SIGNINGKEY_H
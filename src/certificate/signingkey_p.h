@@ -0,0 +1,112 @@
+/****************************************************************************
+**
+** Copyright (C) 2012-2013 Richard J. Moore <rich@kde.org>
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef SIGNINGKEY_P_H
+#define SIGNINGKEY_P_H
+
+#include <gnutls/gnutls.h>
+#include <gnutls/abstract.h>
+
+#include <QList>
+#include <QMutex>
+#include <QWaitCondition>
+
+#include "certificate.h"
+#include "signingkey.h"
+
+QT_BEGIN_NAMESPACE_CERTIFICATE
+
+class SigningKeyPrivate : public QSharedData
+{
+public:
+    SigningKeyPrivate();
+    ~SigningKeyPrivate();
+
+    void setKey(gnutls_privkey_t key);
+
+    gnutls_privkey_t acquire();
+    void release(gnutls_privkey_t key);
+
+    bool null;
+    int errno;
+
+    // Software keys can be used by several threads at once, but each token
+    // session can only perform one operation at a time so those keys are
+    // handed out exclusively.
+    bool exclusive;
+
+    // Wiped by the destructor
+    QByteArray pin;
+
+    QMutex mutex;
+    QWaitCondition available;
+    QList<gnutls_privkey_t> keys;
+    QList<gnutls_privkey_t> idle;
+};
+
+// Borrows a key from a SigningKey for the duration of a signing operation.
+class SigningKeyLocker
+{
+public:
+    SigningKeyLocker(SigningKeyPrivate *d)
+        : d(d),
+          key(d->acquire())
+    {
+    }
+
+    ~SigningKeyLocker()
+    {
+        d->release(key);
+    }
+
+    gnutls_privkey_t privkey() const { return key; }
+
+private:
+    Q_DISABLE_COPY(SigningKeyLocker)
+
+    SigningKeyPrivate *d;
+    gnutls_privkey_t key;
+};
+
+QByteArray signingkey_algorithm(SigningKeyPrivate *d, Certificate::SignatureDigest digest, int *errno);
+QByteArray signingkey_sign(SigningKeyPrivate *d, Certificate::SignatureDigest digest, const QByteArray &data,
+                           int *errno);
+
+QT_END_NAMESPACE_CERTIFICATE
+
+#endif // SIGNINGKEY_P_H
@@ -39,59 +39,138 @@
 #include <gnutls/gnutls.h>
 
 #include <QByteArray>
+#include <QHostAddress>
+#include <QThreadStorage>
 #include <QSslKey>
 #include <QSslCertificate>
 
+#include "securememory_p.h"
 #include "utils_p.h"
 
 QT_BEGIN_NAMESPACE_CERTIFICATE
 
 using namespace Certificate;
 
-void ensure_gnutls_init()
+/*!
+  \internal
+  Holds the reference on the gnutls library. Q_GLOBAL_STATIC ensures this is
+  only constructed once even if several threads start using the library at
+  the same time.
+ */
+class GnutlsInitializer
 {
-    static bool done = false;
+public:
+    GnutlsInitializer()
+    {
+        result = gnutls_global_init();
+    }
 
-    // TODO: protect with a mutex
-    if (!done) {
-        gnutls_global_init();
-        done = true;
+    ~GnutlsInitializer()
+    {
+        if (GNUTLS_E_SUCCESS == result)
+            gnutls_global_deinit();
     }
-}
 
-QByteArray entrytype_to_oid(Certificate::EntryType type)
+    int result;
+};
+
+Q_GLOBAL_STATIC(GnutlsInitializer, gnutlsInitializer)
+
+int ensure_gnutls_init()
 {
-    QByteArray oid;
+    return gnutlsInitializer()->result;
+}
 
+const char *entrytype_oid(Certificate::EntryType type)
+{
     // TODO: More common name entry types
 
     switch(type) {
     case EntryCountryName:
-        oid = QByteArray(GNUTLS_OID_X520_COUNTRY_NAME);
-        break;
+        return GNUTLS_OID_X520_COUNTRY_NAME;
     case EntryOrganizationName:
-        oid = QByteArray(GNUTLS_OID_X520_ORGANIZATION_NAME);
-        break;
+        return GNUTLS_OID_X520_ORGANIZATION_NAME;
     case EntryOrganizationalUnitName:
-        oid = QByteArray(GNUTLS_OID_X520_ORGANIZATIONAL_UNIT_NAME);
-        break;
+        return GNUTLS_OID_X520_ORGANIZATIONAL_UNIT_NAME;
     case EntryCommonName:
-        oid = QByteArray(GNUTLS_OID_X520_COMMON_NAME);
-        break;
+        return GNUTLS_OID_X520_COMMON_NAME;
     case EntryLocalityName:
-        oid = QByteArray(GNUTLS_OID_X520_LOCALITY_NAME);
-        break;
+        return GNUTLS_OID_X520_LOCALITY_NAME;
     case EntryStateOrProvinceName:
-        oid = QByteArray(GNUTLS_OID_X520_STATE_OR_PROVINCE_NAME);
-        break;
+        return GNUTLS_OID_X520_STATE_OR_PROVINCE_NAME;
     case EntryEmail:
-        oid = QByteArray(GNUTLS_OID_PKCS9_EMAIL);
-        break;
+        return GNUTLS_OID_PKCS9_EMAIL;
     default:
         qWarning("Unhandled name entry type %d", int(type));
     }
 
-    return oid;
+    return 0;
+}
+
+QByteArray entrytype_to_oid(Certificate::EntryType type)
+{
+    return QByteArray(entrytype_oid(type));
+}
+
+QByteArray keypurpose_to_oid(CertificateBuilder::KeyPurpose purpose)
+{
+    QByteArray ba;
+
+    switch(purpose) {
+    case CertificateBuilder::PurposeWebServer:
+        ba = QByteArray(GNUTLS_KP_TLS_WWW_SERVER);
+        break;
+    case CertificateBuilder::PurposeWebClient:
+        ba = QByteArray(GNUTLS_KP_TLS_WWW_CLIENT);
+        break;
+    case CertificateBuilder::PurposeCodeSigning:
+        ba = QByteArray(GNUTLS_KP_CODE_SIGNING);
+        break;
+    case CertificateBuilder::PurposeEmailProtection:
+        ba = QByteArray(GNUTLS_KP_EMAIL_PROTECTION);
+        break;
+    case CertificateBuilder::PurposeTimeStamping:
+        ba = QByteArray(GNUTLS_KP_TIME_STAMPING);
+        break;
+    case CertificateBuilder::PurposeOcspSigning:
+        ba = QByteArray(GNUTLS_KP_OCSP_SIGNING);
+        break;
+    case CertificateBuilder::PurposeIpsecIke:
+        ba = QByteArray(GNUTLS_KP_IPSEC_IKE);
+        break;
+    case CertificateBuilder::PurposeAny:
+        ba = QByteArray(GNUTLS_KP_ANY);
+        break;
+    default:
+        qWarning("Unknown Purpose %d", int(purpose));
+    }
+
+    return ba;
+}
+
+uint keyusage_to_gnutls(CertificateBuilder::KeyUsageFlags usages)
+{
+    uint usage = 0;
+    if (usages & CertificateBuilder::UsageEncipherOnly)
+        usage |= GNUTLS_KEY_ENCIPHER_ONLY;
+    if (usages & CertificateBuilder::UsageCrlSign)
+        usage |= GNUTLS_KEY_CRL_SIGN;
+    if (usages & CertificateBuilder::UsageKeyCertSign)
+        usage |= GNUTLS_KEY_KEY_CERT_SIGN;
+    if (usages & CertificateBuilder::UsageKeyAgreement)
+        usage |= GNUTLS_KEY_KEY_AGREEMENT;
+    if (usages & CertificateBuilder::UsageDataEncipherment)
+        usage |= GNUTLS_KEY_DATA_ENCIPHERMENT;
+    if (usages & CertificateBuilder::UsageKeyEncipherment)
+        usage |= GNUTLS_KEY_KEY_ENCIPHERMENT;
+    if (usages & CertificateBuilder::UsageNonRepudiation)
+        usage |= GNUTLS_KEY_NON_REPUDIATION;
+    if (usages & CertificateBuilder::UsageDigitalSignature)
+        usage |= GNUTLS_KEY_DIGITAL_SIGNATURE;
+    if (usages & CertificateBuilder::UsageDecipherOnly)
+        usage |= GNUTLS_KEY_DECIPHER_ONLY;
+
+    return usage;
 }
 
 gnutls_x509_privkey_t qsslkey_to_key(const QSslKey &qkey, int *errno)
@@ -102,14 +181,18 @@ gnutls_x509_privkey_t qsslkey_to_key(const QSslKey &qkey, int *errno)
     if (GNUTLS_E_SUCCESS != *errno)
         return 0;
 
-    QByteArray buf(qkey.toPem());
+    QByteArray buf(qkey.toDer());
 
-    // Setup a datum
+    // Setup a datum that refers to the DER directly
     gnutls_datum_t buffer;
-    buffer.data = (unsigned char *)(buf.data());
+    buffer.data = (unsigned char *)(buf.constData());
     buffer.size = buf.size();
 
-    *errno = gnutls_x509_privkey_import(key, &buffer, GNUTLS_X509_FMT_PEM);
+    *errno = gnutls_x509_privkey_import(key, &buffer, GNUTLS_X509_FMT_DER);
+
+    // Don't leave a copy of the key behind on the heap
+    secure_zero(buf);
+
     return key;
 }
 
@@ -121,40 +204,197 @@ gnutls_x509_crt_t qsslcert_to_crt(const QSslCertificate &qcert, int *errno)
     if (GNUTLS_E_SUCCESS != *errno)
         return 0;
 
-    QByteArray buf(qcert.toPem());
+    const QByteArray buf(qcert.toDer());
 
-    // Setup a datum
+    // Setup a datum that refers to the DER directly
     gnutls_datum_t buffer;
-    buffer.data = (unsigned char *)(buf.data());
+    buffer.data = (unsigned char *)(buf.constData());
     buffer.size = buf.size();
 
     // Import the cert
-    *errno = gnutls_x509_crt_import(cert, &buffer, GNUTLS_X509_FMT_PEM);
+    *errno = gnutls_x509_crt_import(cert, &buffer, GNUTLS_X509_FMT_DER);
     return cert;
 }
 
-QSslCertificate crt_to_qsslcert(gnutls_x509_crt_t crt, int *errno)
+gnutls_privkey_t qsslkey_to_privkey(const QSslKey &qkey, int *errno)
+{
+    gnutls_x509_privkey_t key = qsslkey_to_key(qkey, errno);
+    if (GNUTLS_E_SUCCESS != *errno) {
+        if (key)
+            gnutls_x509_privkey_deinit(key);
+        return 0;
+    }
+
+    gnutls_privkey_t abstractKey;
+    *errno = gnutls_privkey_init(&abstractKey);
+    if (GNUTLS_E_SUCCESS != *errno) {
+        gnutls_x509_privkey_deinit(key);
+        return 0;
+    }
+
+    // The abstract key takes ownership of the x509 key
+    *errno = gnutls_privkey_import_x509(abstractKey, key, GNUTLS_PRIVKEY_IMPORT_AUTO_RELEASE);
+    if (GNUTLS_E_SUCCESS != *errno) {
+        gnutls_privkey_deinit(abstractKey);
+        gnutls_x509_privkey_deinit(key);
+        return 0;
+    }
+
+    return abstractKey;
+}
+
+gnutls_privkey_t encoded_to_privkey(const QByteArray &encoded, QSsl::EncodingFormat format, int *errno)
+{
+    gnutls_privkey_t abstractKey;
+    *errno = gnutls_privkey_init(&abstractKey);
+    if (GNUTLS_E_SUCCESS != *errno)
+        return 0;
+
+    gnutls_datum_t buffer;
+    buffer.data = reinterpret_cast<unsigned char *>(const_cast<char *>(encoded.constData()));
+    buffer.size = encoded.size();
+
+    // Accepts both unencrypted PKCS#8 and the traditional formats
+    *errno = gnutls_privkey_import_x509_raw(abstractKey, &buffer,
+                                            (QSsl::Pem == format) ? GNUTLS_X509_FMT_PEM : GNUTLS_X509_FMT_DER,
+                                            0, 0);
+    if (GNUTLS_E_SUCCESS != *errno) {
+        gnutls_privkey_deinit(abstractKey);
+        return 0;
+    }
+
+    return abstractKey;
+}
+
+gnutls_digest_algorithm_t signature_digest(Certificate::SignatureDigest digest, gnutls_privkey_t key)
+{
+    uint bits = 0;
+    int pk = gnutls_privkey_get_pk_algorithm(key, &bits);
+
+#if GNUTLS_VERSION_NUMBER >= 0x030600
+    // EdDSA always hashes with the digest defined by the curve
+    if (GNUTLS_PK_EDDSA_ED25519 == pk)
+        return GNUTLS_DIG_UNKNOWN;
+#endif
+
+    switch(digest) {
+    case Certificate::DigestSha1:
+        return GNUTLS_DIG_SHA1;
+    case Certificate::DigestSha256:
+        return GNUTLS_DIG_SHA256;
+    case Certificate::DigestSha384:
+        return GNUTLS_DIG_SHA384;
+    case Certificate::DigestSha512:
+        return GNUTLS_DIG_SHA512;
+    case Certificate::DigestDefault:
+        break;
+    default:
+        qWarning("Unknown signature digest %d", int(digest));
+    }
+
+    // Match the digest to the size of the curve for ECDSA, otherwise stick
+    // with SHA1 for compatibility with earlier versions
+    if (GNUTLS_PK_ECDSA == pk) {
+        if (bits <= 256)
+            return GNUTLS_DIG_SHA256;
+        if (bits <= 384)
+            return GNUTLS_DIG_SHA384;
+        return GNUTLS_DIG_SHA512;
+    }
+
+    return GNUTLS_DIG_SHA1;
+}
+
+QByteArray crt_to_keyid(gnutls_x509_crt_t crt, int *errno)
 {
-    QByteArray ba(4096, 0);
+    QByteArray ba(128, 0); // Normally 20 bytes (SHA1)
     size_t size = ba.size();
 
-    *errno = gnutls_x509_crt_export(crt, GNUTLS_X509_FMT_PEM, ba.data(), &size);
+    // Try using the subject keyid
+    *errno = gnutls_x509_crt_get_subject_key_id(crt, reinterpret_cast<unsigned char *>(ba.data()), &size, NULL);
+
+    // Or fallback to creating it
+    if (GNUTLS_E_SUCCESS != *errno) {
+        size = ba.size();
+        *errno = gnutls_x509_crt_get_key_id(crt, 0, reinterpret_cast<unsigned char *>(ba.data()), &size);
+
+        if (GNUTLS_E_SUCCESS != *errno)
+            return QByteArray();
+    }
+
+    ba.resize(size);
+    return ba;
+}
+
+/*!
+  \internal
+  Returns the serial number padded with leading zeros to 20 bytes, the
+  maximum RFC 5280 allows, so that comparing two keys orders them
+  numerically. Returns a null QByteArray if the serial is empty or too long.
+ */
+QByteArray serial_to_key(const QByteArray &serial)
+{
+    int start = 0;
+    while (start < serial.size() && 0 == serial[start])
+        start++;
+
+    int size = serial.size() - start;
+    if (serial.isEmpty() || size > 20)
+        return QByteArray();
+
+    QByteArray key(20 - size, 0);
+    key.append(serial.constData() + start, size);
+    return key;
+}
+
+QByteArray &export_scratch_buffer()
+{
+    static QThreadStorage<QByteArray *> buffers;
+
+    if (!buffers.hasLocalData()) {
+        QByteArray *buffer = new QByteArray;
+        buffer->resize(4096); // Enough for most certificates and keys
+        buffers.setLocalData(buffer);
+    }
+
+    return *buffers.localData();
+}
+
+QSslCertificate crt_to_qsslcert(gnutls_x509_crt_t crt, int *errno)
+{
+    QByteArray ba = export_to_bytearray(gnutls_x509_crt_export, crt, GNUTLS_X509_FMT_DER, errno);
     if (GNUTLS_E_SUCCESS != *errno)
         return QSslCertificate();
 
-    return QSslCertificate(ba);
+    return QSslCertificate(ba, QSsl::Der);
 }
 
 QSslKey key_to_qsslkey(gnutls_x509_privkey_t key, QSsl::KeyAlgorithm algo, int *errno)
 {
-    QByteArray ba(4096, 0);
-    size_t size = ba.size();
+    // The key is exported into secure memory rather than the scratch buffer,
+    // which would otherwise hold a copy of it until the thread exits.
+    SecureScope scope;
+
+    size_t size = 0;
+    *errno = gnutls_x509_privkey_export(key, GNUTLS_X509_FMT_DER, 0, &size);
+    if (GNUTLS_E_SHORT_MEMORY_BUFFER != *errno && GNUTLS_E_SUCCESS != *errno)
+        return QSslKey();
 
-    *errno = gnutls_x509_privkey_export(key, GNUTLS_X509_FMT_PEM, ba.data(), &size);
+    char *buffer = scope.allocate(int(size));
+    if (!buffer) {
+        *errno = GNUTLS_E_MEMORY_ERROR;
+        return QSslKey();
+    }
+
+    *errno = gnutls_x509_privkey_export(key, GNUTLS_X509_FMT_DER, buffer, &size);
     if (GNUTLS_E_SUCCESS != *errno)
         return QSslKey();
 
-    return QSslKey(ba, algo);
+    QByteArray ba(buffer, int(size));
+    QSslKey qkey(ba, algo, QSsl::Der);
+    secure_zero(ba);
+
+    return qkey;
 }
 
 #if QT_VERSION >= 0x050000
@@ -167,6 +407,7 @@ gnutls_x509_subject_alt_name_t qssl_altnameentrytype_to_altname(QSsl::Alternativ
         return GNUTLS_SAN_DNSNAME;
     default:
         qWarning("Unknown alternative name type %d", int(qtype));
+        return InvalidAltName;
     }
 }
 #else
@@ -179,8 +420,112 @@ gnutls_x509_subject_alt_name_t qssl_altnameentrytype_to_altname(QSsl::AlternateN
         return GNUTLS_SAN_DNSNAME;
     default:
         qWarning("Unknown alternative name type %d", int(qtype));
+        return InvalidAltName;
     }
 }
 #endif
 
+static gnutls_x509_subject_alt_name_t altnametype_to_altname(AlternativeNameType type)
+{
+    switch(type) {
+    case AlternativeNameEmail:
+        return GNUTLS_SAN_RFC822NAME;
+    case AlternativeNameIpAddress:
+        return GNUTLS_SAN_IPADDRESS;
+    case AlternativeNameUri:
+        return GNUTLS_SAN_URI;
+    case AlternativeNameDns:
+        return GNUTLS_SAN_DNSNAME;
+    default:
+        return InvalidAltName;
+    }
+}
+
+/*!
+  \internal
+  Converts the textual form of an IPv4 or IPv6 address to the network byte
+  order form used in the subject alternative name extension. Returns a null
+  QByteArray if the address cannot be parsed.
+ */
+static QByteArray ipaddress_to_bytes(const QByteArray &text)
+{
+    QHostAddress addr;
+    if (!addr.setAddress(QString::fromLatin1(text)))
+        return QByteArray();
+
+    if (QAbstractSocket::IPv4Protocol == addr.protocol()) {
+        quint32 ip = addr.toIPv4Address();
+        char bytes[4];
+        bytes[0] = char(ip >> 24);
+        bytes[1] = char(ip >> 16);
+        bytes[2] = char(ip >> 8);
+        bytes[3] = char(ip);
+        return QByteArray(bytes, 4);
+    }
+
+    Q_IPV6ADDR ip = addr.toIPv6Address();
+    return QByteArray(reinterpret_cast<const char *>(ip.c), 16);
+}
+
+/*!
+  \internal
+  Encodes a complete subject alternative name extension containing all of
+  the specified names. The names are collected first and the extension is
+  then DER encoded in a single pass, which avoids the decode and re-encode
+  that gnutls performs each time a single name is appended. RFC 5280 does
+  not allow the extension to be empty, so an empty list is an error, as is
+  a name of an unknown type.
+ */
+QByteArray altnames_to_extension(const QList<AlternativeName> &names, int *errno)
+{
+    if (names.isEmpty()) {
+        *errno = GNUTLS_E_INVALID_REQUEST;
+        return QByteArray();
+    }
+
+    gnutls_subject_alt_names_t sans;
+    *errno = gnutls_subject_alt_names_init(&sans);
+    if (GNUTLS_E_SUCCESS != *errno)
+        return QByteArray();
+
+    for (int i = 0; i < names.size(); i++) {
+        gnutls_x509_subject_alt_name_t type = altnametype_to_altname(names[i].first);
+        if (InvalidAltName == type) {
+            *errno = GNUTLS_E_INVALID_REQUEST;
+            break;
+        }
+
+        QByteArray value = names[i].second;
+        if (AlternativeNameIpAddress == names[i].first) {
+            value = ipaddress_to_bytes(value);
+            if (value.isNull()) {
+                *errno = GNUTLS_E_INVALID_REQUEST;
+                break;
+            }
+        }
+
+        gnutls_datum_t datum;
+        datum.data = reinterpret_cast<unsigned char *>(value.data());
+        datum.size = value.size();
+
+        // gnutls takes its own copy of the value
+        *errno = gnutls_subject_alt_names_set(sans, type, &datum, 0);
+        if (GNUTLS_E_SUCCESS != *errno)
+            break;
+    }
+
+    QByteArray result;
+    if (GNUTLS_E_SUCCESS == *errno) {
+        gnutls_datum_t der;
+        *errno = gnutls_x509_ext_export_subject_alt_names(sans, &der);
+        if (GNUTLS_E_SUCCESS == *errno) {
+            result = QByteArray(reinterpret_cast<const char *>(der.data), der.size);
+            gnutls_free(der.data);
+        }
+    }
+
+    gnutls_subject_alt_names_deinit(sans);
+    return result;
+}
+
 QT_END_NAMESPACE_CERTIFICATE
@@ -40,27 +40,93 @@
 #define UTILS_P_H
 
 #include <gnutls/x509.h>
+#include <gnutls/x509-ext.h>
+#include <gnutls/abstract.h>
 
 #include <QtNetwork/QSsl>
+#include <QtCore/QAtomicInt>
+#include <QtCore/QAtomicPointer>
 #include <QtCore/QByteArray>
+#include <QtCore/QList>
 
 #include "certificate_global.h"
 #include "certificate.h"
+#include "certificatebuilder.h"
 
 class QSslKey;
 class QSslCertificate;
 
 QT_BEGIN_NAMESPACE_CERTIFICATE
 
-void ensure_gnutls_init();
+// Marked for export where the conversions benchmark calls them directly
+Q_CERTIFICATE_EXPORT int ensure_gnutls_init();
 
+// Reads an atomic with acquire ordering. Qt 4 has no plain atomic load, so
+// a read-modify-write that changes nothing is used there instead.
+inline int atomic_load_acquire(const QAtomicInt &value)
+{
+#if QT_VERSION >= 0x050000
+    return value.loadAcquire();
+#else
+    return const_cast<QAtomicInt &>(value).fetchAndAddAcquire(0);
+#endif
+}
+
+template <typename T>
+inline T *atomic_load_acquire(const QAtomicPointer<T> &value)
+{
+#if QT_VERSION >= 0x050000
+    return value.loadAcquire();
+#else
+    return const_cast<QAtomicPointer<T> &>(value).fetchAndAddAcquire(0);
+#endif
+}
+
+const char *entrytype_oid(Certificate::EntryType type);
 QByteArray entrytype_to_oid(Certificate::EntryType type);
+QByteArray keypurpose_to_oid(CertificateBuilder::KeyPurpose purpose);
+uint keyusage_to_gnutls(CertificateBuilder::KeyUsageFlags usages);
+
+Q_CERTIFICATE_EXPORT gnutls_x509_privkey_t qsslkey_to_key(const QSslKey &qkey, int *errno);
+Q_CERTIFICATE_EXPORT gnutls_x509_crt_t qsslcert_to_crt(const QSslCertificate &qcert, int *errno);
+gnutls_privkey_t qsslkey_to_privkey(const QSslKey &qkey, int *errno);
+gnutls_privkey_t encoded_to_privkey(const QByteArray &encoded, QSsl::EncodingFormat format, int *errno);
 
-gnutls_x509_privkey_t qsslkey_to_key(const QSslKey &qkey, int *errno);
-gnutls_x509_crt_t qsslcert_to_crt(const QSslCertificate &qcert, int *errno);
+gnutls_digest_algorithm_t signature_digest(Certificate::SignatureDigest digest, gnutls_privkey_t key);
 
-QSslCertificate crt_to_qsslcert(gnutls_x509_crt_t crt, int *errno);
-QSslKey key_to_qsslkey(gnutls_x509_privkey_t key, QSsl::KeyAlgorithm algo, int *errno);
+QByteArray crt_to_keyid(gnutls_x509_crt_t crt, int *errno);
+QByteArray serial_to_key(const QByteArray &serial);
+
+QByteArray &export_scratch_buffer();
+
+// Export a gnutls object using exporter. The export is attempted using a
+// per-thread scratch buffer, which is grown if gnutls reports that it is too
+// small, and the result is returned as a QByteArray of exactly the right size.
+template <typename T>
+QByteArray export_to_bytearray(int (*exporter)(T, gnutls_x509_crt_fmt_t, void *, size_t *),
+                               T object, gnutls_x509_crt_fmt_t format, int *errno)
+{
+    QByteArray &scratch = export_scratch_buffer();
+    size_t size = scratch.size();
+
+    *errno = exporter(object, format, scratch.data(), &size);
+    if (GNUTLS_E_SHORT_MEMORY_BUFFER == *errno) {
+        // size has been updated to the space required
+        scratch.resize(int(size));
+        *errno = exporter(object, format, scratch.data(), &size);
+    }
+
+    if (GNUTLS_E_SUCCESS != *errno)
+        return QByteArray();
+
+    return QByteArray(scratch.constData(), int(size));
+}
+
+Q_CERTIFICATE_EXPORT QSslCertificate crt_to_qsslcert(gnutls_x509_crt_t crt, int *errno);
+Q_CERTIFICATE_EXPORT QSslKey key_to_qsslkey(gnutls_x509_privkey_t key, QSsl::KeyAlgorithm algo, int *errno);
+
+// Returned for subject alternative name types that cannot be encoded
+static const gnutls_x509_subject_alt_name_t InvalidAltName = gnutls_x509_subject_alt_name_t(0);
 
 #if QT_VERSION >= 0x050000
 gnutls_x509_subject_alt_name_t qssl_altnameentrytype_to_altname(QSsl::AlternativeNameEntryType qtype);
@@ -68,6 +134,8 @@ gnutls_x509_subject_alt_name_t qssl_altnameentrytype_to_altname(QSsl::Alternativ
 gnutls_x509_subject_alt_name_t qssl_altnameentrytype_to_altname(QSsl::AlternateNameEntryType qtype);
 #endif
 
+QByteArray altnames_to_extension(const QList<Certificate::AlternativeName> &names, int *errno);
+
 QT_END_NAMESPACE_CERTIFICATE
 
 #endif // UTILS_P_H
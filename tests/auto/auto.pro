@@ -1,7 +1,20 @@
 TEMPLATE = subdirs
 
 SUBDIRS += keybuilder \
+           keypool \
+           randomgenerator \
+           serialallocator \
+           certificatebuilder \
            certificaterequest \
-           certificaterequestbuilder
+           certificaterequestbuilder \
+           bundlereader \
+           signingkey \
+           signerserver \
+           crlbuilder \
+           crlindex \
+           ocspresponder \
+           batchissuer \
+           leafcertificatecache \
+           certificatelibrary
 
 
@@ -0,0 +1,83 @@
+#include <QSslKey>
+#include <QSslCertificate>
+#include <QtTest/QtTest>
+
+#include "batchissuer.h"
+#include "certificatebuilder.h"
+#include "certificateprofile.h"
+#include "certificaterequest.h"
+#include "issuercontext.h"
+#include "keybuilder.h"
+#include "testhelpers.h"
+
+QT_USE_NAMESPACE_CERTIFICATE
+
+class tst_BatchIssuer : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void issueInOrder();
+    void badRequest();
+
+private:
+
+    QSslKey leafKey;
+    IssuerContext issuer;
+};
+
+void tst_BatchIssuer::initTestCase()
+{
+    QSslKey caKey = KeyBuilder::generate(QSsl::Rsa, KeyBuilder::StrengthLow);
+    leafKey = KeyBuilder::generate(QSsl::Rsa, KeyBuilder::StrengthLow);
+
+    QSslCertificate caCert = createCa(caKey, "Batch CA");
+    QVERIFY(!caCert.isNull());
+
+    issuer = IssuerContext(caCert, caKey);
+    QVERIFY(!issuer.isNull());
+}
+
+void tst_BatchIssuer::issueInOrder()
+{
+    QList<CertificateRequest> requests;
+    for (int i = 0; i < 16; i++)
+        requests << makeRequest(leafKey, QByteArray("leaf") + QByteArray::number(i));
+
+    CertificateProfile profile;
+    profile.setBasicConstraints(false);
+    profile.setKeyUsage(CertificateBuilder::UsageDigitalSignature|CertificateBuilder::UsageKeyEncipherment);
+    profile.addKeyPurpose(CertificateBuilder::PurposeWebServer);
+
+    BatchIssuer batch(issuer, profile);
+    batch.setMaxThreadCount(4);
+
+    QList<BatchIssuer::Result> results = batch.issue(requests);
+    QCOMPARE(results.size(), requests.size());
+
+    for (int i = 0; i < results.size(); i++) {
+        QCOMPARE(results[i].error, 0);
+        QCOMPARE(commonName(results[i].certificate), QString("leaf%1").arg(i));
+        QCOMPARE(results[i].certificate.issuerInfo(QSslCertificate::CommonName),
+                 issuer.certificate().subjectInfo(QSslCertificate::CommonName));
+    }
+}
+
+void tst_BatchIssuer::badRequest()
+{
+    QList<CertificateRequest> requests;
+    requests << makeRequest(leafKey, "good") << CertificateRequest() << makeRequest(leafKey, "alsogood");
+
+    BatchIssuer batch(issuer, CertificateProfile());
+    QList<BatchIssuer::Result> results = batch.issue(requests);
+
+    QCOMPARE(results.size(), 3);
+    QCOMPARE(results[0].error, 0);
+    QVERIFY(results[1].error != 0);
+    QVERIFY(results[1].certificate.isNull());
+    QCOMPARE(results[2].error, 0);
+}
+
+QTEST_MAIN(tst_BatchIssuer)
+#include "tst_batchissuer.moc"
@@ -0,0 +1,191 @@
+#include <QBuffer>
+#include <QTemporaryFile>
+#include <QtTest/QtTest>
+
+#include "bundlereader.h"
+#include "certificaterequest.h"
+
+QT_USE_NAMESPACE_CERTIFICATE
+
+//
+// A sequential device that only has data once it has been waited for, a
+// hundred bytes at a time, like a slow socket.
+//
+class TrickleDevice : public QIODevice
+{
+public:
+    TrickleDevice(const QByteArray &data) : data(data), ready(0), pos(0) {}
+
+    bool isSequential() const { return true; }
+
+    bool waitForReadyRead(int)
+    {
+        if (ready >= data.size())
+            return false;
+        ready = qMin(data.size(), ready + 100);
+        return true;
+    }
+
+protected:
+    qint64 readData(char *out, qint64 maxSize)
+    {
+        int count = int(qMin<qint64>(maxSize, ready - pos));
+        memcpy(out, data.constData() + pos, count);
+        pos += count;
+        return count;
+    }
+
+    qint64 writeData(const char *, qint64) { return -1; }
+
+private:
+    QByteArray data;
+    int ready;
+    int pos;
+};
+
+class tst_BundleReader : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void readPemFile();
+    void readPemDevice();
+    void readDer();
+    void readParallel();
+    void trailingText();
+    void sequentialDevice();
+    void truncated();
+    void missingFile();
+
+private:
+    QByteArray bundle();
+};
+
+QByteArray tst_BundleReader::bundle()
+{
+    QFile f("requests/bundle.pem");
+    f.open(QIODevice::ReadOnly);
+    return f.readAll();
+}
+
+static QString commonName(const CertificateRequest &req)
+{
+    return req.nameEntryInfo(Certificate::EntryCommonName).value(0);
+}
+
+void tst_BundleReader::readPemFile()
+{
+    BundleReader reader("requests/bundle.pem");
+    QCOMPARE(reader.error(), 0);
+
+    QCOMPARE(commonName(reader.readRequest()), QString("one.example.com"));
+    QCOMPARE(commonName(reader.readRequest()), QString("two.example.com"));
+    QCOMPARE(commonName(reader.readRequest()), QString("three.example.com"));
+
+    QVERIFY(reader.readRequest().isNull());
+    QVERIFY(reader.atEnd());
+    QCOMPARE(reader.error(), 0);
+}
+
+void tst_BundleReader::readPemDevice()
+{
+    QByteArray data = bundle();
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::ReadOnly);
+
+    BundleReader reader(&buffer);
+
+    int count = 0;
+    for (QByteArray object = reader.readObject(); !object.isEmpty(); object = reader.readObject()) {
+        QVERIFY(object.startsWith("-----BEGIN CERTIFICATE REQUEST-----"));
+        count++;
+    }
+
+    QCOMPARE(count, 3);
+    QVERIFY(reader.atEnd());
+    QCOMPARE(reader.error(), 0);
+}
+
+void tst_BundleReader::readDer()
+{
+    QByteArray data;
+    BundleReader pem("requests/bundle.pem");
+    for (CertificateRequest req = pem.readRequest(); !req.isNull(); req = pem.readRequest())
+        data += req.toDer();
+
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::ReadOnly);
+
+    BundleReader reader(&buffer, QSsl::Der);
+    QList<CertificateRequest> requests = reader.readRequests(10);
+
+    QCOMPARE(requests.size(), 3);
+    QCOMPARE(commonName(requests.at(2)), QString("three.example.com"));
+    QVERIFY(reader.atEnd());
+    QCOMPARE(reader.error(), 0);
+}
+
+void tst_BundleReader::readParallel()
+{
+    BundleReader reader("requests/bundle.pem");
+    reader.setMaxThreadCount(4);
+
+    QList<CertificateRequest> first = reader.readRequests(2);
+    QCOMPARE(first.size(), 2);
+    QCOMPARE(commonName(first.at(0)), QString("one.example.com"));
+    QCOMPARE(commonName(first.at(1)), QString("two.example.com"));
+
+    QList<CertificateRequest> rest = reader.readRequests(2);
+    QCOMPARE(rest.size(), 1);
+    QCOMPARE(commonName(rest.at(0)), QString("three.example.com"));
+}
+
+void tst_BundleReader::trailingText()
+{
+    QTemporaryFile file;
+    QVERIFY(file.open());
+    file.write(bundle());
+    file.write("\n\nThis is not a PEM block\n");
+    file.close();
+
+    BundleReader reader(file.fileName());
+    QCOMPARE(reader.readRequests(3).size(), 3);
+    QVERIFY(reader.atEnd());
+    QCOMPARE(reader.error(), 0);
+}
+
+void tst_BundleReader::sequentialDevice()
+{
+    TrickleDevice device(bundle());
+    device.open(QIODevice::ReadOnly);
+
+    BundleReader reader(&device);
+    QCOMPARE(reader.readRequests(10).size(), 3);
+    QVERIFY(reader.atEnd());
+    QCOMPARE(reader.error(), 0);
+}
+
+void tst_BundleReader::truncated()
+{
+    QByteArray data = bundle();
+    data.truncate(data.lastIndexOf("-----END"));
+
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::ReadOnly);
+
+    BundleReader reader(&buffer);
+    QCOMPARE(reader.readRequests(10).size(), 2);
+    QVERIFY(reader.error() != 0);
+    QVERIFY(reader.atEnd());
+}
+
+void tst_BundleReader::missingFile()
+{
+    BundleReader reader("requests/does-not-exist.pem");
+    QVERIFY(reader.error() != 0);
+    QVERIFY(reader.atEnd());
+    QVERIFY(reader.readRequest().isNull());
+}
+
+QTEST_MAIN(tst_BundleReader)
+#include "tst_bundlereader.moc"
@@ -0,0 +1,141 @@
+#include <QFuture>
+#include <QSslKey>
+#include <QSslCertificate>
+#include <QtTest/QtTest>
+
+#include "certificatebuilder.h"
+#include "certificaterequest.h"
+#include "certificaterequestbuilder.h"
+#include "issuercontext.h"
+#include "keybuilder.h"
+#include "randomgenerator.h"
+
+QT_USE_NAMESPACE_CERTIFICATE
+
+class tst_CertificateBuilder : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void selfSignedAsync();
+    void caSignedAsync();
+    void issuerSignedAsync();
+    void asyncError();
+
+private:
+    CertificateRequest makeRequest(const QSslKey &key, const QByteArray &cn);
+    void setupBuilder(CertificateBuilder &builder, const QSslKey &key, const QByteArray &cn);
+
+    QSslKey caKey;
+    QSslCertificate caCert;
+    QSslKey leafKey;
+};
+
+CertificateRequest tst_CertificateBuilder::makeRequest(const QSslKey &key, const QByteArray &cn)
+{
+    CertificateRequestBuilder reqbuilder;
+    reqbuilder.setVersion(1);
+    reqbuilder.setKey(key);
+    reqbuilder.addNameEntry(Certificate::EntryCommonName, cn);
+
+    return reqbuilder.signedRequest(key);
+}
+
+void tst_CertificateBuilder::setupBuilder(CertificateBuilder &builder, const QSslKey &key, const QByteArray &cn)
+{
+    builder.setRequest(makeRequest(key, cn));
+    builder.setVersion(3);
+    builder.setSerial(RandomGenerator::getPositiveBytes(16));
+    builder.setActivationTime(QDateTime::currentDateTimeUtc());
+    builder.setExpirationTime(QDateTime::currentDateTimeUtc().addDays(1));
+    builder.setSignatureDigest(Certificate::DigestSha256);
+}
+
+void tst_CertificateBuilder::initTestCase()
+{
+    caKey = KeyBuilder::generate(QSsl::Rsa, KeyBuilder::StrengthLow);
+    QVERIFY(!caKey.isNull());
+
+    leafKey = KeyBuilder::generate(QSsl::Rsa, KeyBuilder::StrengthLow);
+    QVERIFY(!leafKey.isNull());
+
+    CertificateBuilder builder;
+    setupBuilder(builder, caKey, "Async CA");
+    builder.setBasicConstraints(true);
+    builder.setKeyUsage(CertificateBuilder::UsageCrlSign | CertificateBuilder::UsageKeyCertSign);
+    builder.addSubjectKeyIdentifier();
+
+    caCert = builder.signedCertificate(caKey);
+    QVERIFY(!caCert.isNull());
+}
+
+void tst_CertificateBuilder::selfSignedAsync()
+{
+    CertificateBuilder builder;
+    setupBuilder(builder, leafKey, "self.example.com");
+
+    QFuture<QSslCertificate> future = builder.signedCertificateAsync(leafKey);
+    future.waitForFinished();
+
+    QSslCertificate cert = future.result();
+    QVERIFY(!cert.isNull());
+    QCOMPARE(builder.error(), 0);
+    QCOMPARE(cert.issuerInfo(QSslCertificate::CommonName), cert.subjectInfo(QSslCertificate::CommonName));
+}
+
+void tst_CertificateBuilder::caSignedAsync()
+{
+    CertificateBuilder builder;
+    setupBuilder(builder, leafKey, "leaf.example.com");
+
+    QFuture<QSslCertificate> future = builder.signedCertificateAsync(caCert, caKey);
+    future.waitForFinished();
+
+    QSslCertificate cert = future.result();
+    QVERIFY(!cert.isNull());
+    QCOMPARE(builder.error(), 0);
+    QCOMPARE(cert.issuerInfo(QSslCertificate::CommonName), caCert.subjectInfo(QSslCertificate::CommonName));
+}
+
+void tst_CertificateBuilder::issuerSignedAsync()
+{
+    IssuerContext issuer(caCert, caKey);
+    QVERIFY(!issuer.isNull());
+
+    CertificateBuilder builder;
+    setupBuilder(builder, leafKey, "leaf.example.com");
+
+    QFuture<QSslCertificate> future = builder.signedCertificateAsync(issuer);
+    future.waitForFinished();
+
+    QSslCertificate cert = future.result();
+    QVERIFY(!cert.isNull());
+    QCOMPARE(builder.error(), 0);
+    QCOMPARE(cert.issuerInfo(QSslCertificate::CommonName), caCert.subjectInfo(QSslCertificate::CommonName));
+}
+
+void tst_CertificateBuilder::asyncError()
+{
+    CertificateBuilder builder;
+    setupBuilder(builder, leafKey, "leaf.example.com");
+
+    // Failures are reported through the builder once the future finishes
+    QFuture<QSslCertificate> future = builder.signedCertificateAsync(QSslKey());
+    future.waitForFinished();
+    QVERIFY(future.result().isNull());
+    QVERIFY(builder.error() != 0);
+
+    future = builder.signedCertificateAsync(QSslCertificate(), caKey);
+    future.waitForFinished();
+    QVERIFY(future.result().isNull());
+    QVERIFY(builder.error() != 0);
+
+    future = builder.signedCertificateAsync(IssuerContext());
+    future.waitForFinished();
+    QVERIFY(future.result().isNull());
+    QVERIFY(builder.error() != 0);
+}
+
+QTEST_MAIN(tst_CertificateBuilder)
+#include "tst_certificatebuilder.moc"
@@ -0,0 +1,79 @@
+#include <QSemaphore>
+#include <QThread>
+#include <QtTest/QtTest>
+
+#include "certificatelibrary.h"
+#include "keybuilder.h"
+
+QT_USE_NAMESPACE_CERTIFICATE
+
+//
+// Waits for the other threads to be ready so that they all warm up at
+// once, then records whether it worked.
+//
+class WarmUpThread : public QThread
+{
+public:
+    WarmUpThread(QSemaphore *go)
+        : go(go),
+          result(false)
+    {
+    }
+
+    void run()
+    {
+        go->acquire();
+        result = CertificateLibrary::warmUp();
+    }
+
+    QSemaphore *go;
+    bool result;
+};
+
+class tst_CertificateLibrary : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void concurrentWarmUp();
+    void warmUp();
+};
+
+void tst_CertificateLibrary::concurrentWarmUp()
+{
+    // This runs first, so that the threads are the first to initialise
+    // the library
+    const int count = 8;
+
+    QSemaphore go;
+    QList<WarmUpThread *> threads;
+    for (int i = 0; i < count; i++) {
+        threads << new WarmUpThread(&go);
+        threads.last()->start();
+    }
+
+    go.release(count);
+
+    int succeeded = 0;
+    for (int i = 0; i < count; i++) {
+        if (threads[i]->wait(60000) && threads[i]->result)
+            succeeded++;
+    }
+
+    qDeleteAll(threads);
+    QCOMPARE(succeeded, count);
+
+    // The library is still usable afterwards
+    QVERIFY(!KeyBuilder::generate(QSsl::Rsa, KeyBuilder::StrengthLow).isNull());
+}
+
+void tst_CertificateLibrary::warmUp()
+{
+    QVERIFY(CertificateLibrary::warmUp());
+
+    // Calling it again is harmless
+    QVERIFY(CertificateLibrary::warmUp());
+}
+
+QTEST_MAIN(tst_CertificateLibrary)
+#include "tst_certificatelibrary.moc"
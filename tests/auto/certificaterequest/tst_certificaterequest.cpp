@@ -11,9 +11,12 @@ class tst_CertificateRequest : public QObject
 private slots:
     void checkNull();
     void loadCrq();
+    void loadFromMemory();
+    void loadFromFile();
     void checkEntryAttributes();
     void checkEntries();
     void checkToText();
+    void checkSharedCopy();
 };
 
 void tst_CertificateRequest::checkNull()
@@ -40,6 +43,41 @@ void tst_CertificateRequest::loadCrq()
     QVERIFY(filePem == csr.toPem());
 }
 
+void tst_CertificateRequest::loadFromMemory()
+{
+    QFile f("requests/test-ocsp-good-req.pem");
+    f.open(QIODevice::ReadOnly);
+    QByteArray filePem = f.readAll();
+    f.close();
+
+    CertificateRequest csr(filePem);
+    QVERIFY(!csr.isNull());
+    QCOMPARE(csr.toPem(), filePem);
+
+    CertificateRequest csr2 = CertificateRequest::fromData(filePem.constData(), filePem.size());
+    QVERIFY(!csr2.isNull());
+    QCOMPARE(csr2.toPem(), filePem);
+
+    CertificateRequest der(csr.toDer(), QSsl::Der);
+    QVERIFY(!der.isNull());
+    QCOMPARE(der.toPem(), filePem);
+
+    CertificateRequest bad(QByteArray("garbage"));
+    QVERIFY(bad.isNull());
+    QVERIFY(bad.error() != 0);
+}
+
+void tst_CertificateRequest::loadFromFile()
+{
+    CertificateRequest csr = CertificateRequest::fromFile("requests/test-ocsp-good-req.pem");
+    QVERIFY(!csr.isNull());
+    QCOMPARE(csr.nameEntryInfo(Certificate::EntryCommonName), QStringList() << "example.com");
+
+    CertificateRequest missing = CertificateRequest::fromFile("requests/does-not-exist.pem");
+    QVERIFY(missing.isNull());
+    QVERIFY(missing.error() != 0);
+}
+
 void tst_CertificateRequest::checkEntryAttributes()
 {
     QFile f("requests/test-ocsp-good-req.pem");
@@ -113,5 +151,43 @@ void tst_CertificateRequest::checkToText()
     QCOMPARE(text, csr.toText());
 }
 
+void tst_CertificateRequest::checkSharedCopy()
+{
+    QFile f("requests/test-ocsp-good-req.pem");
+    f.open(QIODevice::ReadOnly);
+    CertificateRequest csr(&f);
+    f.close();
+
+    const CertificateRequest copy = csr;
+    QVERIFY(!copy.isNull());
+    QCOMPARE(copy.toDer(), csr.toDer());
+    QCOMPARE(copy.nameEntryInfo(Certificate::EntryCommonName), QStringList() << "example.com");
+
+    // Reading does not change the error
+    QVERIFY(copy.nameEntryInfo(Certificate::EntryLocalityName).isEmpty());
+    QCOMPARE(copy.error(), 0);
+
+    // Assigning over one copy leaves the others alone
+    CertificateRequest other = csr;
+    other = CertificateRequest(QByteArray("not a request"));
+    QVERIFY(other.isNull());
+    QVERIFY(other.error() != 0);
+
+    QVERIFY(!csr.isNull());
+    QCOMPARE(csr.error(), 0);
+    QCOMPARE(csr.nameEntryInfo(Certificate::EntryCommonName), QStringList() << "example.com");
+    QCOMPARE(copy.toPem(), csr.toPem());
+    QCOMPARE(copy.toDer(), csr.toDer());
+
+    other = copy;
+    QCOMPARE(other.toPem(), csr.toPem());
+
+    // The copy survives the original going away
+    csr = CertificateRequest();
+    QVERIFY(csr.isNull());
+    QCOMPARE(copy.nameEntryAttributes().size(), 5);
+    QCOMPARE(copy.toPem(), other.toPem());
+}
+
 QTEST_MAIN(tst_CertificateRequest)
 #include "tst_certificaterequest.moc"
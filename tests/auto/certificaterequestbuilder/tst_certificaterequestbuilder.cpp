@@ -1,7 +1,9 @@
+#include <QFuture>
 #include <QtTest/QtTest>
 
 #include "certificaterequest.h"
 #include "certificaterequestbuilder.h"
+#include "keybuilder.h"
 
 QT_USE_NAMESPACE_CERTIFICATE
 
@@ -12,6 +14,11 @@ class tst_CertificateRequestBuilder : public QObject
 private slots:
     void version();
     void entries();
+    void encodedKey();
+    void alternativeNames();
+    void invalidIpAddress();
+    void invalidAlternativeNames();
+    void signedRequestAsync();
 };
 
 void tst_CertificateRequestBuilder::version()
@@ -41,6 +48,7 @@ void tst_CertificateRequestBuilder::entries()
 
     builder.setKey(key);
     CertificateRequest req = builder.signedRequest(key);
+    QVERIFY(!req.isNull());
 
     QStringList countryName;
     countryName << "GB";
@@ -68,6 +76,115 @@ void tst_CertificateRequestBuilder::entries()
     QCOMPARE(commonName, req.nameEntryInfo(Certificate::EntryCommonName));
 }
 
+void tst_CertificateRequestBuilder::encodedKey()
+{
+    QByteArray key = KeyBuilder::generateEncoded(KeyBuilder::TypeEd25519, KeyBuilder::StrengthNormal);
+
+    CertificateRequestBuilder builder;
+    builder.setVersion(1);
+    builder.addNameEntry(Certificate::EntryCommonName, "www.example.com");
+    builder.setSignatureDigest(Certificate::DigestSha256);
+
+    QVERIFY(builder.setKey(key));
+    CertificateRequest req = builder.signedRequest(key);
+    QCOMPARE(builder.error(), 0);
+
+    QStringList commonName;
+    commonName << "www.example.com";
+    QCOMPARE(commonName, req.nameEntryInfo(Certificate::EntryCommonName));
+}
+
+void tst_CertificateRequestBuilder::alternativeNames()
+{
+    QFile f("keys/leaf.key");
+    f.open(QIODevice::ReadOnly);
+    QSslKey key(&f, QSsl::Rsa);
+    f.close();
+
+    QList<Certificate::AlternativeName> names;
+    names << Certificate::AlternativeName(Certificate::AlternativeNameDns, "www.example.com");
+    names << Certificate::AlternativeName(Certificate::AlternativeNameEmail, "test@example.com");
+    names << Certificate::AlternativeName(Certificate::AlternativeNameIpAddress, "192.0.2.1");
+    names << Certificate::AlternativeName(Certificate::AlternativeNameIpAddress, "2001:db8::1");
+    names << Certificate::AlternativeName(Certificate::AlternativeNameUri, "https://www.example.com/");
+    for (int i = 0; i < 1000; i++)
+        names << Certificate::AlternativeName(Certificate::AlternativeNameDns, "host" + QByteArray::number(i) + ".example.com");
+
+    CertificateRequestBuilder builder;
+    builder.setVersion(1);
+    builder.setKey(key);
+    builder.addNameEntry(Certificate::EntryCommonName, "www.example.com");
+    builder.addSubjectAlternativeNameEntry(QSsl::DnsEntry, "replaced.example.com");
+    QVERIFY(builder.setSubjectAlternativeNames(names));
+
+    CertificateRequest req = builder.signedRequest(key);
+    QVERIFY(!req.isNull());
+
+    QString text = req.toText();
+    QVERIFY(text.contains(QLatin1String("DNSname: www.example.com")));
+    QVERIFY(text.contains(QLatin1String("RFC822Name: test@example.com")));
+    QVERIFY(text.contains(QLatin1String("IPAddress: 192.0.2.1")));
+    QVERIFY(text.contains(QLatin1String("IPAddress: 2001:db8::1")));
+    QVERIFY(text.contains(QLatin1String("URI: https://www.example.com/")));
+    QVERIFY(text.contains(QLatin1String("DNSname: host999.example.com")));
+    QVERIFY(!text.contains(QLatin1String("replaced.example.com")));
+}
+
+void tst_CertificateRequestBuilder::invalidIpAddress()
+{
+    QList<Certificate::AlternativeName> names;
+    names << Certificate::AlternativeName(Certificate::AlternativeNameIpAddress, "not an address");
+
+    CertificateRequestBuilder builder;
+    QVERIFY(!builder.setSubjectAlternativeNames(names));
+    QVERIFY(builder.error() != 0);
+}
+
+void tst_CertificateRequestBuilder::invalidAlternativeNames()
+{
+    CertificateRequestBuilder builder;
+    QVERIFY(!builder.setSubjectAlternativeNames(QList<Certificate::AlternativeName>()));
+    QVERIFY(builder.error() != 0);
+
+    QList<Certificate::AlternativeName> names;
+    names << Certificate::AlternativeName(Certificate::AlternativeNameDns, "www.example.com");
+    names << Certificate::AlternativeName(Certificate::AlternativeNameType(42), "unknown");
+
+    CertificateRequestBuilder other;
+    QVERIFY(!other.setSubjectAlternativeNames(names));
+    QVERIFY(other.error() != 0);
+}
+
+void tst_CertificateRequestBuilder::signedRequestAsync()
+{
+    QFile f("keys/leaf.key");
+    f.open(QIODevice::ReadOnly);
+    QSslKey key(&f, QSsl::Rsa);
+    f.close();
+
+    CertificateRequestBuilder builder;
+    builder.setVersion(1);
+    builder.setKey(key);
+    builder.addNameEntry(Certificate::EntryCommonName, "www.example.com");
+
+    QFuture<CertificateRequest> future = builder.signedRequestAsync(key);
+    future.waitForFinished();
+
+    CertificateRequest req = future.result();
+    QVERIFY(!req.isNull());
+    QCOMPARE(builder.error(), 0);
+
+    QStringList commonName;
+    commonName << "www.example.com";
+    QCOMPARE(commonName, req.nameEntryInfo(Certificate::EntryCommonName));
+
+    // Failures are reported through the builder once the future finishes
+    future = builder.signedRequestAsync(QSslKey());
+    future.waitForFinished();
+
+    QVERIFY(future.result().isNull());
+    QVERIFY(builder.error() != 0);
+}
 
 QTEST_MAIN(tst_CertificateRequestBuilder)
 #include "tst_certificaterequestbuilder.moc"
@@ -0,0 +1,11 @@
+TEMPLATE = app
+TARGET = tst_crlbuilder
+
+CONFIG += testcase
+QT += testlib network
+
+LIBS    += -Wl,-rpath,../../../src/certificate -L../../../src/certificate -lcertificate -lgnutls
+INCLUDEPATH += ../../../src/certificate
+
+SOURCES += tst_crlbuilder.cpp
+
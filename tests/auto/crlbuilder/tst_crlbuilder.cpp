@@ -0,0 +1,363 @@
+#include <QSslKey>
+#include <QSslCertificate>
+#include <QtTest/QtTest>
+
+#include <gnutls/gnutls.h>
+#include <gnutls/x509.h>
+
+#include "certificatebuilder.h"
+#include "certificaterequestbuilder.h"
+#include "crlbuilder.h"
+#include "issuercontext.h"
+#include "keybuilder.h"
+#include "randomgenerator.h"
+#include "signingkey.h"
+
+QT_USE_NAMESPACE_CERTIFICATE
+
+static const char *OidDeltaCrlIndicator = "2.5.29.27";
+static const char *OidIssuingDistributionPoint = "2.5.29.28";
+
+//
+// Wraps a gnutls CRL so that the output of CrlBuilder can be checked by an
+// independent parser.
+//
+class ParsedCrl
+{
+public:
+    ParsedCrl(const QByteArray &der)
+    {
+        gnutls_x509_crl_init(&crl);
+
+        gnutls_datum_t datum;
+        datum.data = reinterpret_cast<unsigned char *>(const_cast<char *>(der.constData()));
+        datum.size = der.size();
+        error = gnutls_x509_crl_import(crl, &datum, GNUTLS_X509_FMT_DER);
+    }
+
+    ~ParsedCrl()
+    {
+        gnutls_x509_crl_deinit(crl);
+    }
+
+    QList<QByteArray> serials() const
+    {
+        QList<QByteArray> result;
+        int count = gnutls_x509_crl_get_crt_count(crl);
+        for (int i = 0; i < count; i++) {
+            unsigned char serial[64];
+            size_t size = sizeof(serial);
+            time_t t;
+            if (GNUTLS_E_SUCCESS == gnutls_x509_crl_get_crt_serial(crl, i, serial, &size, &t))
+                result << QByteArray(reinterpret_cast<const char *>(serial), size);
+        }
+        return result;
+    }
+
+    quint64 number() const
+    {
+        unsigned char number[16];
+        size_t size = sizeof(number);
+        if (gnutls_x509_crl_get_number(crl, number, &size, 0) < 0)
+            return 0;
+
+        quint64 result = 0;
+        for (size_t i = 0; i < size; i++)
+            result = (result << 8) | number[i];
+        return result;
+    }
+
+    bool hasExtension(const char *oid, bool *critical) const
+    {
+        for (int i = 0;; i++) {
+            char buf[128];
+            size_t size = sizeof(buf);
+            unsigned int crit;
+            if (gnutls_x509_crl_get_extension_info(crl, i, buf, &size, &crit) < 0)
+                return false;
+            if (0 == qstrcmp(buf, oid)) {
+                *critical = crit;
+                return true;
+            }
+        }
+    }
+
+    bool verify(const QSslCertificate &cacert) const
+    {
+        QByteArray der = cacert.toDer();
+        gnutls_datum_t datum;
+        datum.data = reinterpret_cast<unsigned char *>(der.data());
+        datum.size = der.size();
+
+        gnutls_x509_crt_t crt;
+        gnutls_x509_crt_init(&crt);
+        if (GNUTLS_E_SUCCESS != gnutls_x509_crt_import(crt, &datum, GNUTLS_X509_FMT_DER)) {
+            gnutls_x509_crt_deinit(crt);
+            return false;
+        }
+
+        unsigned int status = 0;
+        int ret = gnutls_x509_crl_verify(crl, &crt, 1, 0, &status);
+        gnutls_x509_crt_deinit(crt);
+
+        return GNUTLS_E_SUCCESS == ret && 0 == status;
+    }
+
+    int error;
+    gnutls_x509_crl_t crl;
+};
+
+static QByteArray serial(int n)
+{
+    QByteArray result(2, 0);
+    result[0] = char(n >> 8);
+    result[1] = char(n & 0xff);
+    return result;
+}
+
+class tst_CrlBuilder : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void emptyCrl();
+    void fullCrl();
+    void outOfOrder();
+    void invalidSerial();
+    void invalidTime();
+    void releaseHold();
+    void deltaCrl();
+    void partitionCrl();
+    void pem();
+
+private:
+    QSslCertificate caCert;
+    IssuerContext issuer;
+};
+
+void tst_CrlBuilder::initTestCase()
+{
+    QSslKey caKey = KeyBuilder::generate(QSsl::Rsa, KeyBuilder::StrengthLow);
+    QVERIFY(!caKey.isNull());
+
+    CertificateRequestBuilder reqbuilder;
+    reqbuilder.setVersion(1);
+    reqbuilder.setKey(caKey);
+    reqbuilder.addNameEntry(Certificate::EntryCommonName, "CRL CA");
+
+    CertificateBuilder builder;
+    builder.setRequest(reqbuilder.signedRequest(caKey));
+    builder.setVersion(3);
+    builder.setSerial(RandomGenerator::getPositiveBytes(16));
+    builder.setActivationTime(QDateTime::currentDateTimeUtc());
+    builder.setExpirationTime(QDateTime::currentDateTimeUtc().addDays(1));
+    builder.setBasicConstraints(true);
+    builder.setKeyUsage(CertificateBuilder::UsageCrlSign | CertificateBuilder::UsageKeyCertSign);
+    builder.addSubjectKeyIdentifier();
+    caCert = builder.signedCertificate(caKey);
+    QVERIFY(!caCert.isNull());
+
+    issuer = IssuerContext(caCert, caKey);
+    QVERIFY(!issuer.isNull());
+}
+
+void tst_CrlBuilder::emptyCrl()
+{
+    CrlBuilder builder;
+    builder.setSignatureDigest(Certificate::DigestSha256);
+    builder.setNextUpdate(QDateTime::currentDateTimeUtc().addDays(1));
+    QCOMPARE(builder.count(), 0);
+
+    QByteArray der = builder.signedCrl(issuer);
+    QCOMPARE(builder.error(), 0);
+
+    ParsedCrl crl(der);
+    QCOMPARE(crl.error, 0);
+    QVERIFY(crl.verify(caCert));
+    QCOMPARE(crl.serials().size(), 0);
+    QCOMPARE(crl.number(), quint64(1));
+    QCOMPARE(builder.crlNumber(), quint64(2));
+}
+
+void tst_CrlBuilder::fullCrl()
+{
+    CrlBuilder builder;
+    builder.setSignatureDigest(Certificate::DigestSha256);
+    builder.setCrlNumber(10);
+    builder.setNextUpdate(QDateTime::currentDateTimeUtc().addDays(1));
+
+    QDateTime now = QDateTime::currentDateTimeUtc();
+    for (int i = 1; i <= 100; i++)
+        QVERIFY(builder.addRevokedSerial(serial(i), now, CrlBuilder::ReasonKeyCompromise));
+
+    QCOMPARE(builder.count(), 100);
+    QVERIFY(builder.isRevoked(serial(50)));
+    QVERIFY(builder.isRevoked(QByteArray(1, char(50))));
+    QVERIFY(!builder.isRevoked(serial(101)));
+
+    ParsedCrl crl(builder.signedCrl(issuer));
+    QCOMPARE(crl.error, 0);
+    QVERIFY(crl.verify(caCert));
+    QCOMPARE(crl.number(), quint64(10));
+
+    QList<QByteArray> serials = crl.serials();
+    QCOMPARE(serials.size(), 100);
+    QCOMPARE(serials.first(), QByteArray(1, char(1)));
+    QCOMPARE(serials.last(), QByteArray(1, char(100)));
+
+    // A later CRL includes the new entry as well as the old ones
+    QVERIFY(builder.addRevokedSerial(serial(1000), now));
+    ParsedCrl next(builder.signedCrl(issuer));
+    QVERIFY(next.verify(caCert));
+    QCOMPARE(next.number(), quint64(11));
+    QCOMPARE(next.serials().size(), 101);
+}
+
+void tst_CrlBuilder::outOfOrder()
+{
+    CrlBuilder builder;
+    builder.setSignatureDigest(Certificate::DigestSha256);
+    QDateTime now = QDateTime::currentDateTimeUtc();
+
+    builder.addRevokedSerial(serial(300), now);
+    builder.addRevokedSerial(serial(2), now);
+    builder.addRevokedSerial(serial(20), now);
+    builder.addRevokedSerial(serial(20), now, CrlBuilder::ReasonSuperseded);
+
+    QCOMPARE(builder.count(), 3);
+
+    ParsedCrl crl(builder.signedCrl(issuer));
+    QVERIFY(crl.verify(caCert));
+
+    QList<QByteArray> serials = crl.serials();
+    QCOMPARE(serials.size(), 3);
+    QCOMPARE(serials[0], QByteArray(1, char(2)));
+    QCOMPARE(serials[1], QByteArray(1, char(20)));
+    QCOMPARE(serials[2], serial(300));
+}
+
+void tst_CrlBuilder::invalidSerial()
+{
+    CrlBuilder builder;
+    builder.setSignatureDigest(Certificate::DigestSha256);
+    QVERIFY(!builder.addRevokedSerial(QByteArray(), QDateTime::currentDateTimeUtc()));
+    QVERIFY(builder.error() != 0);
+    QVERIFY(!builder.addRevokedSerial(QByteArray(21, 1), QDateTime::currentDateTimeUtc()));
+    QCOMPARE(builder.count(), 0);
+
+    QVERIFY(builder.signedCrl(IssuerContext()).isEmpty());
+    QVERIFY(builder.error() != 0);
+}
+
+void tst_CrlBuilder::invalidTime()
+{
+    CrlBuilder builder;
+    QVERIFY(!builder.addRevokedSerial(serial(1), QDateTime()));
+    QVERIFY(builder.error() != 0);
+    QCOMPARE(builder.count(), 0);
+}
+
+void tst_CrlBuilder::releaseHold()
+{
+    CrlBuilder builder;
+    builder.setSignatureDigest(Certificate::DigestSha256);
+    QDateTime now = QDateTime::currentDateTimeUtc();
+
+    // removeFromCRL is only valid in a delta CRL, for a certificate on hold
+    QVERIFY(builder.addRevokedSerial(serial(1), now, CrlBuilder::ReasonCertificateHold));
+    QVERIFY(builder.addRevokedSerial(serial(2), now, CrlBuilder::ReasonKeyCompromise));
+    QVERIFY(!builder.addRevokedSerial(serial(1), now, CrlBuilder::ReasonRemoveFromCrl));
+    QVERIFY(builder.error() != 0);
+
+    QVERIFY(!builder.signedCrl(issuer).isEmpty());
+
+    QVERIFY(!builder.addRevokedSerial(serial(2), now, CrlBuilder::ReasonRemoveFromCrl));
+    QVERIFY(!builder.addRevokedSerial(serial(3), now, CrlBuilder::ReasonRemoveFromCrl));
+    QVERIFY(builder.addRevokedSerial(serial(1), now, CrlBuilder::ReasonRemoveFromCrl));
+    QVERIFY(!builder.isRevoked(serial(1)));
+    QCOMPARE(builder.count(), 1);
+
+    ParsedCrl delta(builder.signedDeltaCrl(issuer));
+    QVERIFY(delta.verify(caCert));
+    QCOMPARE(delta.serials(), QList<QByteArray>() << QByteArray(1, char(1)));
+
+    ParsedCrl full(builder.signedCrl(issuer));
+    QVERIFY(full.verify(caCert));
+    QCOMPARE(full.serials(), QList<QByteArray>() << QByteArray(1, char(2)));
+}
+
+void tst_CrlBuilder::deltaCrl()
+{
+    CrlBuilder builder;
+    builder.setSignatureDigest(Certificate::DigestSha256);
+    QDateTime now = QDateTime::currentDateTimeUtc();
+
+    // A delta needs a base to refer to
+    QVERIFY(builder.signedDeltaCrl(issuer).isEmpty());
+    QVERIFY(builder.error() != 0);
+
+    for (int i = 1; i <= 10; i++)
+        builder.addRevokedSerial(serial(i), now);
+    QVERIFY(!builder.signedCrl(issuer).isEmpty());
+
+    builder.addRevokedSerial(serial(11), now);
+    builder.addRevokedSerial(serial(12), now);
+
+    ParsedCrl delta(builder.signedDeltaCrl(issuer));
+    QCOMPARE(delta.error, 0);
+    QVERIFY(delta.verify(caCert));
+    QCOMPARE(delta.number(), quint64(2));
+    QCOMPARE(delta.serials().size(), 2);
+
+    bool critical = false;
+    QVERIFY(delta.hasExtension(OidDeltaCrlIndicator, &critical));
+    QVERIFY(critical);
+
+    // Issuing a new base resets the delta
+    QVERIFY(!builder.signedCrl(issuer).isEmpty());
+    ParsedCrl empty(builder.signedDeltaCrl(issuer));
+    QVERIFY(empty.verify(caCert));
+    QCOMPARE(empty.serials().size(), 0);
+}
+
+void tst_CrlBuilder::partitionCrl()
+{
+    CrlBuilder builder;
+    builder.setSignatureDigest(Certificate::DigestSha256);
+    QDateTime now = QDateTime::currentDateTimeUtc();
+
+    for (int i = 0; i < 1000; i += 10)
+        builder.addRevokedSerial(serial(i + 1), now);
+
+    ParsedCrl crl(builder.signedPartitionCrl(issuer, serial(100), serial(199),
+                                             "http://crl.example.com/1.crl"));
+    QCOMPARE(crl.error, 0);
+    QVERIFY(crl.verify(caCert));
+
+    QList<QByteArray> serials = crl.serials();
+    QCOMPARE(serials.size(), 10);
+    QCOMPARE(serials.first(), QByteArray(1, char(101)));
+    QCOMPARE(serials.last(), QByteArray(1, char(191)));
+
+    bool critical = false;
+    QVERIFY(crl.hasExtension(OidIssuingDistributionPoint, &critical));
+    QVERIFY(critical);
+
+    QVERIFY(builder.signedPartitionCrl(issuer, serial(200), serial(100), "http://crl.example.com/2.crl").isEmpty());
+    QVERIFY(builder.signedPartitionCrl(issuer, serial(100), serial(200), QByteArray()).isEmpty());
+}
+
+void tst_CrlBuilder::pem()
+{
+    CrlBuilder builder;
+    builder.setSignatureDigest(Certificate::DigestSha256);
+    builder.addRevokedSerial(serial(1), QDateTime::currentDateTimeUtc());
+
+    QByteArray pem = builder.signedCrl(issuer, QSsl::Pem);
+    QVERIFY(pem.startsWith("-----BEGIN X509 CRL-----\n"));
+    QVERIFY(pem.endsWith("-----END X509 CRL-----\n"));
+}
+
+QTEST_MAIN(tst_CrlBuilder)
+#include "tst_crlbuilder.moc"
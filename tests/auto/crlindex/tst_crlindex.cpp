@@ -0,0 +1,261 @@
+#include <QSslKey>
+#include <QSslCertificate>
+#include <QTemporaryFile>
+#include <QThread>
+#include <QtTest/QtTest>
+
+#include "crlbuilder.h"
+#include "crlindex.h"
+#include "issuercontext.h"
+#include "keybuilder.h"
+#include "testhelpers.h"
+
+QT_USE_NAMESPACE_CERTIFICATE
+
+//
+// Repeatedly queries the index while the main thread swaps CRLs, recording
+// any answer that could only come from a partially loaded CRL.
+//
+class QueryThread : public QThread
+{
+public:
+    QueryThread(const CrlIndex *index)
+        : index(index),
+          failures(0),
+          queries(0)
+    {
+    }
+
+    void run()
+    {
+        do {
+            // Serial 1 is in both CRLs, 2 is in neither
+            if (!index->isRevoked(serial(1)) || index->isRevoked(serial(2)))
+                failures++;
+
+            int count = index->count();
+            if (count != 100 && count != 200)
+                failures++;
+
+            queries++;
+        } while (!stop.fetchAndAddOrdered(0));
+    }
+
+    const CrlIndex *index;
+    QAtomicInt stop;
+    int failures;
+    int queries;
+};
+
+class tst_CrlIndex : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void empty();
+    void lookup();
+    void leadingZeros();
+    void loadFile();
+    void wrongIssuer();
+    void invalidCrl();
+    void deltaCrl();
+    void partitionCrl();
+    void concurrentSwap();
+
+private:
+    QByteArray makeCrl(int first, int count, int step=1);
+
+    QSslCertificate caCert;
+    IssuerContext issuer;
+};
+
+QByteArray tst_CrlIndex::makeCrl(int first, int count, int step)
+{
+    CrlBuilder builder;
+    builder.setSignatureDigest(Certificate::DigestSha256);
+    builder.setNextUpdate(QDateTime::currentDateTimeUtc().addDays(1));
+
+    QDateTime now = QDateTime::currentDateTimeUtc();
+    for (int i = 0; i < count; i++)
+        builder.addRevokedSerial(serial(first + i * step), now);
+
+    return builder.signedCrl(issuer);
+}
+
+void tst_CrlIndex::initTestCase()
+{
+    QSslKey caKey = KeyBuilder::generate(QSsl::Rsa, KeyBuilder::StrengthLow);
+    QVERIFY(!caKey.isNull());
+
+    caCert = createCa(caKey, "CRL CA");
+    QVERIFY(!caCert.isNull());
+
+    issuer = IssuerContext(caCert, caKey);
+    QVERIFY(!issuer.isNull());
+}
+
+void tst_CrlIndex::empty()
+{
+    CrlIndex index;
+    QCOMPARE(index.count(), 0);
+    QVERIFY(!index.isRevoked(serial(1)));
+    QVERIFY(!index.thisUpdate().isValid());
+}
+
+void tst_CrlIndex::lookup()
+{
+    CrlIndex index;
+    index.setIssuer(caCert);
+    QVERIFY(index.load(makeCrl(10, 1000, 3)));
+    QCOMPARE(index.error(), 0);
+
+    QCOMPARE(index.count(), 1000);
+    QCOMPARE(index.crlNumber(), quint64(1));
+    QVERIFY(index.thisUpdate().isValid());
+    QVERIFY(index.nextUpdate() > index.thisUpdate());
+
+    for (int i = 0; i < 1000; i++) {
+        QVERIFY(index.isRevoked(serial(10 + i * 3)));
+        QVERIFY(!index.isRevoked(serial(11 + i * 3)));
+    }
+
+    QVERIFY(index.revocationTime(serial(10)).isValid());
+    QVERIFY(qAbs(index.revocationTime(serial(10)).secsTo(index.thisUpdate())) < 60);
+    QVERIFY(!index.revocationTime(serial(11)).isValid());
+
+    QVERIFY(!index.isRevoked(QByteArray()));
+    QVERIFY(!index.isRevoked(QByteArray(21, 1)));
+}
+
+void tst_CrlIndex::leadingZeros()
+{
+    CrlIndex index;
+    QVERIFY(index.load(makeCrl(0x80, 1)));
+
+    // The serial matches however many leading zeros it is given with
+    QVERIFY(index.isRevoked(QByteArray(1, char(0x80))));
+    QVERIFY(index.isRevoked(QByteArray::fromHex("0080")));
+    QVERIFY(index.isRevoked(QByteArray::fromHex("00000080")));
+    QVERIFY(!index.isRevoked(QByteArray::fromHex("8000")));
+}
+
+void tst_CrlIndex::loadFile()
+{
+    QTemporaryFile f;
+    QVERIFY(f.open());
+    f.write(makeCrl(1, 50));
+    f.close();
+
+    CrlIndex index;
+    QVERIFY(index.loadFile(f.fileName()));
+    QCOMPARE(index.count(), 50);
+    QVERIFY(index.isRevoked(serial(50)));
+
+    QVERIFY(!index.loadFile(QLatin1String("does-not-exist.crl")));
+    QVERIFY(index.error() != 0);
+    QCOMPARE(index.count(), 50);
+}
+
+void tst_CrlIndex::wrongIssuer()
+{
+    QSslKey otherKey = KeyBuilder::generate(QSsl::Rsa, KeyBuilder::StrengthLow);
+    QSslCertificate other = createCa(otherKey, "Other CA");
+    QVERIFY(!other.isNull());
+
+    CrlIndex index;
+    index.setIssuer(caCert);
+    QVERIFY(index.load(makeCrl(1, 10)));
+
+    index.setIssuer(other);
+    QVERIFY(!index.load(makeCrl(1, 20)));
+    QVERIFY(index.error() != 0);
+
+    // The previous CRL stays in use
+    QCOMPARE(index.count(), 10);
+}
+
+void tst_CrlIndex::invalidCrl()
+{
+    CrlIndex index;
+    QVERIFY(!index.load(QByteArray("not a crl")));
+    QVERIFY(index.error() != 0);
+    QCOMPARE(index.count(), 0);
+}
+
+void tst_CrlIndex::deltaCrl()
+{
+    CrlBuilder builder;
+    builder.setSignatureDigest(Certificate::DigestSha256);
+    builder.setNextUpdate(QDateTime::currentDateTimeUtc().addDays(1));
+    builder.addRevokedSerial(serial(1), QDateTime::currentDateTimeUtc());
+    QByteArray base = builder.signedCrl(issuer);
+
+    builder.addRevokedSerial(serial(2), QDateTime::currentDateTimeUtc());
+    QByteArray delta = builder.signedDeltaCrl(issuer);
+    QVERIFY(!delta.isEmpty());
+
+    CrlIndex index;
+    QVERIFY(index.load(base));
+
+    // A delta would make serial 1 look valid again
+    QVERIFY(!index.load(delta));
+    QVERIFY(index.error() != 0);
+    QVERIFY(index.isRevoked(serial(1)));
+    QCOMPARE(index.count(), 1);
+}
+
+void tst_CrlIndex::partitionCrl()
+{
+    CrlBuilder builder;
+    builder.setSignatureDigest(Certificate::DigestSha256);
+    builder.setNextUpdate(QDateTime::currentDateTimeUtc().addDays(1));
+    builder.addRevokedSerial(serial(1), QDateTime::currentDateTimeUtc());
+    builder.addRevokedSerial(serial(100), QDateTime::currentDateTimeUtc());
+
+    QByteArray partition = builder.signedPartitionCrl(issuer, serial(1), serial(50),
+                                                      "http://crl.example.com/1.crl");
+    QVERIFY(!partition.isEmpty());
+
+    CrlIndex index;
+    QVERIFY(index.load(builder.signedCrl(issuer)));
+
+    // The partition leaves out serial 100
+    QVERIFY(!index.load(partition));
+    QVERIFY(index.error() != 0);
+    QVERIFY(index.isRevoked(serial(100)));
+    QCOMPARE(index.count(), 2);
+}
+
+void tst_CrlIndex::concurrentSwap()
+{
+    QList<QByteArray> crls;
+    crls << makeCrl(1, 100, 2) << makeCrl(1, 200, 3);
+
+    CrlIndex index;
+    QVERIFY(index.load(crls[0]));
+
+    QList<QueryThread *> threads;
+    for (int i = 0; i < 4; i++) {
+        threads << new QueryThread(&index);
+        threads.last()->start();
+    }
+
+    for (int i = 0; i < 200; i++)
+        QVERIFY(index.load(crls[i % 2]));
+
+    foreach (QueryThread *thread, threads) {
+        thread->stop.fetchAndStoreOrdered(1);
+        thread->wait();
+    }
+
+    foreach (QueryThread *thread, threads) {
+        QCOMPARE(thread->failures, 0);
+        QVERIFY(thread->queries > 0);
+    }
+
+    qDeleteAll(threads);
+}
+
+QTEST_MAIN(tst_CrlIndex)
+#include "tst_crlindex.moc"
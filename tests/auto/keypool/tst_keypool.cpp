@@ -0,0 +1,64 @@
+#include <QSslKey>
+#include <QtTest/QtTest>
+
+#include "keypool.h"
+
+QT_USE_NAMESPACE_CERTIFICATE
+
+class tst_KeyPool : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void missWhenEmpty();
+    void hitAfterReserve();
+    void keysAreUnique();
+};
+
+void tst_KeyPool::missWhenEmpty()
+{
+    KeyPool pool;
+    pool.setPoolSize(1);
+
+    QSslKey key = pool.take(QSsl::Rsa, KeyBuilder::StrengthLow);
+    QVERIFY(!key.isNull());
+
+    KeyPool::Statistics stats = pool.statistics(QSsl::Rsa, KeyBuilder::StrengthLow);
+    QCOMPARE(stats.misses, 1);
+    QCOMPARE(stats.hits, 0);
+}
+
+void tst_KeyPool::hitAfterReserve()
+{
+    KeyPool pool;
+    pool.setPoolSize(2);
+    pool.reserve(QSsl::Rsa, KeyBuilder::StrengthLow);
+
+    QTRY_COMPARE(pool.statistics(QSsl::Rsa, KeyBuilder::StrengthLow).depth, 2);
+
+    QSslKey key = pool.take(QSsl::Rsa, KeyBuilder::StrengthLow);
+    QVERIFY(!key.isNull());
+
+    KeyPool::Statistics stats = pool.statistics(QSsl::Rsa, KeyBuilder::StrengthLow);
+    QCOMPARE(stats.hits, 1);
+    QCOMPARE(stats.misses, 0);
+    QVERIFY(stats.refills >= 2);
+}
+
+void tst_KeyPool::keysAreUnique()
+{
+    KeyPool pool;
+    pool.setPoolSize(3);
+    pool.reserve(QSsl::Rsa, KeyBuilder::StrengthLow);
+
+    QSslKey key1 = pool.take(QSsl::Rsa, KeyBuilder::StrengthLow);
+    QSslKey key2 = pool.take(QSsl::Rsa, KeyBuilder::StrengthLow);
+    QSslKey key3 = pool.take(QSsl::Rsa, KeyBuilder::StrengthLow);
+
+    QVERIFY(key1.toPem() != key2.toPem());
+    QVERIFY(key2.toPem() != key3.toPem());
+    QVERIFY(key1.toPem() != key3.toPem());
+}
+
+QTEST_MAIN(tst_KeyPool)
+#include "tst_keypool.moc"
@@ -0,0 +1,174 @@
+#include <QSslKey>
+#include <QSslCertificate>
+#include <QtTest/QtTest>
+
+#include <gnutls/gnutls.h>
+#include <gnutls/x509.h>
+
+#include "certificatebuilder.h"
+#include "certificateprofile.h"
+#include "certificaterequest.h"
+#include "certificaterequestbuilder.h"
+#include "issuercontext.h"
+#include "keybuilder.h"
+#include "leafcertificatecache.h"
+#include "randomgenerator.h"
+
+QT_USE_NAMESPACE_CERTIFICATE
+
+class tst_LeafCertificateCache : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void hit();
+    void nameOrder();
+    void duplicateNames();
+    void eviction();
+    void ipAddress();
+
+private:
+    QSslKey leafKey;
+    IssuerContext issuer;
+};
+
+void tst_LeafCertificateCache::initTestCase()
+{
+    QSslKey caKey = KeyBuilder::generate(QSsl::Rsa, KeyBuilder::StrengthLow);
+    leafKey = KeyBuilder::generate(QSsl::Rsa, KeyBuilder::StrengthLow);
+
+    CertificateRequestBuilder reqbuilder;
+    reqbuilder.setVersion(1);
+    reqbuilder.setKey(caKey);
+    reqbuilder.addNameEntry(Certificate::EntryCommonName, "Proxy CA");
+    CertificateRequest careq = reqbuilder.signedRequest(caKey);
+
+    CertificateBuilder builder;
+    builder.setRequest(careq);
+    builder.setVersion(3);
+    builder.setSerial(RandomGenerator::getPositiveBytes(16));
+    builder.setActivationTime(QDateTime::currentDateTimeUtc());
+    builder.setExpirationTime(QDateTime::currentDateTimeUtc().addDays(1));
+    builder.setBasicConstraints(true);
+    builder.setKeyUsage(CertificateBuilder::UsageCrlSign|CertificateBuilder::UsageKeyCertSign);
+    builder.addSubjectKeyIdentifier();
+
+    issuer = IssuerContext(builder.signedCertificate(caKey), caKey);
+    QVERIFY(!issuer.isNull());
+}
+
+void tst_LeafCertificateCache::hit()
+{
+    LeafCertificateCache cache(issuer, CertificateProfile());
+    cache.setSharedKey(leafKey);
+
+    QVERIFY(!cache.contains("www.example.com"));
+
+    LeafCertificateCache::Entry first = cache.certificate("www.example.com");
+    QVERIFY(!first.isNull());
+    QCOMPARE(first.error, 0);
+    QCOMPARE(first.key, leafKey);
+    QVERIFY(cache.contains("www.example.com"));
+
+    LeafCertificateCache::Entry second = cache.certificate("WWW.example.com");
+    QCOMPARE(second.certificate, first.certificate);
+    QCOMPARE(cache.size(), 1);
+
+    QStringList names = first.certificate.alternateSubjectNames().values(QSsl::DnsEntry);
+    QVERIFY(names.contains("www.example.com"));
+}
+
+void tst_LeafCertificateCache::nameOrder()
+{
+    LeafCertificateCache cache(issuer, CertificateProfile());
+    cache.setSharedKey(leafKey);
+
+    QStringList names;
+    names << "a.example.com" << "b.example.com";
+    LeafCertificateCache::Entry first = cache.certificate("example.com", names);
+
+    QStringList reversed;
+    reversed << "b.example.com" << "a.example.com";
+    LeafCertificateCache::Entry second = cache.certificate("example.com", reversed);
+
+    QCOMPARE(second.certificate, first.certificate);
+
+    LeafCertificateCache::Entry other = cache.certificate("example.com");
+    QVERIFY(other.certificate != first.certificate);
+    QCOMPARE(cache.size(), 2);
+}
+
+void tst_LeafCertificateCache::duplicateNames()
+{
+    LeafCertificateCache cache(issuer, CertificateProfile());
+    cache.setSharedKey(leafKey);
+
+    QStringList names;
+    names << "WWW.example.com" << "a.example.com" << "A.Example.com" << "a.example.com";
+    LeafCertificateCache::Entry entry = cache.certificate("www.example.com", names);
+    QVERIFY(!entry.isNull());
+
+    // Each name appears once whatever its case
+    QStringList sans = entry.certificate.alternateSubjectNames().values(QSsl::DnsEntry);
+    QCOMPARE(sans.size(), 2);
+    QVERIFY(sans.contains("www.example.com"));
+    QVERIFY(sans.contains("a.example.com"));
+
+    // Repeated names do not change which entry is used
+    QStringList single;
+    single << "a.example.com";
+    QCOMPARE(cache.certificate("www.example.com", single).certificate, entry.certificate);
+    QCOMPARE(cache.size(), 1);
+}
+
+void tst_LeafCertificateCache::eviction()
+{
+    LeafCertificateCache cache(issuer, CertificateProfile());
+    cache.setSharedKey(leafKey);
+    cache.setCapacity(2);
+
+    cache.certificate("one.example.com");
+    cache.certificate("two.example.com");
+    cache.certificate("one.example.com");
+    cache.certificate("three.example.com");
+
+    QCOMPARE(cache.size(), 2);
+    QVERIFY(cache.contains("one.example.com"));
+    QVERIFY(!cache.contains("two.example.com"));
+    QVERIFY(cache.contains("three.example.com"));
+}
+
+void tst_LeafCertificateCache::ipAddress()
+{
+    LeafCertificateCache cache(issuer, CertificateProfile());
+    cache.setSharedKey(leafKey);
+
+    LeafCertificateCache::Entry entry = cache.certificate("192.0.2.1", QStringList() << "www.example.com");
+    QVERIFY(!entry.isNull());
+
+    QByteArray der = entry.certificate.toDer();
+    gnutls_datum_t datum;
+    datum.data = reinterpret_cast<unsigned char *>(der.data());
+    datum.size = der.size();
+
+    gnutls_x509_crt_t crt;
+    gnutls_x509_crt_init(&crt);
+    QCOMPARE(gnutls_x509_crt_import(crt, &datum, GNUTLS_X509_FMT_DER), GNUTLS_E_SUCCESS);
+
+    // The address is stored as 4 bytes in network order, not as a DNS name
+    char name[256];
+    size_t size = sizeof(name);
+    int type = gnutls_x509_crt_get_subject_alt_name(crt, 0, name, &size, 0);
+    QCOMPARE(type, int(GNUTLS_SAN_IPADDRESS));
+    QCOMPARE(QByteArray(name, int(size)), QByteArray("\xc0\x00\x02\x01", 4));
+
+    size = sizeof(name);
+    type = gnutls_x509_crt_get_subject_alt_name(crt, 1, name, &size, 0);
+    QCOMPARE(type, int(GNUTLS_SAN_DNSNAME));
+
+    gnutls_x509_crt_deinit(crt);
+}
+
+QTEST_MAIN(tst_LeafCertificateCache)
+#include "tst_leafcertificatecache.moc"
@@ -0,0 +1,11 @@
+TEMPLATE = app
+TARGET = tst_ocspresponder
+
+CONFIG += testcase
+QT += testlib network
+
+LIBS    += -Wl,-rpath,../../../src/certificate -L../../../src/certificate -lcertificate -lgnutls
+INCLUDEPATH += ../../../src/certificate ../shared
+
+SOURCES += tst_ocspresponder.cpp
+
@@ -0,0 +1,641 @@
+#include <QSemaphore>
+#include <QSslKey>
+#include <QSslCertificate>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QThread>
+#include <QtTest/QtTest>
+
+#include <gnutls/gnutls.h>
+#include <gnutls/ocsp.h>
+#include <gnutls/x509.h>
+
+#include "certificatebuilder.h"
+#include "certificaterequestbuilder.h"
+#include "crlbuilder.h"
+#include "crlindex.h"
+#include "issuercontext.h"
+#include "keybuilder.h"
+#include "ocspresponder.h"
+#include "randomgenerator.h"
+#include "testhelpers.h"
+
+QT_USE_NAMESPACE_CERTIFICATE
+
+//
+// A minimal HTTP server standing in for a real OCSP endpoint. It answers
+// each POST by passing the body to the responder.
+//
+class OcspHttpServer : public QTcpServer
+{
+    Q_OBJECT
+
+public:
+    OcspHttpServer(OcspResponder *responder)
+        : responder(responder)
+    {
+        connect(this, SIGNAL(newConnection()), SLOT(acceptConnections()));
+    }
+
+private slots:
+    void acceptConnections()
+    {
+        while (hasPendingConnections()) {
+            QTcpSocket *socket = nextPendingConnection();
+            connect(socket, SIGNAL(readyRead()), SLOT(readRequest()));
+            connect(socket, SIGNAL(disconnected()), socket, SLOT(deleteLater()));
+        }
+    }
+
+    void readRequest()
+    {
+        QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+        QByteArray &buffer = buffers[socket];
+        buffer += socket->readAll();
+
+        int end = buffer.indexOf("\r\n\r\n");
+        if (end < 0)
+            return;
+
+        int length = 0;
+        foreach (const QByteArray &line, buffer.left(end).split('\n')) {
+            if (line.toLower().startsWith("content-length:"))
+                length = line.mid(15).trimmed().toInt();
+        }
+
+        if (buffer.size() < end + 4 + length)
+            return;
+
+        QByteArray response = responder->respond(buffer.mid(end + 4, length));
+        buffers.remove(socket);
+
+        socket->write("HTTP/1.0 200 OK\r\n"
+                      "Content-Type: application/ocsp-response\r\n"
+                      "Content-Length: " + QByteArray::number(response.size()) + "\r\n"
+                      "\r\n");
+        socket->write(response);
+        socket->disconnectFromHost();
+    }
+
+private:
+    OcspResponder *responder;
+    QHash<QTcpSocket *, QByteArray> buffers;
+};
+
+class ServerThread : public QThread
+{
+public:
+    ServerThread(OcspResponder *responder)
+        : responder(responder),
+          port(0)
+    {
+    }
+
+    bool startServer()
+    {
+        start();
+        ready.acquire();
+        return port != 0;
+    }
+
+    void stopServer()
+    {
+        quit();
+        wait();
+    }
+
+    OcspResponder *responder;
+    quint16 port;
+
+protected:
+    void run()
+    {
+        OcspHttpServer server(responder);
+        if (server.listen(QHostAddress::LocalHost))
+            port = server.serverPort();
+        ready.release();
+
+        if (port)
+            exec();
+    }
+
+private:
+    QSemaphore ready;
+};
+
+//
+// The responses are checked using gnutls' OCSP client support.
+//
+class OcspResponse
+{
+public:
+    OcspResponse(const QByteArray &der)
+        : status(-1),
+          certStatus(-1),
+          revoked(-1)
+    {
+        gnutls_ocsp_resp_init(&resp);
+
+        gnutls_datum_t datum;
+        datum.data = reinterpret_cast<unsigned char *>(const_cast<char *>(der.constData()));
+        datum.size = der.size();
+        if (GNUTLS_E_SUCCESS != gnutls_ocsp_resp_import(resp, &datum))
+            return;
+
+        status = gnutls_ocsp_resp_get_status(resp);
+        if (GNUTLS_OCSP_RESP_SUCCESSFUL != status)
+            return;
+
+        unsigned int cert;
+        time_t thisUpdate, nextUpdate;
+        if (GNUTLS_E_SUCCESS == gnutls_ocsp_resp_get_single(resp, 0, 0, 0, 0, 0, &cert,
+                                                            &thisUpdate, &nextUpdate, &revoked, 0))
+            certStatus = cert;
+    }
+
+    ~OcspResponse()
+    {
+        gnutls_ocsp_resp_deinit(resp);
+    }
+
+    bool verify(gnutls_x509_crt_t issuer) const
+    {
+        unsigned int verify = 0;
+        return GNUTLS_E_SUCCESS == gnutls_ocsp_resp_verify_direct(resp, issuer, &verify, 0) && 0 == verify;
+    }
+
+    bool matches(gnutls_x509_crt_t cert) const
+    {
+        return GNUTLS_E_SUCCESS == gnutls_ocsp_resp_check_crt(resp, 0, cert);
+    }
+
+    int status;
+    int certStatus;
+    time_t revoked;
+    gnutls_ocsp_resp_t resp;
+};
+
+static gnutls_x509_crt_t toCrt(const QSslCertificate &cert)
+{
+    QByteArray der = cert.toDer();
+
+    gnutls_datum_t datum;
+    datum.data = reinterpret_cast<unsigned char *>(der.data());
+    datum.size = der.size();
+
+    gnutls_x509_crt_t crt;
+    gnutls_x509_crt_init(&crt);
+    gnutls_x509_crt_import(crt, &datum, GNUTLS_X509_FMT_DER);
+    return crt;
+}
+
+class RespondThread : public QThread
+{
+public:
+    RespondThread(OcspResponder *responder, const QByteArray &request)
+        : responder(responder),
+          request(request)
+    {
+    }
+
+    void run()
+    {
+        response = responder->respond(request);
+    }
+
+    OcspResponder *responder;
+    QByteArray request;
+    QByteArray response;
+};
+
+class tst_OcspResponder : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void overHttp();
+    void cacheHit();
+    void crlChange();
+    void capacity();
+    void overfill();
+    void concurrentMisses();
+    void prepare();
+    void refresh();
+    void sha256CertId();
+    void noCrl();
+    void wrongIssuer();
+    void malformed();
+
+private:
+    QSslCertificate createLeaf(const IssuerContext &ca, const QByteArray &serial);
+    QByteArray makeRequest(gnutls_digest_algorithm_t digest, gnutls_x509_crt_t issuer, gnutls_x509_crt_t cert);
+    QByteArray makeRequest(const QByteArray &serial);
+    QByteArray makeCrl(const QList<QByteArray> &revoked);
+    QByteArray post(quint16 port, const QByteArray &request);
+
+    QSslCertificate caCert;
+    IssuerContext issuer;
+    gnutls_x509_crt_t caCrt;
+    QList<gnutls_x509_crt_t> leaves;
+    CrlIndex crls;
+};
+
+QSslCertificate tst_OcspResponder::createLeaf(const IssuerContext &ca, const QByteArray &serial)
+{
+    QSslKey key = KeyBuilder::generate(QSsl::Rsa, KeyBuilder::StrengthLow);
+
+    CertificateRequestBuilder reqbuilder;
+    reqbuilder.setVersion(1);
+    reqbuilder.setKey(key);
+    reqbuilder.addNameEntry(Certificate::EntryCommonName, "leaf");
+
+    CertificateBuilder builder;
+    builder.setRequest(reqbuilder.signedRequest(key));
+    builder.setVersion(3);
+    builder.setSerial(serial);
+    builder.setActivationTime(QDateTime::currentDateTimeUtc());
+    builder.setExpirationTime(QDateTime::currentDateTimeUtc().addDays(1));
+
+    return builder.signedCertificate(ca);
+}
+
+QByteArray tst_OcspResponder::makeRequest(gnutls_digest_algorithm_t digest,
+                                          gnutls_x509_crt_t issuer, gnutls_x509_crt_t cert)
+{
+    gnutls_ocsp_req_t req;
+    gnutls_ocsp_req_init(&req);
+    gnutls_ocsp_req_add_cert(req, digest, issuer, cert);
+
+    gnutls_datum_t datum;
+    QByteArray result;
+    if (GNUTLS_E_SUCCESS == gnutls_ocsp_req_export(req, &datum)) {
+        result = QByteArray(reinterpret_cast<const char *>(datum.data), datum.size);
+        gnutls_free(datum.data);
+    }
+
+    gnutls_ocsp_req_deinit(req);
+    return result;
+}
+
+QByteArray tst_OcspResponder::makeRequest(const QByteArray &serial)
+{
+    gnutls_ocsp_req_t req;
+    gnutls_ocsp_req_init(&req);
+    gnutls_ocsp_req_add_cert(req, GNUTLS_DIG_SHA1, caCrt, leaves[0]);
+
+    // Reuse the issuer hashes for a certificate that need not exist
+    gnutls_digest_algorithm_t digest;
+    gnutls_datum_t nameHash, keyHash, leafSerial;
+    gnutls_ocsp_req_get_cert_id(req, 0, &digest, &nameHash, &keyHash, &leafSerial);
+    gnutls_free(leafSerial.data);
+    gnutls_ocsp_req_deinit(req);
+
+    gnutls_datum_t number;
+    number.data = reinterpret_cast<unsigned char *>(const_cast<char *>(serial.constData()));
+    number.size = serial.size();
+
+    gnutls_ocsp_req_init(&req);
+    gnutls_ocsp_req_add_cert_id(req, digest, &nameHash, &keyHash, &number);
+    gnutls_free(nameHash.data);
+    gnutls_free(keyHash.data);
+
+    gnutls_datum_t datum;
+    QByteArray result;
+    if (GNUTLS_E_SUCCESS == gnutls_ocsp_req_export(req, &datum)) {
+        result = QByteArray(reinterpret_cast<const char *>(datum.data), datum.size);
+        gnutls_free(datum.data);
+    }
+
+    gnutls_ocsp_req_deinit(req);
+    return result;
+}
+
+QByteArray tst_OcspResponder::makeCrl(const QList<QByteArray> &revoked)
+{
+    CrlBuilder builder;
+    builder.setSignatureDigest(Certificate::DigestSha256);
+    builder.setNextUpdate(QDateTime::currentDateTimeUtc().addDays(1));
+    foreach (const QByteArray &serial, revoked)
+        builder.addRevokedSerial(serial, QDateTime::currentDateTimeUtc().addSecs(-60));
+
+    return builder.signedCrl(issuer);
+}
+
+QByteArray tst_OcspResponder::post(quint16 port, const QByteArray &request)
+{
+    QTcpSocket socket;
+    socket.connectToHost(QHostAddress::LocalHost, port);
+    if (!socket.waitForConnected(5000))
+        return QByteArray();
+
+    socket.write("POST / HTTP/1.0\r\n"
+                 "Content-Type: application/ocsp-request\r\n"
+                 "Content-Length: " + QByteArray::number(request.size()) + "\r\n"
+                 "\r\n");
+    socket.write(request);
+
+    QByteArray reply;
+    while (socket.waitForReadyRead(5000))
+        reply += socket.readAll();
+    reply += socket.readAll();
+
+    int end = reply.indexOf("\r\n\r\n");
+    if (!reply.startsWith("HTTP/1.0 200") || end < 0)
+        return QByteArray();
+
+    return reply.mid(end + 4);
+}
+
+void tst_OcspResponder::initTestCase()
+{
+    QSslKey caKey = KeyBuilder::generate(QSsl::Rsa, KeyBuilder::StrengthLow);
+    QVERIFY(!caKey.isNull());
+
+    caCert = createCa(caKey, "OCSP CA");
+    QVERIFY(!caCert.isNull());
+
+    issuer = IssuerContext(caCert, caKey);
+    QVERIFY(!issuer.isNull());
+
+    caCrt = toCrt(caCert);
+    for (int i = 1; i <= 4; i++) {
+        QSslCertificate leaf = createLeaf(issuer, serial(i));
+        QVERIFY(!leaf.isNull());
+        leaves << toCrt(leaf);
+    }
+
+    // Serial 2 is revoked
+    QVERIFY(crls.load(makeCrl(QList<QByteArray>() << serial(2))));
+}
+
+void tst_OcspResponder::cleanupTestCase()
+{
+    gnutls_x509_crt_deinit(caCrt);
+    foreach (gnutls_x509_crt_t leaf, leaves)
+        gnutls_x509_crt_deinit(leaf);
+}
+
+void tst_OcspResponder::overHttp()
+{
+    OcspResponder responder(issuer);
+    responder.setSignatureDigest(Certificate::DigestSha256);
+    QCOMPARE(responder.error(), 0);
+    responder.setCrlIndex(&crls);
+
+    ServerThread server(&responder);
+    QVERIFY(server.startServer());
+
+    OcspResponse good(post(server.port, makeRequest(GNUTLS_DIG_SHA1, caCrt, leaves[0])));
+    QCOMPARE(good.status, int(GNUTLS_OCSP_RESP_SUCCESSFUL));
+    QVERIFY(good.verify(caCrt));
+    QVERIFY(good.matches(leaves[0]));
+    QCOMPARE(good.certStatus, int(GNUTLS_OCSP_CERT_GOOD));
+
+    OcspResponse revoked(post(server.port, makeRequest(GNUTLS_DIG_SHA1, caCrt, leaves[1])));
+    QCOMPARE(revoked.status, int(GNUTLS_OCSP_RESP_SUCCESSFUL));
+    QVERIFY(revoked.verify(caCrt));
+    QVERIFY(revoked.matches(leaves[1]));
+    QCOMPARE(revoked.certStatus, int(GNUTLS_OCSP_CERT_REVOKED));
+    QCOMPARE(qint64(revoked.revoked), qint64(crls.revocationTime(serial(2)).toTime_t()));
+
+    server.stopServer();
+
+    OcspResponder::Statistics stats = responder.statistics();
+    QCOMPARE(stats.misses, 2);
+    QCOMPARE(stats.hits, 0);
+    QCOMPARE(stats.size, 2);
+}
+
+void tst_OcspResponder::cacheHit()
+{
+    OcspResponder responder(issuer);
+    responder.setSignatureDigest(Certificate::DigestSha256);
+    responder.setCrlIndex(&crls);
+
+    QByteArray request = makeRequest(GNUTLS_DIG_SHA1, caCrt, leaves[0]);
+    QByteArray first = responder.respond(request);
+    QByteArray second = responder.respond(request);
+
+    // The second request is answered with the same signed response
+    QCOMPARE(second, first);
+    QCOMPARE(responder.statistics().hits, 1);
+    QCOMPARE(responder.statistics().misses, 1);
+
+    responder.clear();
+    QCOMPARE(responder.statistics().size, 0);
+}
+
+void tst_OcspResponder::crlChange()
+{
+    CrlIndex index;
+    QVERIFY(index.load(makeCrl(QList<QByteArray>())));
+
+    OcspResponder responder(issuer);
+    responder.setSignatureDigest(Certificate::DigestSha256);
+    responder.setCrlIndex(&index);
+
+    QByteArray request = makeRequest(GNUTLS_DIG_SHA1, caCrt, leaves[2]);
+    QCOMPARE(OcspResponse(responder.respond(request)).certStatus, int(GNUTLS_OCSP_CERT_GOOD));
+
+    // The cached good response must not be used once the certificate is revoked
+    QVERIFY(index.load(makeCrl(QList<QByteArray>() << serial(3))));
+
+    OcspResponse revoked(responder.respond(request));
+    QVERIFY(revoked.verify(caCrt));
+    QCOMPARE(revoked.certStatus, int(GNUTLS_OCSP_CERT_REVOKED));
+    QCOMPARE(responder.statistics().misses, 2);
+}
+
+void tst_OcspResponder::capacity()
+{
+    OcspResponder responder(issuer);
+    responder.setSignatureDigest(Certificate::DigestSha256);
+    responder.setCrlIndex(&crls);
+    responder.setCapacity(0);
+    QCOMPARE(responder.capacity(), 0);
+
+    // Once the cache is full requests are still answered, just not cached
+    QByteArray request = makeRequest(GNUTLS_DIG_SHA1, caCrt, leaves[0]);
+    QVERIFY(OcspResponse(responder.respond(request)).verify(caCrt));
+    QVERIFY(OcspResponse(responder.respond(request)).verify(caCrt));
+
+    QCOMPARE(responder.statistics().size, 0);
+    QCOMPARE(responder.statistics().hits, 0);
+    QCOMPARE(responder.statistics().misses, 2);
+
+    // Prepared responses are kept whatever the capacity
+    responder.prepare(QList<QByteArray>() << serial(1));
+    QVERIFY(responder.waitForPrepared(10000));
+    QCOMPARE(responder.statistics().size, 1);
+}
+
+void tst_OcspResponder::overfill()
+{
+    OcspResponder responder(issuer);
+    responder.setSignatureDigest(Certificate::DigestSha256);
+    responder.setCrlIndex(&crls);
+    responder.setCapacity(32);
+
+    QByteArray request = makeRequest(GNUTLS_DIG_SHA1, caCrt, leaves[0]);
+    QByteArray first = responder.respond(request);
+    QCOMPARE(responder.respond(request), first);
+
+    // Requests for serials that nobody asks for twice fill the cache
+    for (int i = 0; i < 300; i++) {
+        QByteArray random = makeRequest(RandomGenerator::getPositiveBytes(8));
+        QVERIFY(OcspResponse(responder.respond(random)).verify(caCrt));
+    }
+
+    OcspResponder::Statistics stats = responder.statistics();
+    QVERIFY(stats.size <= 32);
+    QVERIFY(stats.size > 16);
+
+    // They push each other out, but not the certificate that is in use
+    QCOMPARE(responder.respond(request), first);
+    QCOMPARE(responder.statistics().hits, stats.hits + 1);
+
+    // Newly requested certificates are still cached
+    request = makeRequest(GNUTLS_DIG_SHA1, caCrt, leaves[1]);
+    first = responder.respond(request);
+    QCOMPARE(responder.respond(request), first);
+    QCOMPARE(responder.statistics().hits, stats.hits + 2);
+}
+
+void tst_OcspResponder::concurrentMisses()
+{
+    OcspResponder responder(issuer);
+    responder.setSignatureDigest(Certificate::DigestSha256);
+    responder.setCrlIndex(&crls);
+
+    QByteArray request = makeRequest(GNUTLS_DIG_SHA1, caCrt, leaves[0]);
+
+    QList<RespondThread *> threads;
+    for (int i = 0; i < 8; i++) {
+        threads << new RespondThread(&responder, request);
+        threads.last()->start();
+    }
+
+    foreach (RespondThread *thread, threads)
+        thread->wait();
+
+    // Requests that arrive while the response is being signed share it
+    QByteArray response = threads.first()->response;
+    QVERIFY(OcspResponse(response).verify(caCrt));
+    foreach (RespondThread *thread, threads)
+        QCOMPARE(thread->response, response);
+
+    OcspResponder::Statistics stats = responder.statistics();
+    QCOMPARE(stats.hits + stats.misses, 8);
+    QCOMPARE(stats.size, 1);
+
+    qDeleteAll(threads);
+}
+
+void tst_OcspResponder::prepare()
+{
+    OcspResponder responder(issuer);
+    responder.setSignatureDigest(Certificate::DigestSha256);
+    responder.setCrlIndex(&crls);
+    responder.setBatchSize(2);
+
+    QList<QByteArray> serials;
+    for (int i = 1; i <= 4; i++)
+        serials << serial(i);
+
+    responder.prepare(serials);
+    QVERIFY(responder.waitForPrepared(10000));
+    QCOMPARE(responder.statistics().size, 4);
+
+    for (int i = 0; i < 4; i++) {
+        OcspResponse response(responder.respond(makeRequest(GNUTLS_DIG_SHA1, caCrt, leaves[i])));
+        QVERIFY(response.verify(caCrt));
+        QVERIFY(response.matches(leaves[i]));
+    }
+
+    QCOMPARE(responder.statistics().hits, 4);
+    QCOMPARE(responder.statistics().misses, 0);
+}
+
+void tst_OcspResponder::refresh()
+{
+    OcspResponder responder(issuer);
+    responder.setSignatureDigest(Certificate::DigestSha256);
+    responder.setCrlIndex(&crls);
+    responder.setValidityPeriod(4);
+    responder.setRefreshMargin(2);
+
+    QByteArray request = makeRequest(GNUTLS_DIG_SHA1, caCrt, leaves[0]);
+    QByteArray first = responder.respond(request);
+    QCOMPARE(responder.respond(request), first);
+
+    // The response has been used, so is signed again before it expires
+    QTRY_VERIFY(responder.statistics().refreshes > 0);
+
+    QByteArray refreshed = responder.respond(request);
+    QVERIFY(refreshed != first);
+    QVERIFY(OcspResponse(refreshed).verify(caCrt));
+    QCOMPARE(responder.statistics().misses, 1);
+}
+
+void tst_OcspResponder::sha256CertId()
+{
+    OcspResponder responder(issuer);
+    responder.setSignatureDigest(Certificate::DigestSha256);
+    responder.setCrlIndex(&crls);
+
+    OcspResponse response(responder.respond(makeRequest(GNUTLS_DIG_SHA256, caCrt, leaves[1])));
+    QCOMPARE(response.status, int(GNUTLS_OCSP_RESP_SUCCESSFUL));
+    QVERIFY(response.verify(caCrt));
+    QVERIFY(response.matches(leaves[1]));
+    QCOMPARE(response.certStatus, int(GNUTLS_OCSP_CERT_REVOKED));
+}
+
+void tst_OcspResponder::noCrl()
+{
+    OcspResponder responder(issuer);
+    responder.setSignatureDigest(Certificate::DigestSha256);
+
+    OcspResponse response(responder.respond(makeRequest(GNUTLS_DIG_SHA1, caCrt, leaves[0])));
+    QVERIFY(response.verify(caCrt));
+    QCOMPARE(response.certStatus, int(GNUTLS_OCSP_CERT_UNKNOWN));
+}
+
+void tst_OcspResponder::wrongIssuer()
+{
+    QSslKey otherKey = KeyBuilder::generate(QSsl::Rsa, KeyBuilder::StrengthLow);
+    QSslCertificate otherCert = createCa(otherKey, "Other CA");
+    IssuerContext other(otherCert, otherKey);
+    QVERIFY(!other.isNull());
+
+    gnutls_x509_crt_t otherCrt = toCrt(otherCert);
+    gnutls_x509_crt_t otherLeaf = toCrt(createLeaf(other, serial(1)));
+
+    OcspResponder responder(issuer);
+    responder.setSignatureDigest(Certificate::DigestSha256);
+    responder.setCrlIndex(&crls);
+
+    OcspResponse response(responder.respond(makeRequest(GNUTLS_DIG_SHA1, otherCrt, otherLeaf)));
+    QCOMPARE(response.status, int(GNUTLS_OCSP_RESP_UNAUTHORIZED));
+
+    gnutls_x509_crt_deinit(otherLeaf);
+    gnutls_x509_crt_deinit(otherCrt);
+}
+
+void tst_OcspResponder::malformed()
+{
+    OcspResponder responder(issuer);
+    responder.setSignatureDigest(Certificate::DigestSha256);
+
+    OcspResponse response(responder.respond("not a request"));
+    QCOMPARE(response.status, int(GNUTLS_OCSP_RESP_MALFORMEDREQUEST));
+
+    OcspResponder broken((IssuerContext()));
+    QVERIFY(broken.error() != 0);
+    QCOMPARE(OcspResponse(broken.respond(makeRequest(GNUTLS_DIG_SHA1, caCrt, leaves[0]))).status,
+             int(GNUTLS_OCSP_RESP_INTERNALERROR));
+}
+
+QTEST_MAIN(tst_OcspResponder)
+#include "tst_ocspresponder.moc"
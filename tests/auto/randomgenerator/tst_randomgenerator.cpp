@@ -0,0 +1,103 @@
+#include <QtTest/QtTest>
+
+#ifdef Q_OS_UNIX
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "randomgenerator.h"
+
+QT_USE_NAMESPACE_CERTIFICATE
+
+class tst_RandomGenerator : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void positiveBytes();
+    void fillLevels();
+    void refill();
+#ifdef Q_OS_UNIX
+    void forkSafety();
+#endif
+};
+
+void tst_RandomGenerator::positiveBytes()
+{
+    for (int i = 0; i < 256; i++) {
+        QByteArray serial = RandomGenerator::getPositiveBytes(16);
+        QCOMPARE(serial.size(), 16);
+        QVERIFY(!(serial.at(0) & 0x80));
+    }
+
+    QVERIFY(RandomGenerator::getPositiveBytes(16) != RandomGenerator::getPositiveBytes(16));
+}
+
+void tst_RandomGenerator::fillLevels()
+{
+    char nonce[16];
+    char random[16];
+    char key[32];
+
+    QVERIFY(RandomGenerator::fill(nonce, sizeof(nonce), RandomGenerator::LevelNonce));
+    QVERIFY(RandomGenerator::fill(random, sizeof(random), RandomGenerator::LevelRandom));
+    QVERIFY(RandomGenerator::fill(key, sizeof(key), RandomGenerator::LevelKey));
+
+    QVERIFY(memcmp(nonce, random, sizeof(nonce)) != 0);
+}
+
+void tst_RandomGenerator::refill()
+{
+    // Enough requests to go through the per-thread buffer several times
+    QSet<QByteArray> seen;
+    for (int i = 0; i < 2048; i++) {
+        QByteArray value(16, 0);
+        QVERIFY(RandomGenerator::fill(value.data(), value.size()));
+        QVERIFY(!seen.contains(value));
+        seen.insert(value);
+    }
+
+    QByteArray large(64*1024, 0);
+    QVERIFY(RandomGenerator::fill(large.data(), large.size()));
+}
+
+#ifdef Q_OS_UNIX
+void tst_RandomGenerator::forkSafety()
+{
+    // Make sure this thread has buffered data before forking
+    char value[16];
+    QVERIFY(RandomGenerator::fill(value, sizeof(value)));
+
+    int fds[2];
+    QCOMPARE(pipe(fds), 0);
+
+    pid_t child = fork();
+    QVERIFY(child >= 0);
+
+    if (child == 0) {
+        char childValue[16];
+        RandomGenerator::fill(childValue, sizeof(childValue));
+        ssize_t written = write(fds[1], childValue, sizeof(childValue));
+        _exit(written == sizeof(childValue) ? 0 : 1);
+    }
+
+    close(fds[1]);
+
+    char parentValue[16];
+    QVERIFY(RandomGenerator::fill(parentValue, sizeof(parentValue)));
+
+    char childValue[16];
+    QCOMPARE(int(read(fds[0], childValue, sizeof(childValue))), int(sizeof(childValue)));
+    close(fds[0]);
+
+    int status;
+    waitpid(child, &status, 0);
+    QVERIFY(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    QVERIFY(memcmp(parentValue, childValue, sizeof(parentValue)) != 0);
+}
+#endif // Q_OS_UNIX
+
+QTEST_MAIN(tst_RandomGenerator)
+#include "tst_randomgenerator.moc"
@@ -0,0 +1,11 @@
+TEMPLATE = app
+TARGET = tst_serialallocator
+
+CONFIG += testcase
+QT += testlib network
+
+LIBS    += -Wl,-rpath,../../../src/certificate -L../../../src/certificate -lcertificate
+INCLUDEPATH += ../../../src/certificate
+
+SOURCES += tst_serialallocator.cpp
+
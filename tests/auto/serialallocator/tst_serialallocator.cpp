@@ -0,0 +1,163 @@
+#include <QtTest/QtTest>
+
+#include "serialallocator.h"
+
+QT_USE_NAMESPACE_CERTIFICATE
+
+class AllocateJob : public QRunnable
+{
+public:
+    AllocateJob(SerialAllocator *allocator) : allocator(allocator) {}
+
+    void run()
+    {
+        for (int i = 0; i < 10; i++)
+            serials += allocator->allocate(100);
+    }
+
+    SerialAllocator *allocator;
+    QList<QByteArray> serials;
+};
+
+class tst_SerialAllocator : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+
+    void allocate();
+    void persist();
+    void flush();
+    void reserve();
+    void wrongSize();
+    void concurrent();
+
+private:
+    QString fileName;
+};
+
+void tst_SerialAllocator::init()
+{
+    fileName = QDir::temp().filePath(QString("tst_serialallocator-%1.idx").arg(QCoreApplication::applicationPid()));
+    cleanup();
+}
+
+void tst_SerialAllocator::cleanup()
+{
+    QFile::remove(fileName);
+    QFile::remove(fileName + ".journal");
+}
+
+void tst_SerialAllocator::allocate()
+{
+    SerialAllocator allocator(fileName);
+    QCOMPARE(allocator.error(), 0);
+
+    QByteArray serial = allocator.allocate();
+    QCOMPARE(serial.size(), 16);
+    QVERIFY(!(serial.at(0) & 0x80));
+    QVERIFY(allocator.contains(serial));
+
+    QList<QByteArray> batch = allocator.allocate(500);
+    QCOMPARE(batch.size(), 500);
+    QCOMPARE(batch.toSet().size(), 500);
+    QVERIFY(!batch.contains(serial));
+    QCOMPARE(allocator.count(), qint64(501));
+}
+
+void tst_SerialAllocator::persist()
+{
+    QList<QByteArray> serials;
+    {
+        SerialAllocator allocator(fileName);
+        serials = allocator.allocate(100);
+    }
+
+    SerialAllocator allocator(fileName);
+    QCOMPARE(allocator.error(), 0);
+    QCOMPARE(allocator.count(), qint64(100));
+    foreach (const QByteArray &serial, serials)
+        QVERIFY(allocator.contains(serial));
+
+    QVERIFY(!allocator.contains(QByteArray(16, 0)));
+}
+
+void tst_SerialAllocator::flush()
+{
+    QList<QByteArray> serials;
+    {
+        SerialAllocator allocator(fileName);
+        serials = allocator.allocate(1000);
+        QVERIFY(allocator.flush());
+        QCOMPARE(QFileInfo(fileName + ".journal").size(), qint64(0));
+
+        // Still known once they have moved into the index
+        foreach (const QByteArray &serial, serials)
+            QVERIFY(allocator.contains(serial));
+
+        serials += allocator.allocate(10);
+    }
+
+    SerialAllocator allocator(fileName);
+    QCOMPARE(allocator.count(), qint64(1010));
+    foreach (const QByteArray &serial, serials)
+        QVERIFY(allocator.contains(serial));
+}
+
+void tst_SerialAllocator::reserve()
+{
+    SerialAllocator allocator(fileName);
+
+    QByteArray serial = QByteArray::fromHex("00112233445566778899aabbccddeeff");
+    QVERIFY(allocator.reserve(serial));
+    QVERIFY(!allocator.reserve(serial));
+    QVERIFY(allocator.contains(serial));
+
+    QVERIFY(!allocator.reserve(QByteArray(8, 1)));
+    QVERIFY(allocator.error() != 0);
+}
+
+void tst_SerialAllocator::wrongSize()
+{
+    {
+        SerialAllocator allocator(fileName);
+        allocator.allocate(10);
+        QVERIFY(allocator.flush());
+    }
+
+    SerialAllocator allocator(fileName, 8);
+    QVERIFY(allocator.error() != 0);
+    QVERIFY(allocator.allocate().isNull());
+}
+
+void tst_SerialAllocator::concurrent()
+{
+    SerialAllocator allocator(fileName);
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(4);
+
+    QList<AllocateJob *> jobs;
+    for (int i = 0; i < 4; i++) {
+        AllocateJob *job = new AllocateJob(&allocator);
+        job->setAutoDelete(false);
+        jobs << job;
+        pool.start(job);
+    }
+    pool.waitForDone();
+
+    QSet<QByteArray> all;
+    foreach (AllocateJob *job, jobs) {
+        QCOMPARE(job->serials.size(), 1000);
+        all += job->serials.toSet();
+    }
+    qDeleteAll(jobs);
+
+    QCOMPARE(all.size(), 4000);
+    QCOMPARE(allocator.count(), qint64(4000));
+}
+
+QTEST_MAIN(tst_SerialAllocator)
+#include "tst_serialallocator.moc"
@@ -0,0 +1,71 @@
+#ifndef TESTHELPERS_H
+#define TESTHELPERS_H
+
+//
+// Helpers shared by the autotests that need to create requests, CAs and
+// serial numbers to work with.
+//
+
+#include <QDateTime>
+#include <QSslCertificate>
+#include <QSslKey>
+
+#include "certificatebuilder.h"
+#include "certificaterequest.h"
+#include "certificaterequestbuilder.h"
+#include "randomgenerator.h"
+
+QT_BEGIN_NAMESPACE_CERTIFICATE
+
+inline QString commonName(const QSslCertificate &cert)
+{
+#if QT_VERSION >= 0x050000
+    return cert.subjectInfo(QSslCertificate::CommonName).value(0);
+#else
+    return cert.subjectInfo(QSslCertificate::CommonName);
+#endif
+}
+
+inline CertificateRequest makeRequest(const QSslKey &key, const QByteArray &cn)
+{
+    CertificateRequestBuilder builder;
+    builder.setVersion(1);
+    builder.setKey(key);
+    builder.addNameEntry(Certificate::EntryCommonName, cn);
+
+    return builder.signedRequest(key);
+}
+
+// A self-signed CA that can sign certificates and CRLs, valid for a day
+inline QSslCertificate createCa(const QSslKey &key, const QByteArray &cn)
+{
+    CertificateBuilder builder;
+    builder.setRequest(makeRequest(key, cn));
+    builder.setVersion(3);
+    builder.setSerial(RandomGenerator::getPositiveBytes(16));
+    builder.setActivationTime(QDateTime::currentDateTimeUtc());
+    builder.setExpirationTime(QDateTime::currentDateTimeUtc().addDays(1));
+    builder.setBasicConstraints(true);
+    builder.setKeyUsage(CertificateBuilder::UsageCrlSign | CertificateBuilder::UsageKeyCertSign);
+    builder.addSubjectKeyIdentifier();
+
+    return builder.signedCertificate(key);
+}
+
+// The serial n in its shortest positive form, as gnutls returns it
+inline QByteArray serial(int n)
+{
+    QByteArray result;
+    do {
+        result.prepend(char(n & 0xff));
+        n >>= 8;
+    } while (n);
+
+    if (uchar(result.at(0)) & 0x80)
+        result.prepend('\0');
+    return result;
+}
+
+QT_END_NAMESPACE_CERTIFICATE
+
+#endif // TESTHELPERS_H
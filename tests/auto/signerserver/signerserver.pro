@@ -0,0 +1,11 @@
+TEMPLATE = app
+TARGET = tst_signerserver
+
+CONFIG += testcase
+QT += testlib network
+
+LIBS    += -Wl,-rpath,../../../src/certificate -L../../../src/certificate -lcertificate
+INCLUDEPATH += ../../../src/certificate ../shared
+
+SOURCES += tst_signerserver.cpp
+
@@ -0,0 +1,235 @@
+#include <QSemaphore>
+#include <QSslKey>
+#include <QSslCertificate>
+#include <QThread>
+#include <QtTest/QtTest>
+
+#include "batchissuer.h"
+#include "certificatebuilder.h"
+#include "certificateprofile.h"
+#include "certificaterequest.h"
+#include "certificaterequestbuilder.h"
+#include "issuercontext.h"
+#include "keybuilder.h"
+#include "randomgenerator.h"
+#include "signerserver.h"
+#include "signingkey.h"
+#include "testhelpers.h"
+
+QT_USE_NAMESPACE_CERTIFICATE
+
+// Runs a SignerServer with an event loop of its own, since signing blocks
+// the thread that asks for the signature.
+class ServerThread : public QThread
+{
+public:
+    ServerThread(const SigningKey &key, const QString &name, int maxPending=64)
+        : key(key),
+          name(name),
+          maxPending(maxPending),
+          listening(false)
+    {
+    }
+
+    bool startServer()
+    {
+        start();
+        ready.acquire();
+        return listening;
+    }
+
+    void stopServer()
+    {
+        quit();
+        wait();
+    }
+
+protected:
+    void run()
+    {
+        SignerServer server(key);
+        server.setMaxPending(maxPending);
+        listening = server.listen(name);
+        ready.release();
+
+        if (listening)
+            exec();
+    }
+
+private:
+    SigningKey key;
+    QString name;
+    int maxPending;
+    bool listening;
+    QSemaphore ready;
+};
+
+class tst_SignerServer : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void noServer();
+    void issue();
+    void issueConcurrently();
+    void ed25519();
+    void serverGone();
+
+private:
+    QSslCertificate makeCa(const QByteArray &encodedKey);
+
+    QSslKey leafKey;
+    QByteArray caKey;
+    QSslCertificate caCert;
+};
+
+QSslCertificate tst_SignerServer::makeCa(const QByteArray &encodedKey)
+{
+    CertificateRequestBuilder reqbuilder;
+    reqbuilder.setVersion(1);
+    reqbuilder.setKey(encodedKey);
+    reqbuilder.addNameEntry(Certificate::EntryCommonName, "Signer CA");
+
+    CertificateBuilder builder;
+    builder.setRequest(reqbuilder.signedRequest(encodedKey));
+    builder.setVersion(3);
+    builder.setSerial(RandomGenerator::getPositiveBytes(16));
+    builder.setActivationTime(QDateTime::currentDateTimeUtc());
+    builder.setExpirationTime(QDateTime::currentDateTimeUtc().addDays(1));
+    builder.setBasicConstraints(true);
+    builder.setKeyUsage(CertificateBuilder::UsageCrlSign|CertificateBuilder::UsageKeyCertSign);
+    builder.addSubjectKeyIdentifier();
+
+    return builder.signedCertificate(encodedKey);
+}
+
+void tst_SignerServer::initTestCase()
+{
+    leafKey = KeyBuilder::generate(QSsl::Rsa, KeyBuilder::StrengthLow);
+    QVERIFY(!leafKey.isNull());
+
+    caKey = KeyBuilder::generateEncoded(KeyBuilder::TypeRsa, KeyBuilder::StrengthLow);
+    caCert = makeCa(caKey);
+    QVERIFY(!caCert.isNull());
+}
+
+void tst_SignerServer::noServer()
+{
+    SigningKey key = SigningKey::fromSignerService("tst_signerserver_missing");
+    QVERIFY(key.isNull());
+    QVERIFY(key.error() != 0);
+}
+
+void tst_SignerServer::issue()
+{
+    ServerThread server(SigningKey(caKey), "tst_signerserver_issue");
+    QVERIFY(server.startServer());
+
+    SigningKey key = SigningKey::fromSignerService("tst_signerserver_issue");
+    QVERIFY2(!key.isNull(), qPrintable(key.errorString()));
+
+    IssuerContext issuer(caCert, key);
+    QVERIFY(!issuer.isNull());
+
+    CertificateBuilder builder;
+    builder.setRequest(makeRequest(leafKey, "leaf"));
+    builder.setVersion(3);
+    builder.setSerial(RandomGenerator::getPositiveBytes(16));
+    builder.setActivationTime(QDateTime::currentDateTimeUtc());
+    builder.setExpirationTime(QDateTime::currentDateTimeUtc().addDays(1));
+    builder.setSignatureDigest(Certificate::DigestSha256);
+    QSslCertificate leaf = builder.signedCertificate(issuer);
+    QCOMPARE(builder.error(), 0);
+    QCOMPARE(commonName(leaf), QString("leaf"));
+
+#if QT_VERSION >= 0x050000
+    QList<QSslCertificate> chain;
+    chain << leaf << caCert;
+    QList<QSslError> errors = QSslCertificate::verify(chain);
+    for (int i = 0; i < errors.size(); i++)
+        QVERIFY(errors[i].error() != QSslError::CertificateSignatureFailed);
+#endif
+
+    server.stopServer();
+}
+
+void tst_SignerServer::issueConcurrently()
+{
+    ServerThread server(SigningKey(caKey), "tst_signerserver_concurrent", 2);
+    QVERIFY(server.startServer());
+
+    // Fewer slots than threads so that the client has to hold requests back
+    SigningKey key = SigningKey::fromSignerService("tst_signerserver_concurrent", 3);
+    QVERIFY(!key.isNull());
+
+    IssuerContext issuer(caCert, key);
+
+    QList<CertificateRequest> requests;
+    for (int i = 0; i < 32; i++)
+        requests << makeRequest(leafKey, QByteArray("leaf") + QByteArray::number(i));
+
+    BatchIssuer batch(issuer, CertificateProfile());
+    batch.setMaxThreadCount(8);
+
+    QList<BatchIssuer::Result> results = batch.issue(requests);
+    QCOMPARE(results.size(), requests.size());
+
+    for (int i = 0; i < results.size(); i++) {
+        QCOMPARE(results[i].error, 0);
+        QCOMPARE(commonName(results[i].certificate), QString("leaf%1").arg(i));
+    }
+
+    server.stopServer();
+}
+
+void tst_SignerServer::ed25519()
+{
+    QByteArray edKey = KeyBuilder::generateEncoded(KeyBuilder::TypeEd25519, KeyBuilder::StrengthNormal);
+    QSslCertificate edCa = makeCa(edKey);
+    QVERIFY(!edCa.isNull());
+
+    ServerThread server(SigningKey(edKey), "tst_signerserver_ed25519");
+    QVERIFY(server.startServer());
+
+    SigningKey key = SigningKey::fromSignerService("tst_signerserver_ed25519");
+    QVERIFY(!key.isNull());
+
+    CertificateBuilder builder;
+    builder.setRequest(makeRequest(leafKey, "leaf"));
+    builder.setVersion(3);
+    builder.setSerial(RandomGenerator::getPositiveBytes(16));
+    builder.setActivationTime(QDateTime::currentDateTimeUtc());
+    builder.setExpirationTime(QDateTime::currentDateTimeUtc().addDays(1));
+    QSslCertificate leaf = builder.signedCertificate(IssuerContext(edCa, key));
+    QCOMPARE(builder.error(), 0);
+    QVERIFY(!leaf.isNull());
+
+    server.stopServer();
+}
+
+void tst_SignerServer::serverGone()
+{
+    ServerThread *server = new ServerThread(SigningKey(caKey), "tst_signerserver_gone");
+    QVERIFY(server->startServer());
+
+    SigningKey key = SigningKey::fromSignerService("tst_signerserver_gone");
+    QVERIFY(!key.isNull());
+
+    // Destroying the server closes its connections
+    server->stopServer();
+    delete server;
+
+    CertificateBuilder builder;
+    builder.setRequest(makeRequest(leafKey, "leaf"));
+    builder.setVersion(3);
+    builder.setSerial(RandomGenerator::getPositiveBytes(16));
+    builder.setActivationTime(QDateTime::currentDateTimeUtc());
+    builder.setExpirationTime(QDateTime::currentDateTimeUtc().addDays(1));
+    QSslCertificate leaf = builder.signedCertificate(IssuerContext(caCert, key));
+    QVERIFY(builder.error() != 0);
+    QVERIFY(leaf.isNull());
+}
+
+QTEST_MAIN(tst_SignerServer)
+#include "tst_signerserver.moc"
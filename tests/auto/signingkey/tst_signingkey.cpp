@@ -0,0 +1,179 @@
+#include <QSslKey>
+#include <QSslCertificate>
+#include <QtTest/QtTest>
+
+#include "batchissuer.h"
+#include "certificatebuilder.h"
+#include "certificateprofile.h"
+#include "certificaterequest.h"
+#include "certificaterequestbuilder.h"
+#include "issuercontext.h"
+#include "keybuilder.h"
+#include "randomgenerator.h"
+#include "signingkey.h"
+#include "testhelpers.h"
+
+QT_USE_NAMESPACE_CERTIFICATE
+
+//
+// The PKCS#11 tests only run if a token has been configured, for example
+// using SoftHSM:
+//
+//   softhsm2-util --init-token --free --label test --pin 1234 --so-pin 5678
+//   p11tool --login --generate-rsa --bits 2048 --label ca-key "pkcs11:token=test"
+//   certtool --generate-self-signed --load-privkey "pkcs11:token=test;object=ca-key" \
+//            --outfile ca.crt
+//
+//   QT_CERTIFICATE_PKCS11_MODULE=/usr/lib/softhsm/libsofthsm2.so
+//   QT_CERTIFICATE_PKCS11_URL="pkcs11:token=test;object=ca-key;type=private"
+//   QT_CERTIFICATE_PKCS11_PIN=1234
+//   QT_CERTIFICATE_PKCS11_CERT=ca.crt
+//
+
+class tst_SigningKey : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void nullKey();
+    void softwareKey();
+    void selfSigned();
+    void pkcs11();
+
+private:
+
+    QSslKey leafKey;
+};
+
+void tst_SigningKey::initTestCase()
+{
+    leafKey = KeyBuilder::generate(QSsl::Rsa, KeyBuilder::StrengthLow);
+    QVERIFY(!leafKey.isNull());
+}
+
+void tst_SigningKey::nullKey()
+{
+    SigningKey key;
+    QVERIFY(key.isNull());
+    QCOMPARE(key.sessionCount(), 0);
+
+    SigningKey bad(QByteArray("not a key"));
+    QVERIFY(bad.isNull());
+    QVERIFY(bad.error() != 0);
+
+    IssuerContext issuer(QSslCertificate(), key);
+    QVERIFY(issuer.isNull());
+}
+
+void tst_SigningKey::softwareKey()
+{
+    QSslKey caKey = KeyBuilder::generate(QSsl::Rsa, KeyBuilder::StrengthLow);
+    SigningKey key(caKey);
+    QVERIFY(!key.isNull());
+    QCOMPARE(key.error(), 0);
+    QCOMPARE(key.sessionCount(), -1);
+
+    CertificateRequestBuilder reqbuilder;
+    reqbuilder.setVersion(1);
+    reqbuilder.setKey(caKey);
+    reqbuilder.addNameEntry(Certificate::EntryCommonName, "Software CA");
+
+    CertificateBuilder builder;
+    builder.setRequest(reqbuilder.signedRequest(caKey));
+    builder.setVersion(3);
+    builder.setSerial(RandomGenerator::getPositiveBytes(16));
+    builder.setActivationTime(QDateTime::currentDateTimeUtc());
+    builder.setExpirationTime(QDateTime::currentDateTimeUtc().addDays(1));
+    builder.setBasicConstraints(true);
+    builder.addSubjectKeyIdentifier();
+    QSslCertificate caCert = builder.signedCertificate(key);
+    QVERIFY(!caCert.isNull());
+
+    IssuerContext issuer(caCert, key);
+    QVERIFY(!issuer.isNull());
+    QCOMPARE(issuer.signingKey().sessionCount(), -1);
+
+    CertificateBuilder leafbuilder;
+    leafbuilder.setRequest(makeRequest(leafKey, "leaf"));
+    leafbuilder.setVersion(3);
+    leafbuilder.setSerial(RandomGenerator::getPositiveBytes(16));
+    leafbuilder.setActivationTime(QDateTime::currentDateTimeUtc());
+    leafbuilder.setExpirationTime(QDateTime::currentDateTimeUtc().addDays(1));
+    QSslCertificate leaf = leafbuilder.signedCertificate(issuer);
+    QCOMPARE(leafbuilder.error(), 0);
+    QCOMPARE(commonName(leaf), QString("leaf"));
+    QCOMPARE(leaf.issuerInfo(QSslCertificate::CommonName), caCert.subjectInfo(QSslCertificate::CommonName));
+}
+
+void tst_SigningKey::selfSigned()
+{
+    QByteArray encoded = KeyBuilder::generateEncoded(KeyBuilder::TypeEd25519, KeyBuilder::StrengthNormal);
+    SigningKey key(encoded);
+    QVERIFY(!key.isNull());
+
+    CertificateRequestBuilder reqbuilder;
+    reqbuilder.setVersion(1);
+    reqbuilder.setKey(encoded);
+    reqbuilder.addNameEntry(Certificate::EntryCommonName, "Ed25519 CA");
+
+    CertificateBuilder builder;
+    builder.setRequest(reqbuilder.signedRequest(encoded));
+    builder.setVersion(3);
+    builder.setSerial(RandomGenerator::getPositiveBytes(16));
+    builder.setActivationTime(QDateTime::currentDateTimeUtc());
+    builder.setExpirationTime(QDateTime::currentDateTimeUtc().addDays(1));
+
+    QSslCertificate cert = builder.signedCertificate(key);
+    QCOMPARE(builder.error(), 0);
+    QVERIFY(!cert.isNull());
+}
+
+void tst_SigningKey::pkcs11()
+{
+    QByteArray module = qgetenv("QT_CERTIFICATE_PKCS11_MODULE");
+    QByteArray url = qgetenv("QT_CERTIFICATE_PKCS11_URL");
+    QByteArray pin = qgetenv("QT_CERTIFICATE_PKCS11_PIN");
+    QByteArray certFile = qgetenv("QT_CERTIFICATE_PKCS11_CERT");
+
+    if (module.isEmpty() || url.isEmpty() || certFile.isEmpty()) {
+#if QT_VERSION >= 0x050000
+        QSKIP("No PKCS#11 token configured");
+#else
+        QSKIP("No PKCS#11 token configured", SkipSingle);
+#endif
+    }
+
+    QCOMPARE(SigningKey::addPkcs11Provider(QString::fromLocal8Bit(module)), 0);
+
+    QFile f(QString::fromLocal8Bit(certFile));
+    QVERIFY(f.open(QIODevice::ReadOnly));
+    QSslCertificate caCert(&f, QSsl::Pem);
+    QVERIFY(!caCert.isNull());
+
+    SigningKey key = SigningKey::fromPkcs11Url(QString::fromUtf8(url), pin, 4);
+    QVERIFY2(!key.isNull(), qPrintable(key.errorString()));
+    QCOMPARE(key.sessionCount(), 4);
+
+    IssuerContext issuer(caCert, key);
+    QVERIFY(!issuer.isNull());
+
+    // Issue from several threads so that all of the sessions are used
+    QList<CertificateRequest> requests;
+    for (int i = 0; i < 16; i++)
+        requests << makeRequest(leafKey, QByteArray("leaf") + QByteArray::number(i));
+
+    BatchIssuer batch(issuer, CertificateProfile());
+    batch.setMaxThreadCount(4);
+
+    QList<BatchIssuer::Result> results = batch.issue(requests);
+    QCOMPARE(results.size(), requests.size());
+
+    for (int i = 0; i < results.size(); i++) {
+        QCOMPARE(results[i].error, 0);
+        QCOMPARE(commonName(results[i].certificate), QString("leaf%1").arg(i));
+    }
+}
+
+QTEST_MAIN(tst_SigningKey)
+#include "tst_signingkey.moc"
@@ -0,0 +1,15 @@
+# Settings shared by all the benchmarks
+
+TEMPLATE = app
+QT += testlib network
+
+INCLUDEPATH += $$PWD/../../src/certificate
+
+# The fixtures are found relative to the sources, not the working directory
+DEFINES += SRCDIR=\\\"$$PWD/\\\"
+
+# 'make benchmark' runs the benchmark and saves the results as XML so that
+# they can be compared between releases
+benchmark.commands = ./$$TARGET -xml -o $${TARGET}.xml
+benchmark.depends = $$TARGET
+QMAKE_EXTRA_TARGETS += benchmark
@@ -0,0 +1,13 @@
+TEMPLATE = subdirs
+
+SUBDIRS += conversions \
+           keybuilder \
+           certificaterequest \
+           certificaterequestbuilder \
+           certificatebuilder \
+           crlindex \
+           randomgenerator
+
+# 'make benchmark' runs all of the benchmarks
+benchmark.CONFIG = recursive
+QMAKE_EXTRA_TARGETS += benchmark
@@ -0,0 +1,237 @@
+#include <QSslKey>
+#include <QSslCertificate>
+#include <QtTest/QtTest>
+
+#include "batchissuer.h"
+#include "certificatebuilder.h"
+#include "certificateprofile.h"
+#include "certificaterequest.h"
+#include "certificaterequestbuilder.h"
+#include "issuercontext.h"
+#include "keybuilder.h"
+#include "randomgenerator.h"
+
+QT_USE_NAMESPACE_CERTIFICATE
+
+Q_DECLARE_METATYPE(KeyBuilder::KeyType)
+Q_DECLARE_METATYPE(KeyBuilder::KeyStrength)
+Q_DECLARE_METATYPE(Certificate::SignatureDigest)
+
+class tst_Bench_CertificateBuilder : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void selfSigned();
+    void caSigned();
+    void issuerSigned();
+    void profileSigned();
+    void signatureAlgorithm_data();
+    void signatureAlgorithm();
+    void batch_data();
+    void batch();
+
+private:
+    void setupLeaf(CertificateBuilder &builder);
+    CertificateProfile leafProfile() const;
+    QSslCertificate createCa(const QByteArray &key);
+
+    QSslKey caKey;
+    QSslCertificate caCert;
+    QSslKey leafKey;
+    CertificateRequest leafReq;
+};
+
+void tst_Bench_CertificateBuilder::initTestCase()
+{
+    QFile k(SRCDIR "data/ca.key");
+    QVERIFY(k.open(QIODevice::ReadOnly));
+    caKey = QSslKey(&k, QSsl::Rsa);
+    QVERIFY(!caKey.isNull());
+
+    QFile c(SRCDIR "data/ca.crt");
+    QVERIFY(c.open(QIODevice::ReadOnly));
+    caCert = QSslCertificate(&c);
+    QVERIFY(!caCert.isNull());
+
+    QFile lk(SRCDIR "data/leaf.key");
+    QVERIFY(lk.open(QIODevice::ReadOnly));
+    leafKey = QSslKey(&lk, QSsl::Rsa);
+    QVERIFY(!leafKey.isNull());
+
+    QFile lr(SRCDIR "data/leaf.req");
+    QVERIFY(lr.open(QIODevice::ReadOnly));
+    leafReq = CertificateRequest(&lr);
+    QVERIFY(!leafReq.isNull());
+}
+
+void tst_Bench_CertificateBuilder::setupLeaf(CertificateBuilder &builder)
+{
+    builder.setRequest(leafReq);
+    builder.setVersion(3);
+    builder.setSerial(RandomGenerator::getPositiveBytes(16));
+    builder.setActivationTime(QDateTime::currentDateTimeUtc());
+    builder.setExpirationTime(QDateTime::currentDateTimeUtc().addDays(90));
+    builder.setBasicConstraints(false);
+    builder.addKeyPurpose(CertificateBuilder::PurposeWebServer);
+    builder.setKeyUsage(CertificateBuilder::UsageKeyAgreement|CertificateBuilder::UsageKeyEncipherment);
+    builder.addSubjectKeyIdentifier();
+}
+
+CertificateProfile tst_Bench_CertificateBuilder::leafProfile() const
+{
+    CertificateProfile profile;
+    profile.setValidityPeriod(90);
+    profile.setBasicConstraints(false);
+    profile.addKeyPurpose(CertificateBuilder::PurposeWebServer);
+    profile.setKeyUsage(CertificateBuilder::UsageKeyAgreement|CertificateBuilder::UsageKeyEncipherment);
+
+    return profile;
+}
+
+QSslCertificate tst_Bench_CertificateBuilder::createCa(const QByteArray &key)
+{
+    CertificateRequestBuilder reqBuilder;
+    reqBuilder.setVersion(1);
+    reqBuilder.setKey(key);
+    reqBuilder.addNameEntry(Certificate::EntryCommonName, "Benchmark CA");
+
+    CertificateBuilder builder;
+    builder.setRequest(reqBuilder.signedRequest(key));
+    builder.setVersion(3);
+    builder.setSerial(RandomGenerator::getPositiveBytes(16));
+    builder.setActivationTime(QDateTime::currentDateTimeUtc());
+    builder.setExpirationTime(QDateTime::currentDateTimeUtc().addDays(1));
+    builder.setBasicConstraints(true);
+    builder.setKeyUsage(CertificateBuilder::UsageCrlSign|CertificateBuilder::UsageKeyCertSign);
+    builder.addSubjectKeyIdentifier();
+
+    return builder.signedCertificate(key);
+}
+
+void tst_Bench_CertificateBuilder::selfSigned()
+{
+    QSslCertificate cert;
+    QBENCHMARK {
+        CertificateBuilder builder;
+        setupLeaf(builder);
+        cert = builder.signedCertificate(leafKey);
+    }
+    QVERIFY(!cert.isNull());
+}
+
+void tst_Bench_CertificateBuilder::caSigned()
+{
+    QSslCertificate cert;
+    QBENCHMARK {
+        CertificateBuilder builder;
+        setupLeaf(builder);
+        builder.addAuthorityKeyIdentifier(caCert);
+        cert = builder.signedCertificate(caCert, caKey);
+    }
+    QVERIFY(!cert.isNull());
+}
+
+void tst_Bench_CertificateBuilder::issuerSigned()
+{
+    IssuerContext issuer(caCert, caKey);
+    QVERIFY(!issuer.isNull());
+
+    QSslCertificate cert;
+    QBENCHMARK {
+        CertificateBuilder builder;
+        setupLeaf(builder);
+        builder.addAuthorityKeyIdentifier(issuer);
+        cert = builder.signedCertificate(issuer);
+    }
+    QVERIFY(!cert.isNull());
+}
+
+void tst_Bench_CertificateBuilder::profileSigned()
+{
+    IssuerContext issuer(caCert, caKey);
+    CertificateProfile profile = leafProfile();
+
+    QSslCertificate cert;
+    QBENCHMARK {
+        CertificateBuilder builder(profile);
+        builder.setRequest(leafReq);
+        builder.setSerial(RandomGenerator::getPositiveBytes(16));
+        builder.setActivationTime(QDateTime::currentDateTimeUtc());
+        builder.setExpirationTime(QDateTime::currentDateTimeUtc().addDays(90));
+        builder.addSubjectKeyIdentifier();
+        builder.addAuthorityKeyIdentifier(issuer);
+        cert = builder.signedCertificate(issuer);
+    }
+    QVERIFY(!cert.isNull());
+}
+
+void tst_Bench_CertificateBuilder::signatureAlgorithm_data()
+{
+    QTest::addColumn<KeyBuilder::KeyType>("type");
+    QTest::addColumn<KeyBuilder::KeyStrength>("strength");
+    QTest::addColumn<Certificate::SignatureDigest>("digest");
+
+    QTest::newRow("rsa-sha1") << KeyBuilder::TypeRsa << KeyBuilder::StrengthNormal << Certificate::DigestSha1;
+    QTest::newRow("rsa-sha256") << KeyBuilder::TypeRsa << KeyBuilder::StrengthNormal << Certificate::DigestSha256;
+    QTest::newRow("ecdsa-p256") << KeyBuilder::TypeEc << KeyBuilder::StrengthNormal << Certificate::DigestDefault;
+    QTest::newRow("ecdsa-p384") << KeyBuilder::TypeEc << KeyBuilder::StrengthHigh << Certificate::DigestDefault;
+    QTest::newRow("ed25519") << KeyBuilder::TypeEd25519 << KeyBuilder::StrengthNormal << Certificate::DigestDefault;
+}
+
+void tst_Bench_CertificateBuilder::signatureAlgorithm()
+{
+    QFETCH(KeyBuilder::KeyType, type);
+    QFETCH(KeyBuilder::KeyStrength, strength);
+    QFETCH(Certificate::SignatureDigest, digest);
+
+    QByteArray key = KeyBuilder::generateEncoded(type, strength);
+    QSslCertificate cacert = createCa(key);
+    QVERIFY(!cacert.isNull());
+
+    IssuerContext issuer(cacert, key);
+    QVERIFY(!issuer.isNull());
+
+    QSslCertificate cert;
+    QBENCHMARK {
+        CertificateBuilder builder;
+        setupLeaf(builder);
+        builder.setSignatureDigest(digest);
+        builder.addAuthorityKeyIdentifier(issuer);
+        cert = builder.signedCertificate(issuer);
+    }
+    QVERIFY(!cert.isNull());
+}
+
+void tst_Bench_CertificateBuilder::batch_data()
+{
+    QTest::addColumn<int>("threads");
+
+    QTest::newRow("1") << 1;
+    QTest::newRow("2") << 2;
+    QTest::newRow("4") << 4;
+    QTest::newRow("ideal") << QThread::idealThreadCount();
+}
+
+void tst_Bench_CertificateBuilder::batch()
+{
+    QFETCH(int, threads);
+
+    QList<CertificateRequest> requests;
+    for (int i = 0; i < 64; i++)
+        requests << leafReq;
+
+    BatchIssuer issuer(IssuerContext(caCert, caKey), leafProfile());
+    issuer.setMaxThreadCount(threads);
+
+    QList<BatchIssuer::Result> results;
+    QBENCHMARK {
+        results = issuer.issue(requests);
+    }
+    QCOMPARE(results.size(), requests.size());
+    QCOMPARE(results.last().error, 0);
+}
+
+QTEST_MAIN(tst_Bench_CertificateBuilder)
+#include "tst_bench_certificatebuilder.moc"
@@ -0,0 +1,135 @@
+#include <QBuffer>
+#include <QtTest/QtTest>
+
+#include "certificaterequest.h"
+
+QT_USE_NAMESPACE_CERTIFICATE
+
+Q_DECLARE_METATYPE(QSsl::EncodingFormat)
+
+class tst_Bench_CertificateRequest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void load_data();
+    void load();
+    void loadFromData_data();
+    void loadFromData();
+    void loadFromFile_data();
+    void loadFromFile();
+    void nameEntryInfo();
+    void toPem();
+    void toDer();
+
+private:
+    CertificateRequest loadRequest();
+};
+
+CertificateRequest tst_Bench_CertificateRequest::loadRequest()
+{
+    QFile f(SRCDIR "data/leaf.req");
+    f.open(QIODevice::ReadOnly);
+    return CertificateRequest(&f);
+}
+
+void tst_Bench_CertificateRequest::load_data()
+{
+    QTest::addColumn<QString>("fileName");
+    QTest::addColumn<QSsl::EncodingFormat>("format");
+
+    QTest::newRow("pem") << QString(SRCDIR "data/leaf.req") << QSsl::Pem;
+    QTest::newRow("der") << QString(SRCDIR "data/leaf.der") << QSsl::Der;
+}
+
+void tst_Bench_CertificateRequest::load()
+{
+    QFETCH(QString, fileName);
+    QFETCH(QSsl::EncodingFormat, format);
+
+    QFile f(fileName);
+    QVERIFY(f.open(QIODevice::ReadOnly));
+    QByteArray data = f.readAll();
+
+    QBENCHMARK {
+        QBuffer buffer(&data);
+        buffer.open(QIODevice::ReadOnly);
+        CertificateRequest req(&buffer, format);
+        QVERIFY(!req.isNull());
+    }
+}
+
+void tst_Bench_CertificateRequest::loadFromData_data()
+{
+    load_data();
+}
+
+void tst_Bench_CertificateRequest::loadFromData()
+{
+    QFETCH(QString, fileName);
+    QFETCH(QSsl::EncodingFormat, format);
+
+    QFile f(fileName);
+    QVERIFY(f.open(QIODevice::ReadOnly));
+    QByteArray data = f.readAll();
+
+    QBENCHMARK {
+        CertificateRequest req(data, format);
+        QVERIFY(!req.isNull());
+    }
+}
+
+void tst_Bench_CertificateRequest::loadFromFile_data()
+{
+    load_data();
+}
+
+void tst_Bench_CertificateRequest::loadFromFile()
+{
+    QFETCH(QString, fileName);
+    QFETCH(QSsl::EncodingFormat, format);
+
+    QBENCHMARK {
+        CertificateRequest req = CertificateRequest::fromFile(fileName, format);
+        QVERIFY(!req.isNull());
+    }
+}
+
+void tst_Bench_CertificateRequest::nameEntryInfo()
+{
+    CertificateRequest req = loadRequest();
+    QVERIFY(!req.isNull());
+
+    QStringList commonName;
+    QBENCHMARK {
+        commonName = req.nameEntryInfo(Certificate::EntryCommonName);
+    }
+    QCOMPARE(commonName, QStringList() << "www.example.com");
+}
+
+void tst_Bench_CertificateRequest::toPem()
+{
+    CertificateRequest req = loadRequest();
+    QVERIFY(!req.isNull());
+
+    QByteArray pem;
+    QBENCHMARK {
+        pem = req.toPem();
+    }
+    QVERIFY(pem.startsWith("-----BEGIN"));
+}
+
+void tst_Bench_CertificateRequest::toDer()
+{
+    CertificateRequest req = loadRequest();
+    QVERIFY(!req.isNull());
+
+    QByteArray der;
+    QBENCHMARK {
+        der = req.toDer();
+    }
+    QVERIFY(!der.isEmpty());
+}
+
+QTEST_MAIN(tst_Bench_CertificateRequest)
+#include "tst_bench_certificaterequest.moc"
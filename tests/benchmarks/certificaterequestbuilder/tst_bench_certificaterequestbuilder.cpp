@@ -0,0 +1,115 @@
+#include <QSslKey>
+#include <QtTest/QtTest>
+
+#include "certificaterequest.h"
+#include "certificaterequestbuilder.h"
+
+QT_USE_NAMESPACE_CERTIFICATE
+
+class tst_Bench_CertificateRequestBuilder : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void setKey();
+    void buildAndSign();
+    void appendAlternativeNames_data();
+    void appendAlternativeNames();
+    void setAlternativeNames_data();
+    void setAlternativeNames();
+
+private:
+    QSslKey key;
+};
+
+void tst_Bench_CertificateRequestBuilder::initTestCase()
+{
+    QFile f(SRCDIR "data/leaf.key");
+    QVERIFY(f.open(QIODevice::ReadOnly));
+    key = QSslKey(&f, QSsl::Rsa);
+    QVERIFY(!key.isNull());
+}
+
+void tst_Bench_CertificateRequestBuilder::setKey()
+{
+    CertificateRequestBuilder builder;
+
+    QBENCHMARK {
+        builder.setKey(key);
+    }
+    QCOMPARE(builder.error(), 0);
+}
+
+void tst_Bench_CertificateRequestBuilder::buildAndSign()
+{
+    int error = 0;
+
+    QBENCHMARK {
+        CertificateRequestBuilder builder;
+        builder.setVersion(1);
+        builder.setKey(key);
+        builder.addNameEntry(Certificate::EntryCountryName, "GB");
+        builder.addNameEntry(Certificate::EntryOrganizationName, "Westpoint");
+        builder.addNameEntry(Certificate::EntryCommonName, "www.example.com");
+        builder.addSubjectAlternativeNameEntry(QSsl::DnsEntry, "www.example.com");
+
+        CertificateRequest req = builder.signedRequest(key);
+        error = builder.error();
+    }
+    QCOMPARE(error, 0);
+}
+
+void tst_Bench_CertificateRequestBuilder::appendAlternativeNames_data()
+{
+    QTest::addColumn<int>("count");
+
+    QTest::newRow("10") << 10;
+    QTest::newRow("100") << 100;
+    QTest::newRow("1000") << 1000;
+}
+
+void tst_Bench_CertificateRequestBuilder::appendAlternativeNames()
+{
+    QFETCH(int, count);
+
+    QList<QByteArray> names;
+    for (int i = 0; i < count; i++)
+        names << "host" + QByteArray::number(i) + ".example.com";
+
+    int error = 0;
+
+    QBENCHMARK {
+        CertificateRequestBuilder builder;
+        for (int i = 0; i < names.size(); i++)
+            builder.addSubjectAlternativeNameEntry(QSsl::DnsEntry, names[i]);
+        error = builder.error();
+    }
+    QCOMPARE(error, 0);
+}
+
+void tst_Bench_CertificateRequestBuilder::setAlternativeNames_data()
+{
+    appendAlternativeNames_data();
+}
+
+void tst_Bench_CertificateRequestBuilder::setAlternativeNames()
+{
+    QFETCH(int, count);
+
+    QList<Certificate::AlternativeName> names;
+    for (int i = 0; i < count; i++)
+        names << Certificate::AlternativeName(Certificate::AlternativeNameDns, "host" + QByteArray::number(i) + ".example.com");
+
+    int error = 0;
+
+    QBENCHMARK {
+        CertificateRequestBuilder builder;
+        builder.setSubjectAlternativeNames(names);
+        error = builder.error();
+    }
+    QCOMPARE(error, 0);
+}
+
+QTEST_MAIN(tst_Bench_CertificateRequestBuilder)
+#include "tst_bench_certificaterequestbuilder.moc"
@@ -0,0 +1,6 @@
+TARGET = tst_bench_conversions
+include(../benchmark.pri)
+
+LIBS    += -Wl,-rpath,../../../src/certificate -L../../../src/certificate -lcertificate -lgnutls
+
+SOURCES += tst_bench_conversions.cpp
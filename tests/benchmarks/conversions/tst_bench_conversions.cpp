@@ -0,0 +1,209 @@
+#include <QSslKey>
+#include <QSslCertificate>
+#include <QtTest/QtTest>
+
+#include <gnutls/gnutls.h>
+#include <gnutls/x509.h>
+
+#include "utils_p.h"
+
+QT_USE_NAMESPACE_CERTIFICATE
+
+//
+// The PEM based conversions that were used before the DER fast path, kept
+// here so the two can be compared.
+//
+
+static gnutls_x509_privkey_t pem_qsslkey_to_key(const QSslKey &qkey, int *errno)
+{
+    gnutls_x509_privkey_t key;
+
+    *errno = gnutls_x509_privkey_init(&key);
+    if (GNUTLS_E_SUCCESS != *errno)
+        return 0;
+
+    QByteArray buf(qkey.toPem());
+
+    gnutls_datum_t buffer;
+    buffer.data = (unsigned char *)(buf.data());
+    buffer.size = buf.size();
+
+    *errno = gnutls_x509_privkey_import(key, &buffer, GNUTLS_X509_FMT_PEM);
+    return key;
+}
+
+static gnutls_x509_crt_t pem_qsslcert_to_crt(const QSslCertificate &qcert, int *errno)
+{
+    gnutls_x509_crt_t cert;
+
+    *errno = gnutls_x509_crt_init(&cert);
+    if (GNUTLS_E_SUCCESS != *errno)
+        return 0;
+
+    QByteArray buf(qcert.toPem());
+
+    gnutls_datum_t buffer;
+    buffer.data = (unsigned char *)(buf.data());
+    buffer.size = buf.size();
+
+    *errno = gnutls_x509_crt_import(cert, &buffer, GNUTLS_X509_FMT_PEM);
+    return cert;
+}
+
+static QSslCertificate pem_crt_to_qsslcert(gnutls_x509_crt_t crt, int *errno)
+{
+    QByteArray ba(4096, 0);
+    size_t size = ba.size();
+
+    *errno = gnutls_x509_crt_export(crt, GNUTLS_X509_FMT_PEM, ba.data(), &size);
+    if (GNUTLS_E_SUCCESS != *errno)
+        return QSslCertificate();
+
+    return QSslCertificate(ba);
+}
+
+static QSslKey pem_key_to_qsslkey(gnutls_x509_privkey_t key, QSsl::KeyAlgorithm algo, int *errno)
+{
+    QByteArray ba(4096, 0);
+    size_t size = ba.size();
+
+    *errno = gnutls_x509_privkey_export(key, GNUTLS_X509_FMT_PEM, ba.data(), &size);
+    if (GNUTLS_E_SUCCESS != *errno)
+        return QSslKey();
+
+    return QSslKey(ba, algo);
+}
+
+class tst_Bench_Conversions : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void qsslkeyToKey_data();
+    void qsslkeyToKey();
+    void qsslcertToCrt_data();
+    void qsslcertToCrt();
+    void keyToQsslkey_data();
+    void keyToQsslkey();
+    void crtToQsslcert_data();
+    void crtToQsslcert();
+
+private:
+    void addFormats();
+
+    QSslKey qkey;
+    QSslCertificate qcert;
+    gnutls_x509_privkey_t key;
+    gnutls_x509_crt_t crt;
+};
+
+void tst_Bench_Conversions::initTestCase()
+{
+    ensure_gnutls_init();
+
+    QFile k(SRCDIR "data/ca.key");
+    QVERIFY(k.open(QIODevice::ReadOnly));
+    qkey = QSslKey(&k, QSsl::Rsa);
+    QVERIFY(!qkey.isNull());
+
+    QFile c(SRCDIR "data/ca.crt");
+    QVERIFY(c.open(QIODevice::ReadOnly));
+    qcert = QSslCertificate(&c);
+    QVERIFY(!qcert.isNull());
+
+    int errno;
+    key = qsslkey_to_key(qkey, &errno);
+    QCOMPARE(errno, int(GNUTLS_E_SUCCESS));
+    crt = qsslcert_to_crt(qcert, &errno);
+    QCOMPARE(errno, int(GNUTLS_E_SUCCESS));
+}
+
+void tst_Bench_Conversions::cleanupTestCase()
+{
+    gnutls_x509_privkey_deinit(key);
+    gnutls_x509_crt_deinit(crt);
+}
+
+void tst_Bench_Conversions::addFormats()
+{
+    QTest::addColumn<bool>("pem");
+
+    QTest::newRow("pem") << true;
+    QTest::newRow("der") << false;
+}
+
+void tst_Bench_Conversions::qsslkeyToKey_data()
+{
+    addFormats();
+}
+
+void tst_Bench_Conversions::qsslkeyToKey()
+{
+    QFETCH(bool, pem);
+
+    int errno;
+    QBENCHMARK {
+        gnutls_x509_privkey_t result = pem ? pem_qsslkey_to_key(qkey, &errno) : qsslkey_to_key(qkey, &errno);
+        gnutls_x509_privkey_deinit(result);
+    }
+    QCOMPARE(errno, int(GNUTLS_E_SUCCESS));
+}
+
+void tst_Bench_Conversions::qsslcertToCrt_data()
+{
+    addFormats();
+}
+
+void tst_Bench_Conversions::qsslcertToCrt()
+{
+    QFETCH(bool, pem);
+
+    int errno;
+    QBENCHMARK {
+        gnutls_x509_crt_t result = pem ? pem_qsslcert_to_crt(qcert, &errno) : qsslcert_to_crt(qcert, &errno);
+        gnutls_x509_crt_deinit(result);
+    }
+    QCOMPARE(errno, int(GNUTLS_E_SUCCESS));
+}
+
+void tst_Bench_Conversions::keyToQsslkey_data()
+{
+    addFormats();
+}
+
+void tst_Bench_Conversions::keyToQsslkey()
+{
+    QFETCH(bool, pem);
+
+    int errno;
+    QSslKey result;
+    QBENCHMARK {
+        result = pem ? pem_key_to_qsslkey(key, QSsl::Rsa, &errno) : key_to_qsslkey(key, QSsl::Rsa, &errno);
+    }
+    QCOMPARE(errno, int(GNUTLS_E_SUCCESS));
+    QCOMPARE(result.toDer(), qkey.toDer());
+}
+
+void tst_Bench_Conversions::crtToQsslcert_data()
+{
+    addFormats();
+}
+
+void tst_Bench_Conversions::crtToQsslcert()
+{
+    QFETCH(bool, pem);
+
+    int errno;
+    QSslCertificate result;
+    QBENCHMARK {
+        result = pem ? pem_crt_to_qsslcert(crt, &errno) : crt_to_qsslcert(crt, &errno);
+    }
+    QCOMPARE(errno, int(GNUTLS_E_SUCCESS));
+    QCOMPARE(result, qcert);
+}
+
+QTEST_MAIN(tst_Bench_Conversions)
+#include "tst_bench_conversions.moc"
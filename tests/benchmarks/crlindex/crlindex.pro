@@ -0,0 +1,6 @@
+TARGET = tst_bench_crlindex
+include(../benchmark.pri)
+
+LIBS    += -Wl,-rpath,../../../src/certificate -L../../../src/certificate -lcertificate
+
+SOURCES += tst_bench_crlindex.cpp
@@ -0,0 +1,115 @@
+#include <QSslKey>
+#include <QSslCertificate>
+#include <QtTest/QtTest>
+
+#include "crlbuilder.h"
+#include "crlindex.h"
+#include "issuercontext.h"
+
+QT_USE_NAMESPACE_CERTIFICATE
+
+static QByteArray serial(int n)
+{
+    QByteArray result(4, 0);
+    result[0] = char(0x10 | (n >> 24));
+    result[1] = char((n >> 16) & 0xff);
+    result[2] = char((n >> 8) & 0xff);
+    result[3] = char(n & 0xff);
+    return result;
+}
+
+class tst_Bench_CrlIndex : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void load_data();
+    void load();
+    void isRevoked_data();
+    void isRevoked();
+
+private:
+    QByteArray makeCrl(int entries);
+
+    IssuerContext issuer;
+};
+
+void tst_Bench_CrlIndex::initTestCase()
+{
+    QFile k(SRCDIR "data/ca.key");
+    QVERIFY(k.open(QIODevice::ReadOnly));
+    QSslKey caKey(&k, QSsl::Rsa);
+    QVERIFY(!caKey.isNull());
+
+    QFile c(SRCDIR "data/ca.crt");
+    QVERIFY(c.open(QIODevice::ReadOnly));
+    QSslCertificate caCert(&c);
+    QVERIFY(!caCert.isNull());
+
+    issuer = IssuerContext(caCert, caKey);
+    QVERIFY(!issuer.isNull());
+}
+
+QByteArray tst_Bench_CrlIndex::makeCrl(int entries)
+{
+    CrlBuilder builder;
+
+    QDateTime now = QDateTime::currentDateTimeUtc();
+    for (int i = 0; i < entries; i++)
+        builder.addRevokedSerial(serial(i * 2), now);
+
+    return builder.signedCrl(issuer);
+}
+
+void tst_Bench_CrlIndex::load_data()
+{
+    QTest::addColumn<int>("entries");
+
+    QTest::newRow("1000") << 1000;
+    QTest::newRow("100000") << 100000;
+}
+
+void tst_Bench_CrlIndex::load()
+{
+    QFETCH(int, entries);
+
+    QByteArray crl = makeCrl(entries);
+    CrlIndex index;
+
+    QBENCHMARK {
+        index.load(crl);
+    }
+    QCOMPARE(index.count(), entries);
+}
+
+void tst_Bench_CrlIndex::isRevoked_data()
+{
+    load_data();
+}
+
+void tst_Bench_CrlIndex::isRevoked()
+{
+    QFETCH(int, entries);
+
+    CrlIndex index;
+    QVERIFY(index.load(makeCrl(entries)));
+
+    // Half of these are revoked
+    QList<QByteArray> serials;
+    for (int i = 0; i < 1000; i++)
+        serials << serial((i * 7919) % (entries * 2));
+
+    int revoked = 0;
+    QBENCHMARK {
+        revoked = 0;
+        foreach (const QByteArray &s, serials) {
+            if (index.isRevoked(s))
+                revoked++;
+        }
+    }
+    QVERIFY(revoked > 0);
+}
+
+QTEST_MAIN(tst_Bench_CrlIndex)
+#include "tst_bench_crlindex.moc"
@@ -0,0 +1,97 @@
+#include <QSslKey>
+#include <QtTest/QtTest>
+
+#include "keybuilder.h"
+#include "keypool.h"
+
+QT_USE_NAMESPACE_CERTIFICATE
+
+Q_DECLARE_METATYPE(QSsl::KeyAlgorithm)
+Q_DECLARE_METATYPE(KeyBuilder::KeyStrength)
+Q_DECLARE_METATYPE(KeyBuilder::KeyType)
+
+class tst_Bench_KeyBuilder : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void generate_data();
+    void generate();
+    void generateEncoded_data();
+    void generateEncoded();
+    void poolTake();
+};
+
+void tst_Bench_KeyBuilder::generate_data()
+{
+    QTest::addColumn<QSsl::KeyAlgorithm>("algorithm");
+    QTest::addColumn<KeyBuilder::KeyStrength>("strength");
+
+    QTest::newRow("rsa-low") << QSsl::Rsa << KeyBuilder::StrengthLow;
+    QTest::newRow("rsa-normal") << QSsl::Rsa << KeyBuilder::StrengthNormal;
+    QTest::newRow("dsa-low") << QSsl::Dsa << KeyBuilder::StrengthLow;
+    QTest::newRow("dsa-normal") << QSsl::Dsa << KeyBuilder::StrengthNormal;
+#if QT_VERSION >= 0x050500
+    QTest::newRow("ec-normal") << QSsl::Ec << KeyBuilder::StrengthNormal;
+    QTest::newRow("ec-high") << QSsl::Ec << KeyBuilder::StrengthHigh;
+#endif
+
+#ifdef ENABLE_SLOW_TESTS
+    QTest::newRow("rsa-high") << QSsl::Rsa << KeyBuilder::StrengthHigh;
+    QTest::newRow("rsa-ultra") << QSsl::Rsa << KeyBuilder::StrengthUltra;
+    QTest::newRow("dsa-high") << QSsl::Dsa << KeyBuilder::StrengthHigh;
+#endif // ENABLE_SLOW_TESTS
+}
+
+void tst_Bench_KeyBuilder::generate()
+{
+    QFETCH(QSsl::KeyAlgorithm, algorithm);
+    QFETCH(KeyBuilder::KeyStrength, strength);
+
+    QSslKey key;
+    QBENCHMARK {
+        key = KeyBuilder::generate(algorithm, strength);
+    }
+    QVERIFY(!key.isNull());
+}
+
+void tst_Bench_KeyBuilder::generateEncoded_data()
+{
+    QTest::addColumn<KeyBuilder::KeyType>("type");
+    QTest::addColumn<KeyBuilder::KeyStrength>("strength");
+
+    QTest::newRow("rsa-normal") << KeyBuilder::TypeRsa << KeyBuilder::StrengthNormal;
+    QTest::newRow("ec-normal") << KeyBuilder::TypeEc << KeyBuilder::StrengthNormal;
+    QTest::newRow("ec-high") << KeyBuilder::TypeEc << KeyBuilder::StrengthHigh;
+    QTest::newRow("ed25519") << KeyBuilder::TypeEd25519 << KeyBuilder::StrengthNormal;
+}
+
+void tst_Bench_KeyBuilder::generateEncoded()
+{
+    QFETCH(KeyBuilder::KeyType, type);
+    QFETCH(KeyBuilder::KeyStrength, strength);
+
+    QByteArray key;
+    QBENCHMARK {
+        key = KeyBuilder::generateEncoded(type, strength, QSsl::Der);
+    }
+    QVERIFY(!key.isEmpty());
+}
+
+void tst_Bench_KeyBuilder::poolTake()
+{
+    KeyPool pool;
+    pool.setPoolSize(4);
+    pool.reserve(QSsl::Rsa, KeyBuilder::StrengthLow);
+    QTRY_COMPARE(pool.statistics(QSsl::Rsa, KeyBuilder::StrengthLow).depth, 4);
+
+    QSslKey key;
+    QBENCHMARK_ONCE {
+        key = pool.take(QSsl::Rsa, KeyBuilder::StrengthLow);
+    }
+    QVERIFY(!key.isNull());
+    QCOMPARE(pool.statistics(QSsl::Rsa, KeyBuilder::StrengthLow).hits, 1);
+}
+
+QTEST_MAIN(tst_Bench_KeyBuilder)
+#include "tst_bench_keybuilder.moc"
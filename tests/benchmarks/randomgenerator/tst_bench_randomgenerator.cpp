@@ -0,0 +1,103 @@
+#include <QtTest/QtTest>
+
+#include "randomgenerator.h"
+#include "serialallocator.h"
+
+QT_USE_NAMESPACE_CERTIFICATE
+
+class tst_Bench_RandomGenerator : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void getPositiveBytes_data();
+    void getPositiveBytes();
+    void fill_data();
+    void fill();
+    void allocateSerials_data();
+    void allocateSerials();
+};
+
+void tst_Bench_RandomGenerator::getPositiveBytes_data()
+{
+    QTest::addColumn<int>("size");
+
+    QTest::newRow("serial") << 16;
+    QTest::newRow("32") << 32;
+    QTest::newRow("1024") << 1024;
+}
+
+void tst_Bench_RandomGenerator::getPositiveBytes()
+{
+    QFETCH(int, size);
+
+    QByteArray bytes;
+    QBENCHMARK {
+        bytes = RandomGenerator::getPositiveBytes(size);
+    }
+    QCOMPARE(bytes.size(), size);
+}
+
+Q_DECLARE_METATYPE(RandomGenerator::RandomLevel)
+
+void tst_Bench_RandomGenerator::fill_data()
+{
+    QTest::addColumn<RandomGenerator::RandomLevel>("level");
+    QTest::addColumn<int>("size");
+
+    QTest::newRow("nonce-16") << RandomGenerator::LevelNonce << 16;
+    QTest::newRow("random-16") << RandomGenerator::LevelRandom << 16;
+    QTest::newRow("random-4096") << RandomGenerator::LevelRandom << 4096;
+    QTest::newRow("key-32") << RandomGenerator::LevelKey << 32;
+}
+
+void tst_Bench_RandomGenerator::fill()
+{
+    QFETCH(RandomGenerator::RandomLevel, level);
+    QFETCH(int, size);
+
+    QByteArray buffer(size, 0);
+    bool ok = false;
+    QBENCHMARK {
+        ok = RandomGenerator::fill(buffer.data(), size, level);
+    }
+    QVERIFY(ok);
+}
+
+void tst_Bench_RandomGenerator::allocateSerials_data()
+{
+    QTest::addColumn<int>("batch");
+
+    QTest::newRow("single") << 1;
+    QTest::newRow("batch-100") << 100;
+}
+
+void tst_Bench_RandomGenerator::allocateSerials()
+{
+    QFETCH(int, batch);
+
+    QString fileName = QDir::temp().filePath(QString("tst_bench_serials-%1.idx").arg(QCoreApplication::applicationPid()));
+    QFile::remove(fileName);
+    QFile::remove(fileName + ".journal");
+
+    {
+        SerialAllocator allocator(fileName);
+        QVERIFY(allocator.error() == 0);
+
+        // Start from a realistically sized index
+        allocator.allocate(100000);
+        QVERIFY(allocator.flush());
+
+        QList<QByteArray> serials;
+        QBENCHMARK {
+            serials = allocator.allocate(batch);
+        }
+        QCOMPARE(serials.size(), batch);
+    }
+
+    QFile::remove(fileName);
+    QFile::remove(fileName + ".journal");
+}
+
+QTEST_MAIN(tst_Bench_RandomGenerator)
+#include "tst_bench_randomgenerator.moc"